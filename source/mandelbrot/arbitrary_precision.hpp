@@ -0,0 +1,305 @@
+/**
+*************************************************************************
+*
+* @file arbitrary_precision.hpp
+*
+* Fixed point numbers with as many 32 bit limbs as a zoom needs, for the
+* view centers and reference orbits beyond the reach of double_double
+*
+************************************************************************/
+
+#ifndef ARBITRARY_PRECISION_HPP_INCLUDED
+#define ARBITRARY_PRECISION_HPP_INCLUDED
+
+#include "double_double.hpp"
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+
+/**
+*************************************************************************
+*
+* @class arbitrary_precision
+*
+* sign and magnitude, the magnitude being 64 bits before the binary point
+* and \bref{limbs} limbs of 32 bits after it. the results of the operations
+* have the larger precision of their operands and are truncated to it.
+* conversions from double and double_double are exact, their precision is
+* the one the value needs. the integer bits limit the values to below
+* 2^64, enough for any orbit up to its escape
+*
+************************************************************************/
+class arbitrary_precision {
+public:
+	/** fractional limbs at most, 4096 bits resolve zooms to about 1e-1200 */
+	static const int max_limbs = 128;
+
+	arbitrary_precision() : negative_(false), limbs_(0)
+	{
+		std::fill(limb_, limb_ + integer_limbs, 0u);
+	}
+
+	explicit arbitrary_precision(double value) : negative_(value < 0.), limbs_(0)
+	{
+		std::fill(limb_, limb_ + integer_limbs, 0u);
+		/*every digit is the rest truncated to a multiple of its weight, so the subtraction is exact*/
+		double rest = fabs(value);
+		for (int i = 0; i < integer_limbs + max_limbs && rest > 0.; i++) {
+			double digit = floor(ldexp(rest, -weight(i)));
+			limb_[i] = (uint32_t)digit;
+			rest -= ldexp(digit, weight(i));
+			if (i >= integer_limbs) limbs_ = i - integer_limbs + 1;
+		}
+	}
+
+	explicit arbitrary_precision(const double_double& value)
+	{
+		*this = arbitrary_precision(value.hi) + arbitrary_precision(value.lo);
+	}
+
+	/** only the limbs in use are copied */
+	//{
+	arbitrary_precision(const arbitrary_precision& other)
+	{
+		*this = other;
+	}
+
+	arbitrary_precision& operator=(const arbitrary_precision& other)
+	{
+		negative_ = other.negative_;
+		limbs_ = other.limbs_;
+		std::copy(other.limb_, other.limb_ + integer_limbs + limbs_, limb_);
+		return *this;
+	}
+	//}
+
+	/** fractional limbs in use */
+	int limbs() const { return limbs_; }
+
+	/** truncates towards 0 or extends with zeros to \bref{limbs} fractional limbs */
+	void set_limbs(int limbs)
+	{
+		limbs = clamp_limbs(limbs);
+		if (limbs > limbs_) std::fill(limb_ + integer_limbs + limbs_, limb_ + integer_limbs + limbs, 0u);
+		limbs_ = limbs;
+		if (zero()) negative_ = false;
+	}
+
+	/** fractional limbs that resolve \bref{bits} bits after the binary point */
+	static int limbs_for_bits(int bits)
+	{
+		return clamp_limbs((bits + 31) / 32);
+	}
+
+	bool zero() const
+	{
+		for (int i = 0; i < integer_limbs + limbs_; i++) if (limb_[i] != 0) return false;
+		return true;
+	}
+
+	bool negative() const { return negative_; }
+
+	/** e with 2^e <= |value| < 2^(e + 1), INT_MIN for 0 */
+	int exponent() const
+	{
+		for (int i = 0; i < integer_limbs + limbs_; i++) {
+			if (limb_[i] == 0) continue;
+			int bit = 31;
+			while (!(limb_[i] >> bit)) bit--;
+			return weight(i) + bit;
+		}
+		return -2147483647 - 1;
+	}
+
+	/** value * 2^\bref{scale}, rounded from the leading 96 bits */
+	double to_double(int scale = 0) const
+	{
+		for (int i = 0; i < integer_limbs + limbs_; i++) {
+			if (limb_[i] == 0) continue;
+			double ret = 0.;
+			for (int j = std::min(i + 2, integer_limbs + limbs_ - 1); j >= i; j--)
+				ret += ldexp((double)limb_[j], weight(j) + scale);
+			return negative_ ? -ret : ret;
+		}
+		return 0.;
+	}
+
+	double_double to_double_double() const
+	{
+		double hi = to_double();
+		return double_double::quick_two_sum(hi, (*this - arbitrary_precision(hi)).to_double());
+	}
+
+	friend arbitrary_precision operator-(const arbitrary_precision& a);
+	friend arbitrary_precision operator+(const arbitrary_precision& a, const arbitrary_precision& b);
+	friend arbitrary_precision operator-(const arbitrary_precision& a, const arbitrary_precision& b);
+	friend arbitrary_precision operator*(const arbitrary_precision& a, const arbitrary_precision& b);
+	friend arbitrary_precision operator/(const arbitrary_precision& a, uint32_t divisor);
+	friend arbitrary_precision ldexp(const arbitrary_precision& a, int exponent);
+	friend bool operator<(const arbitrary_precision& a, const arbitrary_precision& b);
+	friend bool operator==(const arbitrary_precision& a, const arbitrary_precision& b);
+
+private:
+	static const int integer_limbs = 2;
+
+	bool negative_;
+	int limbs_;
+	/** most significant first, only the integer limbs and limbs_ fractional ones are valid */
+	uint32_t limb_[integer_limbs + max_limbs];
+
+	/** binary exponent of the lowest bit of limb \bref{i} */
+	static int weight(int i) { return 32 * (integer_limbs - 1 - i); }
+
+	/** \bref{limbs} limited to 0 ... max_limbs */
+	static int clamp_limbs(int limbs)
+	{
+		if (limbs < 0) return 0;
+		return limbs < max_limbs ? limbs : (int)max_limbs;
+	}
+
+	/** limb \bref{i} or 0 beyond the precision */
+	uint32_t limb(int i) const { return i < integer_limbs + limbs_ ? limb_[i] : 0u; }
+
+	/** -1, 0 or 1 as |a| is smaller, equal or larger than |b| */
+	static int compare_magnitude(const arbitrary_precision& a, const arbitrary_precision& b)
+	{
+		int count = integer_limbs + std::max(a.limbs_, b.limbs_);
+		for (int i = 0; i < count; i++) {
+			if (a.limb(i) != b.limb(i)) return a.limb(i) < b.limb(i) ? -1 : 1;
+		}
+		return 0;
+	}
+};
+
+inline arbitrary_precision operator-(const arbitrary_precision& a)
+{
+	arbitrary_precision ret = a;
+	if (!ret.zero()) ret.negative_ = !ret.negative_;
+	return ret;
+}
+
+inline arbitrary_precision operator+(const arbitrary_precision& a, const arbitrary_precision& b)
+{
+	arbitrary_precision ret;
+	ret.limbs_ = std::max(a.limbs_, b.limbs_);
+	int count = arbitrary_precision::integer_limbs + ret.limbs_;
+
+	if (a.negative_ == b.negative_) {
+		uint64_t carry = 0;
+		for (int i = count - 1; i >= 0; i--) {
+			uint64_t sum = (uint64_t)a.limb(i) + b.limb(i) + carry;
+			ret.limb_[i] = (uint32_t)sum;
+			carry = sum >> 32;
+		}
+		ret.negative_ = a.negative_;
+	}
+	else {
+		/*the smaller magnitude is subtracted from the larger one, which gives the sign*/
+		bool a_larger = arbitrary_precision::compare_magnitude(a, b) >= 0;
+		const arbitrary_precision& larger = a_larger ? a : b;
+		const arbitrary_precision& smaller = a_larger ? b : a;
+		int64_t borrow = 0;
+		for (int i = count - 1; i >= 0; i--) {
+			int64_t difference = (int64_t)larger.limb(i) - smaller.limb(i) - borrow;
+			borrow = difference < 0 ? 1 : 0;
+			ret.limb_[i] = (uint32_t)(difference + (borrow << 32));
+		}
+		ret.negative_ = larger.negative_;
+	}
+	if (ret.zero()) ret.negative_ = false;
+	return ret;
+}
+
+inline arbitrary_precision operator-(const arbitrary_precision& a, const arbitrary_precision& b)
+{
+	return a + (-b);
+}
+
+inline arbitrary_precision operator*(const arbitrary_precision& a, const arbitrary_precision& b)
+{
+	const int integer_limbs = arbitrary_precision::integer_limbs;
+	arbitrary_precision ret;
+	ret.limbs_ = std::max(a.limbs_, b.limbs_);
+	int a_count = integer_limbs + a.limbs_;
+	int b_count = integer_limbs + b.limbs_;
+
+	/*
+	* limbs i and j add to limb i + j - integer_limbs + 1 of the product, lower indices would
+	* be beyond the integer bits. two more limbs than kept carry into the last one, the
+	* rest is truncated
+	*/
+	int shift = integer_limbs - 1;
+	int last = integer_limbs + ret.limbs_ + 1;
+	uint64_t low = 0;
+	uint64_t high = 0;
+	for (int k = last; k >= 0; k--) {
+		int first_i = std::max(0, k + shift - (b_count - 1));
+		int last_i = std::min(a_count - 1, k + shift);
+		for (int i = first_i; i <= last_i; i++) {
+			uint64_t product = (uint64_t)a.limb_[i] * b.limb_[k + shift - i];
+			low += product & 0xffffffffu;
+			high += product >> 32;
+		}
+		if (k < integer_limbs + ret.limbs_) ret.limb_[k] = (uint32_t)low;
+		low = (low >> 32) + high;
+		high = 0;
+	}
+	ret.negative_ = a.negative_ != b.negative_ && !ret.zero();
+	return ret;
+}
+
+/** division by a small positive integer, for decimal conversions */
+inline arbitrary_precision operator/(const arbitrary_precision& a, uint32_t divisor)
+{
+	arbitrary_precision ret = a;
+	uint64_t rest = 0;
+	for (int i = 0; i < arbitrary_precision::integer_limbs + a.limbs_; i++) {
+		uint64_t current = (rest << 32) | a.limb_[i];
+		ret.limb_[i] = (uint32_t)(current / divisor);
+		rest = current % divisor;
+	}
+	if (ret.zero()) ret.negative_ = false;
+	return ret;
+}
+
+/** a * 2^exponent in the precision of a, bits beyond it are truncated */
+inline arbitrary_precision ldexp(const arbitrary_precision& a, int exponent)
+{
+	const int integer_limbs = arbitrary_precision::integer_limbs;
+	arbitrary_precision ret = a;
+	int count = integer_limbs + a.limbs_;
+	int limb_shift = exponent >= 0 ? exponent / 32 : -((-exponent + 31) / 32);
+	int bit_shift = exponent - 32 * limb_shift;
+
+	/*limb i of the result takes its bits from limbs i + limb_shift and the one after*/
+	for (int i = 0; i < count; i++) {
+		int source = i + limb_shift;
+		uint64_t pair = ((uint64_t)(source >= 0 && source < count ? a.limb_[source] : 0u) << 32)
+			| (source + 1 >= 0 && source + 1 < count ? a.limb_[source + 1] : 0u);
+		ret.limb_[i] = (uint32_t)((pair << bit_shift) >> 32);
+	}
+	if (ret.zero()) ret.negative_ = false;
+	return ret;
+}
+
+inline bool operator<(const arbitrary_precision& a, const arbitrary_precision& b)
+{
+	if (a.negative_ != b.negative_) return a.negative_;
+	int magnitude = arbitrary_precision::compare_magnitude(a, b);
+	return a.negative_ ? magnitude > 0 : magnitude < 0;
+}
+
+inline bool operator==(const arbitrary_precision& a, const arbitrary_precision& b)
+{
+	return a.negative_ == b.negative_ && arbitrary_precision::compare_magnitude(a, b) == 0;
+}
+
+inline bool operator>(const arbitrary_precision& a, const arbitrary_precision& b) { return b < a; }
+inline bool operator<=(const arbitrary_precision& a, const arbitrary_precision& b) { return !(b < a); }
+inline bool operator>=(const arbitrary_precision& a, const arbitrary_precision& b) { return !(a < b); }
+inline bool operator!=(const arbitrary_precision& a, const arbitrary_precision& b) { return !(a == b); }
+
+inline double to_double(const arbitrary_precision& value) { return value.to_double(); }
+
+#endif//#ifndef ARBITRARY_PRECISION_HPP_INCLUDED
@@ -0,0 +1,142 @@
+/**
+*************************************************************************
+*
+* @file double_double.hpp
+*
+* Unevaluated sum of two doubles, giving about 106 bits of mantissa,
+* see Dekker, "A floating-point technique for extending the available
+* precision", 1971
+*
+************************************************************************/
+
+#ifndef DOUBLE_DOUBLE_HPP_INCLUDED
+#define DOUBLE_DOUBLE_HPP_INCLUDED
+
+/**
+*************************************************************************
+*
+* @class double_double
+*
+* extended precision scalar type for deep zooms into the mandelbrot set.
+* only uses plain double additions and multiplications (no fma), hence the
+* results do not depend on compiler contraction settings
+*
+************************************************************************/
+class double_double {
+public:
+	double hi;
+	double lo;
+
+	double_double() : hi(0.), lo(0.) {}
+	double_double(double value) : hi(value), lo(0.) {}
+	double_double(double high, double low) : hi(high), lo(low) {}
+
+	double to_double() const { return hi + lo; }
+
+	/** exact sum of a and b, |a| >= |b| is required */
+	static double_double quick_two_sum(double a, double b)
+	{
+		double s = a + b;
+		return double_double(s, b - (s - a));
+	}
+
+	/** exact sum of a and b */
+	static double_double two_sum(double a, double b)
+	{
+		double s = a + b;
+		double bb = s - a;
+		return double_double(s, (a - (s - bb)) + (b - bb));
+	}
+
+	/** exact product of a and b */
+	static double_double two_prod(double a, double b)
+	{
+		double p = a * b;
+		double a_hi, a_lo, b_hi, b_lo;
+		split(a, a_hi, a_lo);
+		split(b, b_hi, b_lo);
+		return double_double(p, ((a_hi * b_hi - p) + a_hi * b_lo + a_lo * b_hi) + a_lo * b_lo);
+	}
+
+private:
+	/** splits a into two halves of 26 bits each */
+	static void split(double a, double& a_hi, double& a_lo)
+	{
+		double t = 134217729.0 * a;//2^27 + 1
+		a_hi = t - (t - a);
+		a_lo = a - a_hi;
+	}
+};
+
+inline double_double operator-(const double_double& a)
+{
+	return double_double(-a.hi, -a.lo);
+}
+
+inline double_double operator+(const double_double& a, const double_double& b)
+{
+	double_double s = double_double::two_sum(a.hi, b.hi);
+	double_double t = double_double::two_sum(a.lo, b.lo);
+	s.lo += t.hi;
+	s = double_double::quick_two_sum(s.hi, s.lo);
+	s.lo += t.lo;
+	return double_double::quick_two_sum(s.hi, s.lo);
+}
+
+inline double_double operator-(const double_double& a, const double_double& b)
+{
+	return a + (-b);
+}
+
+inline double_double operator*(const double_double& a, const double_double& b)
+{
+	double_double p = double_double::two_prod(a.hi, b.hi);
+	p.lo += a.hi * b.lo + a.lo * b.hi;
+	return double_double::quick_two_sum(p.hi, p.lo);
+}
+
+inline double_double operator/(const double_double& a, const double_double& b)
+{
+	double q1 = a.hi / b.hi;
+	double_double r = a - q1 * b;
+	double q2 = r.hi / b.hi;
+	r = r - q2 * b;
+	double q3 = r.hi / b.hi;
+	return double_double::quick_two_sum(q1, q2) + q3;
+}
+
+inline double_double& operator+=(double_double& a, const double_double& b) { return a = a + b; }
+inline double_double& operator-=(double_double& a, const double_double& b) { return a = a - b; }
+inline double_double& operator*=(double_double& a, const double_double& b) { return a = a * b; }
+inline double_double& operator/=(double_double& a, const double_double& b) { return a = a / b; }
+
+inline bool operator<(const double_double& a, const double_double& b)
+{
+	return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+inline bool operator<=(const double_double& a, const double_double& b)
+{
+	return a.hi < b.hi || (a.hi == b.hi && a.lo <= b.lo);
+}
+inline bool operator>(const double_double& a, const double_double& b) { return b < a; }
+inline bool operator>=(const double_double& a, const double_double& b) { return b <= a; }
+inline bool operator==(const double_double& a, const double_double& b) { return a.hi == b.hi && a.lo == b.lo; }
+inline bool operator!=(const double_double& a, const double_double& b) { return !(a == b); }
+
+inline double_double abs(const double_double& a)
+{
+	return a.hi < 0. ? -a : a;
+}
+
+/** conversions between the scalar types the generators are instantiated with */
+//{
+inline void convert_precision(const double_double& in, float& out) { out = (float)in.hi; }
+inline void convert_precision(const double_double& in, double& out) { out = in.hi; }
+inline void convert_precision(const double_double& in, double_double& out) { out = in; }
+
+inline double to_double(float value) { return value; }
+inline double to_double(double value) { return value; }
+inline double to_double(const double_double& value) { return value.hi; }
+//}
+
+#endif//#ifndef DOUBLE_DOUBLE_HPP_INCLUDED
@@ -0,0 +1,117 @@
+/**
+*************************************************************************
+*
+* @file float_exp.hpp
+*
+* Doubles with a separate int exponent, for the perturbation deltas of
+* zooms beyond the exponent range of double
+*
+************************************************************************/
+
+#ifndef FLOAT_EXP_HPP_INCLUDED
+#define FLOAT_EXP_HPP_INCLUDED
+
+#include <math.h>
+
+/**
+*************************************************************************
+*
+* @class float_exp
+*
+* mantissa * 2^exponent with the mantissa in [0.5, 1) or 0. the mantissa
+* has the precision of a double and the operations round like double ones,
+* as long as the result fits into a double it is the same as with doubles
+*
+************************************************************************/
+class float_exp {
+public:
+	double mantissa;
+	int exponent;
+
+	float_exp() : mantissa(0.), exponent(zero_exponent) {}
+
+	float_exp(double value)
+	{
+		mantissa = frexp(value, &exponent);
+		if (mantissa == 0.) exponent = zero_exponent;
+	}
+
+	/** value * 2^\bref{scale} */
+	float_exp(double value, int scale)
+	{
+		mantissa = frexp(value, &exponent);
+		if (mantissa == 0.) exponent = zero_exponent;
+		else exponent += scale;
+	}
+
+	/** rounded to double, 0 or infinity beyond its range */
+	double to_double() const
+	{
+		return ldexp(mantissa, exponent);
+	}
+
+	/** exponent of 0, low enough to vanish in any sum without overflowing when exponents are added */
+	static const int zero_exponent = -0x20000000;
+};
+
+inline double to_double(const float_exp& value)
+{
+	return value.to_double();
+}
+
+inline float_exp operator-(const float_exp& a)
+{
+	float_exp ret = a;
+	ret.mantissa = -ret.mantissa;
+	return ret;
+}
+
+inline float_exp operator*(const float_exp& a, const float_exp& b)
+{
+	if (a.mantissa == 0. || b.mantissa == 0.) return float_exp();
+	return float_exp(a.mantissa * b.mantissa, a.exponent + b.exponent);
+}
+
+inline float_exp operator+(const float_exp& a, const float_exp& b)
+{
+	/*the smaller operand is aligned to the larger one, beyond 64 bits it is below the rounding*/
+	int difference = a.exponent - b.exponent;
+	if (difference > 64 || b.mantissa == 0.) return a;
+	if (difference < -64 || a.mantissa == 0.) return b;
+	if (difference >= 0) return float_exp(a.mantissa + ldexp(b.mantissa, -difference), a.exponent);
+	return float_exp(ldexp(a.mantissa, difference) + b.mantissa, b.exponent);
+}
+
+inline float_exp operator-(const float_exp& a, const float_exp& b)
+{
+	return a + (-b);
+}
+
+/** a * 2^\bref{scale} */
+inline float_exp ldexp(const float_exp& a, int scale)
+{
+	float_exp ret = a;
+	if (ret.mantissa != 0.) ret.exponent += scale;
+	return ret;
+}
+
+inline bool operator<(const float_exp& a, const float_exp& b)
+{
+	return (a - b).mantissa < 0.;
+}
+
+inline bool operator<=(const float_exp& a, const float_exp& b)
+{
+	return !(b < a);
+}
+
+/** square root of a non-negative value */
+inline float_exp sqrt(const float_exp& a)
+{
+	if (a.mantissa == 0.) return a;
+	/*an even exponent halves exactly*/
+	int odd = a.exponent & 1;
+	return float_exp(::sqrt(ldexp(a.mantissa, odd)), (a.exponent - odd) / 2);
+}
+
+#endif//#ifndef FLOAT_EXP_HPP_INCLUDED
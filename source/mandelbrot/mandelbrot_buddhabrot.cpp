@@ -0,0 +1,490 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_buddhabrot.cpp
+*
+* implementation of \bref{mandelbrot_buddhabrot}
+*
+************************************************************************/
+
+#include "mandelbrot_buddhabrot.hpp"
+
+#include "mandelbrot_profiler.hpp"
+#include "render_thread_pool.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+using namespace viral_core;
+
+/** first bytes of a file written by \bref{mandelbrot_buddhabrot::save}, followed by the chains and the histogram */
+struct buddhabrot_state_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	int32_t channel_max_iter[3];
+	int32_t min_iter;
+	int32_t formula_family;
+	int32_t formula_power;
+	int32_t formula_julia;
+	double julia_re;
+	double julia_im;
+	double real_min;
+	double imaginary_min;
+	double real_max;
+	double imaginary_max;
+	uint64_t seed;
+	uint32_t sampling;
+	int32_t passes;
+	int64_t samples;
+	int64_t counted;
+	int64_t hits;
+	int64_t iterations;
+	double seconds;
+	uint32_t chain_count;
+};
+
+static const char buddhabrot_state_magic[8] = { 'M', 'B', 'B', 'U', 'D', 'D', 'H', 'A' };
+static const uint32_t buddhabrot_state_version = 1;
+
+/** values of the histograms summed by one task of the merge */
+static const size_t merge_chunk_size = 1 << 16;
+
+/** splitmix64, decorrelates the generators of neighbouring batches or chains */
+static uint64_t stream_seed(uint64_t seed, long long stream, int substream)
+{
+	uint64_t z = seed + 0x9e3779b97f4a7c15ull * ((uint64_t)stream * 65537u + (uint64_t)substream + 1);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+/** the steps of the formula on one orbit, see \bref{mandelbrot_buddhabrot::trace_orbit} */
+template<typename step>
+static void trace_orbit_steps(const mandelbrot_buddhabrot::settings& s, double re, double im, int length,
+	float escape_threshold, std::vector<int>& pixels_out)
+{
+	const double c_x = s.formula_.julia_ ? s.formula_.julia_re_ : re;
+	const double c_y = s.formula_.julia_ ? s.formula_.julia_im_ : im;
+	const double scale_x = s.image_dimensions_.x / (s.real_max_ - s.real_min_);
+	const double scale_y = s.image_dimensions_.y / (s.imaginary_max_ - s.imaginary_min_);
+
+	double x = re;
+	double y = im;
+	for (int i = 0; i < length; i++) {
+		double xx = x * x;
+		double yy = y * y;
+		if (xx + yy > escape_threshold) break;
+
+		/*floor, so points left of or above the view are not truncated into column or row 0*/
+		double column = floor((x - s.real_min_) * scale_x);
+		double row = floor((y - s.imaginary_min_) * scale_y);
+		if (column >= 0. && column < s.image_dimensions_.x && row >= 0. && row < s.image_dimensions_.y)
+			pixels_out.push_back((int)row * s.image_dimensions_.x + (int)column);
+
+		double xy = x * y;
+		double next_x, next_y;
+		step::iterate(x, y, xx, yy, xy, c_x, c_y, next_x, next_y);
+		x = next_x;
+		y = next_y;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// mandelbrot_buddhabrot
+//
+//////////////////////////////////////////////////////////////////////////
+
+const double mandelbrot_buddhabrot::domain = 2.;
+const float mandelbrot_buddhabrot::escape_threshold = 4.f;
+
+double mandelbrot_buddhabrot::progress::samples_per_second() const
+{
+	return seconds_ > 0. ? samples_ / seconds_ : 0.;
+}
+
+mandelbrot_buddhabrot::mandelbrot_buddhabrot(const settings & s) :
+	settings_(s),
+	histogram_((size_t)s.image_dimensions_.x * s.image_dimensions_.y * 3, 0.)
+{}
+
+const mandelbrot_buddhabrot::settings & mandelbrot_buddhabrot::parameters() const
+{
+	return settings_;
+}
+
+const mandelbrot_buddhabrot::progress & mandelbrot_buddhabrot::current_progress() const
+{
+	return progress_;
+}
+
+const std::vector<double>& mandelbrot_buddhabrot::histogram() const
+{
+	return histogram_;
+}
+
+void mandelbrot_buddhabrot::cancel()
+{
+	cancel_ = true;
+}
+
+int mandelbrot_buddhabrot::max_iter() const
+{
+	return std::max(settings_.channel_max_iter_[0],
+		std::max(settings_.channel_max_iter_[1], settings_.channel_max_iter_[2]));
+}
+
+bool mandelbrot_buddhabrot::accumulate(long long samples, const pass_callback & on_pass)
+{
+	std::shared_ptr<render_thread_pool> pool = render_thread_pool::shared(settings_.worker_count_);
+	int threads = pool->worker_count();
+	thread_histograms_.resize(threads);
+	for (std::vector<float>& h : thread_histograms_) h.resize(histogram_.size(), 0.f);
+	chains_.resize(threads);
+
+	/*whole batches only, so a batch is the same whichever pass takes it*/
+	long long batches = (samples + batch_size - 1) / batch_size;
+	long long batches_per_pass = std::max((settings_.samples_per_pass_ + batch_size - 1) / batch_size, 1ll);
+
+	long long taken = 0;
+	bool stopped = false;
+	while (taken < batches && !stopped) {
+		auto start = std::chrono::steady_clock::now();
+		long long pass_batches = std::min(batches_per_pass, batches - taken);
+		long long first_batch = progress_.samples_ / batch_size;
+		int pass = progress_.passes_;
+
+		std::vector<pass_totals> totals(threads);
+		pool->run(threads, [&](int thread) {
+			long long thread_batches = pass_batches / threads + (thread < pass_batches % threads ? 1 : 0);
+			MANDELBROT_PROFILE_SCOPE("buddhabrot samples", thread_batches * batch_size);
+			if (settings_.sampling_ == sampling_metropolis)
+				sample_metropolis(thread, pass, thread_batches * batch_size, totals[thread]);
+			else sample_uniform(thread, first_batch, pass_batches, totals[thread]);
+		});
+		merge(threads);
+
+		for (const pass_totals& t : totals) {
+			progress_.counted_ += t.counted;
+			progress_.hits_ += t.hits;
+			progress_.iterations_ += t.iterations;
+		}
+		progress_.passes_++;
+		progress_.samples_ += pass_batches * batch_size;
+		progress_.seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		taken += pass_batches;
+
+		stopped = cancel_.exchange(false) || (on_pass && !on_pass(progress_));
+	}
+	return taken >= batches;
+}
+
+void mandelbrot_buddhabrot::sample_uniform(int thread, long long first_batch, long long batches,
+	pass_totals & totals)
+{
+	int threads = (int)thread_histograms_.size();
+	std::vector<float>& target = thread_histograms_[thread];
+
+	mandelbrot_simd::escape_parameters escape;
+	escape.max_threshold = escape_threshold;
+	escape.max_iter = max_iter();
+	escape.interior_check = true;
+	escape.periodicity_check = true;
+	escape.formula = settings_.formula_;
+	mandelbrot_simd::escape_statistics statistics;
+
+	double re[batch_size];
+	double im[batch_size];
+	int remain_iter[batch_size];
+	std::vector<int> pixels;
+	for (long long batch = thread; batch < batches; batch += threads) {
+		std::mt19937_64 random(stream_seed(settings_.seed_, first_batch + batch, 0));
+		std::uniform_real_distribution<double> coordinate(-domain, domain);
+		for (int i = 0; i < batch_size; i++) {
+			re[i] = coordinate(random);
+			im[i] = coordinate(random);
+		}
+		/*most points stay inside or escape at once, only the others are traced point by point*/
+		mandelbrot_simd::escape_time(settings_.simd_level_, re, im, batch_size, escape, remain_iter, statistics);
+
+		for (int i = 0; i < batch_size; i++) {
+			if (remain_iter[i] <= 0) continue;
+			int length = escape.max_iter - remain_iter[i];
+			if (length < settings_.min_iter_) continue;
+
+			pixels.clear();
+			trace_orbit(re[i], im[i], length, pixels);
+			if (pixels.empty()) continue;
+			splat(target, pixels, length, 1.f);
+			totals.counted++;
+			totals.hits += (long long)pixels.size();
+		}
+	}
+	totals.iterations += statistics.iterations;
+}
+
+void mandelbrot_buddhabrot::sample_metropolis(int thread, int pass, long long samples, pass_totals & totals)
+{
+	std::mt19937_64 random(stream_seed(settings_.seed_, pass, thread));
+	std::uniform_real_distribution<double> unit(0., 1.);
+	std::vector<float>& target = thread_histograms_[thread];
+	chain& current = chains_[thread];
+
+	mandelbrot_simd::escape_parameters escape;
+	escape.max_threshold = escape_threshold;
+	escape.max_iter = max_iter();
+	escape.interior_check = true;
+	escape.periodicity_check = true;
+	escape.formula = settings_.formula_;
+	mandelbrot_simd::escape_statistics statistics;
+
+	/*small mutations move by 1e-4 to 1e-1 of the view, distributed exponentially*/
+	double view_size = std::max(settings_.real_max_ - settings_.real_min_,
+		settings_.imaginary_max_ - settings_.imaginary_min_);
+	double min_radius = view_size * 1e-4;
+	double max_radius = view_size * 1e-1;
+
+	/*lengths and orbits of the current point and the proposal, the current one is counted after every step*/
+	int current_length = 0;
+	std::vector<int> current_pixels;
+	std::vector<int> proposal_pixels;
+	auto evaluate = [&](double re, double im, std::vector<int>& pixels_out) {
+		pixels_out.clear();
+		int remain_iter;
+		mandelbrot_simd::escape_time(settings_.simd_level_, &re, &im, 1, escape, &remain_iter, statistics);
+		int length = escape.max_iter - remain_iter;
+		if (remain_iter <= 0 || length < settings_.min_iter_) return 0;
+		trace_orbit(re, im, length, pixels_out);
+		return length;
+	};
+	if (current.weight > 0) {
+		current_length = evaluate(current.re, current.im, current_pixels);
+		current.weight = (int)current_pixels.size();
+	}
+
+	for (long long i = 0; i < samples; i++) {
+		double re, im;
+		if (current.weight == 0 || unit(random) < settings_.large_mutation_probability_) {
+			re = (unit(random) * 2. - 1.) * domain;
+			im = (unit(random) * 2. - 1.) * domain;
+		}
+		else {
+			double radius = max_radius * exp(-log(max_radius / min_radius) * unit(random));
+			double angle = unit(random) * 6.283185307179586;
+			re = current.re + radius * cos(angle);
+			im = current.im + radius * sin(angle);
+		}
+
+		/*both mutations are symmetric, so the acceptance is the ratio of the weights*/
+		int weight = 0;
+		int length = 0;
+		if (fabs(re) <= domain && fabs(im) <= domain) {
+			length = evaluate(re, im, proposal_pixels);
+			weight = length > 0 ? (int)proposal_pixels.size() : 0;
+		}
+		if (weight > 0 && (current.weight == 0 || unit(random) * current.weight < weight)) {
+			current.re = re;
+			current.im = im;
+			current.weight = weight;
+			current_length = length;
+			current_pixels.swap(proposal_pixels);
+			totals.counted++;
+		}
+
+		if (current.weight > 0) {
+			splat(target, current_pixels, current_length, 1.f / current.weight);
+			totals.hits += current.weight;
+		}
+	}
+	totals.iterations += statistics.iterations;
+}
+
+void mandelbrot_buddhabrot::trace_orbit(double re, double im, int length, std::vector<int>& pixels_out) const
+{
+	settings_.formula_.dispatch([&](auto step) {
+		trace_orbit_steps<decltype(step)>(settings_, re, im, length, escape_threshold, pixels_out);
+	});
+}
+
+void mandelbrot_buddhabrot::splat(std::vector<float>& target, const std::vector<int>& pixels, int length,
+	float weight) const
+{
+	for (int channel = 0; channel < 3; channel++) {
+		if (length > settings_.channel_max_iter_[channel]) continue;
+		float* values = target.data() + channel;
+		for (int pixel : pixels) values[(size_t)pixel * 3] += weight;
+	}
+}
+
+void mandelbrot_buddhabrot::merge(int threads)
+{
+	MANDELBROT_PROFILE_SCOPE("buddhabrot merge");
+	std::shared_ptr<render_thread_pool> pool = render_thread_pool::shared(settings_.worker_count_);
+	int chunks = (int)((histogram_.size() + merge_chunk_size - 1) / merge_chunk_size);
+	pool->run(chunks, [&](int chunk) {
+		size_t begin = chunk * merge_chunk_size;
+		size_t end = std::min(begin + merge_chunk_size, histogram_.size());
+		for (int thread = 0; thread < threads; thread++) {
+			float* values = thread_histograms_[thread].data();
+			for (size_t i = begin; i < end; i++) {
+				histogram_[i] += values[i];
+				values[i] = 0.f;
+			}
+		}
+	});
+}
+
+auto_pointer<image> mandelbrot_buddhabrot::snapshot() const
+{
+	auto_pointer<image> ret(new image(settings_.image_dimensions_));
+	size_t pixel_count = histogram_.size() / 3;
+
+	/*the brightest 0.1% would otherwise leave the rest dark*/
+	double scale[3];
+	std::vector<double> values;
+	for (int channel = 0; channel < 3; channel++) {
+		values.clear();
+		for (size_t i = 0; i < pixel_count; i++)
+			if (histogram_[i * 3 + channel] > 0.) values.push_back(histogram_[i * 3 + channel]);
+		double white = 0.;
+		if (!values.empty()) {
+			size_t rank = std::min(values.size() - 1, (size_t)(values.size() * 0.999));
+			std::nth_element(values.begin(), values.begin() + rank, values.end());
+			white = values[rank];
+		}
+		scale[channel] = white > 0. ? settings_.exposure_ / white : 0.;
+	}
+
+	float exponent = settings_.gamma_ > 0.f ? 1.f / settings_.gamma_ : 1.f;
+	unsigned char* data = ret->data();
+	for (size_t i = 0; i < pixel_count; i++) {
+		for (int channel = 0; channel < 3; channel++) {
+			double value = std::min(histogram_[i * 3 + channel] * scale[channel], 1.);
+			data[i * 4 + channel] = (unsigned char)(powf((float)value, exponent) * 255.f + 0.5f);
+		}
+		data[i * 4 + 3] = 255;
+	}
+	return ret;
+}
+
+bool mandelbrot_buddhabrot::save(const std::string & path, std::string & error_out) const
+{
+	buddhabrot_state_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, buddhabrot_state_magic, sizeof(header.magic));
+	header.version = buddhabrot_state_version;
+	header.width = settings_.image_dimensions_.x;
+	header.height = settings_.image_dimensions_.y;
+	for (int channel = 0; channel < 3; channel++) header.channel_max_iter[channel] = settings_.channel_max_iter_[channel];
+	header.min_iter = settings_.min_iter_;
+	header.formula_family = settings_.formula_.family_;
+	header.formula_power = settings_.formula_.power_;
+	header.formula_julia = settings_.formula_.julia_ ? 1 : 0;
+	header.julia_re = settings_.formula_.julia_re_;
+	header.julia_im = settings_.formula_.julia_im_;
+	header.real_min = settings_.real_min_;
+	header.imaginary_min = settings_.imaginary_min_;
+	header.real_max = settings_.real_max_;
+	header.imaginary_max = settings_.imaginary_max_;
+	header.seed = settings_.seed_;
+	header.sampling = settings_.sampling_;
+	header.passes = progress_.passes_;
+	header.samples = progress_.samples_;
+	header.counted = progress_.counted_;
+	header.hits = progress_.hits_;
+	header.iterations = progress_.iterations_;
+	header.seconds = progress_.seconds_;
+	header.chain_count = (uint32_t)chains_.size();
+
+	/*written next to the target first, so an interrupted save keeps the previous state*/
+	std::string temporary = path + ".part";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (!file) {
+		error_out = "could not create " + temporary;
+		return false;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+	for (const chain& c : chains_) {
+		int32_t weight = c.weight;
+		written = written && fwrite(&c.re, sizeof(c.re), 1, file) == 1 && fwrite(&c.im, sizeof(c.im), 1, file) == 1
+			&& fwrite(&weight, sizeof(weight), 1, file) == 1;
+	}
+	written = written && fwrite(histogram_.data(), sizeof(double), histogram_.size(), file) == histogram_.size();
+	written = fclose(file) == 0 && written;
+
+	remove(path.c_str());
+	if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(temporary.c_str());
+		error_out = "could not write " + path;
+		return false;
+	}
+	return true;
+}
+
+bool mandelbrot_buddhabrot::load(const std::string & path, std::string & error_out)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file) {
+		error_out = "could not open " + path;
+		return false;
+	}
+
+	buddhabrot_state_header header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, buddhabrot_state_magic, sizeof(header.magic)) != 0
+		|| header.version != buddhabrot_state_version) {
+		fclose(file);
+		error_out = path + " is no buddhabrot state of this version";
+		return false;
+	}
+
+	mandelbrot_formula formula;
+	formula.family_ = (mandelbrot_formula::family)header.formula_family;
+	formula.power_ = header.formula_power;
+	formula.julia_ = header.formula_julia != 0;
+	formula.julia_re_ = header.julia_re;
+	formula.julia_im_ = header.julia_im;
+	bool matches = (int)header.width == settings_.image_dimensions_.x && (int)header.height == settings_.image_dimensions_.y
+		&& header.min_iter == settings_.min_iter_ && formula == settings_.formula_
+		&& header.real_min == settings_.real_min_ && header.imaginary_min == settings_.imaginary_min_
+		&& header.real_max == settings_.real_max_ && header.imaginary_max == settings_.imaginary_max_
+		&& header.seed == settings_.seed_ && header.sampling == (uint32_t)settings_.sampling_;
+	for (int channel = 0; channel < 3; channel++)
+		matches = matches && header.channel_max_iter[channel] == settings_.channel_max_iter_[channel];
+	if (!matches) {
+		fclose(file);
+		error_out = path + " was accumulated with other settings";
+		return false;
+	}
+
+	std::vector<chain> chains(header.chain_count);
+	bool read = true;
+	for (chain& c : chains) {
+		int32_t weight = 0;
+		read = read && fread(&c.re, sizeof(c.re), 1, file) == 1 && fread(&c.im, sizeof(c.im), 1, file) == 1
+			&& fread(&weight, sizeof(weight), 1, file) == 1;
+		c.weight = weight;
+	}
+	std::vector<double> histogram(histogram_.size());
+	read = read && fread(histogram.data(), sizeof(double), histogram.size(), file) == histogram.size();
+	fclose(file);
+	if (!read) {
+		error_out = path + " is truncated";
+		return false;
+	}
+
+	chains_.swap(chains);
+	histogram_.swap(histogram);
+	progress_.passes_ = header.passes;
+	progress_.samples_ = header.samples;
+	progress_.counted_ = header.counted;
+	progress_.hits_ = header.hits;
+	progress_.iterations_ = header.iterations;
+	progress_.seconds_ = header.seconds;
+	return true;
+}
@@ -0,0 +1,226 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_buddhabrot.hpp
+*
+* Orbit density renderer: Buddhabrot and Nebulabrot images accumulated
+* from the orbits of sampled points
+*
+************************************************************************/
+
+#ifndef MANDELBROT_BUDDHABROT_HPP_INCLUDED
+#define MANDELBROT_BUDDHABROT_HPP_INCLUDED
+
+#include <viral_core/image.hpp>
+
+#include "mandelbrot_formula.hpp"
+#include "mandelbrot_simd.hpp"
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_buddhabrot
+*
+* samples starting points in [-2, 2]^2, finds the escaping ones with the
+* kernels of \bref{mandelbrot_simd} and counts every point of their orbits
+* in a histogram over the view. each channel counts the orbits up to its
+* own iteration limit, equal limits give the grayscale Buddhabrot, limits
+* like 5000, 500 and 50 the Nebulabrot.
+*
+* samples are taken in passes. every thread of the pass accumulates into a
+* histogram of its own, after the pass the histograms are summed in
+* parallel over disjoint ranges of pixels into the total, so no thread
+* ever waits for or writes into the histogram of another. the histograms
+* of the threads take 12 bytes per pixel each.
+*
+* \bref{sampling_metropolis} runs one Markov chain per thread over the
+* starting points, weighted by the number of orbit points that land in the
+* view. mutations are small steps relative to the view or, with
+* large_mutation_probability_, a new uniform point. every orbit is counted
+* with the inverse of its weight, so the image converges to the same
+* density as uniform sampling, but zoomed views get most of the samples
+* instead of almost none.
+*
+* the accumulation can be saved and continued later with the same settings
+*
+************************************************************************/
+class mandelbrot_buddhabrot {
+public:
+	enum sampling {
+		sampling_uniform,		/**< independent uniform starting points */
+		sampling_metropolis		/**< Metropolis-Hastings chains that favour orbits crossing the view */
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_buddhabrot::settings
+	* view and sampling of an accumulation
+	************************************************************************/
+	class settings {
+	public:
+		viral_core::vector2i image_dimensions_ = viral_core::vector2i(1024, 768);
+		/** area of the plane shown, the orbits are traced in double precision */
+		//{
+		double real_min_ = -2.;
+		double imaginary_min_ = -1.5;
+		double real_max_ = 1.;
+		double imaginary_max_ = 1.5;
+		//}
+		/** red, green and blue count the orbits escaping after at most this many iterations */
+		int channel_max_iter_[3] = { 5000, 500, 50 };
+		/** shorter orbits are not counted */
+		int min_iter_ = 0;
+		/** as a julia set, the starting points are z and c is fixed */
+		mandelbrot_formula formula_;
+		sampling sampling_ = sampling_uniform;
+		/** chance of a uniform instead of a small mutation in \bref{sampling_metropolis} */
+		double large_mutation_probability_ = 0.1;
+		/** starting points per pass, progress is reported and can be saved after each pass */
+		long long samples_per_pass_ = 1 << 20;
+		/**
+		* uniform samples depend on the seed and their batch only, so they are the same with
+		* any number of threads, passes and resumes. the chains of \bref{sampling_metropolis}
+		* depend on the thread count and the passes as well
+		*/
+		uint64_t seed_ = 1;
+		/** number of threads, 0 uses all hardware threads */
+		int worker_count_ = 0;
+		mandelbrot_simd::simd_level simd_level_ = mandelbrot_simd::automatic;
+		/** tone mapping of \bref{snapshot}: brightness and the exponent 1 / gamma_ of the densities */
+		//{
+		float exposure_ = 1.f;
+		float gamma_ = 2.f;
+		//}
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_buddhabrot::progress
+	* totals of all passes, including those of a loaded state
+	************************************************************************/
+	class progress {
+	public:
+		int passes_ = 0;
+		long long samples_ = 0;
+		/** samples whose orbit was counted, the accepted mutations with \bref{sampling_metropolis} */
+		long long counted_ = 0;
+		/** orbit points that landed in the view */
+		long long hits_ = 0;
+		long long iterations_ = 0;
+		/** time spent in \bref{accumulate} */
+		double seconds_ = 0.;
+
+		double samples_per_second() const;
+	};
+
+	/** called after each pass, false stops the accumulation */
+	typedef std::function<bool(const progress& p)> pass_callback;
+
+	explicit mandelbrot_buddhabrot(const settings& s);
+
+	mandelbrot_buddhabrot(const mandelbrot_buddhabrot&) = delete;
+	mandelbrot_buddhabrot& operator=(const mandelbrot_buddhabrot&) = delete;
+
+	const settings& parameters() const;
+	const progress& current_progress() const;
+
+	/**
+	* takes passes until \bref{samples} more samples are taken, rounded up to whole batches
+	* of \bref{batch_size}. the last pass may be shorter. false if \bref{on_pass} or
+	* \bref{cancel} stopped it early
+	*/
+	bool accumulate(long long samples, const pass_callback& on_pass = pass_callback());
+
+	/** may be called from any thread, \bref{accumulate} returns after the pass in progress */
+	void cancel();
+
+	/**
+	* the tone mapped densities so far, each channel scaled so that its brightest
+	* pixels (ignoring the top 0.1%) are white. not while \bref{accumulate} runs on
+	* another thread, calling it from \bref{pass_callback} streams the progress
+	*/
+	viral_core::auto_pointer<viral_core::image> snapshot() const;
+
+	/** starting points per call of the escape kernels, samples are taken in whole batches */
+	static const int batch_size = 1024;
+
+	/** summed densities, 3 values per pixel in row order, not normalized */
+	const std::vector<double>& histogram() const;
+
+	/** writes the histogram, the progress and the chains, false with a message if it failed */
+	bool save(const std::string& path, std::string& error_out) const;
+
+	/**
+	* continues the accumulation saved by \bref{save}. the view, the iteration limits, the
+	* formula, the sampling and the seed have to match the settings of this object
+	*/
+	bool load(const std::string& path, std::string& error_out);
+
+private:
+	/**
+	*************************************************************************
+	* @class mandelbrot_buddhabrot::chain
+	* current starting point of a Metropolis-Hastings chain
+	************************************************************************/
+	struct chain {
+		double re = 0.;
+		double im = 0.;
+		/** orbit points in the view, 0 until the chain found its first point */
+		int weight = 0;
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_buddhabrot::pass_totals
+	* counters of one thread in a pass
+	************************************************************************/
+	struct pass_totals {
+		long long counted = 0;
+		long long hits = 0;
+		long long iterations = 0;
+	};
+
+	/** size of the sample domain [-domain, domain]^2 */
+	static const double domain;
+	/** |z|^2 beyond which an orbit escaped */
+	static const float escape_threshold;
+
+	const settings settings_;
+	progress progress_;
+	std::atomic<bool> cancel_{ false };
+
+	std::vector<double> histogram_;
+	/** per thread of a pass, emptied after each pass */
+	std::vector<std::vector<float> > thread_histograms_;
+	/** one per thread, only for \bref{sampling_metropolis} */
+	std::vector<chain> chains_;
+
+	int max_iter() const;
+
+	/**
+	* take samples into the histogram of \bref{thread}: every threads-th of the \bref{batches}
+	* from \bref{first_batch}, or \bref{samples} steps of the chain of the thread
+	*/
+	//{
+	void sample_uniform(int thread, long long first_batch, long long batches, pass_totals& totals);
+	void sample_metropolis(int thread, int pass, long long samples, pass_totals& totals);
+	//}
+
+	/**
+	* pixel indices of the orbit points of \bref{re} + \bref{im}i in the view, at most
+	* \bref{length} points while the orbit is inside the escape radius
+	*/
+	void trace_orbit(double re, double im, int length, std::vector<int>& pixels_out) const;
+	/** adds \bref{weight} to the channels that count orbits of \bref{length} */
+	void splat(std::vector<float>& target, const std::vector<int>& pixels, int length, float weight) const;
+	/** sums the histograms of the threads into histogram_ and clears them */
+	void merge(int threads);
+};
+
+#endif//#ifndef MANDELBROT_BUDDHABROT_HPP_INCLUDED
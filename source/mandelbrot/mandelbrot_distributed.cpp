@@ -0,0 +1,529 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_distributed.cpp
+*
+* implementation of \bref{mandelbrot_distributed}
+*
+************************************************************************/
+
+#include "mandelbrot_distributed.hpp"
+
+#include "mandelbrot_profiler.hpp"
+
+#include <string.h>
+#include <algorithm>
+
+using namespace viral_core;
+
+/** a payload larger than this is taken as a corrupt stream */
+static const uint32_t max_payload_size = 1u << 30;
+
+/** the number of values written by \bref{put_statistics} */
+static const size_t statistics_values = 11;
+
+/** little endian integers of the messages */
+//{
+static void put_u32(std::vector<unsigned char>& out, uint32_t value)
+{
+	for (int i = 0; i < 4; i++) out.push_back((unsigned char)(value >> (8 * i)));
+}
+
+static void put_i64(std::vector<unsigned char>& out, long long value)
+{
+	for (int i = 0; i < 8; i++) out.push_back((unsigned char)((unsigned long long)value >> (8 * i)));
+}
+
+static bool get_u32(const std::vector<unsigned char>& in, size_t& offset, uint32_t& value_out)
+{
+	if (in.size() < offset + 4) return false;
+	value_out = 0;
+	for (int i = 0; i < 4; i++) value_out |= (uint32_t)in[offset + i] << (8 * i);
+	offset += 4;
+	return true;
+}
+
+static bool get_i64(const std::vector<unsigned char>& in, size_t& offset, long long& value_out)
+{
+	if (in.size() < offset + 8) return false;
+	unsigned long long value = 0;
+	for (int i = 0; i < 8; i++) value |= (unsigned long long)in[offset + i] << (8 * i);
+	value_out = (long long)value;
+	offset += 8;
+	return true;
+}
+//}
+
+static void put_statistics(std::vector<unsigned char>& out, const mandelbrot_generator::frame_statistics& s)
+{
+	put_i64(out, s.escape_.iterations);
+	put_i64(out, s.escape_.interior_pixels);
+	put_i64(out, s.escape_.interior_skipped_iterations);
+	put_i64(out, s.escape_.periodic_pixels);
+	put_i64(out, s.escape_.periodic_skipped_iterations);
+	put_i64(out, s.evaluated_pixels_);
+	put_i64(out, s.filled_pixels_);
+	put_i64(out, s.pixels_);
+	put_i64(out, s.samples_);
+	put_i64(out, s.cached_pixels_);
+	put_i64(out, s.escaped_pixels_);
+}
+
+static bool get_statistics(const std::vector<unsigned char>& in, size_t& offset,
+	mandelbrot_generator::frame_statistics& s_out)
+{
+	long long* values[statistics_values] = {
+		&s_out.escape_.iterations,
+		&s_out.escape_.interior_pixels,
+		&s_out.escape_.interior_skipped_iterations,
+		&s_out.escape_.periodic_pixels,
+		&s_out.escape_.periodic_skipped_iterations,
+		&s_out.evaluated_pixels_,
+		&s_out.filled_pixels_,
+		&s_out.pixels_,
+		&s_out.samples_,
+		&s_out.cached_pixels_,
+		&s_out.escaped_pixels_
+	};
+	for (long long* value : values)
+		if (!get_i64(in, offset, *value)) return false;
+	return true;
+}
+
+static std::vector<unsigned char> error_payload(uint32_t id, const std::string& message)
+{
+	/*sized once, growing the vector between the id and the message trips gcc's overflow warnings*/
+	std::vector<unsigned char> ret(4 + message.size());
+	for (int i = 0; i < 4; i++) ret[i] = (unsigned char)(id >> (8 * i));
+	if (!message.empty()) memcpy(&ret[4], message.data(), message.size());
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// mandelbrot_distributed
+//
+//////////////////////////////////////////////////////////////////////////
+
+const uint32_t mandelbrot_distributed::protocol_version;
+
+mandelbrot_distributed::mandelbrot_distributed(const std::vector<mandelbrot_parameter_file::frame>& frames,
+	const settings & s) :
+	frames_(frames),
+	settings_(s)
+{}
+
+bool mandelbrot_distributed::coordinate(const std::vector<mandelbrot_parameter_file::frame>& frames,
+	const settings & s, const frame_callback & on_frame, std::string & error_out)
+{
+	if (s.tile_size_ <= 0 || s.max_attempts_ <= 0) {
+		error_out = "tile size and attempts have to be positive";
+		return false;
+	}
+	mandelbrot_distributed coordinator(frames, s);
+	return coordinator.run(on_frame, error_out);
+}
+
+bool mandelbrot_distributed::run(const frame_callback & on_frame, std::string & error_out)
+{
+	if (!mandelbrot_socket::listen(settings_.address_, listener_, error_out)) return false;
+	if (frames_.empty()) return true;
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	last_worker_seen_ = clock::now();
+	queue_frames();
+	std::thread accept_thread(&mandelbrot_distributed::accept_main, this);
+
+	while (!stopping_) {
+		frame_state* front = active_frames_.empty() ? 0 : &active_frames_.front();
+		if (front && front->remaining_tiles == 0) {
+			/*the next frame is split before the callback, so the workers stay busy while it saves*/
+			frame_state delivered = std::move(*front);
+			active_frames_.pop_front();
+			int index = delivered_frames_++;
+			queue_frames();
+			condition_.notify_all();
+
+			lock.unlock();
+			bool proceed = on_frame(index, *delivered.img, delivered.statistics);
+			lock.lock();
+			if (!proceed) stop("stopped after frame " + std::to_string(index));
+			else if (delivered_frames_ == (int)frames_.size()) stop("");
+			continue;
+		}
+
+		clock::time_point now = clock::now();
+		if (connected_workers_ == 0 && now - last_worker_seen_ > std::chrono::seconds(settings_.worker_timeout_seconds_)) {
+			stop("no worker connected to " + settings_.address_ + " for "
+				+ std::to_string(settings_.worker_timeout_seconds_) + " s");
+			break;
+		}
+		condition_.wait_for(lock, std::chrono::milliseconds(100));
+	}
+	lock.unlock();
+
+	accept_thread.join();
+	for (std::thread& t : connection_threads_) t.join();
+	listener_.close();
+
+	error_out = error_;
+	return error_.empty();
+}
+
+void mandelbrot_distributed::accept_main()
+{
+	while (true) {
+		std::unique_ptr<connection> c(new connection());
+		if (!listener_.accept(c->socket)) return;
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (stopping_) {
+			lock.unlock();
+			send_message(c->socket, message_shutdown, std::vector<unsigned char>());
+			return;
+		}
+		connection* accepted = c.get();
+		connections_.push_back(std::move(c));
+		connection_threads_.push_back(std::thread(&mandelbrot_distributed::connection_main, this, accepted));
+	}
+}
+
+void mandelbrot_distributed::connection_main(connection * c)
+{
+	message_type type;
+	std::vector<unsigned char> payload;
+	size_t offset = 0;
+	uint32_t version = 0;
+	if (!receive_message(c->socket, type, payload) || type != message_hello
+		|| !get_u32(payload, offset, version) || version != protocol_version) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		c->socket.close();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		connected_workers_++;
+		c->state = connection::state_idle;
+	}
+
+	while (true) {
+		int id = next_job(c);
+		if (id < 0) {
+			send_message(c->socket, message_shutdown, std::vector<unsigned char>());
+			break;
+		}
+
+		const std::vector<unsigned char>* message;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			message = &jobs_[id]->message;
+		}
+		bool sent = send_message(c->socket, message_job, *message);
+		if (sent) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			c->state = connection::state_rendering;
+		}
+		if (!sent || !receive_message(c->socket, type, payload)) {
+			fail_job(id, "the connection to a worker broke");
+			break;
+		}
+
+		offset = 0;
+		uint32_t reply_id = 0;
+		if (!get_u32(payload, offset, reply_id) || reply_id != (uint32_t)id
+			|| (type != message_result && type != message_error)) {
+			fail_job(id, "a worker sent an unexpected message");
+			break;
+		}
+		if (type == message_error) fail_job(id, std::string(payload.begin() + offset, payload.end()));
+		else if (!complete_job(id, payload)) {
+			fail_job(id, "a worker sent a malformed result");
+			break;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		c->state = connection::state_idle;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	c->socket.close();
+	connected_workers_--;
+	last_worker_seen_ = clock::now();
+}
+
+void mandelbrot_distributed::queue_frames()
+{
+	int in_flight = std::max(settings_.frames_in_flight_, 1);
+	while (queued_frames_ < (int)frames_.size() && queued_frames_ - delivered_frames_ < in_flight) {
+		mandelbrot_parameter_file::frame f = frames_[queued_frames_];
+		f.raw_output_.clear();
+		const vector2i& dimensions = f.params_.image_dimensions_;
+
+		frame_state state;
+		state.img.reset(new image(dimensions));
+		for (int y = 0; y < dimensions.y; y += settings_.tile_size_) {
+			for (int x = 0; x < dimensions.x; x += settings_.tile_size_) {
+				std::unique_ptr<job> j(new job());
+				j->frame = queued_frames_;
+				j->begin = vector2i(x, y);
+				j->size = vector2i(std::min(settings_.tile_size_, dimensions.x - x),
+					std::min(settings_.tile_size_, dimensions.y - y));
+
+				/*the supersampling compares a pixel with its neighbours, so they are rendered along*/
+				j->render_begin = j->begin;
+				j->render_size = j->size;
+				if (f.visualization_ == mandelbrot_parameter_file::visualization_julia_iter && f.params_.max_samples_ > 1) {
+					j->render_begin = vector2i(std::max(x - 1, 0), std::max(y - 1, 0));
+					j->render_size = vector2i(std::min(x + j->size.x + 1, dimensions.x) - j->render_begin.x,
+						std::min(y + j->size.y + 1, dimensions.y) - j->render_begin.y);
+				}
+
+				mandelbrot_parameter_file::frame tile = f;
+				tile.params_ = tile_parameters(f.params_, j->render_begin, j->render_size);
+				std::string text = mandelbrot_parameter_file::write(tile);
+				put_u32(j->message, (uint32_t)jobs_.size());
+				j->message.insert(j->message.end(), text.begin(), text.end());
+
+				j->queued = true;
+				queue_.push_back((int)jobs_.size());
+				jobs_.push_back(std::move(j));
+				state.remaining_tiles++;
+			}
+		}
+		active_frames_.push_back(std::move(state));
+		queued_frames_++;
+	}
+}
+
+int mandelbrot_distributed::next_job(connection * c)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (!stopping_) {
+		clock::time_point now = clock::now();
+		int id = -1;
+		if (!queue_.empty()) {
+			id = queue_.front();
+			queue_.pop_front();
+			jobs_[id]->queued = false;
+		}
+		else id = find_straggler(now);
+
+		if (id >= 0) {
+			job& j = *jobs_[id];
+			if (j.running++ == 0) j.started = now;
+			c->state = connection::state_sending;
+			return id;
+		}
+		/*woken by new jobs, the timeout rechecks the stragglers*/
+		condition_.wait_for(lock, std::chrono::milliseconds(50));
+	}
+	return -1;
+}
+
+int mandelbrot_distributed::find_straggler(clock::time_point now) const
+{
+	if (tile_seconds_.empty()) return -1;
+
+	std::vector<double> seconds = tile_seconds_;
+	std::nth_element(seconds.begin(), seconds.begin() + seconds.size() / 2, seconds.end());
+	double threshold = seconds[seconds.size() / 2] * settings_.straggler_factor_;
+
+	int ret = -1;
+	double longest = threshold;
+	for (const std::unique_ptr<job>& j : jobs_) {
+		if (j->done || j->running != 1) continue;
+		double elapsed = std::chrono::duration<double>(now - j->started).count();
+		if (elapsed > longest) {
+			longest = elapsed;
+			ret = (int)(&j - jobs_.data());
+		}
+	}
+	return ret;
+}
+
+bool mandelbrot_distributed::complete_job(int id, const std::vector<unsigned char>& result)
+{
+	size_t offset = 4;
+	mandelbrot_generator::frame_statistics statistics;
+	uint32_t width = 0, height = 0;
+	if (!get_statistics(result, offset, statistics) || !get_u32(result, offset, width)
+		|| !get_u32(result, offset, height)) return false;
+
+	/*the first result claims the job, the pixels are copied without the lock*/
+	image* img;
+	vector2i begin;
+	vector2i size;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		job& j = *jobs_[id];
+		if ((int)width != j.render_size.x || (int)height != j.render_size.y
+			|| result.size() - offset != (size_t)width * height * 4) return false;
+		j.running--;
+		if (j.done || stopping_) return true;
+		j.done = true;
+		tile_seconds_.push_back(std::chrono::duration<double>(clock::now() - j.started).count());
+		img = active_frames_[j.frame - delivered_frames_].img.get();
+		begin = j.begin;
+		size = j.size;
+		/*the apron is left out, its pixels count for the tiles they belong to*/
+		offset += ((size_t)(begin.y - j.render_begin.y) * width + (begin.x - j.render_begin.x)) * 4;
+		long long apron_pixels = (long long)width * height - (long long)size.x * size.y;
+		statistics.pixels_ -= apron_pixels;
+		statistics.samples_ -= apron_pixels;
+	}
+
+	const unsigned char* source = result.data() + offset;
+	for (int y = 0; y < size.y; y++)
+		memcpy(img->data() + ((size_t)(begin.y + y) * img->size().x + begin.x) * 4, source + (size_t)y * width * 4,
+			(size_t)size.x * 4);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	frame_state& f = active_frames_[jobs_[id]->frame - delivered_frames_];
+	f.statistics.add(statistics);
+	f.remaining_tiles--;
+	condition_.notify_all();
+	return true;
+}
+
+void mandelbrot_distributed::fail_job(int id, const std::string & reason)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	job& j = *jobs_[id];
+	j.running--;
+	if (stopping_ || j.done || j.queued || j.running > 0) return;
+
+	if (++j.failures >= settings_.max_attempts_) {
+		stop("tile " + std::to_string(j.begin.x) + "," + std::to_string(j.begin.y) + " of frame "
+			+ std::to_string(j.frame) + " failed " + std::to_string(j.failures) + " times: " + reason);
+		return;
+	}
+	j.queued = true;
+	queue_.push_front(id);
+	condition_.notify_all();
+}
+
+void mandelbrot_distributed::stop(const std::string & error)
+{
+	if (stopping_) return;
+	stopping_ = true;
+	error_ = error;
+
+	/*
+	idle workers are sent home by their threads, the others are cut off. a rendering
+	worker finds the shutdown after its result could not be sent
+	*/
+	listener_.shutdown();
+	for (const std::unique_ptr<connection>& c : connections_) {
+		if (c->state == connection::state_idle || !c->socket.is_open()) continue;
+		if (c->state == connection::state_rendering)
+			send_message(c->socket, message_shutdown, std::vector<unsigned char>());
+		c->socket.shutdown();
+	}
+	condition_.notify_all();
+}
+
+bool mandelbrot_distributed::work(const std::string & address, int threads, std::string & error_out)
+{
+	mandelbrot_socket s;
+	clock::time_point deadline = clock::now() + std::chrono::seconds(10);
+	while (!mandelbrot_socket::connect(address, s, error_out)) {
+		if (clock::now() > deadline) return false;
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	}
+
+	std::vector<unsigned char> payload;
+	put_u32(payload, protocol_version);
+	put_u32(payload, (uint32_t)(threads > 0 ? threads : (int)std::thread::hardware_concurrency()));
+	if (!send_message(s, message_hello, payload)) {
+		error_out = "the connection to the coordinator broke";
+		return false;
+	}
+
+	message_type type;
+	std::vector<unsigned char> reply;
+	while (receive_message(s, type, payload)) {
+		if (type == message_shutdown) return true;
+		if (type != message_job) break;
+
+		/*a failed send is not the end yet, the coordinator may have sent this worker home meanwhile*/
+		message_type reply_type = render_job(payload, threads, reply);
+		send_message(s, reply_type, reply);
+	}
+	error_out = "the connection to the coordinator broke";
+	return false;
+}
+
+mandelbrot_distributed::message_type mandelbrot_distributed::render_job(const std::vector<unsigned char>& payload,
+	int threads, std::vector<unsigned char>& reply_out)
+{
+	size_t offset = 0;
+	uint32_t id = 0;
+	get_u32(payload, offset, id);
+
+	std::vector<mandelbrot_parameter_file::frame> frames;
+	std::string error;
+	if (!mandelbrot_parameter_file::parse(std::string(payload.begin() + offset, payload.end()), frames, error)
+		|| frames.size() != 1) {
+		reply_out = error_payload(id, error.empty() ? "a job has to describe one frame" : error);
+		return message_error;
+	}
+	mandelbrot_parameter_file::frame& f = frames[0];
+	f.params_.worker_count_ = threads;
+	MANDELBROT_PROFILE_SCOPE("distributed job", (long long)f.params_.image_dimensions_.x * f.params_.image_dimensions_.y);
+
+	image img(f.params_.image_dimensions_);
+	mandelbrot_generator::frame_statistics statistics;
+	bool rendered = f.visualization_ == mandelbrot_parameter_file::visualization_julia_iter
+		? mandelbrot_generator::generate_mandelbrot_image_julia_iter(f.params_, img, &statistics)
+		: mandelbrot_generator::generate_mandelbrot_image_julia_value(f.params_, img);
+	if (!rendered) {
+		reply_out = error_payload(id, "the tile could not be rendered");
+		return message_error;
+	}
+
+	size_t pixel_bytes = (size_t)img.size().x * img.size().y * 4;
+	reply_out.clear();
+	reply_out.reserve(4 + statistics_values * 8 + 8 + pixel_bytes);
+	put_u32(reply_out, id);
+	put_statistics(reply_out, statistics);
+	put_u32(reply_out, (uint32_t)img.size().x);
+	put_u32(reply_out, (uint32_t)img.size().y);
+	reply_out.insert(reply_out.end(), img.data(), img.data() + pixel_bytes);
+	return message_result;
+}
+
+mandelbrot_generator::parameter_set mandelbrot_distributed::tile_parameters(
+	const mandelbrot_generator::parameter_set & params, const vector2i & begin, const vector2i & size)
+{
+	mandelbrot_generator::parameter_set ret = params;
+	ret.frame_dimensions_ = params.frame_size();
+	ret.image_offset_ = vector2i(params.image_offset_.x + begin.x, params.image_offset_.y + begin.y);
+	ret.image_dimensions_ = size;
+	return ret;
+}
+
+bool mandelbrot_distributed::send_message(mandelbrot_socket & s, message_type type,
+	const std::vector<unsigned char>& payload)
+{
+	std::vector<unsigned char> header;
+	header.push_back((unsigned char)type);
+	put_u32(header, (uint32_t)payload.size());
+	return s.send(header.data(), header.size()) && (payload.empty() || s.send(payload.data(), payload.size()));
+}
+
+bool mandelbrot_distributed::receive_message(mandelbrot_socket & s, message_type & type_out,
+	std::vector<unsigned char>& payload_out)
+{
+	std::vector<unsigned char> header(5);
+	if (!s.receive(header.data(), header.size())) return false;
+
+	size_t offset = 1;
+	uint32_t size = 0;
+	get_u32(header, offset, size);
+	if (header[0] < message_hello || header[0] > message_shutdown || size > max_payload_size) return false;
+
+	type_out = (message_type)header[0];
+	payload_out.resize(size);
+	return size == 0 || s.receive(payload_out.data(), size);
+}
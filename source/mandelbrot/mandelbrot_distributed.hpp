@@ -0,0 +1,236 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_distributed.hpp
+*
+* Rendering of the frames of a parameter file by worker processes that
+* receive tiles over a socket
+*
+************************************************************************/
+
+#ifndef MANDELBROT_DISTRIBUTED_HPP_INCLUDED
+#define MANDELBROT_DISTRIBUTED_HPP_INCLUDED
+
+#include "mandelbrot_generator.hpp"
+#include "mandelbrot_parameter_file.hpp"
+#include "mandelbrot_socket.hpp"
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_distributed
+*
+* a coordinator splits the frames into tiles and hands them to the workers
+* that connect to its address, one tile per worker at a time. a tile is a
+* part of the frame, see \bref{tile_parameters}, so the workers render it
+* with the usual generators on all of their cores, and the coordinator
+* copies the pixels into the frame. with supersampling a tile is rendered
+* with a one pixel apron of its neighbours, which the coordinator leaves
+* out, so the frame is the same as one rendered in one piece. frames are
+* delivered in order, the tiles of the next frames are handed out while the
+* last tiles of a frame are still rendering.
+*
+* a tile whose worker disconnects or reports an error goes back to the
+* queue. once the queue is empty, tiles that take much longer than the
+* others are handed to a second worker as well and the first result is
+* taken, so a slow or hung worker does not hold up the frame.
+*
+* messages are a type byte and a 32 bit payload size followed by the
+* payload, integers are little endian:
+*
+*	hello		worker -> coordinator	version, threads
+*	job			coordinator -> worker	job id, parameter file text of the tile
+*	result		worker -> coordinator	job id, statistics, width, height, rgba pixels
+*	error		worker -> coordinator	job id, message
+*	shutdown	coordinator -> worker	-
+*
+************************************************************************/
+class mandelbrot_distributed {
+public:
+	/**
+	*************************************************************************
+	* @class mandelbrot_distributed::settings
+	* how the coordinator splits and schedules the frames
+	************************************************************************/
+	class settings {
+	public:
+		/** host:port or unix:path, see \bref{mandelbrot_socket} */
+		std::string address_;
+		/** edge length of the square tiles in pixels, the last row and column may be smaller */
+		int tile_size_ = 512;
+		/** a tile that failed this often fails the render */
+		int max_attempts_ = 3;
+		/** a tile running this many times longer than the median tile is handed out again */
+		double straggler_factor_ = 3.;
+		/** frames whose tiles are handed out before the earliest one is complete */
+		int frames_in_flight_ = 2;
+		/** the render fails if tiles are waiting and no worker is connected for this long */
+		int worker_timeout_seconds_ = 60;
+	};
+
+	/** called in frame order on the calling thread of \bref{coordinate}, false stops the render */
+	typedef std::function<bool(int index, const viral_core::image& img,
+		const mandelbrot_generator::frame_statistics& statistics)> frame_callback;
+
+	/**
+	* listens on \bref{s}.address_ and renders \bref{frames} on the workers that connect,
+	* raw_output_ is ignored. returns once all frames are delivered or false with a
+	* message in \bref{error_out}. the workers are sent home in either case
+	*/
+	static bool coordinate(const std::vector<mandelbrot_parameter_file::frame>& frames, const settings& s,
+		const frame_callback& on_frame, std::string& error_out);
+
+	/**
+	* connects to the coordinator at \bref{address}, retrying for a while if it is not
+	* listening yet, and renders tiles with \bref{threads} threads (0 uses all) until
+	* it is sent home. false if it never connected or the connection broke
+	*/
+	static bool work(const std::string& address, int threads, std::string& error_out);
+
+	/**
+	* \bref{params} restricted to the pixels from \bref{begin} with \bref{size}. the view
+	* stays the one of the whole frame and the tile is placed in it by image_offset_, so
+	* its pixels are computed from the same coordinates as in a render of the frame
+	*/
+	static mandelbrot_generator::parameter_set tile_parameters(const mandelbrot_generator::parameter_set& params,
+		const viral_core::vector2i& begin, const viral_core::vector2i& size);
+
+	static const uint32_t protocol_version = 2;
+
+private:
+	enum message_type {
+		message_hello = 1,
+		message_job,
+		message_result,
+		message_error,
+		message_shutdown
+	};
+
+	typedef std::chrono::steady_clock clock;
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_distributed::job
+	* a tile of a frame
+	************************************************************************/
+	struct job {
+		int frame;
+		viral_core::vector2i begin;
+		viral_core::vector2i size;
+		/** the pixels the workers render, the tile and its apron */
+		//{
+		viral_core::vector2i render_begin;
+		viral_core::vector2i render_size;
+		//}
+		/** the message sent to the workers */
+		std::vector<unsigned char> message;
+		/** failed attempts */
+		int failures = 0;
+		/** workers rendering the tile, more than one once it straggles */
+		int running = 0;
+		bool queued = false;
+		bool done = false;
+		clock::time_point started;
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_distributed::connection
+	* a connected worker
+	************************************************************************/
+	struct connection {
+		enum connection_state {
+			state_greeting,		/**< waits for the hello */
+			state_idle,			/**< between jobs, its thread sends the worker home */
+			state_sending,
+			state_rendering		/**< its thread waits for the result of the worker */
+		};
+
+		mandelbrot_socket socket;
+		connection_state state = state_greeting;
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_distributed::frame_state
+	* a frame whose tiles are handed out
+	************************************************************************/
+	struct frame_state {
+		std::unique_ptr<viral_core::image> img;
+		mandelbrot_generator::frame_statistics statistics;
+		int remaining_tiles = 0;
+	};
+
+	const std::vector<mandelbrot_parameter_file::frame>& frames_;
+	const settings settings_;
+
+	mandelbrot_socket listener_;
+
+	/** all state below is guarded by the mutex */
+	//{
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	/** indexed by the job id */
+	std::vector<std::unique_ptr<job> > jobs_;
+	/** ids of the jobs that wait for a worker, retried ones in front */
+	std::deque<int> queue_;
+	/** frames from delivered_frames_ on, at most settings::frames_in_flight_ */
+	std::deque<frame_state> active_frames_;
+	int delivered_frames_ = 0;
+	int queued_frames_ = 0;
+	/** seconds of the completed tiles, for the straggler threshold */
+	std::vector<double> tile_seconds_;
+	int connected_workers_ = 0;
+	clock::time_point last_worker_seen_;
+	bool stopping_ = false;
+	std::string error_;
+	std::vector<std::unique_ptr<connection> > connections_;
+	std::vector<std::thread> connection_threads_;
+	//}
+
+	mandelbrot_distributed(const std::vector<mandelbrot_parameter_file::frame>& frames, const settings& s);
+
+	bool run(const frame_callback& on_frame, std::string& error_out);
+
+	void accept_main();
+	void connection_main(connection* c);
+
+	/** splits frames until settings::frames_in_flight_ frames are active, lock held */
+	void queue_frames();
+	/**
+	* blocks until a job is waiting or straggling and marks it as running on \bref{c},
+	* -1 once the coordinator stops
+	*/
+	int next_job(connection* c);
+	/** copies the pixels of the first result of a job into its frame, false if the result is malformed */
+	bool complete_job(int id, const std::vector<unsigned char>& result);
+	/** requeues a job that was not completed, or fails the render after max_attempts_ */
+	void fail_job(int id, const std::string& reason);
+	/** a job running longer than straggler_factor_ times the median tile, -1 if none, lock held */
+	int find_straggler(clock::time_point now) const;
+	/** stops all threads with \bref{error} unless they stopped already, lock held */
+	void stop(const std::string& error);
+
+	/** framing of the messages, false if the connection broke */
+	//{
+	static bool send_message(mandelbrot_socket& s, message_type type, const std::vector<unsigned char>& payload);
+	static bool receive_message(mandelbrot_socket& s, message_type& type_out, std::vector<unsigned char>& payload_out);
+	//}
+
+	/** renders a job message into a result or an error message */
+	static message_type render_job(const std::vector<unsigned char>& payload, int threads,
+		std::vector<unsigned char>& reply_out);
+};
+
+#endif//#ifndef MANDELBROT_DISTRIBUTED_HPP_INCLUDED
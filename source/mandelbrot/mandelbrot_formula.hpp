@@ -0,0 +1,328 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_formula.hpp
+*
+* Iteration formulas of the escape time and julia value generators
+*
+************************************************************************/
+
+#ifndef MANDELBROT_FORMULA_HPP_INCLUDED
+#define MANDELBROT_FORMULA_HPP_INCLUDED
+
+#include <cmath>
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_formula
+*
+* selects the map z -> f(z) + c that \bref{mandelbrot_simd} iterates. in the
+* default mode c is the pixel and z starts at c, i.e. the first step from 0
+* is skipped. as a julia set, c is the fixed julia_re_ + julia_im_*i and z
+* starts at the pixel.
+*
+* every formula is a step policy whose templates are written in the
+* arithmetic operators of their value type only, so the same step is
+* compiled into the scalar loop for float, double and double_double and into
+* the vector kernels of every instruction set. \bref{dispatch} calls a
+* function with the step of the selected formula, once per batch of points
+*
+************************************************************************/
+class mandelbrot_formula {
+public:
+	enum family {
+		mandelbrot,		/**< z^2 + c */
+		multibrot,		/**< z^power_ + c */
+		burning_ship,	/**< (|re z| + |im z| i)^2 + c */
+		tricorn			/**< conj(z)^2 + c */
+	};
+
+	/** powers of \bref{multibrot} that have a step, 2 is the mandelbrot step */
+	//{
+	static const int min_power = 2;
+	static const int max_power = 8;
+	//}
+
+	family family_ = mandelbrot;
+	/** exponent of \bref{multibrot}, the other families ignore it */
+	int power_ = 2;
+	/** iterates the julia set of julia_re_ + julia_im_*i instead */
+	//{
+	bool julia_ = false;
+	double julia_re_ = 0.;
+	double julia_im_ = 0.;
+	//}
+
+	bool operator==(const mandelbrot_formula& other) const;
+	bool operator!=(const mandelbrot_formula& other) const;
+
+	/** exponent of the leading term, the growth of log|z| per iteration after the escape */
+	int degree() const;
+
+	/**
+	* true for the quadratic mandelbrot set, only there the main cardioid and the period-2
+	* bulb are known to be interior and the perturbation of \bref{mandelbrot_perturbation} applies
+	*/
+	bool quadratic_mandelbrot() const;
+
+	/**
+	* true if z after any number of steps is a polynomial of the pixel, i.e. for the powers
+	* of z. the folds of burning_ship and tricorn are not
+	*/
+	bool holomorphic() const;
+
+	/**
+	* step policies. iterate computes the next z from z = \bref{x} + \bref{y}i and its products
+	* \bref{xx}, \bref{yy} and \bref{xy}, which the kernels keep for the escape test anyway.
+	* derivative computes dz' = f'(z) dz + \bref{offset}, the offset being 1 for dz/dc and 0
+	* for the derivative by the starting point of a julia set. \bref{needs_z} is false if
+	* iterate only uses the products, the kernels then do not keep z
+	*/
+	//{
+	struct quadratic_step {
+		static const bool needs_z = false;
+
+		template<typename value>
+		static void iterate(const value& x, const value& y, const value& xx, const value& yy, const value& xy,
+			const value& c_x, const value& c_y, value& x_out, value& y_out);
+		template<typename value>
+		static void derivative(const value& x, const value& y, const value& dz_x, const value& dz_y,
+			const value& offset, value& dz_x_out, value& dz_y_out);
+	};
+
+	/** z^power by squarings and multiplications unrolled at compile time */
+	template<int power>
+	struct power_step {
+		static const bool needs_z = true;
+
+		template<typename value>
+		static void iterate(const value& x, const value& y, const value& xx, const value& yy, const value& xy,
+			const value& c_x, const value& c_y, value& x_out, value& y_out);
+		template<typename value>
+		static void derivative(const value& x, const value& y, const value& dz_x, const value& dz_y,
+			const value& offset, value& dz_x_out, value& dz_y_out);
+	};
+
+	/**
+	* the folds are not holomorphic, the derivative is the one of z^2 + c. both folds keep |z|,
+	* so the distance estimate is of the right magnitude though not a bound
+	*/
+	//{
+	struct burning_ship_step : quadratic_step {
+		template<typename value>
+		static void iterate(const value& x, const value& y, const value& xx, const value& yy, const value& xy,
+			const value& c_x, const value& c_y, value& x_out, value& y_out);
+	};
+
+	struct tricorn_step : quadratic_step {
+		template<typename value>
+		static void iterate(const value& x, const value& y, const value& xx, const value& yy, const value& xy,
+			const value& c_x, const value& c_y, value& x_out, value& y_out);
+	};
+	//}
+	//}
+
+	/**
+	* calls \bref{function} with a default constructed step of this formula, whose type
+	* selects the instantiation of the kernel. powers without a step iterate z^2 + c
+	*/
+	template<typename function>
+	void dispatch(function&& f) const;
+
+private:
+	/**
+	* z^power from z and its products, \bref{even} selects squaring z^(power/2) over
+	* multiplying z^(power-1) by z
+	*/
+	//{
+	template<int power>
+	struct power_of {
+		template<typename value>
+		static void apply(const value& x, const value& y, const value& xx, const value& yy, const value& xy,
+			value& x_out, value& y_out);
+	};
+	template<int power, bool even>
+	struct power_of_parity;
+	//}
+};
+
+inline bool mandelbrot_formula::operator==(const mandelbrot_formula & other) const
+{
+	/*the fields that do not change the iteration are ignored, e.g. the power of another family*/
+	return family_ == other.family_
+		&& (family_ != multibrot || power_ == other.power_)
+		&& julia_ == other.julia_
+		&& (!julia_ || (julia_re_ == other.julia_re_ && julia_im_ == other.julia_im_));
+}
+
+inline bool mandelbrot_formula::operator!=(const mandelbrot_formula & other) const
+{
+	return !(*this == other);
+}
+
+inline int mandelbrot_formula::degree() const
+{
+	return family_ == multibrot ? power_ : 2;
+}
+
+inline bool mandelbrot_formula::quadratic_mandelbrot() const
+{
+	return !julia_ && (family_ == mandelbrot || (family_ == multibrot && power_ == 2));
+}
+
+inline bool mandelbrot_formula::holomorphic() const
+{
+	return family_ == mandelbrot || family_ == multibrot;
+}
+
+template<typename value>
+inline void mandelbrot_formula::quadratic_step::iterate(const value &, const value &,
+	const value & xx, const value & yy, const value & xy, const value & c_x, const value & c_y,
+	value & x_out, value & y_out)
+{
+	x_out = xx - yy + c_x;
+	y_out = xy + xy + c_y;
+}
+
+template<typename value>
+inline void mandelbrot_formula::quadratic_step::derivative(const value & x, const value & y,
+	const value & dz_x, const value & dz_y, const value & offset, value & dz_x_out, value & dz_y_out)
+{
+	value t = x*dz_x - y*dz_y;
+	value u = x*dz_y + y*dz_x;
+	dz_x_out = (t + t) + offset;
+	dz_y_out = u + u;
+}
+
+template<int power>
+template<typename value>
+inline void mandelbrot_formula::power_step<power>::iterate(const value & x, const value & y,
+	const value & xx, const value & yy, const value & xy, const value & c_x, const value & c_y,
+	value & x_out, value & y_out)
+{
+	value p_x, p_y;
+	power_of<power>::apply(x, y, xx, yy, xy, p_x, p_y);
+	x_out = p_x + c_x;
+	y_out = p_y + c_y;
+}
+
+template<int power>
+template<typename value>
+inline void mandelbrot_formula::power_step<power>::derivative(const value & x, const value & y,
+	const value & dz_x, const value & dz_y, const value & offset, value & dz_x_out, value & dz_y_out)
+{
+	/*power * z^(power-1) * dz*/
+	value w_x, w_y;
+	power_of<power - 1>::apply(x, y, x*x, y*y, x*y, w_x, w_y);
+	value t = w_x*dz_x - w_y*dz_y;
+	value u = w_x*dz_y + w_y*dz_x;
+	value factor = value((double)power);
+	dz_x_out = t * factor + offset;
+	dz_y_out = u * factor;
+}
+
+template<typename value>
+inline void mandelbrot_formula::burning_ship_step::iterate(const value &, const value &,
+	const value & xx, const value & yy, const value & xy, const value & c_x, const value & c_y,
+	value & x_out, value & y_out)
+{
+	/*2 |x| |y| = |2xy|*/
+	using std::abs;
+	x_out = xx - yy + c_x;
+	y_out = abs(xy + xy) + c_y;
+}
+
+template<typename value>
+inline void mandelbrot_formula::tricorn_step::iterate(const value &, const value &,
+	const value & xx, const value & yy, const value & xy, const value & c_x, const value & c_y,
+	value & x_out, value & y_out)
+{
+	x_out = xx - yy + c_x;
+	y_out = c_y - (xy + xy);
+}
+
+template<int power>
+template<typename value>
+inline void mandelbrot_formula::power_of<power>::apply(const value & x, const value & y,
+	const value & xx, const value & yy, const value & xy, value & x_out, value & y_out)
+{
+	power_of_parity<power, power % 2 == 0>::apply(x, y, xx, yy, xy, x_out, y_out);
+}
+
+template<>
+struct mandelbrot_formula::power_of<1> {
+	template<typename value>
+	static void apply(const value& x, const value& y, const value&, const value&, const value&,
+		value& x_out, value& y_out)
+	{
+		x_out = x;
+		y_out = y;
+	}
+};
+
+template<>
+struct mandelbrot_formula::power_of<2> {
+	template<typename value>
+	static void apply(const value&, const value&, const value& xx, const value& yy, const value& xy,
+		value& x_out, value& y_out)
+	{
+		x_out = xx - yy;
+		y_out = xy + xy;
+	}
+};
+
+template<int power>
+struct mandelbrot_formula::power_of_parity<power, true> {
+	template<typename value>
+	static void apply(const value& x, const value& y, const value& xx, const value& yy, const value& xy,
+		value& x_out, value& y_out)
+	{
+		value h_x, h_y;
+		power_of<power / 2>::apply(x, y, xx, yy, xy, h_x, h_y);
+		value h_xy = h_x*h_y;
+		x_out = h_x*h_x - h_y*h_y;
+		y_out = h_xy + h_xy;
+	}
+};
+
+template<int power>
+struct mandelbrot_formula::power_of_parity<power, false> {
+	template<typename value>
+	static void apply(const value& x, const value& y, const value& xx, const value& yy, const value& xy,
+		value& x_out, value& y_out)
+	{
+		value p_x, p_y;
+		power_of<power - 1>::apply(x, y, xx, yy, xy, p_x, p_y);
+		x_out = p_x*x - p_y*y;
+		y_out = p_x*y + p_y*x;
+	}
+};
+
+template<typename function>
+void mandelbrot_formula::dispatch(function && f) const
+{
+	switch (family_) {
+	case multibrot:
+		switch (power_) {
+		case 3: f(power_step<3>()); return;
+		case 4: f(power_step<4>()); return;
+		case 5: f(power_step<5>()); return;
+		case 6: f(power_step<6>()); return;
+		case 7: f(power_step<7>()); return;
+		case 8: f(power_step<8>()); return;
+		default: f(quadratic_step()); return;
+		}
+	case burning_ship:
+		f(burning_ship_step());
+		return;
+	case tricorn:
+		f(tricorn_step());
+		return;
+	default:
+		f(quadratic_step());
+		return;
+	}
+}
+
+#endif//#ifndef MANDELBROT_FORMULA_HPP_INCLUDED
@@ -8,14 +8,164 @@
 ************************************************************************/
 
 #include "mandelbrot_generator.hpp"
+#include "mandelbrot_orbit_cache.hpp"
+#include "mandelbrot_perturbation.hpp"
+#include "mandelbrot_profiler.hpp"
+#include "mandelbrot_tile_cache.hpp"
+#include "render_thread_pool.hpp"
 
 #include <viral_core/geo_util.hpp>
 #include <viral_core/log.hpp>
 
+#include <float.h>
 #include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
 
 using namespace viral_core;
 
+/** hue in turns of the angles of \bref{count} julia values, shifted by \bref{offset} */
+template<typename math>
+static void julia_value_hues(const float* x, const float* y, int count, float turns_per_radian, float offset,
+	float* hue_out)
+{
+	for (int i = 0; i < count; i++) {
+		float h = math::atan2(y[i], x[i]) * turns_per_radian + offset;
+		hue_out[i] = h - floorf(h);
+	}
+}
+
+/** true if \bref{output} has the size of the frame of \bref{params} */
+static bool output_fits(const mandelbrot_generator::parameter_set& params, const image& output)
+{
+	if (output.size().x == params.image_dimensions_.x && output.size().y == params.image_dimensions_.y) return true;
+	LOG_ERROR(string("output image of ") + string(output.size().x) + string("x") + string(output.size().y)
+		+ string(" for a frame of ") + string(params.image_dimensions_.x) + string("x")
+		+ string(params.image_dimensions_.y));
+	return false;
+}
+
+/** a / b rounded towards negative infinity, grid positions can be negative */
+static long long floor_div(long long a, long long b)
+{
+	long long ret = a / b;
+	return ret * b > a ? ret - 1 : ret;
+}
+
+/** copies the pixels tile \bref{x}, \bref{y} shares with its parent one level up, every other pixel */
+static int seed_from_parent(const mandelbrot_tile_cache::entry& parent, long long x, long long y,
+	mandelbrot_tile_cache::entry& tile)
+{
+	const int size = mandelbrot_tile_cache::tile_size;
+	int offset_x = (int)(x - 2 * floor_div(x, 2)) * (size / 2);
+	int offset_y = (int)(y - 2 * floor_div(y, 2)) * (size / 2);
+	for (int row = 0; row < size; row += 2) {
+		for (int column = 0; column < size; column += 2) {
+			int i = row * size + column;
+			int j = (offset_y + row / 2) * size + offset_x + column / 2;
+			tile.remain_iter_[i] = parent.remain_iter_[j];
+			if (!tile.smooth_.empty()) tile.smooth_[i] = parent.smooth_[j];
+			/*distances are in pixels, the parent's are twice as large*/
+			if (!tile.distance_.empty()) tile.distance_[i] = parent.distance_[j] * 2.f;
+		}
+	}
+	return size * size / 4;
+}
+
+/** copies the pixels the quarter \bref{quarter_x}, \bref{quarter_y} of a tile shares with its child there */
+static int seed_from_child(const mandelbrot_tile_cache::entry& child, int quarter_x, int quarter_y,
+	mandelbrot_tile_cache::entry& tile)
+{
+	const int size = mandelbrot_tile_cache::tile_size;
+	for (int row = 0; row < size / 2; row++) {
+		for (int column = 0; column < size / 2; column++) {
+			int i = (quarter_y * size / 2 + row) * size + quarter_x * size / 2 + column;
+			int j = 2 * row * size + 2 * column;
+			tile.remain_iter_[i] = child.remain_iter_[j];
+			if (!tile.smooth_.empty()) tile.smooth_[i] = child.smooth_[j];
+			if (!tile.distance_.empty()) tile.distance_[i] = child.distance_[j] * 0.5f;
+		}
+	}
+	return size * size / 4;
+}
+
+/**
+* true if every point within \bref{radius} of \bref{re} + \bref{im}i escapes after exactly
+* \bref{max_iter} - \bref{remain_iter} iterations, or never if \bref{remain_iter} is 0. a ball
+* bounds the z of all these points through every iteration, the rounding of the steps
+* included. \bref{z_x_out}, \bref{z_y_out} receive the center of the ball at the escape.
+* only for the holomorphic formulas, see mandelbrot_formula::holomorphic
+*/
+static bool ball_escape(const mandelbrot_formula& formula, float max_threshold, int max_iter,
+	double re, double im, double radius, int remain_iter, double& z_x_out, double& z_y_out)
+{
+	int power = formula.degree();
+	double c_x = formula.julia_ ? formula.julia_re_ : re;
+	double c_y = formula.julia_ ? formula.julia_im_ : im;
+	double abs_c = sqrt(c_x * c_x + c_y * c_y);
+	/*the pixels of a julia set only move the start, those of the mandelbrot set move c as well*/
+	double c_radius = formula.julia_ ? 0. : radius;
+
+	/*the kernels round z in float, so the proof keeps a margin to the escape radius*/
+	double escape_radius = sqrt((double)max_threshold);
+	double inside = escape_radius * (1. - 1e-4);
+	double outside = escape_radius * (1. + 1e-4);
+	int escape_step = remain_iter > 0 ? max_iter - remain_iter : -1;
+
+	double x = re;
+	double y = im;
+	double r = radius;
+	double check_x = x, check_y = y, check_r = -1.;
+	int check_interval = 1;
+	int check_steps = 0;
+	for (int n = 0;; n++) {
+		double abs_z = sqrt(x * x + y * y);
+		if (n == escape_step) {
+			z_x_out = x;
+			z_y_out = y;
+			return abs_z - r > outside;
+		}
+		if (abs_z + r > inside) return false;
+		if (escape_step < 0) {
+			if (n >= max_iter - 1) return true;
+			/*
+			* a ball inside an earlier one maps into the balls in between forever, which all
+			* stayed inside. like the periodicity check of the kernels, with doubling intervals
+			*/
+			double dx = x - check_x;
+			double dy = y - check_y;
+			if (sqrt(dx * dx + dy * dy) + r <= check_r) return true;
+			if (++check_steps == check_interval) {
+				/*a slightly larger ball is still a bound and can contain its images*/
+				if (abs_z + 1.5 * r <= inside) r *= 1.5;
+				check_x = x;
+				check_y = y;
+				check_r = r;
+				check_steps = 0;
+				check_interval *= 2;
+			}
+		}
+
+		/*z^power + c, (|z| + r)^power - |z|^power expanded so small radii do not cancel*/
+		double p_x = x, p_y = y;
+		double abs_p = abs_z;
+		double growth = 1.;
+		for (int k = 1; k < power; k++) {
+			double t = p_x * x - p_y * y;
+			p_y = p_x * y + p_y * x;
+			p_x = t;
+			growth = growth * (abs_z + r) + abs_p;
+			abs_p *= abs_z;
+		}
+		x = p_x + c_x;
+		y = p_y + c_y;
+		double rounding = (4. * power + 4.) * DBL_EPSILON * (abs_p + abs_c);
+		r = (r * growth + c_radius + rounding) * (1. + 64. * DBL_EPSILON);
+	}
+}
+
 //////////////////////////////////////////////////////////////////////////
 //
 // mandelbrot_generator
@@ -25,141 +175,1443 @@ using namespace viral_core;
 void mandelbrot_generator::linear_angle_and_abs(float start_x, float start_y, 
 	float goal_x, float goal_y, float interpolation, float & x, float & y)
 {
-	float start_abs = sqrtf(start_x * start_x + start_y * start_y);
-	float next_abs = sqrtf(goal_x * goal_x + goal_y * goal_y);
-	float start_angle = geo_util::atan2(start_y, start_x);
-	float next_angle = geo_util::atan2(goal_y, goal_x);
-	float curr_abs = interpolation * (next_abs - start_abs) + start_abs;
-	float curr_angle = interpolation * (next_angle - start_angle) + start_angle;
-	x = curr_abs * cosf(curr_angle);
-	y = curr_abs * sinf(curr_angle);
+	mandelbrot_interpolation::angle_and_abs_kernel<false>::apply<mandelbrot_interpolation::exact_math>(
+		start_x, start_y, goal_x, goal_y, interpolation, x, y);
 }
 
 void mandelbrot_generator::linear_short_angle_and_abs(float start_x, float start_y,
 	float goal_x, float goal_y, float interpolation, float & x, float & y)
 {
-	float start_abs = sqrtf(start_x * start_x + start_y * start_y);
-	float next_abs = sqrtf(goal_x * goal_x + goal_y * goal_y);
-	float start_angle = geo_util::atan2(start_y, start_x);
-	float next_angle = geo_util::atan2(goal_y, goal_x);
-	if (next_angle - start_angle > geo_constants::pi) {//go shorter way for angle
-		next_angle -= geo_constants::double_pi;
-	}
-	float curr_abs = interpolation * (next_abs - start_abs) + start_abs;
-	float curr_angle = interpolation * (next_angle - start_angle) + start_angle;
-	x = curr_abs * cosf(curr_angle);
-	y = curr_abs * sinf(curr_angle);
+	mandelbrot_interpolation::angle_and_abs_kernel<true>::apply<mandelbrot_interpolation::exact_math>(
+		start_x, start_y, goal_x, goal_y, interpolation, x, y);
 }
 
 void mandelbrot_generator::polynomial(float start_x, float start_y,
 	float goal_x, float goal_y, float interpolation, float & x, float & y)
 {
-	complex_pow_real(start_x, start_y, 2.f / (2.f - interpolation), x, y);
-	x += interpolation * (goal_x + start_y*start_y - start_x * start_x);//re_part of c
-	y += interpolation * (goal_y - 2.f * start_x * start_y);			//im_part of c
+	mandelbrot_interpolation::polynomial_kernel::apply<mandelbrot_interpolation::exact_math>(
+		start_x, start_y, goal_x, goal_y, interpolation, x, y);
 }
 
 void mandelbrot_generator::linear_xy(float start_x, float start_y,
 	float goal_x, float goal_y, float interpolation, float & x, float & y)
 {
-	x = start_x + interpolation * (goal_x - start_x);
-	y = start_y + interpolation * (goal_y - start_y);
+	mandelbrot_interpolation::linear_xy_kernel::apply<mandelbrot_interpolation::exact_math>(
+		start_x, start_y, goal_x, goal_y, interpolation, x, y);
 }
 
-auto_pointer<image> mandelbrot_generator::generate_mandelbrot_image_julia_iter(const parameter_set& params)
+auto_pointer<image> mandelbrot_generator::generate_mandelbrot_image_julia_iter(const parameter_set& params,
+	frame_statistics* statistics, progressive_control* progressive, raw_frame* raw, mandelbrot_tile_cache* tile_cache)
 {
 	auto_pointer<image> ret(new image(params.image_dimensions_));
+	if (!generate_mandelbrot_image_julia_iter(params, *ret, statistics, progressive, raw, tile_cache)) ret.reset();
+	return ret;
+}
 
-	/*computation according to https://de.wikipedia.org/wiki/Mandelbrot-Menge#Programmbeispiel */
-	for (int i = 0; i < ret->size().x * ret->size().y; i++) {
-		int x_coordinate = i % ret->size().x;
-		int y_coordinate = i / ret->size().x;
-		float im_part = params.imaginary_min_ + (params.imaginary_max_ - params.imaginary_min_) * y_coordinate / ret->size().y;
-		float re_part = params.real_min_ + (params.real_max_ - params.real_min_) * x_coordinate / ret->size().x;
-
-		int remain_iter = params.max_iter_;
-		float xx = re_part * re_part;
-		float yy = im_part * im_part;
-		float xy = re_part * im_part;
-		float abs_2 = xx + yy;
+bool mandelbrot_generator::generate_mandelbrot_image_julia_iter(const parameter_set& params, image& img,
+	frame_statistics* statistics, progressive_control* progressive, raw_frame* raw, mandelbrot_tile_cache* tile_cache)
+{
+	if (!output_fits(params, img)) return false;
+	/*only the perturbation iterates deep views at their depth*/
+	if (params.deep_view() && select_precision(params) != precision_perturbation)
+		return generate_mandelbrot_image_julia_iter(params.flat_view(), img, statistics, progressive, raw, tile_cache);
+	MANDELBROT_PROFILE_SCOPE("julia_iter frame", (long long)img.size().x * img.size().y);
 
-		while (abs_2 <= params.max_threshold_ && remain_iter > 0) {
-			remain_iter--;
-			float x = xx - yy + re_part;
-			float y = xy + xy + im_part;
-			xx = x*x;
-			yy = y*y;
-			xy = x*y;
-			abs_2 = xx + yy;
-		}
+	std::vector<unsigned char> palette_entries = julia_iter_palette(params);
+	const unsigned char* palette = palette_entries.data();
+	if (raw) {
+		size_t pixel_count = (size_t)params.image_dimensions_.x * params.image_dimensions_.y;
+		raw->size_ = params.image_dimensions_;
+		raw->remain_iter_.assign(pixel_count, 0);
+		raw->x_.assign(pixel_count, 0.f);
+		raw->y_.assign(pixel_count, 0.f);
+		raw->smooth_.assign(pixel_count, 0.f);
+		raw->distance_.assign(params.coloring_ == coloring_distance ? pixel_count : 0, 0.f);
+	}
 
-		int julia_iter = params.max_iter_ - remain_iter;
+	std::function<void(const tile&, frame_statistics&)> tile_function;
+	sample_evaluator sampler;
+	auto_pointer<mandelbrot_perturbation> reference;
+	precision used_precision = select_precision(params);
 
-		if (remain_iter == 0) ret->data()[i * 4] = ret->data()[i * 4 + 1] = ret->data()[i * 4 + 2] = 0;
+	switch (used_precision) {
+	case precision_double:
+		tile_function = [&](const tile& t, frame_statistics& s) {
+			julia_iter_tile<double>(params, img, t, palette, raw, s); };
+		sampler = julia_iter_sampler<double>(params);
+		break;
+	case precision_double_double:
+		tile_function = [&](const tile& t, frame_statistics& s) {
+			julia_iter_tile<double_double>(params, img, t, palette, raw, s); };
+		sampler = julia_iter_sampler<double_double>(params);
+		break;
+	case precision_perturbation:
+	{
+		double_double center_re = (params.real_min_ + params.real_max_) * 0.5;
+		double_double center_im = (params.imaginary_min_ + params.imaginary_max_) * 0.5;
+		double radius_re = ((params.real_max_ - params.real_min_) * 0.5).hi;
+		double radius_im = ((params.imaginary_max_ - params.imaginary_min_) * 0.5).hi;
+		double radius = sqrt(radius_re * radius_re + radius_im * radius_im);
+		/*the deltas of a deep view stay relative to the center, in units of 2^-view_exponent_*/
+		if (params.deep_view()) {
+			reference.reset(new mandelbrot_perturbation(params.deep_coordinate(params.center_re_, center_re),
+				params.deep_coordinate(params.center_im_, center_im), radius, params.view_exponent_,
+				params.max_threshold_, params.max_iter_));
+		}
 		else {
-			float h_value = (float)julia_iter / (float)params.max_iter_ + params.hsv_color_offset_;
-			h_value = h_value - (int)h_value;//mod h_value
-			hsv_to_rgb(h_value, 1.f, 1.f, ret->data()[i * 4], ret->data()[i * 4 + 1], ret->data()[i * 4 + 2]);
+			reference.reset(new mandelbrot_perturbation(center_re, center_im, radius,
+				params.max_threshold_, params.max_iter_));
 		}
+		tile_function = [&](const tile& t, frame_statistics& s) {
+			julia_iter_tile_perturbation(params, img, t, *reference, palette, raw, s); };
+		sampler = julia_iter_sampler_perturbation(params, *reference);
+		break;
+	}
+	default:
+		tile_function = [&](const tile& t, frame_statistics& s) {
+			julia_iter_tile<float>(params, img, t, palette, raw, s); };
+		sampler = julia_iter_sampler<float>(params);
+		break;
+	}
+
+	/*perturbation deltas belong to the reference orbit of one frame, so those tiles cannot be shared*/
+	mandelbrot_tile_cache::placement placement;
+	bool cached = tile_cache && used_precision != precision_perturbation
+		&& mandelbrot_tile_cache::place(params, placement);
 
-		ret->data()[i * 4 + 3] = 255;//Alpha-value
+	/*tiles count locally, the lock is only taken once per tile*/
+	frame_statistics frame;
+	std::mutex frame_mutex;
+	bool completed;
+	if (cached) {
+		const std::atomic<bool>* cancel = progressive ? &progressive->cancel_ : 0;
+		completed = julia_iter_cached_frame(params, used_precision, placement.level, placement.x, placement.y,
+			img, *tile_cache, palette, raw, cancel, frame)
+			&& (params.max_samples_ <= 1 || supersample_frame(params, img, sampler, palette, cancel, frame));
+		if (completed && progressive && progressive->on_pass_) progressive->on_pass_(img, true);
 	}
-	return ret;
+	else {
+		completed = process_passes(params, img, progressive, [&](const tile& t) {
+			frame_statistics tile_statistics;
+			tile_function(t, tile_statistics);
+
+			std::lock_guard<std::mutex> lock(frame_mutex);
+			frame.add(tile_statistics);
+		}, params.max_samples_ > 1 ? [&](const std::atomic<bool>* cancel) {
+			return supersample_frame(params, img, sampler, palette, cancel, frame);
+		} : std::function<bool(const std::atomic<bool>*)>());
+	}
+
+	frame.pixels_ = (long long)img.size().x * img.size().y;
+	frame.samples_ += frame.pixels_;
+	MANDELBROT_PROFILE_COUNTER("iterations", frame.escape_.iterations);
+	MANDELBROT_PROFILE_COUNTER("escaped pixels", frame.escaped_pixels_);
+	MANDELBROT_PROFILE_COUNTER("interior pixels", frame.escape_.interior_pixels);
+	MANDELBROT_PROFILE_COUNTER("evaluated pixels", frame.evaluated_pixels_);
+	if (statistics) *statistics = frame;
+	return completed;
 }
 
 viral_core::auto_pointer<viral_core::image> mandelbrot_generator::generate_mandelbrot_image_julia_value(
-	const parameter_set& params)
+	const parameter_set& params, progressive_control* progressive, mandelbrot_orbit_cache* orbit_cache,
+	raw_frame* raw)
+{
+	auto_pointer<image> ret(new image(params.image_dimensions_));
+	if (!generate_mandelbrot_image_julia_value(params, *ret, progressive, orbit_cache, raw)) ret.reset();
+	return ret;
+}
+
+bool mandelbrot_generator::generate_mandelbrot_image_julia_value(const parameter_set & params, image & img,
+	progressive_control * progressive, mandelbrot_orbit_cache * orbit_cache, raw_frame * raw)
 {
 	//LOG_INFO(string("compuatation with iteration: ") + params.iterations_ + 
 		//string(" and interpolation: ") + params.interpolation_);
-	auto_pointer<image> ret(new image(params.image_dimensions_));
+	if (!output_fits(params, img)) return false;
+	if (params.deep_view())
+		return generate_mandelbrot_image_julia_value(params.flat_view(), img, progressive, orbit_cache, raw);
+	MANDELBROT_PROFILE_SCOPE("julia_value frame", (long long)img.size().x * img.size().y);
 
-	/*computation according to https://de.wikipedia.org/wiki/Mandelbrot-Menge#Programmbeispiel */
-	for (int i = 0; i < ret->size().x * ret->size().y; i++) {
-		int x_coordinate = i % ret->size().x;
-		int y_coordinate = i / ret->size().x;
-		float re_part = params.real_min_ + (params.real_max_ - params.real_min_) * x_coordinate / ret->size().x;
-		float im_part = params.imaginary_min_ 
-			+ (params.imaginary_max_ - params.imaginary_min_) * y_coordinate / ret->size().y;
-
-		float x = re_part;
-		float y = im_part;
-		float xx = x * x;
-		float yy = y * y;
-		float xy = x * y;
-
-		for (int j = 0; j < params.iterations_; j++) {
-			x = xx - yy + re_part;
-			y = xy + xy + im_part;
-			xx = x*x;
-			yy = y*y;
-			xy = x*y;
-		}
-		/*interpolation*/
-		if (params.interpolate_) {
-			float start_x = x;
-			float start_y = y;
-			float goal_x = xx - yy + re_part;
-			float goal_y = xy + xy + im_part;
-			(*params.interpolation_method_)(start_x, start_y, goal_x, goal_y, params.interpolation_, x, y);
-			xx = x*x;
-			yy = y*y;
-			xy = x*y;
+	if (raw) {
+		size_t pixel_count = (size_t)params.image_dimensions_.x * params.image_dimensions_.y;
+		raw->size_ = params.image_dimensions_;
+		raw->remain_iter_.clear();
+		raw->smooth_.clear();
+		raw->distance_.clear();
+		raw->x_.assign(pixel_count, 0.f);
+		raw->y_.assign(pixel_count, 0.f);
+	}
+
+	/*fixed iteration counts gain nothing from perturbation, z_n is small anyway*/
+	bool completed;
+	switch (select_precision(params)) {
+	case precision_double:
+		completed = julia_value_frame<double>(params, img, precision_double, progressive, orbit_cache, raw);
+		break;
+	case precision_double_double:
+	case precision_perturbation:
+		completed = julia_value_frame<double_double>(params, img, precision_double_double, progressive,
+			orbit_cache, raw);
+		break;
+	default:
+		completed = julia_value_frame<float>(params, img, precision_float, progressive, orbit_cache, raw);
+		break;
+	}
+	return completed;
+}
+
+bool mandelbrot_generator::generate_mandelbrot_image_julia_value_sweep(const parameter_set & params,
+	const std::vector<float>& interpolations, const std::vector<image*>& outputs, const std::atomic<bool>* cancel,
+	mandelbrot_orbit_cache * orbit_cache)
+{
+	if (interpolations.size() != outputs.size()) {
+		LOG_ERROR(string("julia value sweep of ") + string((int)interpolations.size()) + string(" interpolations into ")
+			+ string((int)outputs.size()) + string(" images"));
+		return false;
+	}
+	if (outputs.empty()) return true;
+	if (params.deep_view()) {
+		return generate_mandelbrot_image_julia_value_sweep(params.flat_view(), interpolations, outputs, cancel,
+			orbit_cache);
+	}
+
+	std::vector<julia_value_output> sweep_outputs;
+	for (size_t i = 0; i < outputs.size(); i++) {
+		if (!output_fits(params, *outputs[i])) return false;
+		julia_value_output output = { outputs[i], interpolations[i] };
+		sweep_outputs.push_back(output);
+	}
+	MANDELBROT_PROFILE_SCOPE("julia_value sweep", (long long)params.image_dimensions_.x * params.image_dimensions_.y
+		* (long long)outputs.size());
+
+	switch (select_precision(params)) {
+	case precision_double:
+		return julia_value_sweep_frame<double>(params, sweep_outputs, precision_double, cancel, orbit_cache);
+	case precision_double_double:
+	case precision_perturbation:
+		return julia_value_sweep_frame<double_double>(params, sweep_outputs, precision_double_double, cancel,
+			orbit_cache);
+	default:
+		return julia_value_sweep_frame<float>(params, sweep_outputs, precision_float, cancel, orbit_cache);
+	}
+}
+
+auto_pointer<image> mandelbrot_generator::recolor_julia_iter(const parameter_set & params, const raw_frame & raw)
+{
+	auto_pointer<image> ret(new image(raw.size_));
+	unsigned char* data = ret->data();
+	std::vector<unsigned char> palette = julia_iter_palette(params);
+
+	bool smooth = params.coloring_ != coloring_escape_time && !raw.smooth_.empty();
+	bool shaded = params.coloring_ == coloring_distance && !raw.distance_.empty();
+
+	process_tiles(params, raw.size_, 1, 0, 0, [&](const tile& t) {
+		for (int y = t.begin.y; y < t.end.y; y++) {
+			for (int x = t.begin.x; x < t.end.x; x++) {
+				int i = y * raw.size_.x + x;
+				if (smooth) {
+					color_escape(params, palette.data(), raw.remain_iter_[i], raw.smooth_[i],
+						shaded ? raw.distance_[i] : FLT_MAX, data + i * 4);
+					continue;
+				}
+				const unsigned char* entry = palette.data() + raw.remain_iter_[i] * 4;
+				std::copy(entry, entry + 4, data + i * 4);
+			}
+		}
+	});
+	return ret;
+}
+
+auto_pointer<image> mandelbrot_generator::recolor_julia_value(const parameter_set & params, const raw_frame & raw)
+{
+	auto_pointer<image> ret(new image(raw.size_));
+	unsigned char* data = ret->data();
+
+	process_tiles(params, raw.size_, 1, 0, 0, [&](const tile& t) {
+		for (int y = t.begin.y; y < t.end.y; y++) {
+			int i = y * raw.size_.x + t.begin.x;
+			color_julia_values(params, raw.x_.data() + i, raw.y_.data() + i, t.end.x - t.begin.x, data + i * 4);
+		}
+	});
+	return ret;
+}
+
+void mandelbrot_generator::frame_statistics::add(const frame_statistics & other)
+{
+	escape_.add(other.escape_);
+	evaluated_pixels_ += other.evaluated_pixels_;
+	filled_pixels_ += other.filled_pixels_;
+	pixels_ += other.pixels_;
+	samples_ += other.samples_;
+	cached_pixels_ += other.cached_pixels_;
+	escaped_pixels_ += other.escaped_pixels_;
+}
+
+const int mandelbrot_generator::progressive_steps[] = { 4, 2, 1 };
+const int mandelbrot_generator::progressive_pass_count = 3;
+const int mandelbrot_generator::tile_size;
+const int mandelbrot_generator::max_batch_size;
+const int mandelbrot_generator::min_subdivision_size;
+const int mandelbrot_generator::unknown_remain_iter;
+const int mandelbrot_generator::pending_remain_iter;
+const int mandelbrot_generator::max_supersamples;
+
+vector2i mandelbrot_generator::parameter_set::frame_size() const
+{
+	return frame_dimensions_.x > 0 && frame_dimensions_.y > 0 ? frame_dimensions_ : image_dimensions_;
+}
+
+bool mandelbrot_generator::parameter_set::deep_view() const
+{
+	return view_exponent_ != 0 || !center_re_.zero() || !center_im_.zero();
+}
+
+arbitrary_precision mandelbrot_generator::parameter_set::deep_coordinate(const arbitrary_precision & center,
+	const double_double & relative) const
+{
+	/*128 bits below the units of the relative coordinates, as for the reference orbit*/
+	arbitrary_precision offset(relative);
+	offset.set_limbs(arbitrary_precision::limbs_for_bits(view_exponent_ + 128));
+	return center + ldexp(offset, -view_exponent_);
+}
+
+mandelbrot_generator::parameter_set mandelbrot_generator::parameter_set::flat_view() const
+{
+	parameter_set ret = *this;
+	if (!deep_view()) return ret;
+
+	ret.real_min_ = deep_coordinate(center_re_, real_min_).to_double_double();
+	ret.imaginary_min_ = deep_coordinate(center_im_, imaginary_min_).to_double_double();
+	ret.real_max_ = deep_coordinate(center_re_, real_max_).to_double_double();
+	ret.imaginary_max_ = deep_coordinate(center_im_, imaginary_max_).to_double_double();
+	ret.center_re_ = arbitrary_precision();
+	ret.center_im_ = arbitrary_precision();
+	ret.view_exponent_ = 0;
+	return ret;
+}
+
+long long mandelbrot_generator::frame_statistics::skipped_iterations() const
+{
+	return escape_.interior_skipped_iterations + escape_.periodic_skipped_iterations;
+}
+
+double mandelbrot_generator::frame_statistics::samples_per_pixel() const
+{
+	return pixels_ > 0 ? (double)samples_ / pixels_ : 1.;
+}
+
+mandelbrot_generator::precision mandelbrot_generator::select_precision(const parameter_set & params)
+{
+	/*the reference orbit of the perturbation is one of z^2 + c*/
+	if (params.precision_ == precision_perturbation && !params.formula_.quadratic_mandelbrot())
+		return precision_double_double;
+	if (params.precision_ != precision_automatic) return params.precision_;
+
+	/*a part of a frame takes the precision of the whole frame*/
+	vector2i frame = params.frame_size();
+	double spacing = std::max(
+		(params.real_max_ - params.real_min_).hi / frame.x,
+		(params.imaginary_max_ - params.imaginary_min_).hi / frame.y);
+	double magnitude = std::max(
+		std::max(fabs(params.real_min_.hi), fabs(params.real_max_.hi)),
+		std::max(fabs(params.imaginary_min_.hi), fabs(params.imaginary_max_.hi)));
+	/*deep bounds are in units of 2^-view_exponent_, the center in these units may overflow to infinity*/
+	if (params.deep_view()) {
+		magnitude = std::max(magnitude, std::max(fabs(params.center_re_.to_double(params.view_exponent_)),
+			fabs(params.center_im_.to_double(params.view_exponent_))));
+	}
+	double relative_spacing = spacing / std::max(magnitude, 1e-300);
+
+	if (relative_spacing > 1e-5) return precision_float;
+	if (relative_spacing > 1e-13) return precision_double;
+	return params.formula_.quadratic_mandelbrot() ? precision_perturbation : precision_double_double;
+}
+
+void mandelbrot_generator::process_tiles(const parameter_set & params, const vector2i & size,
+	int step, int previous_step, const std::atomic<bool>* cancel,
+	const std::function<void(const tile&)>& tile_function)
+{
+	int tiles_x = (size.x + tile_size - 1) / tile_size;
+	int tiles_y = (size.y + tile_size - 1) / tile_size;
+
+	std::shared_ptr<render_thread_pool> pool = render_thread_pool::shared(params.worker_count_);
+	pool->run(tiles_x * tiles_y, [&](int index) {
+		if (cancel && *cancel) return;
+
+		tile t;
+		t.begin = vector2i((index % tiles_x) * tile_size, (index / tiles_x) * tile_size);
+		t.end = vector2i(std::min(t.begin.x + tile_size, size.x), std::min(t.begin.y + tile_size, size.y));
+		t.step = step;
+		t.previous_step = previous_step;
+		MANDELBROT_PROFILE_SCOPE("tile", (long long)(t.end.x - t.begin.x) * (t.end.y - t.begin.y));
+		tile_function(t);
+	});
+}
+
+bool mandelbrot_generator::process_passes(const parameter_set & params, image & img,
+	progressive_control * progressive, const std::function<void(const tile&)>& tile_function,
+	const std::function<bool(const std::atomic<bool>*cancel)>& refine)
+{
+	if (!progressive || !progressive->passes_) {
+		const std::atomic<bool>* cancel = progressive ? &progressive->cancel_ : 0;
+		process_tiles(params, img.size(), 1, 0, cancel, tile_function);
+		if (cancel && *cancel) return false;
+		if (refine && !refine(cancel)) return false;
+		if (progressive && progressive->on_pass_) progressive->on_pass_(img, true);
+		return true;
+	}
+
+	int previous_step = 0;
+	for (int pass = 0; pass < progressive_pass_count; pass++) {
+		int step = progressive_steps[pass];
+		process_tiles(params, img.size(), step, previous_step, &progressive->cancel_, tile_function);
+		if (progressive->cancel_) return false;
+
+		bool last_pass = pass + 1 == progressive_pass_count;
+		if (progressive->on_pass_) progressive->on_pass_(img, last_pass && !refine);
+		previous_step = step;
+	}
+
+	/*the unrefined image is shown meanwhile, refining takes a fraction of a pass*/
+	if (refine) {
+		if (!refine(&progressive->cancel_)) return false;
+		if (progressive->on_pass_) progressive->on_pass_(img, true);
+	}
+	return true;
+}
+
+bool mandelbrot_generator::in_pass(const tile & t, int x, int y)
+{
+	if (x % t.step != 0 || y % t.step != 0) return false;
+	return t.previous_step == 0 || x % t.previous_step != 0 || y % t.previous_step != 0;
+}
+
+void mandelbrot_generator::fill_pass_block(image & img, const tile & t, int x, int y)
+{
+	if (t.step == 1) return;
+
+	unsigned char* data = img.data();
+	const unsigned char* sample = data + (y * img.size().x + x) * 4;
+	int end_x = std::min(x + t.step, t.end.x);
+	int end_y = std::min(y + t.step, t.end.y);
+	for (int block_y = y; block_y < end_y; block_y++) {
+		for (int block_x = x; block_x < end_x; block_x++) {
+			if (block_x == x && block_y == y) continue;
+			std::copy(sample, sample + 4, data + (block_y * img.size().x + block_x) * 4);
 		}
+	}
+}
+
+template<typename scalar_type>
+void mandelbrot_generator::julia_iter_tile(const parameter_set & params, image & img, const tile & t,
+	const unsigned char* palette, raw_frame* raw, frame_statistics & statistics)
+{
+	mandelbrot_simd::simd_level level = mandelbrot_simd::resolve(params.simd_level_);
 
-		float v = 1.f / (1.f + 5.f*sqrtf(xx + yy));
-		float h_degree = geo_util::atan2(y, x) * geo_constants::radians_to_degrees;
-		while (h_degree < 0.0f) h_degree += 360.f;
+	scalar_type real_min, real_max, imaginary_min, imaginary_max;
+	convert_precision(params.real_min_, real_min);
+	convert_precision(params.real_max_, real_max);
+	convert_precision(params.imaginary_min_, imaginary_min);
+	convert_precision(params.imaginary_max_, imaginary_max);
 
-		//rgb_project_2d(h_degree / 360.f, v, ret->data()[i * 4], ret->data()[i * 4 + 1], ret->data()[i * 4 + 2]);
-		hsl_to_rgb(h_degree / 360.f, 1.f, v, ret->data()[i * 4], ret->data()[i * 4 + 1], ret->data()[i * 4 + 2]);
+	scalar_type re_column[tile_size];
+	scalar_type im_row[tile_size];
+	scalar_type re_batch[max_batch_size];
+	scalar_type im_batch[max_batch_size];
 
+	mandelbrot_simd::escape_parameters escape;
+	escape.max_threshold = params.max_threshold_;
+	escape.max_iter = params.max_iter_;
+	escape.interior_check = params.interior_check_;
+	escape.formula = params.formula_;
+	escape.periodicity_check = params.periodicity_check_;
+	vector2i frame = params.frame_size();
+	vector2i offset = params.image_offset_;
+	escape.distance_scale = frame.x / to_double(params.real_max_ - params.real_min_);
 
-		ret->data()[i * 4 + 3] = 255;//Alpha-value
+	for (int x_coordinate = t.begin.x; x_coordinate < t.end.x; x_coordinate++)
+		re_column[x_coordinate - t.begin.x] = real_min + (real_max - real_min) * (offset.x + x_coordinate) / frame.x;
+	for (int y_coordinate = t.begin.y; y_coordinate < t.end.y; y_coordinate++)
+		im_row[y_coordinate - t.begin.y] = imaginary_min + (imaginary_max - imaginary_min) * (offset.y + y_coordinate) / frame.y;
+
+	iterate_tile(params, img, t, [&](const vector2i* pixels, int count, int* remain_iter_out,
+		float* x_out, float* y_out, float* distance_out) {
+		for (int i = 0; i < count; i++) {
+			re_batch[i] = re_column[pixels[i].x];
+			im_batch[i] = im_row[pixels[i].y];
+		}
+		mandelbrot_simd::escape_time(level, re_batch, im_batch, count, escape, remain_iter_out, statistics.escape_,
+			x_out, y_out, distance_out);
+	}, palette, raw, statistics);
+}
+
+void mandelbrot_generator::julia_iter_tile_perturbation(const parameter_set & params, image & img, const tile & t,
+	const mandelbrot_perturbation & reference, const unsigned char* palette, raw_frame* raw,
+	frame_statistics & statistics)
+{
+	double_double center_re = (params.real_min_ + params.real_max_) * 0.5;
+	double_double center_im = (params.imaginary_min_ + params.imaginary_max_) * 0.5;
+
+	double delta_re_column[tile_size];
+	double delta_im_row[tile_size];
+	double delta_re_batch[max_batch_size];
+	double delta_im_batch[max_batch_size];
+	vector2i frame = params.frame_size();
+	vector2i offset = params.image_offset_;
+	double distance_scale = frame.x / to_double(params.real_max_ - params.real_min_);
+
+	/*only the offsets to the reference orbit need to be exact, the rest is done in double*/
+	for (int x_coordinate = t.begin.x; x_coordinate < t.end.x; x_coordinate++)
+		delta_re_column[x_coordinate - t.begin.x] = (params.real_min_ 
+			+ (params.real_max_ - params.real_min_) * (offset.x + x_coordinate) / frame.x - center_re).hi;
+	for (int y_coordinate = t.begin.y; y_coordinate < t.end.y; y_coordinate++)
+		delta_im_row[y_coordinate - t.begin.y] = (params.imaginary_min_
+			+ (params.imaginary_max_ - params.imaginary_min_) * (offset.y + y_coordinate) / frame.y - center_im).hi;
+
+	iterate_tile(params, img, t, [&](const vector2i* pixels, int count, int* remain_iter_out,
+		float* x_out, float* y_out, float* distance_out) {
+		for (int i = 0; i < count; i++) {
+			delta_re_batch[i] = delta_re_column[pixels[i].x];
+			delta_im_batch[i] = delta_im_row[pixels[i].y];
+		}
+		reference.escape_time(delta_re_batch, delta_im_batch, count, remain_iter_out, x_out, y_out,
+			distance_out, distance_scale);
+		/*the series approximation skips iterations, but they still count as done*/
+		for (int i = 0; i < count; i++) statistics.escape_.iterations += params.max_iter_ - remain_iter_out[i];
+	}, palette, raw, statistics);
+}
+
+template<typename scalar_type>
+void mandelbrot_generator::julia_iter_grid_tile(const parameter_set & params, int level, long long x, long long y,
+	int * remain, float * smooth, float * distance, frame_statistics & statistics)
+{
+	mandelbrot_simd::simd_level simd = mandelbrot_simd::resolve(params.simd_level_);
+
+	/*grid coordinates are exact, so a tile has the same values whichever frame computes it*/
+	scalar_type re_column[tile_size];
+	scalar_type im_row[tile_size];
+	for (int i = 0; i < tile_size; i++) {
+		convert_precision(mandelbrot_tile_cache::coordinate(x * tile_size + i, level), re_column[i]);
+		convert_precision(mandelbrot_tile_cache::coordinate(y * tile_size + i, level), im_row[i]);
 	}
+
+	mandelbrot_simd::escape_parameters escape;
+	escape.max_threshold = params.max_threshold_;
+	escape.max_iter = params.max_iter_;
+	escape.interior_check = params.interior_check_;
+	escape.formula = params.formula_;
+	escape.periodicity_check = params.periodicity_check_;
+	escape.distance_scale = 1. / mandelbrot_tile_cache::spacing(level);
+
+	scalar_type re_batch[max_batch_size];
+	scalar_type im_batch[max_batch_size];
+	pixel_evaluator evaluate = [&](const vector2i* pixels, int count, int* remain_iter_out,
+		float* x_out, float* y_out, float* distance_out) {
+		for (int i = 0; i < count; i++) {
+			re_batch[i] = re_column[pixels[i].x];
+			im_batch[i] = im_row[pixels[i].y];
+		}
+		mandelbrot_simd::escape_time(simd, re_batch, im_batch, count, escape, remain_iter_out, statistics.escape_,
+			x_out, y_out, distance_out);
+	};
+
+	vector2i pixels[tile_size * tile_size];
+	int count = 0;
+	for (int row = 0; row < tile_size; row++)
+		for (int column = 0; column < tile_size; column++)
+			if (remain[row * tile_size + column] == unknown_remain_iter) pixels[count++] = vector2i(column, row);
+
+	float x_buffer[tile_size * tile_size];
+	float y_buffer[tile_size * tile_size];
+	float* z_x = smooth ? x_buffer : 0;
+	float* z_y = smooth ? y_buffer : 0;
+
+	/*subdivision needs the whole tile, seeded tiles only compute the pixels in between*/
+	if (count == tile_size * tile_size && params.render_mode_ == render_subdivision) {
+		double re_proof[tile_size];
+		double im_proof[tile_size];
+		for (int i = 0; i < tile_size; i++) {
+			re_proof[i] = mandelbrot_tile_cache::coordinate(x * tile_size + i, level).hi;
+			im_proof[i] = mandelbrot_tile_cache::coordinate(y * tile_size + i, level).hi;
+		}
+		subdivide_tile(params, evaluate, vector2i(tile_size, tile_size), re_proof, im_proof,
+			mandelbrot_tile_cache::spacing(level), remain, z_x, z_y, distance, !smooth, statistics);
+	}
+	else
+		evaluate_pixels(evaluate, pixels, count, remain, z_x, z_y, distance, statistics);
+
+	if (smooth) {
+		for (int i = 0; i < count; i++) {
+			int j = pixels[i].y * tile_size + pixels[i].x;
+			smooth[j] = smooth_iteration(params, remain[j], z_x[j], z_y[j]);
+		}
+	}
+}
+
+template<typename scalar_type>
+mandelbrot_generator::sample_evaluator mandelbrot_generator::julia_iter_sampler(const parameter_set & params)
+{
+	mandelbrot_simd::simd_level level = mandelbrot_simd::resolve(params.simd_level_);
+
+	scalar_type real_min, real_max, imaginary_min, imaginary_max;
+	convert_precision(params.real_min_, real_min);
+	convert_precision(params.real_max_, real_max);
+	convert_precision(params.imaginary_min_, imaginary_min);
+	convert_precision(params.imaginary_max_, imaginary_max);
+	int width = params.frame_size().x;
+	int height = params.frame_size().y;
+
+	mandelbrot_simd::escape_parameters escape;
+	escape.max_threshold = params.max_threshold_;
+	escape.max_iter = params.max_iter_;
+	escape.interior_check = params.interior_check_;
+	escape.formula = params.formula_;
+	escape.periodicity_check = params.periodicity_check_;
+	escape.distance_scale = width / to_double(params.real_max_ - params.real_min_);
+
+	return [=](const double* x, const double* y, int count, int* remain_iter_out,
+		float* x_out, float* y_out, float* distance_out, frame_statistics& statistics) {
+		scalar_type re_batch[max_batch_size];
+		scalar_type im_batch[max_batch_size];
+		for (int i = 0; i < count; i++) {
+			re_batch[i] = real_min + (real_max - real_min) * (scalar_type)x[i] / (scalar_type)width;
+			im_batch[i] = imaginary_min + (imaginary_max - imaginary_min) * (scalar_type)y[i] / (scalar_type)height;
+		}
+		mandelbrot_simd::escape_time(level, re_batch, im_batch, count, escape, remain_iter_out, statistics.escape_,
+			x_out, y_out, distance_out);
+	};
+}
+
+mandelbrot_generator::sample_evaluator mandelbrot_generator::julia_iter_sampler_perturbation(
+	const parameter_set & params, const mandelbrot_perturbation & reference)
+{
+	double_double center_re = (params.real_min_ + params.real_max_) * 0.5;
+	double_double center_im = (params.imaginary_min_ + params.imaginary_max_) * 0.5;
+	double_double real_min = params.real_min_;
+	double_double imaginary_min = params.imaginary_min_;
+	double_double real_range = params.real_max_ - params.real_min_;
+	double_double imaginary_range = params.imaginary_max_ - params.imaginary_min_;
+	double width = params.frame_size().x;
+	double height = params.frame_size().y;
+	double distance_scale = width / to_double(real_range);
+	int max_iter = params.max_iter_;
+	const mandelbrot_perturbation* orbit = &reference;
+
+	return [=](const double* x, const double* y, int count, int* remain_iter_out,
+		float* x_out, float* y_out, float* distance_out, frame_statistics& statistics) {
+		/*zeroed, gcc cannot see that escape_time only reads the count lanes written below*/
+		double delta_re_batch[max_batch_size] = {};
+		double delta_im_batch[max_batch_size] = {};
+		for (int i = 0; i < count; i++) {
+			delta_re_batch[i] = (real_min + real_range * x[i] / width - center_re).hi;
+			delta_im_batch[i] = (imaginary_min + imaginary_range * y[i] / height - center_im).hi;
+		}
+		orbit->escape_time(delta_re_batch, delta_im_batch, count, remain_iter_out, x_out, y_out,
+			distance_out, distance_scale);
+		for (int i = 0; i < count; i++) statistics.escape_.iterations += max_iter - remain_iter_out[i];
+	};
+}
+
+void mandelbrot_generator::iterate_tile(const parameter_set & params, image & img, const tile & t,
+	const pixel_evaluator & evaluate, const unsigned char* palette, raw_frame* raw,
+	frame_statistics & statistics)
+{
+	unsigned char* data = img.data();
+	vector2i size(t.end.x - t.begin.x, t.end.y - t.begin.y);
+	int remain[tile_size * tile_size];
+	/*z is only kept if the raw frame or the coloring wants it*/
+	bool smooth = params.coloring_ != coloring_escape_time;
+	bool shaded = params.coloring_ == coloring_distance;
+	float x_buffer[tile_size * tile_size];
+	float y_buffer[tile_size * tile_size];
+	float distance_buffer[tile_size * tile_size];
+	float* x = raw || smooth ? x_buffer : 0;
+	float* y = raw || smooth ? y_buffer : 0;
+	float* distance = shaded ? distance_buffer : 0;
+
+	/*subdivision needs the complete tile, so it only runs in the final pass*/
+	bool subdivide = params.render_mode_ == render_subdivision && t.step == 1;
+	{
+		MANDELBROT_PROFILE_SCOPE("iterate");
+		if (subdivide) {
+			/*the proofs of the fills take the pixels in double, whatever precision the kernel uses*/
+			vector2i frame = params.frame_size();
+			vector2i offset = params.image_offset_;
+			double re_proof[tile_size];
+			double im_proof[tile_size];
+			for (int column = 0; column < size.x; column++)
+				re_proof[column] = (params.real_min_
+					+ (params.real_max_ - params.real_min_) * (offset.x + t.begin.x + column) / frame.x).hi;
+			for (int row = 0; row < size.y; row++)
+				im_proof[row] = (params.imaginary_min_
+					+ (params.imaginary_max_ - params.imaginary_min_) * (offset.y + t.begin.y + row) / frame.y).hi;
+			double spacing = std::max(to_double(params.real_max_ - params.real_min_) / frame.x,
+				to_double(params.imaginary_max_ - params.imaginary_min_) / frame.y);
+			subdivide_tile(params, evaluate, size, re_proof, im_proof, spacing, remain, x, y, distance, !smooth,
+				statistics);
+		}
+		else {
+			vector2i pixels[tile_size];
+			for (int row = 0; row < size.y; row++) {
+				int count = 0;
+				for (int column = 0; column < size.x; column++)
+					if (in_pass(t, t.begin.x + column, t.begin.y + row)) pixels[count++] = vector2i(column, row);
+				evaluate_pixels(evaluate, pixels, count, remain, x, y, distance, statistics);
+			}
+		}
+	}
+
+	/*coloring is a lookup per pixel, the smooth colorings blend two entries*/
+	MANDELBROT_PROFILE_SCOPE("color");
+	for (int row = 0; row < size.y; row++) {
+		for (int column = 0; column < size.x; column++) {
+			if (!subdivide && !in_pass(t, t.begin.x + column, t.begin.y + row)) continue;
+
+			int i = (t.begin.y + row) * img.size().x + t.begin.x + column;
+			int j = row * tile_size + column;
+			int remain_iter = remain[j];
+			if (remain_iter > 0) statistics.escaped_pixels_++;
+			float smooth_iter = x ? smooth_iteration(params, remain_iter, x[j], y[j]) : 0.f;
+			if (raw) {
+				raw->remain_iter_[i] = remain_iter;
+				raw->x_[i] = x[j];
+				raw->y_[i] = y[j];
+				raw->smooth_[i] = smooth_iter;
+				if (shaded) raw->distance_[i] = distance[j];
+			}
+			if (smooth) color_escape(params, palette, remain_iter, smooth_iter, shaded ? distance[j] : FLT_MAX, data + i * 4);
+			else std::copy(palette + remain_iter * 4, palette + remain_iter * 4 + 4, data + i * 4);
+			fill_pass_block(img, t, t.begin.x + column, t.begin.y + row);
+		}
+	}
+}
+
+void mandelbrot_generator::evaluate_pixels(const pixel_evaluator & evaluate,
+	const vector2i * pixels, int count, int * remain, float * x, float * y, float * distance,
+	frame_statistics & statistics)
+{
+	int remain_batch[max_batch_size];
+	float x_batch[max_batch_size];
+	float y_batch[max_batch_size];
+	float distance_batch[max_batch_size];
+	for (int first = 0; first < count; first += max_batch_size) {
+		int batch_size = std::min(count - first, max_batch_size);
+		evaluate(pixels + first, batch_size, remain_batch, x ? x_batch : 0, y ? y_batch : 0,
+			distance ? distance_batch : 0);
+		for (int i = 0; i < batch_size; i++) {
+			int j = pixels[first + i].y * tile_size + pixels[first + i].x;
+			remain[j] = remain_batch[i];
+			if (x) {
+				x[j] = x_batch[i];
+				y[j] = y_batch[i];
+			}
+			if (distance) distance[j] = distance_batch[i];
+		}
+	}
+	statistics.evaluated_pixels_ += count;
+}
+
+void mandelbrot_generator::subdivide_tile(const parameter_set & params, const pixel_evaluator & evaluate,
+	const vector2i & size, const double * re_column, const double * im_row, double spacing,
+	int * remain, float * x, float * y, float * distance, bool fill_escaped, frame_statistics & statistics)
+{
+	std::fill(remain, remain + tile_size * tile_size, unknown_remain_iter);
+	/*proofs of border pixels, shared by the rectangles on both sides: 0 not tried, 1 proven, -1 failed*/
+	signed char proven[tile_size * tile_size] = {};
+	double escape_x[tile_size * tile_size];
+	double escape_y[tile_size * tile_size];
+	auto prove = [&](int column, int row) {
+		int i = row * tile_size + column;
+		if (!proven[i]) {
+			double re = re_column[column];
+			double im = im_row[row];
+			/*the disc reaches the neighbouring border pixels, plus the rounding of the coordinates*/
+			double radius = 0.5 * spacing + 4. * DBL_EPSILON * (fabs(re) + fabs(im));
+			proven[i] = ball_escape(params.formula_, params.max_threshold_, params.max_iter_, re, im, radius,
+				remain[i], escape_x[i], escape_y[i]) ? 1 : -1;
+		}
+		return proven[i] > 0;
+	};
+	std::vector<vector2i> border;
+	border.reserve(4 * tile_size);
+
+	/*filled pixels have no z of their own*/
+	if (x) {
+		std::fill(x, x + tile_size * tile_size, 0.f);
+		std::fill(y, y + tile_size * tile_size, 0.f);
+	}
+	if (distance) std::fill(distance, distance + tile_size * tile_size, 0.f);
+
+	tile whole;
+	whole.begin = vector2i(0, 0);
+	whole.end = size;
+	std::vector<tile> rectangles(1, whole);
+	std::vector<tile> next_rectangles;
+	std::vector<vector2i> pixels;
+	pixels.reserve(tile_size * tile_size);
+
+	/*the rectangles of one level are processed together, so the kernels get full batches*/
+	while (!rectangles.empty()) {
+		pixels.clear();
+		auto collect = [&](int x, int y) {
+			int& r = remain[y * tile_size + x];
+			if (r != unknown_remain_iter) return;//shared with a neighbour or a parent
+			r = pending_remain_iter;
+			pixels.push_back(vector2i(x, y));
+		};
+		for (const tile& r : rectangles) {
+			for (int x = r.begin.x; x < r.end.x; x++) {
+				collect(x, r.begin.y);
+				collect(x, r.end.y - 1);
+			}
+			for (int y = r.begin.y + 1; y < r.end.y - 1; y++) {
+				collect(r.begin.x, y);
+				collect(r.end.x - 1, y);
+			}
+		}
+		evaluate_pixels(evaluate, pixels.data(), (int)pixels.size(), remain, x, y, distance, statistics);
+
+		pixels.clear();
+		next_rectangles.clear();
+		for (const tile& r : rectangles) {
+			int width = r.end.x - r.begin.x;
+			int height = r.end.y - r.begin.y;
+			if (width <= 2 || height <= 2) continue;//no interior
+
+			int border_remain = remain[r.begin.y * tile_size + r.begin.x];
+			bool uniform = true;
+			for (int x = r.begin.x; x < r.end.x && uniform; x++)
+				uniform = remain[r.begin.y * tile_size + x] == border_remain
+					&& remain[(r.end.y - 1) * tile_size + x] == border_remain;
+			for (int y = r.begin.y; y < r.end.y && uniform; y++)
+				uniform = remain[y * tile_size + r.begin.x] == border_remain
+					&& remain[y * tile_size + r.end.x - 1] == border_remain;
+			if (!fill_escaped && border_remain != 0) uniform = false;
+			if (!params.formula_.holomorphic()) uniform = false;
+			/*the proofs iterate in scalar double, for small rectangles the kernel is cheaper*/
+			if ((width - 2) * (height - 2) < 4 * (width + height)) uniform = false;
+
+			if (uniform) {
+				/*
+				* the border iterated as balls that overlap along it: inside the set the maximum of
+				* |z| is on the border, escaped the border of z at the escape must not wind around 0,
+				* else a zero of it inside could still be a point that escapes later
+				*/
+				border.clear();
+				for (int column = r.begin.x; column < r.end.x; column++) border.push_back(vector2i(column, r.begin.y));
+				for (int row = r.begin.y + 1; row < r.end.y; row++) border.push_back(vector2i(r.end.x - 1, row));
+				for (int column = r.end.x - 2; column >= r.begin.x; column--) border.push_back(vector2i(column, r.end.y - 1));
+				for (int row = r.end.y - 2; row > r.begin.y; row--) border.push_back(vector2i(r.begin.x, row));
+				for (size_t k = 0; k < border.size() && uniform; k++) uniform = prove(border[k].x, border[k].y);
+				if (uniform && border_remain != 0) {
+					double winding = 0.;
+					for (size_t k = 0; k < border.size(); k++) {
+						int i = border[k].y * tile_size + border[k].x;
+						int j = border[(k + 1) % border.size()].y * tile_size + border[(k + 1) % border.size()].x;
+						winding += atan2(escape_x[i] * escape_y[j] - escape_y[i] * escape_x[j],
+							escape_x[i] * escape_x[j] + escape_y[i] * escape_y[j]);
+					}
+					/*the angles add up to a multiple of 2 pi*/
+					uniform = fabs(winding) < 3.;
+				}
+			}
+
+			if (uniform) {
+				for (int y = r.begin.y + 1; y < r.end.y - 1; y++)
+					std::fill(remain + y * tile_size + r.begin.x + 1, remain + y * tile_size + r.end.x - 1, border_remain);
+				statistics.filled_pixels_ += (width - 2) * (height - 2);
+			}
+			else if (width <= min_subdivision_size || height <= min_subdivision_size) {
+				/*splitting further costs more border pixels than it could save*/
+				for (int y = r.begin.y + 1; y < r.end.y - 1; y++)
+					for (int x = r.begin.x + 1; x < r.end.x - 1; x++)
+						pixels.push_back(vector2i(x, y));
+			}
+			else {
+				/*four quarters that share their inner borders*/
+				vector2i middle((r.begin.x + r.end.x) / 2, (r.begin.y + r.end.y) / 2);
+				tile quarter;
+				quarter.begin = r.begin;
+				quarter.end = vector2i(middle.x + 1, middle.y + 1);
+				next_rectangles.push_back(quarter);
+				quarter.begin = vector2i(middle.x, r.begin.y);
+				quarter.end = vector2i(r.end.x, middle.y + 1);
+				next_rectangles.push_back(quarter);
+				quarter.begin = vector2i(r.begin.x, middle.y);
+				quarter.end = vector2i(middle.x + 1, r.end.y);
+				next_rectangles.push_back(quarter);
+				quarter.begin = middle;
+				quarter.end = r.end;
+				next_rectangles.push_back(quarter);
+			}
+		}
+		evaluate_pixels(evaluate, pixels.data(), (int)pixels.size(), remain, x, y, distance, statistics);
+		rectangles.swap(next_rectangles);
+	}
+}
+
+bool mandelbrot_generator::julia_iter_cached_frame(const parameter_set & params, precision used_precision,
+	int level, long long origin_x, long long origin_y, image & img, mandelbrot_tile_cache & tile_cache,
+	const unsigned char* palette, raw_frame* raw, const std::atomic<bool>* cancel, frame_statistics & statistics)
+{
+	static_assert(mandelbrot_tile_cache::tile_size == tile_size, "grid tiles are computed with the tile buffers");
+	typedef mandelbrot_tile_cache::entry entry;
+
+	vector2i size = img.size();
+	long long first_x = floor_div(origin_x, tile_size);
+	long long first_y = floor_div(origin_y, tile_size);
+	int tiles_x = (int)(floor_div(origin_x + size.x - 1, tile_size) - first_x + 1);
+	int tiles_y = (int)(floor_div(origin_y + size.y - 1, tile_size) - first_y + 1);
+
+	struct missing_tile {
+		mandelbrot_tile_cache::key key;
+		entry* tile;
+		const entry* parent;
+		const entry* children[4];
+		bool done;
+	};
+	std::vector<const entry*> tiles((size_t)tiles_x * tiles_y);
+	std::vector<missing_tile> missing;
+
+	/*lookups and insertions happen here, the workers only write to tiles that exist already*/
+	for (int tile_y = 0; tile_y < tiles_y; tile_y++) {
+		for (int tile_x = 0; tile_x < tiles_x; tile_x++) {
+			long long x = first_x + tile_x;
+			long long y = first_y + tile_y;
+			mandelbrot_tile_cache::key key = mandelbrot_tile_cache::tile_key(params, used_precision, level, x, y);
+			const entry* found = tile_cache.find(key);
+			if (found) {
+				tiles[tile_y * tiles_x + tile_x] = found;
+				statistics.cached_pixels_ += tile_size * tile_size;
+				continue;
+			}
+
+			missing_tile m;
+			m.key = key;
+			m.parent = tile_cache.find(mandelbrot_tile_cache::tile_key(params, used_precision, level - 1,
+				floor_div(x, 2), floor_div(y, 2)));
+			for (int child = 0; child < 4; child++)
+				m.children[child] = tile_cache.find(mandelbrot_tile_cache::tile_key(params, used_precision, level + 1,
+					2 * x + child % 2, 2 * y + child / 2));
+			m.tile = &tile_cache.insert(key);
+			m.done = false;
+			tiles[tile_y * tiles_x + tile_x] = m.tile;
+			missing.push_back(m);
+		}
+	}
+
+	std::mutex statistics_mutex;
+	render_thread_pool::shared(params.worker_count_)->run((int)missing.size(), [&](int index) {
+		if (cancel && *cancel) return;
+
+		missing_tile& m = missing[index];
+		frame_statistics tile_statistics;
+		int* remain = m.tile->remain_iter_.data();
+		const int unknown = unknown_remain_iter;
+		std::fill(remain, remain + tile_size * tile_size, unknown);
+		if (m.parent) tile_statistics.cached_pixels_ += seed_from_parent(*m.parent, m.key.x, m.key.y, *m.tile);
+		for (int child = 0; child < 4; child++) {
+			if (m.children[child])
+				tile_statistics.cached_pixels_ += seed_from_child(*m.children[child], child % 2, child / 2, *m.tile);
+		}
+
+		float* smooth = m.tile->smooth_.empty() ? 0 : m.tile->smooth_.data();
+		float* distance = m.tile->distance_.empty() ? 0 : m.tile->distance_.data();
+		switch (used_precision) {
+		case precision_double:
+			julia_iter_grid_tile<double>(params, level, m.key.x, m.key.y, remain, smooth, distance, tile_statistics);
+			break;
+		case precision_double_double:
+			julia_iter_grid_tile<double_double>(params, level, m.key.x, m.key.y, remain, smooth, distance,
+				tile_statistics);
+			break;
+		default:
+			julia_iter_grid_tile<float>(params, level, m.key.x, m.key.y, remain, smooth, distance, tile_statistics);
+			break;
+		}
+		m.done = true;
+
+		std::lock_guard<std::mutex> lock(statistics_mutex);
+		statistics.add(tile_statistics);
+	});
+
+	if (cancel && *cancel) {
+		for (const missing_tile& m : missing)
+			if (!m.done) tile_cache.erase(m.key);
+		return false;
+	}
+
+	unsigned char* data = img.data();
+	bool smooth = params.coloring_ != coloring_escape_time;
+	bool shaded = params.coloring_ == coloring_distance;
+	process_tiles(params, size, 1, 0, 0, [&](const tile& t) {
+		for (int row = t.begin.y; row < t.end.y; row++) {
+			long long y = origin_y + row;
+			long long tile_y = floor_div(y, tile_size);
+			int local_y = (int)(y - tile_y * tile_size);
+			for (int column = t.begin.x; column < t.end.x; column++) {
+				long long x = origin_x + column;
+				long long tile_x = floor_div(x, tile_size);
+				int j = local_y * tile_size + (int)(x - tile_x * tile_size);
+				const entry& source = *tiles[(tile_y - first_y) * tiles_x + (tile_x - first_x)];
+
+				int remain_iter = source.remain_iter_[j];
+				float smooth_iter = smooth ? source.smooth_[j] : (float)(params.max_iter_ - remain_iter);
+				float distance = shaded ? source.distance_[j] : FLT_MAX;
+				int i = row * size.x + column;
+				if (raw) {
+					raw->remain_iter_[i] = remain_iter;
+					raw->smooth_[i] = smooth_iter;
+					if (shaded) raw->distance_[i] = distance;
+				}
+				color_escape(params, palette, remain_iter, smooth_iter, distance, data + i * 4);
+			}
+		}
+	});
+
+	tile_cache.trim();
+	return true;
+}
+
+bool mandelbrot_generator::supersample_frame(const parameter_set & params, image & img,
+	const sample_evaluator & evaluate, const unsigned char* palette, const std::atomic<bool>* cancel,
+	frame_statistics & statistics)
+{
+	vector2i size = img.size();
+	const unsigned char* data = img.data();
+	int threshold = (int)(params.supersample_threshold_ * 255.f);
+	std::vector<unsigned char> edge((size_t)size.x * size.y, 0);
+
+	/*edges are marked on the unchanged image first, resampling then only writes its own pixels*/
+	process_tiles(params, size, 1, 0, cancel, [&](const tile& t) {
+		auto differs = [&](const unsigned char* pixel, int x, int y) {
+			if (x < 0 || y < 0 || x >= size.x || y >= size.y) return false;
+			const unsigned char* neighbour = data + ((size_t)y * size.x + x) * 4;
+			for (int channel = 0; channel < 3; channel++)
+				if (std::abs(pixel[channel] - neighbour[channel]) > threshold) return true;
+			return false;
+		};
+		for (int y = t.begin.y; y < t.end.y; y++) {
+			for (int x = t.begin.x; x < t.end.x; x++) {
+				size_t i = (size_t)y * size.x + x;
+				const unsigned char* pixel = data + i * 4;
+				edge[i] = differs(pixel, x - 1, y) || differs(pixel, x + 1, y)
+					|| differs(pixel, x, y - 1) || differs(pixel, x, y + 1);
+			}
+		}
+	});
+	if (cancel && *cancel) return false;
+
+	std::mutex statistics_mutex;
+	process_tiles(params, size, 1, 0, cancel, [&](const tile& t) {
+		frame_statistics tile_statistics;
+		supersample_tile(params, img, t, edge.data(), evaluate, palette, tile_statistics);
+
+		std::lock_guard<std::mutex> lock(statistics_mutex);
+		statistics.add(tile_statistics);
+	});
+	return !(cancel && *cancel);
+}
+
+void mandelbrot_generator::supersample_tile(const parameter_set & params, image & img, const tile & t,
+	const unsigned char* edge, const sample_evaluator & evaluate, const unsigned char* palette,
+	frame_statistics & statistics)
+{
+	unsigned char* data = img.data();
+	int width = img.size().x;
+	int threshold = (int)(params.supersample_threshold_ * 255.f);
+	int sample_count = std::min(params.max_samples_, max_supersamples);
+	int first_round = std::min(sample_count, 4);
+	bool smooth = params.coloring_ != coloring_escape_time;
+	bool shaded = params.coloring_ == coloring_distance;
+
+	/*the pixel's own color is its first sample*/
+	vector2i pixels[tile_size * tile_size];
+	float sums[tile_size * tile_size][3];
+	unsigned char lowest[tile_size * tile_size][3];
+	unsigned char highest[tile_size * tile_size][3];
+	int count = 0;
+	for (int y = t.begin.y; y < t.end.y; y++) {
+		for (int x = t.begin.x; x < t.end.x; x++) {
+			if (!edge[(size_t)y * width + x]) continue;
+			const unsigned char* pixel = data + ((size_t)y * width + x) * 4;
+			for (int channel = 0; channel < 3; channel++) {
+				sums[count][channel] = pixel[channel];
+				lowest[count][channel] = highest[count][channel] = pixel[channel];
+			}
+			pixels[count++] = vector2i(x, y);
+		}
+	}
+	if (count == 0) return;
+
+	std::vector<int> active(count);
+	for (int i = 0; i < count; i++) active[i] = i;
+	std::vector<int> taken(count, 1);
+
+	/*samples of several pixels share a batch, so the kernels run on full vectors*/
+	double x_batch[max_batch_size];
+	double y_batch[max_batch_size];
+	int owner_batch[max_batch_size];
+	int remain_batch[max_batch_size];
+	float z_x_batch[max_batch_size];
+	float z_y_batch[max_batch_size];
+	float distance_batch[max_batch_size];
+	int batch_size = 0;
+
+	auto flush = [&]() {
+		evaluate(x_batch, y_batch, batch_size, remain_batch, smooth ? z_x_batch : 0, smooth ? z_y_batch : 0,
+			shaded ? distance_batch : 0, statistics);
+		for (int i = 0; i < batch_size; i++) {
+			float smooth_iter = smooth ? smooth_iteration(params, remain_batch[i], z_x_batch[i], z_y_batch[i]) : 0.f;
+			unsigned char color[4];
+			color_escape(params, palette, remain_batch[i], smooth_iter, shaded ? distance_batch[i] : FLT_MAX, color);
+
+			int owner = owner_batch[i];
+			for (int channel = 0; channel < 3; channel++) {
+				sums[owner][channel] += color[channel];
+				lowest[owner][channel] = std::min(lowest[owner][channel], color[channel]);
+				highest[owner][channel] = std::max(highest[owner][channel], color[channel]);
+			}
+		}
+		statistics.samples_ += batch_size;
+		batch_size = 0;
+	};
+
+	auto sample_round = [&](int first_sample, int end_sample) {
+		for (int owner : active) {
+			for (int sample = first_sample; sample < end_sample; sample++) {
+				/*samples are placed in the whole frame, a part of it takes the same ones*/
+				int x = params.image_offset_.x + pixels[owner].x;
+				int y = params.image_offset_.y + pixels[owner].y;
+				double offset_x, offset_y;
+				sample_offset(sample, x, y, offset_x, offset_y);
+				x_batch[batch_size] = x + offset_x;
+				y_batch[batch_size] = y + offset_y;
+				owner_batch[batch_size] = owner;
+				if (++batch_size == max_batch_size) flush();
+			}
+			taken[owner] = end_sample;
+		}
+		if (batch_size > 0) flush();
+	};
+
+	sample_round(1, first_round);
+
+	/*only pixels whose first samples disagree are worth the remaining ones*/
+	std::vector<int> disagreeing;
+	for (int owner : active) {
+		for (int channel = 0; channel < 3; channel++) {
+			if (highest[owner][channel] - lowest[owner][channel] > threshold) {
+				disagreeing.push_back(owner);
+				break;
+			}
+		}
+	}
+	active.swap(disagreeing);
+	if (first_round < sample_count) sample_round(first_round, sample_count);
+
+	for (int i = 0; i < count; i++) {
+		unsigned char* pixel = data + ((size_t)pixels[i].y * width + pixels[i].x) * 4;
+		for (int channel = 0; channel < 3; channel++)
+			pixel[channel] = (unsigned char)(sums[i][channel] / taken[i] + 0.5f);
+	}
+}
+
+void mandelbrot_generator::sample_offset(int sample, int x, int y, double & x_out, double & y_out)
+{
+	/*
+	* R2 low discrepancy sequence (http://extremelearning.com.au/unreasonable-effectiveness-of-quasirandom-sequences/),
+	* every prefix covers the pixel evenly whatever number of samples a pixel ends up with.
+	* shifted per pixel by a hash of its position, so neighbouring pixels do not alias in the same pattern
+	*/
+	const double a1 = 0.7548776662466927;
+	const double a2 = 0.5698402909980532;
+	unsigned int hash = (unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u;
+	hash ^= hash >> 13;
+	hash *= 0x5bd1e995u;
+	hash ^= hash >> 15;
+	double shift_x = (hash & 0xffff) / 65536.;
+	double shift_y = (hash >> 16) / 65536.;
+
+	x_out = shift_x + a1 * sample;
+	y_out = shift_y + a2 * sample;
+	x_out = x_out - floor(x_out) - 0.5;
+	y_out = y_out - floor(y_out) - 0.5;
+}
+
+template<typename scalar_type>
+bool mandelbrot_generator::julia_value_frame(const parameter_set & params, image & img, precision used_precision,
+	progressive_control * progressive, mandelbrot_orbit_cache * orbit_cache, raw_frame* raw)
+{
+	scalar_type* x_plane = 0;
+	scalar_type* y_plane = 0;
+	int cached_iterations = 0;
+	if (orbit_cache) cached_iterations = orbit_cache->begin_frame(params, used_precision, x_plane, y_plane);
+
+	/*the kernel is picked once per frame, the tiles call it once per row*/
+	mandelbrot_interpolation::sweep_function interpolation_sweep = params.interpolate_
+		? mandelbrot_interpolation::select(params.interpolation_method_, params.fast_math_) : 0;
+
+	julia_value_output output = { &img, params.interpolation_ };
+	bool completed = process_passes(params, img, progressive, [&](const tile& t) {
+		julia_value_tile<scalar_type>(params, &output, 1, t, x_plane, y_plane, cached_iterations,
+			interpolation_sweep, raw); });
+
+	if (orbit_cache) orbit_cache->end_frame(params, completed);
+	return completed;
+}
+
+template<typename scalar_type>
+bool mandelbrot_generator::julia_value_sweep_frame(const parameter_set & params,
+	const std::vector<julia_value_output>& outputs, precision used_precision, const std::atomic<bool>* cancel,
+	mandelbrot_orbit_cache * orbit_cache)
+{
+	scalar_type* x_plane = 0;
+	scalar_type* y_plane = 0;
+	int cached_iterations = 0;
+	if (orbit_cache) cached_iterations = orbit_cache->begin_frame(params, used_precision, x_plane, y_plane);
+
+	mandelbrot_interpolation::sweep_function interpolation_sweep = params.interpolate_
+		? mandelbrot_interpolation::select(params.interpolation_method_, params.fast_math_) : 0;
+
+	process_tiles(params, params.image_dimensions_, 1, 0, cancel, [&](const tile& t) {
+		julia_value_tile<scalar_type>(params, outputs.data(), (int)outputs.size(), t, x_plane, y_plane,
+			cached_iterations, interpolation_sweep, 0); });
+	bool completed = !cancel || !*cancel;
+
+	if (orbit_cache) orbit_cache->end_frame(params, completed);
+	return completed;
+}
+
+float mandelbrot_generator::smooth_iteration(const parameter_set & params, int remain_iter, float x, float y)
+{
+	float iterations = (float)(params.max_iter_ - remain_iter);
+	float abs_2 = x * x + y * y;
+	if (remain_iter == 0 || !(abs_2 > params.max_threshold_) || !(abs_2 > 1.f)) return iterations;
+
+	/*log|z| grows by a factor of the degree per iteration after escaping, see
+	https://en.wikipedia.org/wiki/Plotting_algorithms_for_the_Mandelbrot_set#Continuous_(smooth)_coloring */
+	int degree = params.formula_.degree();
+	if (degree == 2) return iterations + 1.f - log2f(0.5f * logf(abs_2));
+	return iterations + 1.f - logf(0.5f * logf(abs_2)) / logf((float)degree);
+}
+
+void mandelbrot_generator::color_julia_iter(const parameter_set & params, int remain_iter, unsigned char * pixel)
+{
+	int julia_iter = params.max_iter_ - remain_iter;
+
+	if (remain_iter == 0) pixel[0] = pixel[1] = pixel[2] = 0;
+	else {
+		float h_value = (float)julia_iter / (float)params.max_iter_ + params.hsv_color_offset_;
+		h_value = h_value - (int)h_value;//mod h_value
+		int red = params.bgra_ ? 2 : 0;
+		hsv_to_rgb(h_value, 1.f, 1.f, pixel[red], pixel[1], pixel[2 - red]);
+	}
+
+	pixel[3] = 255;//Alpha-value
+}
+
+void mandelbrot_generator::color_escape(const parameter_set & params, const unsigned char * palette,
+	int remain_iter, float smooth, float distance, unsigned char * pixel)
+{
+	if (remain_iter == 0 || params.coloring_ == coloring_escape_time) {
+		std::copy(palette + remain_iter * 4, palette + remain_iter * 4 + 4, pixel);
+		return;
+	}
+
+	/*entries are indexed by the remaining iterations, an escaped point never gets the black entry 0*/
+	float count = floorf(smooth);
+	float fraction = smooth - count;
+	int lower = std::min(std::max(params.max_iter_ - (int)count, 1), params.max_iter_);
+	int upper = std::max(lower - 1, 1);
+
+	/*full brightness from two pixels off the set on, filaments thinner than a pixel stay visible*/
+	float shade = std::min(1.f, sqrtf(std::max(distance, 0.f) * 0.5f));
+	for (int channel = 0; channel < 3; channel++) {
+		float value = palette[lower * 4 + channel] + fraction * (palette[upper * 4 + channel] - palette[lower * 4 + channel]);
+		pixel[channel] = (unsigned char)(value * shade + 0.5f);
+	}
+	pixel[3] = 255;//Alpha-value
+}
+
+std::vector<unsigned char> mandelbrot_generator::julia_iter_palette(const parameter_set & params)
+{
+	std::vector<unsigned char> ret((size_t)(params.max_iter_ + 1) * 4);
+	for (int remain_iter = 0; remain_iter <= params.max_iter_; remain_iter++)
+		color_julia_iter(params, remain_iter, ret.data() + remain_iter * 4);
 	return ret;
 }
 
+void mandelbrot_generator::color_julia_values(const parameter_set & params, const float * x, const float * y,
+	int count, unsigned char * pixels_out)
+{
+	int red = params.bgra_ ? 2 : 0;
+	const float turns_per_radian = 0.5f / geo_constants::pi;
+
+	float hue[tile_size];
+	float lightness[tile_size];
+	for (int first = 0; first < count; first += tile_size) {
+		int n = std::min(count - first, tile_size);
+
+		if (params.fast_math_) {
+			julia_value_hues<mandelbrot_interpolation::fast_math>(x + first, y + first, n,
+				turns_per_radian, params.hsv_color_offset_, hue);
+		}
+		else {
+			julia_value_hues<mandelbrot_interpolation::exact_math>(x + first, y + first, n,
+				turns_per_radian, params.hsv_color_offset_, hue);
+		}
+		for (int i = 0; i < n; i++)
+			lightness[i] = 1.f / (1.f + 5.f * sqrtf(x[first + i] * x[first + i] + y[first + i] * y[first + i]));
+
+		/*
+		* hsl with full saturation, channel n (red 0, green 8, blue 4) is
+		* l - a * clamp(min(k - 3, 9 - k), -1, 1) with k = (n + 12h) mod 12 and a = min(l, 1 - l)
+		*/
+		for (int i = 0; i < n; i++) {
+			float l = lightness[i];
+			float a = std::min(l, 1.f - l);
+			float k_red = hue[i] * 12.f;
+			float k_green = k_red + 8.f;
+			float k_blue = k_red + 4.f;
+			k_green = k_green >= 12.f ? k_green - 12.f : k_green;
+			k_blue = k_blue >= 12.f ? k_blue - 12.f : k_blue;
+			float r = l - a * std::max(-1.f, std::min(std::min(k_red - 3.f, 9.f - k_red), 1.f));
+			float g = l - a * std::max(-1.f, std::min(std::min(k_green - 3.f, 9.f - k_green), 1.f));
+			float b = l - a * std::max(-1.f, std::min(std::min(k_blue - 3.f, 9.f - k_blue), 1.f));
+
+			unsigned char* pixel = pixels_out + (first + i) * 4;
+			pixel[red] = (unsigned char)(r * 255.f + 0.5f);
+			pixel[1] = (unsigned char)(g * 255.f + 0.5f);
+			pixel[2 - red] = (unsigned char)(b * 255.f + 0.5f);
+			pixel[3] = 255;//Alpha-value
+		}
+	}
+}
+
+template<typename scalar_type>
+void mandelbrot_generator::julia_value_tile(const parameter_set & params, const julia_value_output* outputs,
+	int output_count, const tile & t, scalar_type * x_plane, scalar_type * y_plane, int cached_iterations,
+	mandelbrot_interpolation::sweep_function interpolation_sweep, raw_frame* raw)
+{
+	const vector2i size = outputs[0].img->size();
+	mandelbrot_simd::simd_level level = mandelbrot_simd::resolve(params.simd_level_);
+
+	scalar_type real_min, real_max, imaginary_min, imaginary_max;
+	convert_precision(params.real_min_, real_min);
+	convert_precision(params.real_max_, real_max);
+	convert_precision(params.imaginary_min_, imaginary_min);
+	convert_precision(params.imaginary_max_, imaginary_max);
+
+	scalar_type re_column[tile_size];
+	scalar_type re_row[tile_size];
+	scalar_type im_row[tile_size];
+	scalar_type x_row[tile_size];
+	scalar_type y_row[tile_size];
+	int columns[tile_size];
+
+	vector2i frame = params.frame_size();
+	vector2i offset = params.image_offset_;
+	for (int x_coordinate = t.begin.x; x_coordinate < t.end.x; x_coordinate++)
+		re_column[x_coordinate - t.begin.x] = real_min + (real_max - real_min) * (offset.x + x_coordinate) / frame.x;
+
+	/*the interpolated values of a row for every output*/
+	std::vector<float> values((size_t)output_count * tile_size * 2);
+	std::vector<float*> x_values(output_count);
+	std::vector<float*> y_values(output_count);
+	std::vector<float> interpolations(output_count);
+	for (int k = 0; k < output_count; k++) {
+		x_values[k] = values.data() + (size_t)k * tile_size * 2;
+		y_values[k] = x_values[k] + tile_size;
+		interpolations[k] = outputs[k].interpolation;
+	}
+
+	for (int y_coordinate = t.begin.y; y_coordinate < t.end.y; y_coordinate++) {
+		int width = 0;
+		for (int x_coordinate = t.begin.x; x_coordinate < t.end.x; x_coordinate++)
+			if (in_pass(t, x_coordinate, y_coordinate)) columns[width++] = x_coordinate;
+		if (width == 0) continue;
+
+		scalar_type im_part = imaginary_min + (imaginary_max - imaginary_min) * (offset.y + y_coordinate) / frame.y;
+		int row_offset = y_coordinate * size.x;
+		for (int j = 0; j < width; j++) {
+			re_row[j] = re_column[columns[j] - t.begin.x];
+			im_row[j] = im_part;
+			x_row[j] = cached_iterations > 0 ? x_plane[row_offset + columns[j]] : re_row[j];
+			y_row[j] = cached_iterations > 0 ? y_plane[row_offset + columns[j]] : im_part;
+		}
+
+		{
+			MANDELBROT_PROFILE_SCOPE("iterate", width);
+			mandelbrot_simd::advance_iterations(level, params.formula_, re_row, im_row, width,
+				params.iterations_ - cached_iterations, x_row, y_row);
+		}
+
+		if (x_plane) {
+			for (int j = 0; j < width; j++) {
+				x_plane[row_offset + columns[j]] = x_row[j];
+				y_plane[row_offset + columns[j]] = y_row[j];
+			}
+		}
+
+		/*the interpolation and the coloring work in float*/
+		float start_x[tile_size];
+		float start_y[tile_size];
+		float goal_x[tile_size];
+		float goal_y[tile_size];
+		for (int j = 0; j < width; j++) {
+			start_x[j] = (float)to_double(x_row[j]);
+			start_y[j] = (float)to_double(y_row[j]);
+		}
+		MANDELBROT_PROFILE_SCOPE("interpolate and color", (long long)width * output_count);
+		if (params.interpolate_) {
+			/*one more step of the formula from the exact z*/
+			scalar_type goal_x_exact[tile_size];
+			scalar_type goal_y_exact[tile_size];
+			std::copy(x_row, x_row + width, goal_x_exact);
+			std::copy(y_row, y_row + width, goal_y_exact);
+			mandelbrot_simd::advance_iterations(level, params.formula_, re_row, im_row, width, 1,
+				goal_x_exact, goal_y_exact);
+			for (int j = 0; j < width; j++) {
+				goal_x[j] = (float)to_double(goal_x_exact[j]);
+				goal_y[j] = (float)to_double(goal_y_exact[j]);
+			}
+		}
+
+		/*what only depends on z_n and z_n+1 is computed once per pixel, whatever the number of outputs*/
+		if (interpolation_sweep) {
+			interpolation_sweep(start_x, start_y, goal_x, goal_y, interpolations.data(), output_count, width,
+				x_values.data(), y_values.data());
+		}
+		for (int k = 0; k < output_count && !interpolation_sweep; k++) {
+			if (!params.interpolate_) {
+				std::copy(start_x, start_x + width, x_values[k]);
+				std::copy(start_y, start_y + width, y_values[k]);
+				continue;
+			}
+			for (int j = 0; j < width; j++) {
+				(*params.interpolation_method_)(start_x[j], start_y[j], goal_x[j], goal_y[j], interpolations[k],
+					x_values[k][j], y_values[k][j]);
+			}
+		}
+
+		for (int k = 0; k < output_count; k++) {
+			unsigned char colors[tile_size * 4];
+			color_julia_values(params, x_values[k], y_values[k], width, colors);
+			image& img = *outputs[k].img;
+			unsigned char* data = img.data();
+			for (int j = 0; j < width; j++) {
+				int i = row_offset + columns[j];
+				std::copy(colors + j * 4, colors + j * 4 + 4, data + i * 4);
+				if (raw && k == 0) {
+					raw->x_[i] = x_values[k][j];
+					raw->y_[i] = y_values[k][j];
+				}
+				fill_pass_block(img, t, columns[j], y_coordinate);
+			}
+		}
+	}
+}
+
 void mandelbrot_generator::hsv_to_rgb(float h, float s, float v, 
 	unsigned char & r_out, unsigned char & g_out, unsigned char & b_out)
 {
@@ -301,13 +1753,3 @@ void mandelbrot_generator::rgb_project_2d(float angle, float absolute,
 	g_out = 0;
 	b_out = (unsigned char)(cosf(angle)*absolute*255.f);
 }
-
-void mandelbrot_generator::complex_pow_real(float a, float b, float x, float & a_out, float & b_out)
-{
-	float absolute = sqrtf(a*a + b*b);
-	absolute = powf(absolute, x);
-	float argument = geo_util::atan2(b, a);
-	argument *= x;
-	a_out = absolute * cosf(argument);
-	b_out = absolute * sinf(argument);
-}
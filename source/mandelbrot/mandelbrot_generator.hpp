@@ -13,6 +13,19 @@
 
 #include <viral_core/image.hpp>
 
+#include "arbitrary_precision.hpp"
+#include "double_double.hpp"
+#include "mandelbrot_interpolation.hpp"
+#include "mandelbrot_simd.hpp"
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+class mandelbrot_orbit_cache;
+class mandelbrot_perturbation;
+class mandelbrot_tile_cache;
+
 /**
 *************************************************************************
 *
@@ -25,6 +38,39 @@
 class mandelbrot_generator {
 public:
 
+	/** scalar types and algorithms the generators can compute with */
+	enum precision {
+		precision_automatic,		/**< chosen from the pixel spacing, see \bref{select_precision} */
+		precision_float,
+		precision_double,
+		precision_double_double,
+		/**
+		* double_double reference orbit, or an arbitrary_precision one for deep views, and
+		* per pixel deltas in double or, beyond its exponent range, in float_exp
+		*/
+		precision_perturbation
+	};
+
+	/** how \bref{generate_mandelbrot_image_julia_iter} decides which pixels to iterate */
+	enum render_mode {
+		render_brute_force,		/**< every pixel is iterated */
+		/**
+		* Mariani-Silver: rectangles with a uniform border are filled once ball arithmetic over
+		* the whole border proves their escape time, the same image as render_brute_force.
+		* burning ship and tricorn can not be proven and are iterated per pixel
+		*/
+		render_subdivision
+	};
+
+	/** how \bref{generate_mandelbrot_image_julia_iter} maps escaped points to colors */
+	enum escape_coloring {
+		coloring_escape_time,	/**< one palette entry per integral escape time */
+		/** palette entries blended by \bref{smooth_iteration}, no bands even at a low max_iter_ */
+		coloring_smooth,
+		/** smooth colors darkened towards the set by the exterior distance estimate */
+		coloring_distance
+	};
+
 	/**
 	*************************************************************************
 	* @class mandelbrot_generator::parameter_set
@@ -34,20 +80,228 @@ public:
 	class parameter_set {
 	public:
 		viral_core::vector2i image_dimensions_;
+		/** shifts the hue of both visualizations, in turns */
 		float hsv_color_offset_ = 0.f;
-		float real_min_ = -2.001f;
-		float imaginary_min_ = -1.2001f;
-		float real_max_ = 1.f;
-		float imaginary_max_ = 1.2f;
+		double_double real_min_ = -2.001;
+		double_double imaginary_min_ = -1.2001;
+		double_double real_max_ = 1.;
+		double_double imaginary_max_ = 1.2;
+		/**
+		* views deeper than double_double resolves: the point real + imaginary*i of the bounds
+		* above is center + (real + imaginary*i) * 2^-view_exponent_, the bounds are relative to
+		* the center then. only \bref{precision_perturbation} renders such views at their full
+		* depth, the other precisions render their \bref{flat_view}
+		*/
+		//{
+		arbitrary_precision center_re_;
+		arbitrary_precision center_im_;
+		int view_exponent_ = 0;
+		//}
 		float max_threshold_ = 20.f;
 		int max_iter_ = 20;
 		int iterations_ = 1;
 		float interpolation_ = 0.f;
 		bool interpolate_ = false;
-		/**signature is start_x, start_y, goal_x, goal_y, interpolation, out_x, out_y*/
+		/**
+		* signature is start_x, start_y, goal_x, goal_y, interpolation, out_x, out_y. the methods
+		* of this class run as inlined kernels, see \bref{mandelbrot_interpolation}, others are
+		* called per pixel
+		*/
 		void (*interpolation_method_)(float, float, float, float, float, float&, float&) = 0;
+		/**
+		* approximates atan2, sin, cos and pow in the interpolation and the coloring of the julia
+		* values, see \bref{mandelbrot_interpolation::fast_math}. colors change by at most one step
+		*/
+		bool fast_math_ = false;
+		/** number of threads used for the computation, 0 uses all hardware threads */
+		int worker_count_ = 0;
+		/** instruction set of the iteration kernels, automatic picks the best one of the cpu */
+		mandelbrot_simd::simd_level simd_level_ = mandelbrot_simd::automatic;
+		precision precision_ = precision_automatic;
+		/**
+		* map that is iterated and whether it is drawn as a julia set. the perturbation precision
+		* and the interior check are only done for the quadratic mandelbrot set
+		*/
+		mandelbrot_formula formula_;
+		/** skips points inside the main cardioid and the period-2 bulb */
+		bool interior_check_ = true;
+		/** stops iterating orbits that became periodic */
+		bool periodicity_check_ = true;
+		render_mode render_mode_ = render_brute_force;
+		escape_coloring coloring_ = coloring_escape_time;
+		/**
+		* adaptive anti-aliasing of \bref{generate_mandelbrot_image_julia_iter}: pixels whose color
+		* differs from a neighbour by more than supersample_threshold_ (a fraction of the range of
+		* a channel) are resampled, up to max_samples_ samples per pixel. 1 disables it
+		*/
+		//{
+		int max_samples_ = 1;
+		float supersample_threshold_ = 0.1f;
+		//}
+		/** writes the pixels in bgra instead of rgba order, as video encoders expect them */
+		bool bgra_ = false;
+		/**
+		* the image is a part of a larger frame, e.g. a tile of \bref{mandelbrot_distributed}: the
+		* view spans frame_dimensions_ pixels and the image holds image_dimensions_ of them from
+		* image_offset_ on. the pixels keep the coordinates of the whole frame, so the parts are
+		* the same as a render of the frame in one piece. a frame of 0x0 is the image itself
+		*/
+		//{
+		viral_core::vector2i frame_dimensions_ = viral_core::vector2i(0, 0);
+		viral_core::vector2i image_offset_ = viral_core::vector2i(0, 0);
+		//}
+
+		/** frame_dimensions_, or image_dimensions_ if the image is the whole frame */
+		viral_core::vector2i frame_size() const;
+
+		/** true if the view has a center_re_, center_im_ or view_exponent_ */
+		bool deep_view() const;
+
+		/**
+		* the absolute coordinate center + \bref{relative} * 2^-view_exponent_, in the
+		* precision the exponent needs
+		*/
+		arbitrary_precision deep_coordinate(const arbitrary_precision& center, const double_double& relative) const;
+
+		/** the same parameters with absolute bounds rounded to double_double and no center */
+		parameter_set flat_view() const;
 	};
 
+	/**
+	*************************************************************************
+	* @class mandelbrot_generator::frame_statistics
+	* work done for one image, filled in by the generators on request
+	************************************************************************/
+	class frame_statistics {
+	public:
+		mandelbrot_simd::escape_statistics escape_;
+		/** pixels that were iterated and pixels filled by \bref{render_subdivision} */
+		//{
+		long long evaluated_pixels_ = 0;
+		long long filled_pixels_ = 0;
+		//}
+		/** pixels of the frame and samples taken, more than one per pixel with supersampling */
+		//{
+		long long pixels_ = 0;
+		long long samples_ = 0;
+		//}
+		/**
+		* pixels of the tiles of a \bref{mandelbrot_tile_cache} frame that were not iterated,
+		* taken from cached tiles or from the parents and children of missing ones
+		*/
+		long long cached_pixels_ = 0;
+		/** pixels of the frame outside of the set, the others are interior or ran out of iterations */
+		long long escaped_pixels_ = 0;
+
+		void add(const frame_statistics& other);
+
+		/** iterations saved by the interior and periodicity checks */
+		long long skipped_iterations() const;
+
+		/** effective samples per pixel, 1 without supersampling */
+		double samples_per_pixel() const;
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_generator::raw_frame
+	* values of a frame before coloring, filled in by the generators on request,
+	* one plane per value with size_.x * size_.y entries in row order.
+	* \bref{recolor_julia_iter} and \bref{recolor_julia_value} turn them into an
+	* image again, e.g. with another hsv_color_offset_, without iterating,
+	* \bref{mandelbrot_raw_file} stores them on disk
+	************************************************************************/
+	class raw_frame {
+	public:
+		viral_core::vector2i size_;
+		/**
+		* \bref{generate_mandelbrot_image_julia_iter}: remaining iterations per pixel, 0 inside
+		* the set. the iteration count is max_iter_ - remain_iter
+		*/
+		std::vector<int> remain_iter_;
+		/**
+		* \bref{generate_mandelbrot_image_julia_value}: z per pixel after the interpolation.
+		* \bref{generate_mandelbrot_image_julia_iter}: z at the escape, 0 for pixels that were
+		* filled by \bref{render_subdivision} or lie in the main cardioid or bulb
+		*/
+		//{
+		std::vector<float> x_;
+		std::vector<float> y_;
+		//}
+		/** \bref{generate_mandelbrot_image_julia_iter}: see \bref{smooth_iteration} */
+		std::vector<float> smooth_;
+		/**
+		* \bref{generate_mandelbrot_image_julia_iter} with \bref{coloring_distance}: exterior
+		* distance estimate in pixels, 0 for pixels that did not escape. empty otherwise
+		*/
+		std::vector<float> distance_;
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_generator::progressive_control
+	* makes a generator compute the image in passes of increasing resolution,
+	* the first pass computes every 4th pixel in x and y, i.e. 1/16 of the image,
+	* later passes only compute the pixels that are still missing
+	************************************************************************/
+	class progressive_control {
+	public:
+		/**
+		* called on the generating thread after every pass with the image, pixels
+		* that are not computed yet show the nearest sample of an earlier pass
+		*/
+		std::function<void(const viral_core::image& img, bool final_pass)> on_pass_;
+
+		/** may be set from any thread, the generation stops after the tiles in progress */
+		std::atomic<bool> cancel_{ false };
+
+		/**
+		* false computes the image in one pass, the control then only cancels it and
+		* \bref{on_pass_} is called once with the complete image
+		*/
+		bool passes_ = true;
+	};
+
+	/**
+	* resolves \bref{precision_automatic}: float as long as neighbouring pixels differ
+	* by more than 1e-5 relative to the coordinates, double down to 1e-13 and
+	* perturbation below that, for deep views as well
+	*/
+	static precision select_precision(const parameter_set& params);
+
+	/**
+	* converts from [0,1)^3 hsv-space to [0,255)^3 rgb-space
+	*/
+	static void hsv_to_rgb(float h, float s, float v, 
+		unsigned char &r_out, unsigned char &g_out, unsigned char &b_out);
+
+	/**
+	* converts from [0,1)^3 hsl-space to [0,255)^3 rgb-space
+	*/
+	static void hsl_to_rgb(float h, float s, float l, 
+		unsigned char &r_out, unsigned char &g_out, unsigned char &b_out);
+	
+	/**
+	* converts from [0,1)^2 to the rb plane in the [0,255)^3 rgb-space
+	*/
+	static void rgb_project_2d(float angle, float absolute, 
+		unsigned char &r_out, unsigned char &g_out, unsigned char &b_out);
+
+	/**
+	* continuous iteration count of an escaped point from its escape time and the z it
+	* escaped with, n + 1 - log2(log|z|). points that did not escape or have no z
+	* get the integral count
+	*/
+	static float smooth_iteration(const parameter_set& params, int remain_iter, float x, float y);
+
+	/**
+	* color of a pixel of \bref{generate_mandelbrot_image_julia_iter} according to the coloring_
+	* of \bref{params}: the \bref{julia_iter_palette} entry of \bref{remain_iter}, or for escaped
+	* points the blend of the entries around \bref{smooth}, shaded by \bref{distance} in pixels
+	*/
+	static void color_escape(const parameter_set& params, const unsigned char* palette,
+		int remain_iter, float smooth, float distance, unsigned char* pixel);
+
 	/** interpolation methods for \bref{generate_mandelbrot_image_julia_iter} */
 	//{
 	static void linear_angle_and_abs(float, float, float, float, float, float&, float&);
@@ -63,9 +317,27 @@ public:
 	*	define the section of the set to paint	
 	* -	\bref{max_threshold} and \bref{max_iter} determine termination criteria of the algorithm
 	* - \bref{hsv_color_offset} enables the generation of differently colored images
+	* - if \bref{statistics} is given, it receives the iteration counters of the frame
+	* - if \bref{progressive} is given, the image is computed in passes, see \bref{progressive_control}.
+	*	returns no image if the generation was cancelled
+	* - if \bref{raw} is given, it receives the escape times, the z at the escape, the
+	*	smooth iteration counts and the distances, e.g. for \bref{recolor_julia_iter}.
+	*	these are the values of the pixel centers, supersampling only changes the image
+	* - with a \bref{tile_cache}, views on its grid only compute the tiles it does not have, see
+	*	\bref{mandelbrot_tile_cache}. the image is then computed in one pass and raw frames get no z
 	*/
 	static viral_core::auto_pointer<viral_core::image> generate_mandelbrot_image_julia_iter(
-		const parameter_set& params);
+		const parameter_set& params, frame_statistics* statistics = 0, progressive_control* progressive = 0,
+		raw_frame* raw = 0, mandelbrot_tile_cache* tile_cache = 0);
+
+	/**
+	* as above, but writes into the caller's \bref{output}, which has to be of the size of
+	* image_dimensions_. false if the generation was cancelled, the content of \bref{output}
+	* is undefined then. repeated frames reuse their buffer instead of allocating one each
+	*/
+	static bool generate_mandelbrot_image_julia_iter(const parameter_set& params, viral_core::image& output,
+		frame_statistics* statistics = 0, progressive_control* progressive = 0, raw_frame* raw = 0,
+		mandelbrot_tile_cache* tile_cache = 0);
 
 	/**
 	* generates an image that shows the julia value for each pixel for a given number of iterations
@@ -74,33 +346,245 @@ public:
 	* - if interpolation is specified, an image is produced from the interpolation between iterations 
 	*	and iterations + 1, by z_n^(2/(2-r) + r * c, where c is the first element of the sequence 
 	*	and r is the grade of interpolation
+	* - \bref{progressive} as for \bref{generate_mandelbrot_image_julia_iter}
+	* - with an \bref{orbit_cache}, z_n of the previous frame is continued if possible,
+	*	an animation over the iteration count then costs one iteration per frame and pixel
+	* - if \bref{raw} is given, it receives the interpolated z for \bref{recolor_julia_value}
 	*/
 	static viral_core::auto_pointer<viral_core::image> generate_mandelbrot_image_julia_value(
-		const parameter_set& params);
+		const parameter_set& params, progressive_control* progressive = 0,
+		mandelbrot_orbit_cache* orbit_cache = 0, raw_frame* raw = 0);
+
+	/** into a buffer of the caller, as the second \bref{generate_mandelbrot_image_julia_iter} */
+	static bool generate_mandelbrot_image_julia_value(const parameter_set& params, viral_core::image& output,
+		progressive_control* progressive = 0, mandelbrot_orbit_cache* orbit_cache = 0, raw_frame* raw = 0);
+
+	/**
+	* the frames of \bref{generate_mandelbrot_image_julia_value} for each of the \bref{interpolations}
+	* at the iterations_ of \bref{params}, into \bref{outputs} of the size of the frame, one per
+	* interpolation. z_n and z_n+1 are computed once per pixel, then each row of a tile is
+	* interpolated and colored for all outputs while it is in the cache, so a frame costs little
+	* more than its coloring. without interpolate_ all outputs show z_n. false if \bref{cancel}
+	* stopped it, the outputs are undefined then
+	*/
+	static bool generate_mandelbrot_image_julia_value_sweep(const parameter_set& params,
+		const std::vector<float>& interpolations, const std::vector<viral_core::image*>& outputs,
+		const std::atomic<bool>* cancel = 0, mandelbrot_orbit_cache* orbit_cache = 0);
+
+	/**
+	* colors a raw frame of \bref{generate_mandelbrot_image_julia_iter} with the palette and
+	* coloring_ of \bref{params}. max_iter_ has to be the one the frame was generated with,
+	* \bref{coloring_distance} falls back to \bref{coloring_smooth} without distances
+	*/
+	static viral_core::auto_pointer<viral_core::image> recolor_julia_iter(
+		const parameter_set& params, const raw_frame& raw);
+
+	/** colors a raw frame of \bref{generate_mandelbrot_image_julia_value} */
+	static viral_core::auto_pointer<viral_core::image> recolor_julia_value(
+		const parameter_set& params, const raw_frame& raw);
+
+	/**
+	* colors of all escape times of \bref{params}, 4 bytes per entry in the pixel order of
+	* \bref{params}, indexed by the remaining iterations. built once per frame, the
+	* coloring of a pixel is then a lookup
+	*/
+	static std::vector<unsigned char> julia_iter_palette(const parameter_set& params);
+
+	/**
+	* colors \bref{count} julia values \bref{x} + \bref{y}i by their angle and absolute value,
+	* 4 bytes per pixel to \bref{pixels_out}. the hsl conversion works on whole arrays in
+	* float without branches, so the compiler can vectorize it
+	*/
+	static void color_julia_values(const parameter_set& params, const float* x, const float* y, int count,
+		unsigned char* pixels_out);
 
 private:
 	/**
-	* converts from [0,1)^3 hsv-space to [0,255)^3 rgb-space
+	* rectangular section [begin, end) of an image, processed as one unit by a worker.
+	* only pixels on the grid of \bref{step} are computed, those also on the grid
+	* of \bref{previous_step} were computed by the previous pass already
 	*/
-	static void hsv_to_rgb(float h, float s, float v, 
-		unsigned char &r_out, unsigned char &g_out, unsigned char &b_out);
+	struct tile {
+		viral_core::vector2i begin;
+		viral_core::vector2i end;
+		int step = 1;
+		int previous_step = 0;
+	};
+
+	/** pixel spacings of the passes of a progressive generation */
+	static const int progressive_steps[];
+	static const int progressive_pass_count;
+
+	/** edge length of a tile in pixels, 64x64 rgba pixels (16kB) stay in the L1/L2 cache */
+	static const int tile_size = 64;
+
+	/** an image of \bref{julia_value_tile} and the interpolation it is colored with */
+	struct julia_value_output {
+		viral_core::image* img;
+		float interpolation;
+	};
 
 	/**
-	* converts from [0,1)^3 hsl-space to [0,255)^3 rgb-space
+	* splits an image of the given size into tiles and processes them on the
+	* \bref{render_thread_pool} with \bref{worker_count} workers. tiles that were not
+	* started when \bref{cancel} is set are skipped
 	*/
-	static void hsl_to_rgb(float h, float s, float l, 
-		unsigned char &r_out, unsigned char &g_out, unsigned char &b_out);
-	
+	static void process_tiles(const parameter_set& params, const viral_core::vector2i& size,
+		int step, int previous_step, const std::atomic<bool>* cancel,
+		const std::function<void(const tile&)>& tile_function);
+
 	/**
-	* converts from [0,1)^2 to the rb plane in the [0,255)^3 rgb-space
+	* runs \bref{process_tiles} once for the whole image or, if \bref{progressive} is given
+	* with passes_, once per pass. \bref{refine} runs on the complete image after the last pass, it returns
+	* false if it was cancelled. returns false if the generation was cancelled
 	*/
-	static void rgb_project_2d(float angle, float absolute, 
-		unsigned char &r_out, unsigned char &g_out, unsigned char &b_out);
+	static bool process_passes(const parameter_set& params, viral_core::image& img,
+		progressive_control* progressive, const std::function<void(const tile&)>& tile_function,
+		const std::function<bool(const std::atomic<bool>* cancel)>& refine = nullptr);
+
+	/** true if the pixel is computed in the pass of \bref{t} */
+	static bool in_pass(const tile& t, int x, int y);
+
+	/** copies a computed pixel to the pixels of its grid cell that later passes compute */
+	static void fill_pass_block(viral_core::image& img, const tile& t, int x, int y);
+
+	/** largest number of pixels passed to a \bref{pixel_evaluator} at once, the border of a tile */
+	static const int max_batch_size = 4 * tile_size;
+
+	/** rectangles up to this edge length are iterated completely instead of split further */
+	static const int min_subdivision_size = 6;
+
+	/** marks pixels of a tile that \bref{subdivide_tile} did not compute yet or queued for computation */
+	//{
+	static const int unknown_remain_iter = -1;
+	static const int pending_remain_iter = -2;
+	//}
 
 	/**
-	* computes c^x where c is a complex number given as c= a + bi and x is real
+	* computes the remaining iterations for \bref{count} pixels, given in coordinates
+	* relative to the tile, and writes them to \bref{remain_iter_out}. \bref{x_out} and
+	* \bref{y_out} receive the last z, \bref{distance_out} the distance in pixels if not null
 	*/
-	static void complex_pow_real(float a, float b, float x, float& a_out, float& b_out);
+	typedef std::function<void(const viral_core::vector2i* pixels, int count, int* remain_iter_out,
+		float* x_out, float* y_out, float* distance_out)> pixel_evaluator;
+
+	/**
+	* computes the remaining iterations for \bref{count} samples at the coordinates \bref{x}
+	* and \bref{y} in pixels of the whole frame, see parameter_set::image_offset_, the other
+	* outputs as for \bref{pixel_evaluator}.
+	* at most \bref{max_batch_size} samples per call
+	*/
+	typedef std::function<void(const double* x, const double* y, int count, int* remain_iter_out,
+		float* x_out, float* y_out, float* distance_out, frame_statistics& statistics)> sample_evaluator;
+
+	/** largest number of samples per pixel of the adaptive supersampling */
+	static const int max_supersamples = 64;
+
+	/** per tile kernels of the public generators, instantiated for float, double and double_double */
+	//{
+	template<typename scalar_type>
+	static void julia_iter_tile(const parameter_set& params, viral_core::image& img, const tile& t,
+		const unsigned char* palette, raw_frame* raw, frame_statistics& statistics);
+	static void julia_iter_tile_perturbation(const parameter_set& params, viral_core::image& img, const tile& t,
+		const mandelbrot_perturbation& reference, const unsigned char* palette, raw_frame* raw,
+		frame_statistics& statistics);
+	/**
+	* computes the pixels of tile \bref{x}, \bref{y} of \bref{level} of the grid of
+	* \bref{mandelbrot_tile_cache} that are \bref{unknown_remain_iter} in \bref{remain}.
+	* \bref{smooth} and \bref{distance} are filled if not null, all tile_size pixels per row
+	*/
+	template<typename scalar_type>
+	static void julia_iter_grid_tile(const parameter_set& params, int level, long long x, long long y,
+		int* remain, float* smooth, float* distance, frame_statistics& statistics);
+	template<typename scalar_type>
+	static sample_evaluator julia_iter_sampler(const parameter_set& params);
+	static sample_evaluator julia_iter_sampler_perturbation(const parameter_set& params,
+		const mandelbrot_perturbation& reference);
+	/**
+	* iterates the rows of a tile once and interpolates and colors them into each of the
+	* \bref{output_count} \bref{outputs}. \bref{raw} receives the values of the first output
+	*/
+	template<typename scalar_type>
+	static void julia_value_tile(const parameter_set& params, const julia_value_output* outputs, int output_count,
+		const tile& t, scalar_type* x_plane, scalar_type* y_plane, int cached_iterations,
+		mandelbrot_interpolation::sweep_function interpolation_sweep, raw_frame* raw);
+	//}
+
+	/**
+	* computes the escape times of a tile with \bref{evaluate} according to
+	* \bref{render_mode}, then colors the pixels with \bref{palette} in a separate
+	* pass. \bref{raw} receives the values of the tile's pixels if not null
+	*/
+	static void iterate_tile(const parameter_set& params, viral_core::image& img, const tile& t,
+		const pixel_evaluator& evaluate, const unsigned char* palette, raw_frame* raw,
+		frame_statistics& statistics);
+
+	/**
+	* calls \bref{evaluate} in batches and stores the results in the tile buffers \bref{remain}
+	* and, if not null, \bref{x}, \bref{y} and \bref{distance}
+	*/
+	static void evaluate_pixels(const pixel_evaluator& evaluate,
+		const viral_core::vector2i* pixels, int count, int* remain, float* x, float* y, float* distance,
+		frame_statistics& statistics);
+
+	/**
+	* Mariani-Silver subdivision of a tile of the given size: iterates the border of a
+	* rectangle and fills its interior if the whole border has the same escape time and
+	* balls of \bref{spacing} around the border pixels at \bref{re_column}, \bref{im_row}
+	* prove it for every point inside, otherwise splits it into four quarters or iterates
+	* small ones per pixel. \bref{remain} receives the escape times, \bref{x}, \bref{y} and
+	* \bref{distance} the values of the iterated pixels if not null, tile_size pixels per row.
+	* without \bref{fill_escaped} only rectangles inside the set are filled, the smooth
+	* colorings vary within a band of the same escape time
+	*/
+	static void subdivide_tile(const parameter_set& params, const pixel_evaluator& evaluate,
+		const viral_core::vector2i& size, const double* re_column, const double* im_row, double spacing,
+		int* remain, float* x, float* y, float* distance, bool fill_escaped, frame_statistics& statistics);
+
+	/**
+	* \bref{generate_mandelbrot_image_julia_iter} of a view on the grid of \bref{tile_cache},
+	* the top left pixel being \bref{origin_x}, \bref{origin_y} of \bref{level}: computes the missing tiles, starting from their cached parents and children, and
+	* colors the image from the tiles. returns false if cancelled
+	*/
+	static bool julia_iter_cached_frame(const parameter_set& params, precision used_precision,
+		int level, long long origin_x, long long origin_y, viral_core::image& img, mandelbrot_tile_cache& tile_cache,
+		const unsigned char* palette, raw_frame* raw, const std::atomic<bool>* cancel, frame_statistics& statistics);
+
+	/**
+	* adaptive supersampling of a finished image of \bref{generate_mandelbrot_image_julia_iter}:
+	* marks the pixels on color edges, then resamples them with \bref{supersample_tile}.
+	* returns false if cancelled
+	*/
+	static bool supersample_frame(const parameter_set& params, viral_core::image& img,
+		const sample_evaluator& evaluate, const unsigned char* palette, const std::atomic<bool>* cancel,
+		frame_statistics& statistics);
+
+	/**
+	* resamples the pixels of a tile marked in \bref{edge}: a first round of up to 4 samples,
+	* pixels whose samples still differ by more than the threshold get the remaining ones
+	*/
+	static void supersample_tile(const parameter_set& params, viral_core::image& img, const tile& t,
+		const unsigned char* edge, const sample_evaluator& evaluate, const unsigned char* palette,
+		frame_statistics& statistics);
+
+	/** offset in [-0.5, 0.5)^2 of sample \bref{sample} >= 1 of the pixel at \bref{x}, \bref{y} */
+	static void sample_offset(int sample, int x, int y, double& x_out, double& y_out);
+
+	/**
+	* all passes of \bref{generate_mandelbrot_image_julia_value} in \bref{scalar_type},
+	* returns false if cancelled
+	*/
+	template<typename scalar_type>
+	static bool julia_value_frame(const parameter_set& params, viral_core::image& img, precision used_precision,
+		progressive_control* progressive, mandelbrot_orbit_cache* orbit_cache, raw_frame* raw);
+
+	/** \bref{generate_mandelbrot_image_julia_value_sweep} in \bref{scalar_type}, in one pass */
+	template<typename scalar_type>
+	static bool julia_value_sweep_frame(const parameter_set& params, const std::vector<julia_value_output>& outputs,
+		precision used_precision, const std::atomic<bool>* cancel, mandelbrot_orbit_cache* orbit_cache);
+
+	/** coloring of a pixel by its escape time, fills \bref{julia_iter_palette} */
+	static void color_julia_iter(const parameter_set& params, int remain_iter, unsigned char* pixel);
 };
 
 #endif//#ifndef MANDELBROT_GENERATOR_HPP_INCLUDED
\ No newline at end of file
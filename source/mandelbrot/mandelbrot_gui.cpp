@@ -14,6 +14,7 @@
 #include <viral_gui/gui_editbox.hpp>
 #include <viral_gui/gui_value_edit.hpp>
 #include <viral_gui/gui_dropdown.hpp>
+#include <viral_gui/gui_label.hpp>
 
 
 #include <viral_core/render_resource.hpp>
@@ -23,7 +24,9 @@
 #include <viral_core/render_command.hpp>
 #include <viral_core/log.hpp>
 
-#include <opencv2/videoio.hpp>
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
 
 using namespace viral_gui;
 using namespace viral_core;
@@ -45,16 +48,23 @@ mandelbrot_gui::mandelbrot_gui()
 	image_material_(create_image_material(flat_shader_id_)),
 	image_viewport_(new gui_image("image_viewport", gui_, create_image_style(),
 		image(vector2i(1920, 1080)), image_material_)),
-	image_task_(0)
+	video_export_(0)
 {
 	element_cache_.entry<gui_frame>("bg_frame")().
 		set_content(image_viewport_);
 
 	register_event_callback("start_pause_button", *this, (&mandelbrot_gui::start_pause_visualization));
 	register_event_callback("record_button", *this, (&mandelbrot_gui::write_simulation_to_file));
+	register_event_callback("trace_button", *this, (&mandelbrot_gui::write_trace_to_file));
+	register_event_callback("image_viewport", *this, (&mandelbrot_gui::viewport_mouse));
 
 	parameters_.image_dimensions_ = vector2i(1920, 1080);
 	parameters_.interpolate_ = true;
+	/*every later view is on the grid as well, see mandelbrot_navigation*/
+	mandelbrot_tile_cache::snap(parameters_);
+
+	/*the overlay shows the timings of every frame*/
+	mandelbrot_profiler::set_enabled(true);
 }
 
 void mandelbrot_gui::initialize_rendering(render_command_queue & queue)
@@ -86,6 +96,9 @@ void mandelbrot_gui::update_parameters_from_gui()
 {
 	parameters_.iterations_ = element_cache_.entry<gui_editbox>("iteration_editbox")().text().to_int();
 	parameters_.interpolation_ = element_cache_.entry<gui_value_edit>("interpolation_slider")().value();
+	parameters_.hsv_color_offset_ = element_cache_.entry<gui_value_edit>("color_offset_slider")().value();
+	show_escape_time_ = false;
+	parameters_.coloring_ = mandelbrot_generator::coloring_escape_time;
 	switch (element_cache_.entry<gui_dropdown>("method_dropdown")().selected_index()) {
 	case 0:
 		parameters_.interpolation_method_ = &mandelbrot_generator::polynomial;
@@ -99,6 +112,24 @@ void mandelbrot_gui::update_parameters_from_gui()
 	case 3:
 		parameters_.interpolation_method_ = &mandelbrot_generator::linear_xy;
 		break;
+	case 4:
+		show_escape_time_ = true;
+		parameters_.render_mode_ = mandelbrot_generator::render_brute_force;
+		break;
+	case 5:
+		show_escape_time_ = true;
+		parameters_.render_mode_ = mandelbrot_generator::render_subdivision;
+		break;
+	case 6:
+		show_escape_time_ = true;
+		parameters_.render_mode_ = mandelbrot_generator::render_subdivision;
+		parameters_.coloring_ = mandelbrot_generator::coloring_smooth;
+		break;
+	case 7:
+		show_escape_time_ = true;
+		parameters_.render_mode_ = mandelbrot_generator::render_subdivision;
+		parameters_.coloring_ = mandelbrot_generator::coloring_distance;
+		break;
 	default:
 		LOG_ERROR(string("Invalid index from method_dropdown: ")
 			+ string(element_cache_.entry<gui_dropdown>("method_dropdown")().selected_index()));
@@ -114,30 +145,164 @@ void mandelbrot_gui::update_gui_from_parameters()
 
 void mandelbrot_gui::logics_hook(viral_gui::gui_modal_interaction * modal_interaction)
 {
+	long long wait_begin = mandelbrot_profiler::now();
 	MUTEX_SCOPE(visualization_mutex_);
-	if (!image_task_) {
-		update_parameters_from_gui();
-		image_task_.reset(new image_computation_task(parameters_));
-		image_task_->start();
+	mandelbrot_profiler::record("wait visualization_mutex_", wait_begin, mandelbrot_profiler::now());
+	update_video_export();
+	update_parameters_from_gui();
+	bool shown = take_completions();
+
+	if (!render_job_) {
+		if (!run_visualization_ && !frame_outdated(shown_parameters_, shown_escape_time_)) {
+			recolor_shown_frame();
+			return;
+		}
+		submit_frame();
 	}
-	else {
-		if (image_task_->thread_has_terminated()) {
-			image_task_->join();
-			image_viewport_->apply_source_image(
-				*image_task_->get_output(), image_material_);
-			image_task_.reset();
-
-			if (run_visualization_) {
-				parameters_.interpolation_ += element_cache_.entry<gui_editbox>("stepsize_editbox")().text().to_float();
-				if (parameters_.interpolation_ >= 1.f)
-				{
-					parameters_.interpolation_ = 0.f;
-					parameters_.iterations_++;
-				}
-				update_gui_from_parameters();
+	else if (!run_visualization_ && frame_outdated(render_parameters_, render_escape_time_)
+		&& navigation_.abort_outdated(render_interactive_, std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - render_submitted_).count())) {
+		/*the new frame is queued right away and starts once the old one finished its tiles in progress*/
+		scheduler_.cancel(render_job_);
+		submit_frame();
+	}
+	else if (!shown) recolor_shown_frame();
+}
+
+void mandelbrot_gui::submit_frame()
+{
+	/*coarse passes would flicker during the animation and delay the frames while the view changes*/
+	render_interactive_ = !run_visualization_ && navigation_.interacting();
+	bool full_quality = !run_visualization_ && !render_interactive_;
+
+	mandelbrot_render_scheduler::request r;
+	r.parameters_ = navigation_.frame_parameters(parameters_);
+	r.escape_time_ = show_escape_time_;
+	r.progressive_ = full_quality;
+	r.keep_raw_frame_ = full_quality;
+	r.orbit_cache_ = &orbit_cache_;
+	r.tile_cache_ = &tile_cache_;
+	r.priority_ = render_interactive_
+		? mandelbrot_render_scheduler::priority_interactive : mandelbrot_render_scheduler::priority_normal;
+	r.channel_ = viewport_channel;
+
+	render_parameters_ = r.parameters_;
+	render_escape_time_ = r.escape_time_;
+	render_submitted_ = std::chrono::steady_clock::now();
+	render_job_ = scheduler_.submit(r);
+}
+
+bool mandelbrot_gui::take_completions()
+{
+	std::vector<std::unique_ptr<mandelbrot_render_scheduler::completion> > completions =
+		scheduler_.take_completions();
+	auto_pointer<image> preview;
+	bool shown = false;
+	for (size_t i = 0; i < completions.size(); i++) {
+		mandelbrot_render_scheduler::completion& c = *completions[i];
+		/*cancelled frames count as well, they tell how long the ones of this quality take*/
+		if (c.final_ && c.request_.priority_ == mandelbrot_render_scheduler::priority_interactive)
+			navigation_.interactive_frame_rendered(c.render_milliseconds_, c.completed_);
+
+		if (c.job_ != render_job_) {
+			scheduler_.recycle(c.image_);
+			continue;
+		}
+		if (!c.final_) {
+			scheduler_.recycle(preview);
+			preview.reset(c.image_.release());
+			continue;
+		}
+
+		render_job_ = 0;
+		scheduler_.recycle(preview);
+		if (c.completed_) {
+			show_image(*c.image_);
+			scheduler_.recycle(shown_image_);
+			shown_image_.reset(c.image_.release());
+			std::swap(shown_frame_, c.raw_frame_);
+			shown_parameters_ = c.request_.parameters_;
+			shown_escape_time_ = c.request_.escape_time_;
+			shown = true;
+		}
+		update_profile_overlay(c.request_.escape_time_ ? &c.statistics_ : 0);
+		recolor_shown_frame();
+
+		if (run_visualization_) {
+			parameters_.interpolation_ += element_cache_.entry<gui_editbox>("stepsize_editbox")().text().to_float();
+			if (parameters_.interpolation_ >= 1.f)
+			{
+				parameters_.interpolation_ = 0.f;
+				parameters_.iterations_++;
 			}
+			update_gui_from_parameters();
 		}
 	}
+
+	if (preview) {
+		show_image(*preview);
+		scheduler_.recycle(preview);
+		shown = true;
+	}
+	return shown;
+}
+
+void mandelbrot_gui::recolor_shown_frame()
+{
+	float offset = element_cache_.entry<gui_value_edit>("color_offset_slider")().value();
+	if (shown_frame_.size_.x == 0 || offset == shown_parameters_.hsv_color_offset_) return;
+
+	shown_parameters_.hsv_color_offset_ = offset;
+	auto_pointer<image> img = shown_escape_time_
+		? mandelbrot_generator::recolor_julia_iter(shown_parameters_, shown_frame_)
+		: mandelbrot_generator::recolor_julia_value(shown_parameters_, shown_frame_);
+	show_image(*img);
+}
+
+void mandelbrot_gui::show_image(const image & img)
+{
+	MANDELBROT_PROFILE_SCOPE("texture upload", (long long)img.size().x * img.size().y);
+	image_viewport_->apply_source_image(img, image_material_);
+}
+
+void mandelbrot_gui::update_profile_overlay(const mandelbrot_generator::frame_statistics* statistics)
+{
+	std::vector<mandelbrot_profiler::event> events = mandelbrot_profiler::take_events();
+	mandelbrot_profiler::summary summary = mandelbrot_profiler::summarize(events, "tile");
+	std::string text = summary.format();
+	if (statistics) {
+		char line[256];
+		snprintf(line, sizeof(line), "\n%lld iterations, %lld escaped, %lld interior pixels",
+			statistics->escape_.iterations, statistics->escaped_pixels_, statistics->escape_.interior_pixels);
+		text += line;
+	}
+	element_cache_.entry<gui_label>("profile_label")().set_text(string(text.c_str()));
+
+	/*the oldest half goes once the trace is full, so a long session keeps its recent frames*/
+	if (trace_events_.size() + events.size() > max_trace_events)
+		trace_events_.erase(trace_events_.begin(), trace_events_.begin() + trace_events_.size() / 2);
+	trace_events_.insert(trace_events_.end(), events.begin(), events.end());
+}
+
+bool mandelbrot_gui::frame_outdated(const mandelbrot_generator::parameter_set & computing, bool escape_time)
+{
+	mandelbrot_generator::parameter_set wanted = navigation_.frame_parameters(parameters_);
+	return escape_time != show_escape_time_
+		|| computing.image_dimensions_ != wanted.image_dimensions_
+		|| computing.real_min_ != wanted.real_min_
+		|| computing.imaginary_min_ != wanted.imaginary_min_
+		|| computing.real_max_ != wanted.real_max_
+		|| computing.imaginary_max_ != wanted.imaginary_max_
+		|| computing.center_re_ != wanted.center_re_
+		|| computing.center_im_ != wanted.center_im_
+		|| computing.view_exponent_ != wanted.view_exponent_
+		|| computing.max_iter_ != wanted.max_iter_
+		|| computing.iterations_ != parameters_.iterations_
+		|| computing.interpolation_ != parameters_.interpolation_
+		|| computing.interpolation_method_ != parameters_.interpolation_method_
+		|| computing.render_mode_ != parameters_.render_mode_
+		|| computing.coloring_ != parameters_.coloring_
+		|| computing.formula_ != parameters_.formula_;
 }
 
 void mandelbrot_gui::render_hook(render_command_queue & queue)
@@ -183,49 +348,109 @@ void mandelbrot_gui::start_pause_visualization(const gui_button_event & event)
 
 void mandelbrot_gui::write_simulation_to_file(const viral_gui::gui_button_event & event)
 {
-	cv::VideoWriter output_writer;
-	output_writer.open("C:/Users/Josua/Desktop/mandelbrot.avi", cv::VideoWriter::fourcc('M', 'J', 'P', 'G')/*-1*/,
-		30.0, cv::Size(1920,1080), true);
-	if (!output_writer.isOpened()) {
-		LOG_ERROR("could not open output writer!");
+	MUTEX_SCOPE(visualization_mutex_);
+	if (video_export_) {
+		video_export_->cancel();
 		return;
 	}
-	parameters_.interpolation_method_ = &mandelbrot_generator::linear_xy;
-	float t = 0.f;
-	for (int i = 0; i < 240; i++) {
-		if (i % 1 == 0)LOG_INFO(string("processing frame no: ") + string(i));
-		t += 0.1f;
-		float f_t = t;
-		if (t < 12.f) f_t = pow(1.4, t);
-		else f_t = pow(1.4, 24.0 - t);
-		f_t -= 1.f;
-		/*parameters_.interpolation_ += 0.1f;
-		while (parameters_.interpolation_ >= 1.f) {
-			parameters_.iterations_++;
-			parameters_.interpolation_ -= 1.f;
-		}*/
-		parameters_.iterations_ = (int)f_t;
-		parameters_.interpolation_ = f_t - (float)parameters_.iterations_;
-		auto_pointer<image>viral_img = mandelbrot_generator::generate_mandelbrot_image_julia_value(parameters_);
-		viral_img->swap_rgba_bgra();
-		cv::Mat cv_img(viral_img->size().y, viral_img->size().x, CV_8UC4, viral_img->data());
-		//cv::Mat cv_img(1080, 1920, CV_8UC3);
-		output_writer.write(cv_img);
+
+	mandelbrot_video_export::settings export_settings;
+	string path = element_cache_.entry<gui_editbox>("export_path_editbox")().text();
+	export_settings.output_path_ = std::string(path.data(), path.length());
+	export_settings.frame_count_ = element_cache_.entry<gui_editbox>("export_frames_editbox")().text().to_int();
+	export_settings.easing_ = (mandelbrot_video_export::easing)
+		element_cache_.entry<gui_dropdown>("export_easing_dropdown")().selected_index();
+	if (export_settings.output_path_.empty() || export_settings.frame_count_ <= 0) {
+		LOG_ERROR("video export needs an output file and at least one frame");
+		return;
 	}
+
+	mandelbrot_generator::parameter_set export_parameters = parameters_;
+	export_parameters.interpolate_ = true;
+	export_parameters.interpolation_method_ = &mandelbrot_generator::linear_xy;
+
+	video_export_.reset(new mandelbrot_video_export(export_parameters, export_settings));
+	element_cache_.entry<gui_button>("record_button")().set_text("cancel recording");
 }
 
-mandelbrot_gui::image_computation_task::image_computation_task(const mandelbrot_generator::parameter_set & params)
-	:
-	parameters_(params)
+void mandelbrot_gui::write_trace_to_file(const viral_gui::gui_button_event & event)
+{
+	MUTEX_SCOPE(visualization_mutex_);
+	string path = element_cache_.entry<gui_editbox>("trace_path_editbox")().text();
+	std::string trace_path(path.data(), path.length());
+	if (trace_path.empty() || !mandelbrot_profiler::write_chrome_trace(trace_path, trace_events_)) {
+		LOG_ERROR(string("could not write the trace to ") + path);
+		return;
+	}
+	LOG_INFO(string("trace of ") + string((int)trace_events_.size()) + string(" events written to ") + path);
+}
+
+void mandelbrot_gui::viewport_mouse(const viral_gui::gui_mouse_event & event)
 {
+	MUTEX_SCOPE(visualization_mutex_);
+	if (run_visualization_) return;//the animation keeps its view
+
+	vector2f position = viewport_to_image(event.position());
+	switch (event.type()) {
+	case gui_mouse_event::button_down:
+		if (event.button() == gui_mouse_event::left) drag_ = drag_pan;
+		else if (event.button() == gui_mouse_event::right) drag_ = drag_box;
+		drag_start_ = position;
+		drag_last_ = position;
+		break;
+	case gui_mouse_event::move:
+		if (drag_ == drag_pan) {
+			/*whole pixels only, the rest is carried over to the next move*/
+			vector2i delta((int)floor(position.x - drag_last_.x + 0.5f), (int)floor(position.y - drag_last_.y + 0.5f));
+			if (delta.x == 0 && delta.y == 0) break;
+			mandelbrot_navigation::pan(parameters_, delta);
+			drag_last_.x += delta.x;
+			drag_last_.y += delta.y;
+			navigation_.input_received();
+		}
+		break;
+	case gui_mouse_event::button_up:
+		if (drag_ == drag_box) {
+			if (!mandelbrot_navigation::zoom_box(parameters_, drag_start_, position))
+				mandelbrot_navigation::zoom(parameters_, position, -1);
+			navigation_.input_received();
+		}
+		drag_ = drag_none;
+		break;
+	case gui_mouse_event::wheel:
+		mandelbrot_navigation::zoom(parameters_, position, event.wheel_steps());
+		navigation_.input_received();
+		break;
+	default:
+		break;
+	}
 }
 
-viral_core::auto_pointer<viral_core::image>& mandelbrot_gui::image_computation_task::get_output()
+vector2f mandelbrot_gui::viewport_to_image(const vector2f & position) const
 {
-	return output_image_;
+	vector2f origin = image_viewport_->absolute_position();
+	vector2f size = image_viewport_->absolute_size();
+	vector2i image_size = parameters_.image_dimensions_;
+	return vector2f((position.x - origin.x) / size.x * image_size.x, (position.y - origin.y) / size.y * image_size.y);
 }
 
-void mandelbrot_gui::image_computation_task::task_main()
+void mandelbrot_gui::update_video_export()
 {
-	output_image_ = mandelbrot_generator::generate_mandelbrot_image_julia_value(parameters_);
+	if (!video_export_) return;
+
+	if (!video_export_->finished()) {
+		element_cache_.entry<gui_label>("export_progress_label")().set_text(
+			string("rendered ") + string(video_export_->rendered_frames())
+			+ string(", encoded ") + string(video_export_->encoded_frames())
+			+ string(" of ") + string(video_export_->frame_count()));
+		return;
+	}
+
+	if (video_export_->succeeded()) {
+		LOG_INFO(string("video export finished, ") + string(video_export_->frame_count()) + string(" frames"));
+		element_cache_.entry<gui_label>("export_progress_label")().set_text("done");
+	}
+	else element_cache_.entry<gui_label>("export_progress_label")().set_text("cancelled");
+	video_export_.reset();
+	element_cache_.entry<gui_button>("record_button")().set_text("record");
 }
@@ -16,10 +16,17 @@
 
 #include <viral_core/render_resource.hpp>
 #include <viral_core/shared_pointer.hpp>
-#include <viral_core/thread.hpp>
 #include <viral_core/thread_synch.hpp>
 
 #include "mandelbrot_generator.hpp"
+#include "mandelbrot_navigation.hpp"
+#include "mandelbrot_orbit_cache.hpp"
+#include "mandelbrot_profiler.hpp"
+#include "mandelbrot_render_scheduler.hpp"
+#include "mandelbrot_tile_cache.hpp"
+#include "mandelbrot_video_export.hpp"
+
+#include <chrono>
 
 
 
@@ -57,9 +64,63 @@ private:
 
 	bool run_visualization_ = false;
 
+	/** shows the escape time image instead of the julia values */
+	bool show_escape_time_ = false;
+
+	/** z of the last frame, the animation continues from it */
+	mandelbrot_orbit_cache orbit_cache_;
+
+	/** escape time tiles of the previous frames, only views on its grid use it */
+	mandelbrot_tile_cache tile_cache_;
+
+	/** view changes by the mouse and the quality of the frames while they happen */
+	//{
+	mandelbrot_navigation navigation_;
+	enum drag_mode {
+		drag_none,
+		drag_pan,	/**< left button, the image follows the cursor */
+		drag_box	/**< right button, zooms into the box on release */
+	};
+	drag_mode drag_ = drag_none;
+	/** image pixel the drag started at and the one the view was last moved to */
+	//{
+	viral_core::vector2f drag_start_;
+	viral_core::vector2f drag_last_;
+	//}
+	/** pixel of the full image under \bref{position}, given in the coordinates of the mouse events */
+	viral_core::vector2f viewport_to_image(const viral_core::vector2f& position) const;
+	//}
+
+	/**
+	* the frame in the viewport, it stays untouched while the next frames are rendered into
+	* images of the scheduler and goes back to it once the next one is shown
+	*/
+	viral_core::auto_pointer<viral_core::image> shown_image_;
+
+	/** uncolored values of the image in the viewport, empty during the animation */
+	//{
+	mandelbrot_generator::raw_frame shown_frame_;
+	mandelbrot_generator::parameter_set shown_parameters_;
+	bool shown_escape_time_ = false;
+	//}
+	/** recolors \bref{shown_frame_} if the color offset of the gui differs from the one it is shown with */
+	void recolor_shown_frame();
+	/** hands \bref{img} to the viewport, the texture upload is timed */
+	void show_image(const viral_core::image& img);
+
+	/** profiler events of the recent frames, written by \bref{write_trace_to_file} */
+	//{
+	std::vector<mandelbrot_profiler::event> trace_events_;
+	static const size_t max_trace_events = 1 << 22;
+	//}
+	/** shows the timings of the frame that just finished next to the controls */
+	void update_profile_overlay(const mandelbrot_generator::frame_statistics* statistics);
+
 	/** parameter set for the visualization */
 	mandelbrot_generator::parameter_set parameters_;
 	void update_parameters_from_gui();
+	/** true if a frame of \bref{computing} differs from the one the gui wants now, besides its colors */
+	bool frame_outdated(const mandelbrot_generator::parameter_set& computing, bool escape_time);
 	void update_gui_from_parameters();
 	viral_core::mutex visualization_mutex_;
 
@@ -82,29 +143,39 @@ private:
 	//{
 	void start_pause_visualization(const viral_gui::gui_button_event& event);
 	void write_simulation_to_file(const viral_gui::gui_button_event& event);
+	void write_trace_to_file(const viral_gui::gui_button_event& event);
+	/** drag to pan, wheel to zoom, right drag to zoom into a box, right click to zoom out */
+	void viewport_mouse(const viral_gui::gui_mouse_event& event);
 	//}
 
+	/** export started by \bref{write_simulation_to_file}, runs in the background */
+	viral_core::auto_pointer<mandelbrot_video_export> video_export_;
+	/** shows the progress of \bref{video_export_} and releases it once it finished */
+	void update_video_export();
+
+	/** the frame submitted last, 0 once it was delivered */
+	//{
+	int render_job_ = 0;
+	mandelbrot_generator::parameter_set render_parameters_;
+	bool render_escape_time_ = false;
+	/** true if it is a reduced frame while the view changes */
+	bool render_interactive_ = false;
+	std::chrono::steady_clock::time_point render_submitted_;
+	//}
+	/** all frames of the viewport are jobs of this channel, so they never run at the same time */
+	static const int viewport_channel = 0;
+	/** submits the frame the gui wants now as \bref{render_job_} */
+	void submit_frame();
 	/**
-	*************************************************************************
-	*
-	* @class mandelbrot_gui::image_computation_task
-	*
-	* threaded task to compute the mandelbrot image 
-	* using \bref{mandelbrot_generator}
-	*
-	************************************************************************/
-	class image_computation_task :
-		public viral_core::threaded_task
-	{
-	public:
-		image_computation_task(const mandelbrot_generator::parameter_set& params);
-		viral_core::auto_pointer<viral_core::image>& get_output();
-	private:
-		const mandelbrot_generator::parameter_set parameters_;
-		viral_core::auto_pointer<viral_core::image> output_image_;
-		virtual void task_main();
-	};
+	* shows the completions of the scheduler: the frame of \bref{render_job_} once it is
+	* done or its latest preview. false if nothing new was shown
+	*/
+	bool take_completions();
 
-	viral_core::auto_pointer<image_computation_task> image_task_;
+	/**
+	* renders the frames on a thread that lives as long as the gui. declared last, so its
+	* jobs are cancelled before the caches they use are destroyed
+	*/
+	mandelbrot_render_scheduler scheduler_;
 };
 #endif//#ifndef MANDELBROT_GUI_HPP_INCLUDED
\ No newline at end of file
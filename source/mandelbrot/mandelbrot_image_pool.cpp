@@ -0,0 +1,57 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_image_pool.cpp
+*
+* implementation of \bref{mandelbrot_image_pool}
+*
+************************************************************************/
+
+#include "mandelbrot_image_pool.hpp"
+
+using namespace viral_core;
+
+//////////////////////////////////////////////////////////////////////////
+//
+// mandelbrot_image_pool
+//
+//////////////////////////////////////////////////////////////////////////
+
+mandelbrot_image_pool::mandelbrot_image_pool(int capacity) :
+	capacity_(capacity)
+{
+}
+
+auto_pointer<image> mandelbrot_image_pool::acquire(const vector2i & size)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (size_t i = 0; i < free_.size(); i++) {
+			if (free_[i]->size().x != size.x || free_[i]->size().y != size.y) continue;
+			auto_pointer<image> ret(free_[i].release());
+			free_.erase(free_.begin() + i);
+			return ret;
+		}
+	}
+	return auto_pointer<image>(new image(size));
+}
+
+void mandelbrot_image_pool::recycle(auto_pointer<image>& img)
+{
+	if (!img) return;
+
+	std::unique_ptr<image> kept(img.release());
+	std::lock_guard<std::mutex> lock(mutex_);
+	if ((int)free_.size() < capacity_) free_.push_back(std::move(kept));
+	/*sizes that are no longer rendered age out*/
+	else if (capacity_ > 0) {
+		free_.erase(free_.begin());
+		free_.push_back(std::move(kept));
+	}
+}
+
+int mandelbrot_image_pool::free_count() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return (int)free_.size();
+}
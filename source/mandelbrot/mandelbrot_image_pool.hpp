@@ -0,0 +1,56 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_image_pool.hpp
+*
+* Reuse of frame buffers between the frames of an animation or export
+*
+************************************************************************/
+
+#ifndef MANDELBROT_IMAGE_POOL_HPP_INCLUDED
+#define MANDELBROT_IMAGE_POOL_HPP_INCLUDED
+
+#include <viral_core/auto_pointer.hpp>
+#include <viral_core/image.hpp>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_image_pool
+*
+* keeps up to capacity images that are no longer used, so the next frame
+* of the same size gets an image whose pages are already mapped instead of
+* a new allocation of several MB. images may be acquired and recycled from
+* different threads, e.g. by a renderer and an encoder
+*
+************************************************************************/
+class mandelbrot_image_pool {
+public:
+	explicit mandelbrot_image_pool(int capacity);
+
+	mandelbrot_image_pool(const mandelbrot_image_pool&) = delete;
+	mandelbrot_image_pool& operator=(const mandelbrot_image_pool&) = delete;
+
+	/** an image of \bref{size}, a kept one if there is one of that size. its pixels are undefined */
+	viral_core::auto_pointer<viral_core::image> acquire(const viral_core::vector2i& size);
+
+	/**
+	* takes \bref{img} back for later frames, dropping the image kept longest if the pool
+	* is full. \bref{img} is empty afterwards
+	*/
+	void recycle(viral_core::auto_pointer<viral_core::image>& img);
+
+	/** images kept for reuse */
+	int free_count() const;
+
+private:
+	const int capacity_;
+	mutable std::mutex mutex_;
+	std::vector<std::unique_ptr<viral_core::image> > free_;
+};
+
+#endif//#ifndef MANDELBROT_IMAGE_POOL_HPP_INCLUDED
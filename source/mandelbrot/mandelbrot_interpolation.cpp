@@ -0,0 +1,35 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_interpolation.cpp
+*
+* implementation of \bref{mandelbrot_interpolation}
+*
+************************************************************************/
+
+#include "mandelbrot_interpolation.hpp"
+
+#include "mandelbrot_generator.hpp"
+
+/** the sweep function of \bref{kernel} with the math policy of \bref{fast} */
+template<typename kernel>
+static mandelbrot_interpolation::sweep_function sweep_with_math(bool fast)
+{
+	if (fast) return &mandelbrot_interpolation::interpolate_sweep<kernel, mandelbrot_interpolation::fast_math>;
+	return &mandelbrot_interpolation::interpolate_sweep<kernel, mandelbrot_interpolation::exact_math>;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// mandelbrot_interpolation
+//
+//////////////////////////////////////////////////////////////////////////
+
+mandelbrot_interpolation::sweep_function mandelbrot_interpolation::select(method m, bool fast)
+{
+	if (m == &mandelbrot_generator::linear_xy) return sweep_with_math<linear_xy_kernel>(fast);
+	if (m == &mandelbrot_generator::linear_angle_and_abs) return sweep_with_math<angle_and_abs_kernel<false> >(fast);
+	if (m == &mandelbrot_generator::linear_short_angle_and_abs) return sweep_with_math<angle_and_abs_kernel<true> >(fast);
+	if (m == &mandelbrot_generator::polynomial) return sweep_with_math<polynomial_kernel>(fast);
+	return 0;
+}
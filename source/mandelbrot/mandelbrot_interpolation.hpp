@@ -0,0 +1,378 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_interpolation.hpp
+*
+* Interpolation kernels of
+* \bref{mandelbrot_generator::generate_mandelbrot_image_julia_value},
+* inlined into a loop over a row of pixels
+*
+************************************************************************/
+
+#ifndef MANDELBROT_INTERPOLATION_HPP_INCLUDED
+#define MANDELBROT_INTERPOLATION_HPP_INCLUDED
+
+#include <viral_core/geo_util.hpp>
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_interpolation
+*
+* each interpolation method is a kernel whose apply<math> interpolates one
+* pixel. apply is split into prepare, the part that only depends on start and
+* goal, and finish, the part that depends on the interpolation as well.
+* \bref{interpolate_sweep} runs a kernel over a row for any number of
+* interpolations, preparing each pixel once; with the method and the math
+* policy as template parameters, nothing in the loop is called through a
+* pointer, so the compiler inlines the kernel and can vectorize the loop.
+* the generator picks the sweep function once per frame with \bref{select}.
+*
+* math policies provide atan2, sincos and pow. exact_math uses the c library
+* and gives the results of the interpolation methods of
+* \bref{mandelbrot_generator}. fast_math uses polynomial approximations
+* without branches or library calls, see there for their error
+*
+************************************************************************/
+class mandelbrot_interpolation {
+public:
+	/** signature of \bref{mandelbrot_generator::parameter_set::interpolation_method_} */
+	typedef void(*method)(float, float, float, float, float, float&, float&);
+
+	/**
+	* interpolates \bref{count} pixels from start to goal with each of the \bref{interpolation_count}
+	* \bref{interpolations}, the pixels of interpolation k go to x_out[k] and y_out[k]
+	*/
+	typedef void(*sweep_function)(const float* start_x, const float* start_y, const float* goal_x,
+		const float* goal_y, const float* interpolations, int interpolation_count, int count,
+		float* const* x_out, float* const* y_out);
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_interpolation::exact_math
+	* the c library functions, as used by the interpolation methods before
+	************************************************************************/
+	struct exact_math {
+		static float atan2(float y, float x);
+		static void sincos(float angle, float& sin_out, float& cos_out);
+		static float pow(float base, float exponent);
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_interpolation::fast_math
+	* approximations, largest errors measured over the float range they are used in:
+	* - atan2: 2e-6 radians absolute, 0 for (0, 0)
+	* - sincos: 1e-7 absolute for |angle| < 1000
+	* - pow: 6e-6 relative for bases >= 0 and results within the normal floats,
+	*	0 for base 0
+	************************************************************************/
+	struct fast_math {
+		static float atan2(float y, float x);
+		static void sincos(float angle, float& sin_out, float& cos_out);
+		static float pow(float base, float exponent);
+	};
+
+	/** kernels of the interpolation methods of \bref{mandelbrot_generator}, prepared is what finish needs of a pixel */
+	//{
+	struct linear_xy_kernel {
+		struct prepared {
+			float start_x, start_y;
+			float delta_x, delta_y;
+		};
+		template<typename math>
+		static void prepare(float start_x, float start_y, float goal_x, float goal_y, prepared& out);
+		template<typename math>
+		static void finish(const prepared& p, float interpolation, float& x, float& y);
+		template<typename math>
+		static void apply(float start_x, float start_y, float goal_x, float goal_y, float interpolation,
+			float& x, float& y);
+	};
+
+	/** linear in the absolute value and the angle, with \bref{short_way} the angle turns by at most pi */
+	template<bool short_way>
+	struct angle_and_abs_kernel {
+		struct prepared {
+			float start_abs, delta_abs;
+			float start_angle, delta_angle;
+		};
+		template<typename math>
+		static void prepare(float start_x, float start_y, float goal_x, float goal_y, prepared& out);
+		template<typename math>
+		static void finish(const prepared& p, float interpolation, float& x, float& y);
+		template<typename math>
+		static void apply(float start_x, float start_y, float goal_x, float goal_y, float interpolation,
+			float& x, float& y);
+	};
+
+	/** z^(2/(2-r)) + r * c, c taken from the step from start to goal */
+	struct polynomial_kernel {
+		struct prepared {
+			float start_abs, start_angle;
+			float c_x, c_y;
+		};
+		template<typename math>
+		static void prepare(float start_x, float start_y, float goal_x, float goal_y, prepared& out);
+		template<typename math>
+		static void finish(const prepared& p, float interpolation, float& x, float& y);
+		template<typename math>
+		static void apply(float start_x, float start_y, float goal_x, float goal_y, float interpolation,
+			float& x, float& y);
+	};
+	//}
+
+	/** prepares blocks of pixels that stay in the L1 cache while they are finished for each interpolation */
+	template<typename kernel, typename math>
+	static void interpolate_sweep(const float* start_x, const float* start_y, const float* goal_x,
+		const float* goal_y, const float* interpolations, int interpolation_count, int count,
+		float* const* x_out, float* const* y_out);
+
+	/** the sweep function of \bref{m}, null if it is none of the methods of \bref{mandelbrot_generator} */
+	static sweep_function select(method m, bool fast);
+
+private:
+	/** bits of a float and back */
+	//{
+	static uint32_t to_bits(float value);
+	static float from_bits(uint32_t bits);
+	//}
+
+	/** floorf for values within the range of int, without the library call that sse2 needs for floorf */
+	static float round_down(float value);
+
+	/** pixels per block of \bref{interpolate_sweep} */
+	static const int sweep_block = 64;
+};
+
+inline float mandelbrot_interpolation::exact_math::atan2(float y, float x)
+{
+	return viral_core::geo_util::atan2(y, x);
+}
+
+inline void mandelbrot_interpolation::exact_math::sincos(float angle, float & sin_out, float & cos_out)
+{
+	cos_out = cosf(angle);
+	sin_out = sinf(angle);
+}
+
+inline float mandelbrot_interpolation::exact_math::pow(float base, float exponent)
+{
+	return powf(base, exponent);
+}
+
+inline float mandelbrot_interpolation::fast_math::atan2(float y, float x)
+{
+	/*
+	* atan on [0, 1] by a minimax polynomial, the octant is restored afterwards. both sides
+	* of each selection are computed, so the compiler can turn it into a blend
+	*/
+	float abs_x = fabsf(x);
+	float abs_y = fabsf(y);
+	float larger = abs_x > abs_y ? abs_x : abs_y;
+	float smaller = abs_x > abs_y ? abs_y : abs_x;
+	float a = smaller / (larger > 0.f ? larger : 1.f);
+	float s = a * a;
+	float r = (((((-0.01172120f * s + 0.05265332f) * s - 0.11643287f) * s + 0.19354346f) * s
+		- 0.33262347f) * s + 0.99997726f) * a;
+	float complement = 1.57079637f - r;
+	r = abs_y > abs_x ? complement : r;
+	float mirrored = 3.14159274f - r;
+	r = x < 0.f ? mirrored : r;
+	float negated = -r;
+	return y < 0.f ? negated : r;
+}
+
+inline void mandelbrot_interpolation::fast_math::sincos(float angle, float & sin_out, float & cos_out)
+{
+	/*reduction to [-pi/4, pi/4] with pi/2 split into three parts, so q * part is exact*/
+	float q = round_down(angle * 0.636619772f + 0.5f);
+	float r = angle - q * 1.5703125f;
+	r = r - q * 4.83751297e-4f;
+	r = r - q * 7.54978942e-8f;
+	float r2 = r * r;
+	float s = r + r * r2 * (-1.66666546e-1f + r2 * (8.33216087e-3f + r2 * -1.95152959e-4f));
+	float c = 1.f - 0.5f * r2 + r2 * r2 * (4.16666457e-2f + r2 * (-1.38873163e-3f + r2 * 2.44331571e-5f));
+
+	int quadrant = (int)q;
+	float sin_value = (quadrant & 1) ? c : s;
+	float cos_value = (quadrant & 1) ? s : c;
+	float sin_negated = -sin_value;
+	float cos_negated = -cos_value;
+	sin_out = (quadrant & 2) ? sin_negated : sin_value;
+	cos_out = ((quadrant + 1) & 2) ? cos_negated : cos_value;
+}
+
+inline float mandelbrot_interpolation::fast_math::pow(float base, float exponent)
+{
+	/*2^(exponent * log2(base)), log2 of the mantissa in [sqrt(1/2), sqrt(2)) by its atanh series*/
+	uint32_t bits = to_bits(base);
+	int e = (int)((bits >> 23) & 255) - 127;
+	float m = from_bits((bits & 0x007fffff) | 0x3f800000);
+	bool high = m > 1.41421356f;
+	float halved = m * 0.5f;
+	m = high ? halved : m;
+	e = high ? e + 1 : e;
+	float t = (m - 1.f) / (m + 1.f);
+	float t2 = t * t;
+	float log2_base = e + t * (2.88539008f + t2 * (0.961796694f + t2 * (0.577078016f + t2 * 0.412198583f)));
+
+	float v = exponent * log2_base;
+	v = v < -126.f ? -126.f : (v > 127.f ? 127.f : v);
+	float i = round_down(v + 0.5f);
+	float f = v - i;
+	float p = 1.f + f * (0.693147182f + f * (0.240226507f + f * (0.0555041087f + f * (0.00961812911f
+		+ f * (0.00133335581f + f * 0.000154035304f)))));
+	float ret = p * from_bits((uint32_t)((int)i + 127) << 23);
+	return base > 0.f ? ret : 0.f;
+}
+
+template<typename math>
+inline void mandelbrot_interpolation::linear_xy_kernel::prepare(float start_x, float start_y,
+	float goal_x, float goal_y, prepared & out)
+{
+	out.start_x = start_x;
+	out.start_y = start_y;
+	out.delta_x = goal_x - start_x;
+	out.delta_y = goal_y - start_y;
+}
+
+template<typename math>
+inline void mandelbrot_interpolation::linear_xy_kernel::finish(const prepared & p, float interpolation,
+	float & x, float & y)
+{
+	x = p.start_x + interpolation * p.delta_x;
+	y = p.start_y + interpolation * p.delta_y;
+}
+
+template<typename math>
+inline void mandelbrot_interpolation::linear_xy_kernel::apply(float start_x, float start_y,
+	float goal_x, float goal_y, float interpolation, float & x, float & y)
+{
+	prepared p;
+	prepare<math>(start_x, start_y, goal_x, goal_y, p);
+	finish<math>(p, interpolation, x, y);
+}
+
+template<bool short_way>
+template<typename math>
+inline void mandelbrot_interpolation::angle_and_abs_kernel<short_way>::prepare(float start_x, float start_y,
+	float goal_x, float goal_y, prepared & out)
+{
+	float start_abs = sqrtf(start_x * start_x + start_y * start_y);
+	float next_abs = sqrtf(goal_x * goal_x + goal_y * goal_y);
+	float start_angle = math::atan2(start_y, start_x);
+	float next_angle = math::atan2(goal_y, goal_x);
+	if (short_way) {
+		next_angle = next_angle - start_angle > viral_core::geo_constants::pi
+			? next_angle - viral_core::geo_constants::double_pi : next_angle;
+	}
+	out.start_abs = start_abs;
+	out.delta_abs = next_abs - start_abs;
+	out.start_angle = start_angle;
+	out.delta_angle = next_angle - start_angle;
+}
+
+template<bool short_way>
+template<typename math>
+inline void mandelbrot_interpolation::angle_and_abs_kernel<short_way>::finish(const prepared & p,
+	float interpolation, float & x, float & y)
+{
+	float curr_abs = interpolation * p.delta_abs + p.start_abs;
+	float curr_angle = interpolation * p.delta_angle + p.start_angle;
+	float sin_angle, cos_angle;
+	math::sincos(curr_angle, sin_angle, cos_angle);
+	x = curr_abs * cos_angle;
+	y = curr_abs * sin_angle;
+}
+
+template<bool short_way>
+template<typename math>
+inline void mandelbrot_interpolation::angle_and_abs_kernel<short_way>::apply(float start_x, float start_y,
+	float goal_x, float goal_y, float interpolation, float & x, float & y)
+{
+	prepared p;
+	prepare<math>(start_x, start_y, goal_x, goal_y, p);
+	finish<math>(p, interpolation, x, y);
+}
+
+template<typename math>
+inline void mandelbrot_interpolation::polynomial_kernel::prepare(float start_x, float start_y,
+	float goal_x, float goal_y, prepared & out)
+{
+	out.start_abs = sqrtf(start_x * start_x + start_y * start_y);
+	out.start_angle = math::atan2(start_y, start_x);
+	out.c_x = goal_x + start_y * start_y - start_x * start_x;//re_part of c
+	out.c_y = goal_y - 2.f * start_x * start_y;				//im_part of c
+}
+
+template<typename math>
+inline void mandelbrot_interpolation::polynomial_kernel::finish(const prepared & p, float interpolation,
+	float & x, float & y)
+{
+	float exponent = 2.f / (2.f - interpolation);
+	float absolute = math::pow(p.start_abs, exponent);
+	float argument = p.start_angle * exponent;
+	float sin_argument, cos_argument;
+	math::sincos(argument, sin_argument, cos_argument);
+	x = absolute * cos_argument;
+	y = absolute * sin_argument;
+	x += interpolation * p.c_x;
+	y += interpolation * p.c_y;
+}
+
+template<typename math>
+inline void mandelbrot_interpolation::polynomial_kernel::apply(float start_x, float start_y,
+	float goal_x, float goal_y, float interpolation, float & x, float & y)
+{
+	prepared p;
+	prepare<math>(start_x, start_y, goal_x, goal_y, p);
+	finish<math>(p, interpolation, x, y);
+}
+
+template<typename kernel, typename math>
+void mandelbrot_interpolation::interpolate_sweep(const float* start_x, const float* start_y, const float* goal_x,
+	const float* goal_y, const float* interpolations, int interpolation_count, int count,
+	float* const* x_out, float* const* y_out)
+{
+	typename kernel::prepared block[sweep_block];
+	for (int begin = 0; begin < count; begin += sweep_block) {
+		int size = count - begin < sweep_block ? count - begin : sweep_block;
+		for (int i = 0; i < size; i++)
+			kernel::template prepare<math>(start_x[begin + i], start_y[begin + i], goal_x[begin + i],
+				goal_y[begin + i], block[i]);
+
+		for (int k = 0; k < interpolation_count; k++) {
+			float interpolation = interpolations[k];
+			float* x = x_out[k] + begin;
+			float* y = y_out[k] + begin;
+			for (int i = 0; i < size; i++) kernel::template finish<math>(block[i], interpolation, x[i], y[i]);
+		}
+	}
+}
+
+inline float mandelbrot_interpolation::round_down(float value)
+{
+	float truncated = (float)(int)value;
+	float below = truncated - 1.f;
+	return truncated > value ? below : truncated;
+}
+
+inline uint32_t mandelbrot_interpolation::to_bits(float value)
+{
+	uint32_t ret;
+	memcpy(&ret, &value, sizeof(ret));
+	return ret;
+}
+
+inline float mandelbrot_interpolation::from_bits(uint32_t bits)
+{
+	float ret;
+	memcpy(&ret, &bits, sizeof(ret));
+	return ret;
+}
+
+#endif//#ifndef MANDELBROT_INTERPOLATION_HPP_INCLUDED
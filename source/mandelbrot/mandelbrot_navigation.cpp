@@ -0,0 +1,244 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_navigation.cpp
+*
+* implementation of \bref{mandelbrot_navigation}
+*
+************************************************************************/
+
+#include "mandelbrot_navigation.hpp"
+
+#include "mandelbrot_tile_cache.hpp"
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+
+using namespace viral_core;
+
+/**
+* levels the view may zoom to. the grid pixels of deeper levels no longer fit into
+* the 62 bits \bref{mandelbrot_tile_cache} keeps them in near the set
+*/
+//{
+static const int min_level = -8;
+static const int max_level = 54;
+//}
+
+/**
+* deep views keep their relative bounds within zoom_range levels of deep_level and their grid
+* pixels below max_deep_index, larger ones are folded into the center. the reference orbit
+* needs 128 bits below the pixels of view_exponent_ + level, arbitrary_precision holds 4096
+*/
+//{
+static const int deep_level = 0;
+static const int zoom_range = 32;
+static const long long max_deep_index = 1LL << 40;
+static const int max_deep_level = 3960;
+//}
+
+/** placement of the view of \bref{params}, after snapping it to the grid if it is not on it */
+static mandelbrot_tile_cache::placement grid_view(mandelbrot_generator::parameter_set& params)
+{
+	mandelbrot_tile_cache::placement ret;
+	if (!mandelbrot_tile_cache::place(params, ret)) {
+		mandelbrot_tile_cache::snap(params);
+		mandelbrot_tile_cache::place(params, ret);
+	}
+	return ret;
+}
+
+/** \bref{center} + grid pixel \bref{index} of \bref{level} * 2^-\bref{exponent}, exact */
+static arbitrary_precision shifted_center(const arbitrary_precision& center, long long index, int level,
+	int exponent)
+{
+	arbitrary_precision offset(mandelbrot_tile_cache::coordinate(index, level));
+	offset.set_limbs(arbitrary_precision::limbs_for_bits(exponent + level + 64));
+	return center + ldexp(offset, -exponent);
+}
+
+/** x / 2^shift rounded down, for negative x as well */
+static long long shift_floor(long long x, int shift)
+{
+	return x >= 0 ? x >> shift : -((-x - 1) >> shift) - 1;
+}
+
+/** grid pixel of the left or top edge after zooming by 2^steps around \bref{anchor} pixels into the view */
+static long long zoomed_edge(long long edge, float anchor, int steps)
+{
+	if (steps >= 0) {
+		long long factor = 1LL << steps;
+		return edge * factor + (long long)floor(anchor * (factor - 1.) + 0.5);
+	}
+	int shift = -steps;
+	long long factor = 1LL << shift;
+	long long remainder = edge - shift_floor(edge, shift) * factor;
+	return shift_floor(edge, shift) + (long long)floor((remainder + anchor) / factor - anchor + 0.5);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// mandelbrot_navigation
+//
+//////////////////////////////////////////////////////////////////////////
+
+mandelbrot_navigation::mandelbrot_navigation()
+{
+}
+
+mandelbrot_navigation::mandelbrot_navigation(const settings & s) :
+	settings_(s)
+{
+}
+
+void mandelbrot_navigation::pan(mandelbrot_generator::parameter_set & params, const vector2i & delta)
+{
+	mandelbrot_tile_cache::placement view = grid_view(params);
+	set_view(params, view.level, view.x - delta.x, view.y - delta.y);
+	normalize_view(params);
+}
+
+void mandelbrot_navigation::zoom(mandelbrot_generator::parameter_set & params, const vector2f & anchor, int steps)
+{
+	mandelbrot_tile_cache::placement view = grid_view(params);
+	/*beyond the levels of the grid the view continues as a deep one*/
+	bool deep = params.deep_view() || view.level + steps > max_level;
+	if (deep) fold_view(params, view.level, view.x, view.y);
+	int first = deep ? deep_level - zoom_range : min_level;
+	int last = deep ? std::min(deep_level + zoom_range, max_deep_level - params.view_exponent_) : max_level;
+	steps = std::max(first, std::min(last, view.level + steps)) - view.level;
+	if (steps == 0) return;
+
+	set_view(params, view.level + steps, zoomed_edge(view.x, anchor.x, steps), zoomed_edge(view.y, anchor.y, steps));
+	normalize_view(params);
+}
+
+bool mandelbrot_navigation::zoom_box(mandelbrot_generator::parameter_set & params, const vector2f & corner_a,
+	const vector2f & corner_b)
+{
+	float width = fabs(corner_b.x - corner_a.x);
+	float height = fabs(corner_b.y - corner_a.y);
+	if (width < 4.f && height < 4.f) return false;
+
+	mandelbrot_tile_cache::placement view = grid_view(params);
+	vector2i size = params.image_dimensions_;
+	double fitting_zoom = std::min(size.x / std::max(width, 1.f), size.y / std::max(height, 1.f));
+	int steps = (int)floor(log2(fitting_zoom));
+	bool deep = params.deep_view() || view.level + steps > max_level;
+	if (deep) fold_view(params, view.level, view.x, view.y);
+	int last = deep ? std::min(deep_level + zoom_range, max_deep_level - params.view_exponent_) : max_level;
+	steps = std::max(0, std::min(last, view.level + steps) - view.level);
+
+	/*the center of the box becomes the center of the image*/
+	double factor = ldexp(1., steps);
+	double center_x = (corner_a.x + corner_b.x) * 0.5;
+	double center_y = (corner_a.y + corner_b.y) * 0.5;
+	long long x = view.x * (1LL << steps) + (long long)floor(center_x * factor - size.x * 0.5 + 0.5);
+	long long y = view.y * (1LL << steps) + (long long)floor(center_y * factor - size.y * 0.5 + 0.5);
+	set_view(params, view.level + steps, x, y);
+	normalize_view(params);
+	return true;
+}
+
+void mandelbrot_navigation::input_received()
+{
+	last_input_ = std::chrono::steady_clock::now();
+	had_input_ = true;
+}
+
+bool mandelbrot_navigation::interacting() const
+{
+	if (!had_input_) return false;
+	std::chrono::duration<double, std::milli> since = std::chrono::steady_clock::now() - last_input_;
+	return since.count() < settings_.refine_delay_milliseconds_;
+}
+
+mandelbrot_generator::parameter_set mandelbrot_navigation::frame_parameters(
+	const mandelbrot_generator::parameter_set & full) const
+{
+	if (!interacting()) return full;
+
+	mandelbrot_generator::parameter_set ret = full;
+	ret.image_dimensions_ = vector2i(std::max(1, (full.image_dimensions_.x + scale_ - 1) / scale_),
+		std::max(1, (full.image_dimensions_.y + scale_ - 1) / scale_));
+	ret.max_iter_ = std::max(std::min(full.max_iter_, settings_.min_max_iter_), full.max_iter_ / iteration_divisor_);
+	ret.max_samples_ = 1;
+	return ret;
+}
+
+void mandelbrot_navigation::interactive_frame_rendered(double milliseconds, bool finished)
+{
+	double budget = settings_.frame_budget_milliseconds_;
+	if (!finished && milliseconds <= budget) return;
+
+	if (milliseconds > budget && scale_ == settings_.max_scale_) {
+		if (iteration_divisor_ < 1024) iteration_divisor_ *= 2;
+		return;
+	}
+	/*a finer step costs 4 times as much, iterations are restored before the resolution*/
+	if (milliseconds * 4. <= budget && iteration_divisor_ > 1) {
+		iteration_divisor_ /= 2;
+		return;
+	}
+	if (iteration_divisor_ > 1) return;
+
+	/*the time is proportional to the pixels, the smallest power of 2 that fits*/
+	double needed = scale_ * sqrt(milliseconds / budget);
+	int s = 1;
+	while (s < needed && s < settings_.max_scale_) s *= 2;
+	scale_ = s;
+}
+
+bool mandelbrot_navigation::abort_outdated(bool interactive, double milliseconds) const
+{
+	return !interactive || milliseconds > settings_.frame_budget_milliseconds_;
+}
+
+int mandelbrot_navigation::scale() const
+{
+	return scale_;
+}
+
+int mandelbrot_navigation::iteration_divisor() const
+{
+	return iteration_divisor_;
+}
+
+void mandelbrot_navigation::set_view(mandelbrot_generator::parameter_set & params, int level, long long x, long long y)
+{
+	vector2i size = params.image_dimensions_;
+	params.real_min_ = mandelbrot_tile_cache::coordinate(x, level);
+	params.real_max_ = mandelbrot_tile_cache::coordinate(x + size.x, level);
+	params.imaginary_min_ = mandelbrot_tile_cache::coordinate(y, level);
+	params.imaginary_max_ = mandelbrot_tile_cache::coordinate(y + size.y, level);
+}
+
+void mandelbrot_navigation::fold_view(mandelbrot_generator::parameter_set & params, int & level, long long & x,
+	long long & y)
+{
+	vector2i size = params.image_dimensions_;
+	long long center_x = x + size.x / 2;
+	long long center_y = y + size.y / 2;
+	params.center_re_ = shifted_center(params.center_re_, center_x, level, params.view_exponent_);
+	params.center_im_ = shifted_center(params.center_im_, center_y, level, params.view_exponent_);
+	params.view_exponent_ += level - deep_level;
+
+	level = deep_level;
+	x -= center_x;
+	y -= center_y;
+	set_view(params, level, x, y);
+}
+
+void mandelbrot_navigation::normalize_view(mandelbrot_generator::parameter_set & params)
+{
+	if (!params.deep_view()) return;
+
+	mandelbrot_tile_cache::placement view = grid_view(params);
+	if (params.view_exponent_ + view.level <= max_level) {
+		params = params.flat_view();
+		grid_view(params);
+		return;
+	}
+	if (std::max(llabs(view.x), llabs(view.y)) > max_deep_index) fold_view(params, view.level, view.x, view.y);
+}
@@ -0,0 +1,130 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_navigation.hpp
+*
+* Panning and zooming of the view of a
+* \bref{mandelbrot_generator::parameter_set} and the quality of the
+* frames rendered while the view changes
+*
+************************************************************************/
+
+#ifndef MANDELBROT_NAVIGATION_HPP_INCLUDED
+#define MANDELBROT_NAVIGATION_HPP_INCLUDED
+
+#include "mandelbrot_generator.hpp"
+
+#include <chrono>
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_navigation
+*
+* the view operations keep the view on the grid of \bref{mandelbrot_tile_cache}:
+* pans move it by whole pixels and zooms change the pixel spacing by powers
+* of 2, so every frame can reuse the tiles of the ones before. zooms beyond
+* the deepest level of the grid continue with a deep view, see
+* \bref{mandelbrot_generator::parameter_set::center_re_}, whose relative
+* bounds are kept on the grid the same way.
+*
+* while input arrives, \bref{frame_parameters} renders at a lower resolution
+* and, if that is not enough, with fewer iterations, chosen from the time the
+* previous interactive frames took so one fits into the frame budget. once
+* the input stopped for the refine delay, it returns the full parameters again.
+* positions are in pixels of the full image, (0, 0) being the top left corner
+* at real_min_ + imaginary_min_*i
+*
+************************************************************************/
+class mandelbrot_navigation {
+public:
+	/**
+	*************************************************************************
+	* @class mandelbrot_navigation::settings
+	* budget of the interactive frames
+	************************************************************************/
+	class settings {
+	public:
+		/** render time an interactive frame should not exceed */
+		double frame_budget_milliseconds_ = 16.;
+		/** time without input after which the view is rendered in full quality */
+		double refine_delay_milliseconds_ = 150.;
+		/** largest reduction of the resolution, a power of 2 */
+		int max_scale_ = 16;
+		/** max_iter_ is only reduced down to this */
+		int min_max_iter_ = 256;
+	};
+
+	mandelbrot_navigation();
+	explicit mandelbrot_navigation(const settings& s);
+
+	/** view operations, they snap the view to the grid first */
+	//{
+	/** moves the image content by \bref{delta} pixels, the view the opposite way */
+	static void pan(mandelbrot_generator::parameter_set& params, const viral_core::vector2i& delta);
+	/** zooms in by 2^\bref{steps}, out for negative steps, keeping the point under \bref{anchor} in place */
+	static void zoom(mandelbrot_generator::parameter_set& params, const viral_core::vector2f& anchor, int steps);
+	/**
+	* zooms in as far as the box between the two corners still fits into the image, centered on it.
+	* false for boxes too small to be meant as one
+	*/
+	static bool zoom_box(mandelbrot_generator::parameter_set& params, const viral_core::vector2f& corner_a,
+		const viral_core::vector2f& corner_b);
+	//}
+
+	/** marks that the user changed the view, \bref{interacting} until the refine delay passed */
+	void input_received();
+	bool interacting() const;
+
+	/**
+	* \bref{full} with the resolution and max_iter_ of an interactive frame while
+	* \bref{interacting}, \bref{full} itself otherwise
+	*/
+	mandelbrot_generator::parameter_set frame_parameters(const mandelbrot_generator::parameter_set& full) const;
+
+	/**
+	* adapts the quality of the next interactive frames to the time the last one took, it has to
+	* be rendered with the current quality. \bref{finished} is false for frames cancelled after
+	* \bref{milliseconds}, those only count once they exceeded the budget
+	*/
+	void interactive_frame_rendered(double milliseconds, bool finished);
+
+	/**
+	* true if a frame that is no longer wanted should be cancelled after running for
+	* \bref{milliseconds}. frames in full quality are cancelled right away, interactive ones
+	* only once they exceed the budget, so something is shown while the input goes on
+	*/
+	bool abort_outdated(bool interactive, double milliseconds) const;
+
+	/** current reduction of the resolution and of max_iter_ */
+	//{
+	int scale() const;
+	int iteration_divisor() const;
+	//}
+
+private:
+	settings settings_;
+	int scale_ = 1;
+	int iteration_divisor_ = 1;
+	std::chrono::steady_clock::time_point last_input_;
+	bool had_input_ = false;
+
+	/** top left grid pixel and level of a view, see \bref{mandelbrot_tile_cache::placement} */
+	static void set_view(mandelbrot_generator::parameter_set& params, int level, long long x, long long y);
+
+	/**
+	* makes the grid pixel nearest to the center of the view at \bref{level}, \bref{x}, \bref{y}
+	* the center of a deep view whose relative bounds are at the deep level again, the
+	* exponent takes the difference. \bref{level}, \bref{x} and \bref{y} become those of
+	* the relative bounds. a view that was not deep becomes one
+	*/
+	static void fold_view(mandelbrot_generator::parameter_set& params, int& level, long long& x, long long& y);
+
+	/**
+	* after a view operation: deep views that are shallow enough for the grid become
+	* flat again, far pans are folded into the center
+	*/
+	static void normalize_view(mandelbrot_generator::parameter_set& params);
+};
+
+#endif//#ifndef MANDELBROT_NAVIGATION_HPP_INCLUDED
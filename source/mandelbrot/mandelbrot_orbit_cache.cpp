@@ -0,0 +1,106 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_orbit_cache.cpp
+*
+* implementation of \bref{mandelbrot_orbit_cache}
+*
+************************************************************************/
+
+#include "mandelbrot_orbit_cache.hpp"
+
+using namespace viral_core;
+
+//////////////////////////////////////////////////////////////////////////
+//
+// mandelbrot_orbit_cache
+//
+//////////////////////////////////////////////////////////////////////////
+
+void mandelbrot_orbit_cache::clear()
+{
+	iterations_ = 0;
+	std::vector<float>().swap(float_x_);
+	std::vector<float>().swap(float_y_);
+	std::vector<double>().swap(double_x_);
+	std::vector<double>().swap(double_y_);
+	std::vector<double_double>().swap(double_double_x_);
+	std::vector<double_double>().swap(double_double_y_);
+}
+
+int mandelbrot_orbit_cache::cached_iterations() const
+{
+	return iterations_;
+}
+
+int mandelbrot_orbit_cache::begin_frame(const mandelbrot_generator::parameter_set & params,
+	mandelbrot_generator::precision precision, float *& x_plane, float *& y_plane)
+{
+	int ret = begin_frame(params, precision, float_x_, float_y_);
+	x_plane = float_x_.data();
+	y_plane = float_y_.data();
+	return ret;
+}
+
+int mandelbrot_orbit_cache::begin_frame(const mandelbrot_generator::parameter_set & params,
+	mandelbrot_generator::precision precision, double *& x_plane, double *& y_plane)
+{
+	int ret = begin_frame(params, precision, double_x_, double_y_);
+	x_plane = double_x_.data();
+	y_plane = double_y_.data();
+	return ret;
+}
+
+int mandelbrot_orbit_cache::begin_frame(const mandelbrot_generator::parameter_set & params,
+	mandelbrot_generator::precision precision, double_double *& x_plane, double_double *& y_plane)
+{
+	int ret = begin_frame(params, precision, double_double_x_, double_double_y_);
+	x_plane = double_double_x_.data();
+	y_plane = double_double_y_.data();
+	return ret;
+}
+
+void mandelbrot_orbit_cache::end_frame(const mandelbrot_generator::parameter_set & params, bool completed)
+{
+	if (completed) iterations_ = params.iterations_;
+	else clear();
+}
+
+template<typename scalar_type>
+int mandelbrot_orbit_cache::begin_frame(const mandelbrot_generator::parameter_set & params,
+	mandelbrot_generator::precision precision, std::vector<scalar_type>& x_plane, std::vector<scalar_type>& y_plane)
+{
+	/*z cannot be iterated backwards*/
+	if (iterations_ > 0 && same_view(params, precision) && params.iterations_ >= iterations_) return iterations_;
+
+	clear();
+	image_dimensions_ = params.image_dimensions_;
+	frame_dimensions_ = params.frame_size();
+	image_offset_ = params.image_offset_;
+	real_min_ = params.real_min_;
+	imaginary_min_ = params.imaginary_min_;
+	real_max_ = params.real_max_;
+	imaginary_max_ = params.imaginary_max_;
+	precision_ = precision;
+	formula_ = params.formula_;
+
+	size_t pixel_count = (size_t)params.image_dimensions_.x * params.image_dimensions_.y;
+	x_plane.resize(pixel_count);
+	y_plane.resize(pixel_count);
+	return 0;
+}
+
+bool mandelbrot_orbit_cache::same_view(const mandelbrot_generator::parameter_set & params,
+	mandelbrot_generator::precision precision) const
+{
+	return precision == precision_
+		&& params.formula_ == formula_
+		&& params.image_dimensions_.x == image_dimensions_.x
+		&& params.image_dimensions_.y == image_dimensions_.y
+		&& params.frame_size() == frame_dimensions_
+		&& params.image_offset_ == image_offset_
+		&& params.real_min_ == real_min_
+		&& params.imaginary_min_ == imaginary_min_
+		&& params.real_max_ == real_max_
+		&& params.imaginary_max_ == imaginary_max_;
+}
@@ -0,0 +1,91 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_orbit_cache.hpp
+*
+* Per pixel iteration state that is kept between the frames of an animation
+*
+************************************************************************/
+
+#ifndef MANDELBROT_ORBIT_CACHE_HPP_INCLUDED
+#define MANDELBROT_ORBIT_CACHE_HPP_INCLUDED
+
+#include "mandelbrot_generator.hpp"
+
+#include <vector>
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_orbit_cache
+*
+* stores z_n of every pixel of the last frame computed by
+* \bref{mandelbrot_generator::generate_mandelbrot_image_julia_value}, one
+* plane for the real and one for the imaginary parts. as long as the view
+* and the resolution stay the same and the iteration count does not
+* decrease, the next frame only advances z by the difference of the
+* iteration counts instead of starting again from c.
+* a cache must only be used by one generation at a time
+*
+************************************************************************/
+class mandelbrot_orbit_cache {
+public:
+	/** forgets the stored orbits and releases their memory */
+	void clear();
+
+	/** iteration count the stored z belong to, 0 if nothing is stored */
+	int cached_iterations() const;
+
+	/**
+	* called by the generator before a frame of \bref{params}, computed in
+	* \bref{precision}. points \bref{x_plane} and \bref{y_plane} to the planes,
+	* row by row as the image, and returns the iteration count they are at.
+	* if 0 is returned, the planes are uninitialized and z starts from c
+	*/
+	//{
+	int begin_frame(const mandelbrot_generator::parameter_set& params, mandelbrot_generator::precision precision,
+		float*& x_plane, float*& y_plane);
+	int begin_frame(const mandelbrot_generator::parameter_set& params, mandelbrot_generator::precision precision,
+		double*& x_plane, double*& y_plane);
+	int begin_frame(const mandelbrot_generator::parameter_set& params, mandelbrot_generator::precision precision,
+		double_double*& x_plane, double_double*& y_plane);
+	//}
+
+	/**
+	* called by the generator after a frame, the planes now hold z after
+	* params.iterations_ steps. an incomplete frame leaves them inconsistent,
+	* so the cache is cleared
+	*/
+	void end_frame(const mandelbrot_generator::parameter_set& params, bool completed);
+
+private:
+	/** view the planes were computed for */
+	//{
+	viral_core::vector2i image_dimensions_;
+	viral_core::vector2i frame_dimensions_;
+	viral_core::vector2i image_offset_;
+	double_double real_min_;
+	double_double imaginary_min_;
+	double_double real_max_;
+	double_double imaginary_max_;
+	mandelbrot_generator::precision precision_ = mandelbrot_generator::precision_automatic;
+	mandelbrot_formula formula_;
+	//}
+
+	int iterations_ = 0;
+
+	/** only the planes of the scalar type in use are allocated */
+	//{
+	std::vector<float> float_x_, float_y_;
+	std::vector<double> double_x_, double_y_;
+	std::vector<double_double> double_double_x_, double_double_y_;
+	//}
+
+	template<typename scalar_type>
+	int begin_frame(const mandelbrot_generator::parameter_set& params, mandelbrot_generator::precision precision,
+		std::vector<scalar_type>& x_plane, std::vector<scalar_type>& y_plane);
+
+	bool same_view(const mandelbrot_generator::parameter_set& params, mandelbrot_generator::precision precision) const;
+};
+
+#endif//#ifndef MANDELBROT_ORBIT_CACHE_HPP_INCLUDED
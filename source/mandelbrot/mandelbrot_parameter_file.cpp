@@ -0,0 +1,497 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_parameter_file.cpp
+*
+* implementation of \bref{mandelbrot_parameter_file}
+*
+************************************************************************/
+
+#include "mandelbrot_parameter_file.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+using namespace viral_core;
+
+/** names of the enum values in parameter files, in the order of the enums */
+//{
+static const char* const simd_level_names[] = { "automatic", "scalar", "avx2", "avx512" };
+static const char* const precision_names[] = { "automatic", "float", "double", "double_double", "perturbation" };
+static const char* const render_mode_names[] = { "brute_force", "subdivision" };
+static const char* const coloring_names[] = { "escape_time", "smooth", "distance" };
+static const char* const visualization_names[] = { "julia_iter", "julia_value" };
+static const char* const formula_names[] = { "mandelbrot", "multibrot", "burning_ship", "tricorn" };
+//}
+
+/**
+* checks the conversions of an output pattern: %% is a percent sign and at most one %d,
+* %Nd or %0Nd with a width N below 10 is the frame index. false on any other conversion
+*/
+static bool valid_path_pattern(const std::string& pattern)
+{
+	int placeholders = 0;
+	for (size_t i = 0; i < pattern.size(); i++) {
+		if (pattern[i] != '%') continue;
+		if (i + 1 < pattern.size() && pattern[i + 1] == '%') {
+			i++;
+			continue;
+		}
+		size_t end = i + 1;
+		if (end < pattern.size() && pattern[end] == '0') end++;
+		if (end < pattern.size() && pattern[end] >= '1' && pattern[end] <= '9') end++;
+		if (end >= pattern.size() || pattern[end] != 'd') return false;
+		placeholders++;
+		i = end;
+	}
+	return placeholders <= 1;
+}
+
+/**
+* \bref{pattern} with its frame index placeholder replaced by \bref{index}, the pattern
+* is never used as a printf format. invalid patterns are returned unchanged
+*/
+static std::string format_path(const std::string& pattern, int index)
+{
+	if (!valid_path_pattern(pattern)) return pattern;
+
+	std::string ret;
+	for (size_t i = 0; i < pattern.size(); i++) {
+		if (pattern[i] != '%') {
+			ret += pattern[i];
+			continue;
+		}
+		if (pattern[i + 1] == '%') {
+			ret += '%';
+			i++;
+			continue;
+		}
+		bool zero = pattern[i + 1] == '0';
+		size_t width_at = zero ? i + 2 : i + 1;
+		int width = pattern[width_at] == 'd' ? 0 : pattern[width_at] - '0';
+		std::string digits = std::to_string(index);
+		if ((int)digits.size() < width) {
+			size_t padding = width - digits.size();
+			/*the sign goes in front of the zeros*/
+			if (zero && index < 0) digits.insert(1, padding, '0');
+			else digits.insert(0, padding, zero ? '0' : ' ');
+		}
+		ret += digits;
+		i = width == 0 ? width_at : width_at + 1;
+	}
+	return ret;
+}
+
+static std::string trim(const std::string& s)
+{
+	size_t begin = s.find_first_not_of(" \t\r\n");
+	if (begin == std::string::npos) return std::string();
+	size_t end = s.find_last_not_of(" \t\r\n");
+	return s.substr(begin, end - begin + 1);
+}
+
+template<int count>
+static bool parse_name(const std::string& value, const char* const (&names)[count], int& index_out)
+{
+	for (int i = 0; i < count; i++) {
+		if (value == names[i]) {
+			index_out = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool parse_int(const std::string& value, int& out)
+{
+	char* end;
+	long parsed = strtol(value.c_str(), &end, 10);
+	if (end == value.c_str() || *end != 0) return false;
+	out = (int)parsed;
+	return true;
+}
+
+static bool parse_float(const std::string& value, float& out)
+{
+	char* end;
+	double parsed = strtod(value.c_str(), &end);
+	if (end == value.c_str() || *end != 0) return false;
+	out = (float)parsed;
+	return true;
+}
+
+static bool parse_bool(const std::string& value, bool& out)
+{
+	if (value == "true" || value == "1") out = true;
+	else if (value == "false" || value == "0") out = false;
+	else return false;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// mandelbrot_parameter_file
+//
+//////////////////////////////////////////////////////////////////////////
+
+bool mandelbrot_parameter_file::parse(const std::string & text, std::vector<frame>& frames_out, std::string & error_out)
+{
+	frame defaults;
+	std::vector<frame> frames;
+	frame* current = &defaults;
+
+	std::istringstream lines(text);
+	std::string line;
+	for (int line_number = 1; std::getline(lines, line); line_number++) {
+		line = trim(line.substr(0, line.find_first_of("#;")));
+		if (line.empty()) continue;
+
+		if (line == "[frame]") {
+			frames.push_back(defaults);
+			current = &frames.back();
+			continue;
+		}
+
+		size_t equals = line.find('=');
+		if (equals == std::string::npos || !apply(trim(line.substr(0, equals)), trim(line.substr(equals + 1)), *current)) {
+			error_out = "line " + std::to_string(line_number) + ": invalid entry '" + line + "'";
+			return false;
+		}
+	}
+
+	if (frames.empty()) frames.push_back(defaults);
+	for (size_t i = 0; i < frames.size(); i++) {
+		const mandelbrot_generator::parameter_set& p = frames[i].params_;
+		if (frames[i].visualization_ == visualization_julia_value && p.interpolate_ && !p.interpolation_method_) {
+			error_out = "frame " + std::to_string(i) + ": interpolate requires an interpolation_method";
+			return false;
+		}
+		if (p.image_dimensions_.x <= 0 || p.image_dimensions_.y <= 0) {
+			error_out = "frame " + std::to_string(i) + ": image_width and image_height are required";
+			return false;
+		}
+		vector2i frame = p.frame_size();
+		if (p.image_offset_.x + p.image_dimensions_.x > frame.x || p.image_offset_.y + p.image_dimensions_.y > frame.y) {
+			error_out = "frame " + std::to_string(i) + ": the image does not lie within frame_width and frame_height";
+			return false;
+		}
+	}
+	frames_out.swap(frames);
+	return true;
+}
+
+bool mandelbrot_parameter_file::read(const std::string & path, std::vector<frame>& frames_out, std::string & error_out)
+{
+	std::ifstream in(path.c_str(), std::ios::binary);
+	if (!in) {
+		error_out = "could not open " + path;
+		return false;
+	}
+	std::stringstream text;
+	text << in.rdbuf();
+	return parse(text.str(), frames_out, error_out);
+}
+
+std::string mandelbrot_parameter_file::write(const frame & f)
+{
+	const mandelbrot_generator::parameter_set& p = f.params_;
+	const char* method = "none";
+	if (p.interpolation_method_ == &mandelbrot_generator::polynomial) method = "polynomial";
+	else if (p.interpolation_method_ == &mandelbrot_generator::linear_angle_and_abs) method = "linear_angle_and_abs";
+	else if (p.interpolation_method_ == &mandelbrot_generator::linear_short_angle_and_abs) method = "linear_short_angle_and_abs";
+	else if (p.interpolation_method_ == &mandelbrot_generator::linear_xy) method = "linear_xy";
+
+	std::ostringstream out;
+	out.precision(9);
+	out << "visualization = " << visualization_names[f.visualization_] << "\n"
+		<< "output = " << f.output_ << "\n"
+		<< "image_width = " << p.image_dimensions_.x << "\n"
+		<< "image_height = " << p.image_dimensions_.y << "\n"
+		<< "hsv_color_offset = " << p.hsv_color_offset_ << "\n"
+		<< "real_min = " << format_double_double(p.real_min_) << "\n"
+		<< "imaginary_min = " << format_double_double(p.imaginary_min_) << "\n"
+		<< "real_max = " << format_double_double(p.real_max_) << "\n"
+		<< "imaginary_max = " << format_double_double(p.imaginary_max_) << "\n"
+		<< "max_threshold = " << p.max_threshold_ << "\n"
+		<< "max_iter = " << p.max_iter_ << "\n"
+		<< "iterations = " << p.iterations_ << "\n"
+		<< "interpolation = " << p.interpolation_ << "\n"
+		<< "interpolate = " << (p.interpolate_ ? "true" : "false") << "\n"
+		<< "interpolation_method = " << method << "\n"
+		<< "fast_math = " << (p.fast_math_ ? "true" : "false") << "\n"
+		<< "worker_count = " << p.worker_count_ << "\n"
+		<< "simd_level = " << simd_level_names[p.simd_level_] << "\n"
+		<< "precision = " << precision_names[p.precision_] << "\n"
+		<< "formula = " << formula_names[p.formula_.family_] << "\n"
+		<< "power = " << p.formula_.power_ << "\n"
+		<< "julia = " << (p.formula_.julia_ ? "true" : "false") << "\n"
+		<< "julia_re = " << format_double_double(p.formula_.julia_re_) << "\n"
+		<< "julia_im = " << format_double_double(p.formula_.julia_im_) << "\n"
+		<< "interior_check = " << (p.interior_check_ ? "true" : "false") << "\n"
+		<< "periodicity_check = " << (p.periodicity_check_ ? "true" : "false") << "\n"
+		<< "render_mode = " << render_mode_names[p.render_mode_] << "\n"
+		<< "coloring = " << coloring_names[p.coloring_] << "\n"
+		<< "max_samples = " << p.max_samples_ << "\n"
+		<< "supersample_threshold = " << p.supersample_threshold_ << "\n";
+	if (p.deep_view()) {
+		out << "center_re = " << format_arbitrary_precision(p.center_re_) << "\n"
+			<< "center_im = " << format_arbitrary_precision(p.center_im_) << "\n"
+			<< "view_exponent = " << p.view_exponent_ << "\n";
+	}
+	if (p.frame_dimensions_.x > 0 && p.frame_dimensions_.y > 0) {
+		out << "frame_width = " << p.frame_dimensions_.x << "\n"
+			<< "frame_height = " << p.frame_dimensions_.y << "\n"
+			<< "image_offset_x = " << p.image_offset_.x << "\n"
+			<< "image_offset_y = " << p.image_offset_.y << "\n";
+	}
+	if (!f.raw_output_.empty()) out << "raw_output = " << f.raw_output_ << "\n";
+	return out.str();
+}
+
+std::string mandelbrot_parameter_file::output_path(const frame & f, int index)
+{
+	return format_path(f.output_, index);
+}
+
+std::string mandelbrot_parameter_file::raw_output_path(const frame & f, int index)
+{
+	return format_path(f.raw_output_, index);
+}
+
+bool mandelbrot_parameter_file::parse_double_double(const std::string & text, double_double & value_out)
+{
+	const char* c = text.c_str();
+	bool negative = *c == '-';
+	if (*c == '-' || *c == '+') c++;
+
+	/*all digits as one integer, exact up to 2^106*/
+	double_double mantissa = 0.;
+	int exponent = 0;
+	int digits = 0;
+	bool fraction = false;
+	for (;; c++) {
+		if (*c >= '0' && *c <= '9') {
+			mantissa = mantissa * 10. + (double)(*c - '0');
+			if (fraction) exponent--;
+			digits++;
+		}
+		else if (*c == '.' && !fraction) fraction = true;
+		else break;
+	}
+	if (digits == 0) return false;
+
+	if (*c == 'e' || *c == 'E') {
+		char* end;
+		exponent += (int)strtol(c + 1, &end, 10);
+		if (end == c + 1) return false;
+		c = end;
+	}
+	if (*c != 0) return false;
+
+	double_double scale = 1.;
+	for (int i = 0; i < abs(exponent); i++) scale *= 10.;
+	value_out = exponent < 0 ? mantissa / scale : mantissa * scale;
+	if (negative) value_out = -value_out;
+	return true;
+}
+
+std::string mandelbrot_parameter_file::format_double_double(const double_double & value)
+{
+	if (value.hi == 0.) return "0";
+
+	std::string ret = value.hi < 0. ? "-" : "";
+	double_double v = abs(value);
+
+	/*scale into [1, 10)*/
+	int exponent = (int)floor(log10(v.hi));
+	double_double scale = 1.;
+	for (int i = 0; i < abs(exponent); i++) scale *= 10.;
+	v = exponent < 0 ? v * scale : v / scale;
+	if (v.hi >= 10.) {
+		v /= 10.;
+		exponent++;
+	}
+	else if (v.hi < 1.) {
+		v *= 10.;
+		exponent--;
+	}
+
+	for (int i = 0; i < 32; i++) {
+		int digit = (int)floor(v.hi);
+		if (v - (double)digit < 0.) digit--;
+		digit = digit < 0 ? 0 : (digit > 9 ? 9 : digit);
+		ret += (char)('0' + digit);
+		if (i == 0) ret += '.';
+		v = (v - (double)digit) * 10.;
+	}
+
+	/*trailing zeros carry no information*/
+	ret.erase(ret.find_last_not_of('0') + 1);
+	if (ret.back() == '.') ret.pop_back();
+	if (exponent != 0) ret += "e" + std::to_string(exponent);
+	return ret;
+}
+
+bool mandelbrot_parameter_file::parse_arbitrary_precision(const std::string & text, arbitrary_precision & value_out)
+{
+	const char* c = text.c_str();
+	bool negative = *c == '-';
+	if (*c == '-' || *c == '+') c++;
+
+	const char* integer = c;
+	while (*c >= '0' && *c <= '9') c++;
+	const char* integer_end = c;
+	const char* fraction = c;
+	if (*c == '.') {
+		fraction = ++c;
+		while (*c >= '0' && *c <= '9') c++;
+	}
+	const char* fraction_end = c;
+	if (*c != 0 || (integer == integer_end && fraction == fraction_end)) return false;
+
+	/*
+	* the integer digits by horner's scheme, the fraction ones from the last one on, each dividing
+	* by 10. two more limbs than the digits resolve keep the truncations of the divisions below
+	* the rounding to the precision. the digits format_arbitrary_precision writes resolve as
+	* many limbs as the value it formatted had, which gets it back
+	*/
+	arbitrary_precision ten(10.);
+	arbitrary_precision whole;
+	for (const char* digit = integer; digit != integer_end; digit++)
+		whole = whole * ten + arbitrary_precision((double)(*digit - '0'));
+	int limbs = arbitrary_precision::limbs_for_bits(std::max(1, (int)ceil((fraction_end - fraction) * 3.3219281) - 5));
+	arbitrary_precision part;
+	part.set_limbs(limbs + 2);
+	for (const char* digit = fraction_end; digit != fraction; digit--)
+		part = (part + arbitrary_precision((double)(digit[-1] - '0'))) / 10u;
+	arbitrary_precision half(1.);
+	half.set_limbs(limbs + 2);
+	part = part + ldexp(half, -32 * limbs - 1);
+	part.set_limbs(limbs);
+
+	value_out = whole + part;
+	if (negative) value_out = -value_out;
+	return true;
+}
+
+std::string mandelbrot_parameter_file::format_arbitrary_precision(const arbitrary_precision & value)
+{
+	std::string ret = value.negative() ? "-" : "";
+	arbitrary_precision v = value.negative() ? -value : value;
+
+	/*each digit is the integer part of the rest, corrected if to_double rounded it up*/
+	double whole = floor(v.to_double());
+	if (v < arbitrary_precision(whole)) whole -= 1.;
+	ret += std::to_string((long long)whole);
+	v = v - arbitrary_precision(whole);
+
+	/*32 bits are 9.63 digits, half a digit more keeps the truncation below half a bit*/
+	int digits = (int)ceil(value.limbs() * 9.6329598 + 0.5);
+	arbitrary_precision ten(10.);
+	std::string fraction;
+	for (int i = 0; i < digits && !v.zero(); i++) {
+		v = v * ten;
+		int digit = (int)floor(v.to_double());
+		if (v < arbitrary_precision((double)digit)) digit--;
+		digit = digit < 0 ? 0 : (digit > 9 ? 9 : digit);
+		fraction += (char)('0' + digit);
+		v = v - arbitrary_precision((double)digit);
+	}
+	if (!fraction.empty()) ret += "." + fraction;
+	return ret;
+}
+
+bool mandelbrot_parameter_file::apply(const std::string & key, const std::string & value, frame & f)
+{
+	mandelbrot_generator::parameter_set& p = f.params_;
+	int index;
+
+	if (key == "visualization") {
+		if (!parse_name(value, visualization_names, index)) return false;
+		f.visualization_ = (visualization)index;
+		return true;
+	}
+	if (key == "output") {
+		f.output_ = value;
+		return !value.empty() && valid_path_pattern(value);
+	}
+	if (key == "raw_output") {
+		f.raw_output_ = value;
+		return valid_path_pattern(value);
+	}
+	if (key == "image_width") return parse_int(value, p.image_dimensions_.x) && p.image_dimensions_.x > 0;
+	if (key == "image_height") return parse_int(value, p.image_dimensions_.y) && p.image_dimensions_.y > 0;
+	if (key == "frame_width") return parse_int(value, p.frame_dimensions_.x) && p.frame_dimensions_.x > 0;
+	if (key == "frame_height") return parse_int(value, p.frame_dimensions_.y) && p.frame_dimensions_.y > 0;
+	if (key == "image_offset_x") return parse_int(value, p.image_offset_.x) && p.image_offset_.x >= 0;
+	if (key == "image_offset_y") return parse_int(value, p.image_offset_.y) && p.image_offset_.y >= 0;
+	if (key == "hsv_color_offset") return parse_float(value, p.hsv_color_offset_);
+	if (key == "real_min") return parse_double_double(value, p.real_min_);
+	if (key == "imaginary_min") return parse_double_double(value, p.imaginary_min_);
+	if (key == "real_max") return parse_double_double(value, p.real_max_);
+	if (key == "imaginary_max") return parse_double_double(value, p.imaginary_max_);
+	if (key == "center_re") return parse_arbitrary_precision(value, p.center_re_);
+	if (key == "center_im") return parse_arbitrary_precision(value, p.center_im_);
+	if (key == "view_exponent") return parse_int(value, p.view_exponent_) && p.view_exponent_ >= 0;
+	if (key == "max_threshold") return parse_float(value, p.max_threshold_);
+	if (key == "max_iter") return parse_int(value, p.max_iter_) && p.max_iter_ >= 0;
+	if (key == "iterations") return parse_int(value, p.iterations_) && p.iterations_ >= 0;
+	if (key == "interpolation") return parse_float(value, p.interpolation_);
+	if (key == "interpolate") return parse_bool(value, p.interpolate_);
+	if (key == "interpolation_method") {
+		if (value == "polynomial") p.interpolation_method_ = &mandelbrot_generator::polynomial;
+		else if (value == "linear_angle_and_abs") p.interpolation_method_ = &mandelbrot_generator::linear_angle_and_abs;
+		else if (value == "linear_short_angle_and_abs") p.interpolation_method_ = &mandelbrot_generator::linear_short_angle_and_abs;
+		else if (value == "linear_xy") p.interpolation_method_ = &mandelbrot_generator::linear_xy;
+		else if (value == "none") p.interpolation_method_ = 0;
+		else return false;
+		return true;
+	}
+	if (key == "fast_math") return parse_bool(value, p.fast_math_);
+	if (key == "worker_count") return parse_int(value, p.worker_count_);
+	if (key == "simd_level") {
+		if (!parse_name(value, simd_level_names, index)) return false;
+		p.simd_level_ = (mandelbrot_simd::simd_level)index;
+		return true;
+	}
+	if (key == "precision") {
+		if (!parse_name(value, precision_names, index)) return false;
+		p.precision_ = (mandelbrot_generator::precision)index;
+		return true;
+	}
+	if (key == "formula") {
+		if (!parse_name(value, formula_names, index)) return false;
+		p.formula_.family_ = (mandelbrot_formula::family)index;
+		return true;
+	}
+	if (key == "power") {
+		return parse_int(value, p.formula_.power_)
+			&& p.formula_.power_ >= mandelbrot_formula::min_power && p.formula_.power_ <= mandelbrot_formula::max_power;
+	}
+	if (key == "julia") return parse_bool(value, p.formula_.julia_);
+	if (key == "julia_re" || key == "julia_im") {
+		double_double parsed;
+		if (!parse_double_double(value, parsed)) return false;
+		(key == "julia_re" ? p.formula_.julia_re_ : p.formula_.julia_im_) = parsed.hi;
+		return true;
+	}
+	if (key == "interior_check") return parse_bool(value, p.interior_check_);
+	if (key == "periodicity_check") return parse_bool(value, p.periodicity_check_);
+	if (key == "render_mode") {
+		if (!parse_name(value, render_mode_names, index)) return false;
+		p.render_mode_ = (mandelbrot_generator::render_mode)index;
+		return true;
+	}
+	if (key == "max_samples") return parse_int(value, p.max_samples_) && p.max_samples_ >= 1;
+	if (key == "supersample_threshold") return parse_float(value, p.supersample_threshold_);
+	if (key == "coloring") {
+		if (!parse_name(value, coloring_names, index)) return false;
+		p.coloring_ = (mandelbrot_generator::escape_coloring)index;
+		return true;
+	}
+	return false;
+}
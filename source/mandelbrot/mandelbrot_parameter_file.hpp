@@ -0,0 +1,108 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_parameter_file.hpp
+*
+* Text representation of \bref{mandelbrot_generator::parameter_set}
+* for batch rendering
+*
+************************************************************************/
+
+#ifndef MANDELBROT_PARAMETER_FILE_HPP_INCLUDED
+#define MANDELBROT_PARAMETER_FILE_HPP_INCLUDED
+
+#include "mandelbrot_generator.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_parameter_file
+*
+* reads and writes ini style parameter files:
+*
+*	# keys before the first section apply to every frame
+*	image_width = 1920
+*	image_height = 1080
+*	max_iter = 2000
+*	output = frame_%04d.png
+*
+*	[frame]
+*	real_min = -0.7436438870371587
+*	...
+*
+* every [frame] section starts from the keys at the top of the file, a file
+* without sections describes a single frame. the keys are the names of the
+* members of \bref{mandelbrot_generator::parameter_set} without the trailing
+* underscore, image_dimensions_ is split into image_width and image_height,
+* frame_dimensions_ and image_offset_ of a part of a frame into frame_width,
+* frame_height, image_offset_x and image_offset_y, and the members of
+* formula_ are the keys formula, power, julia, julia_re and julia_im.
+* coordinates are parsed in double_double precision, the center_re and
+* center_im of deep views with all the digits they are written with
+*
+************************************************************************/
+class mandelbrot_parameter_file {
+public:
+	/** which generator of \bref{mandelbrot_generator} renders a frame */
+	enum visualization {
+		visualization_julia_iter,
+		visualization_julia_value
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_parameter_file::frame
+	* one image to render
+	************************************************************************/
+	class frame {
+	public:
+		mandelbrot_generator::parameter_set params_;
+		visualization visualization_ = visualization_julia_iter;
+		/** target file, a placeholder %d or %0Nd is replaced by the frame index, %% is a percent sign */
+		std::string output_ = "mandelbrot_%04d.png";
+		/** if not empty, the uncolored planes are written there as \bref{mandelbrot_raw_file}, same pattern */
+		std::string raw_output_;
+	};
+
+	/**
+	* parses \bref{text}, returns false and a message with the line number
+	* in \bref{error_out} on unknown keys or malformed values
+	*/
+	static bool parse(const std::string& text, std::vector<frame>& frames_out, std::string& error_out);
+
+	/** reads and parses the file at \bref{path} */
+	static bool read(const std::string& path, std::vector<frame>& frames_out, std::string& error_out);
+
+	/** all keys of \bref{f} as the top level of a parameter file */
+	static std::string write(const frame& f);
+
+	/** output paths of the frame with the given index */
+	//{
+	static std::string output_path(const frame& f, int index);
+	static std::string raw_output_path(const frame& f, int index);
+	//}
+
+	/** decimal conversion of double_double, exact to about 32 digits */
+	//{
+	static bool parse_double_double(const std::string& text, double_double& value_out);
+	static std::string format_double_double(const double_double& value);
+	//}
+
+	/**
+	* decimal conversion of arbitrary_precision without an exponent. parsing keeps as many
+	* bits as the digits resolve, formatting writes as many digits as the limbs resolve
+	*/
+	//{
+	static bool parse_arbitrary_precision(const std::string& text, arbitrary_precision& value_out);
+	static std::string format_arbitrary_precision(const arbitrary_precision& value);
+	//}
+
+private:
+	/** applies one key, returns false if the key is unknown or the value malformed */
+	static bool apply(const std::string& key, const std::string& value, frame& f);
+};
+
+#endif//#ifndef MANDELBROT_PARAMETER_FILE_HPP_INCLUDED
@@ -0,0 +1,350 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_perturbation.cpp
+*
+* implementation of \bref{mandelbrot_perturbation}
+*
+************************************************************************/
+
+#include "mandelbrot_perturbation.hpp"
+#include "mandelbrot_simd.hpp"
+
+#include <math.h>
+#include <algorithm>
+
+/** rounded to float_exp, which keeps the exponent of values below the range of double */
+//{
+static float_exp to_float_exp(const double_double& value)
+{
+	return float_exp(value.to_double());
+}
+
+static float_exp to_float_exp(const arbitrary_precision& value)
+{
+	if (value.zero()) return float_exp();
+	int exponent = value.exponent() + 1;
+	return float_exp(value.to_double(-exponent), exponent);
+}
+//}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// mandelbrot_perturbation
+//
+//////////////////////////////////////////////////////////////////////////
+
+const double mandelbrot_perturbation::series_tolerance = 1e-12;
+const int mandelbrot_perturbation::max_double_exponent;
+const int mandelbrot_perturbation::handover_exponent;
+
+mandelbrot_perturbation::mandelbrot_perturbation(const double_double & center_re, const double_double & center_im,
+	double radius, float max_threshold, int max_iter)
+	:
+	max_threshold_(max_threshold),
+	max_iter_(max_iter)
+{
+	compute_reference_orbit(center_re, center_im);
+	compute_series(radius);
+}
+
+mandelbrot_perturbation::mandelbrot_perturbation(const arbitrary_precision & center_re,
+	const arbitrary_precision & center_im, double radius, int exponent, float max_threshold, int max_iter)
+	:
+	exponent_(exponent),
+	unit_(ldexp(1., -exponent)),
+	min_d_square_(exponent > max_double_exponent ? ldexp(1., -1000) : 0.),
+	max_threshold_(max_threshold),
+	max_iter_(max_iter)
+{
+	/*the orbit resolves 128 bits below the unit, the products of the iteration keep that precision*/
+	int limbs = arbitrary_precision::limbs_for_bits(exponent + 128);
+	arbitrary_precision re = center_re;
+	arbitrary_precision im = center_im;
+	re.set_limbs(limbs);
+	im.set_limbs(limbs);
+	compute_reference_orbit(re, im);
+	compute_series(radius);
+}
+
+void mandelbrot_perturbation::escape_time(const double * delta_re, const double * delta_im, int count,
+	int * remain_iter_out, float * x_out, float * y_out,
+	float * distance_out, double distance_scale) const
+{
+	for (int i = 0; i < count; i++) {
+		double x, y, dz_re, dz_im;
+		remain_iter_out[i] = exponent_ > max_double_exponent
+			? remain_iter_deep(delta_re[i], delta_im[i], x, y, distance_out != 0, dz_re, dz_im)
+			: remain_iter(delta_re[i], delta_im[i], x, y, distance_out != 0, dz_re, dz_im);
+		if (x_out) {
+			x_out[i] = (float)x;
+			y_out[i] = (float)y;
+		}
+		if (distance_out) {
+			distance_out[i] = remain_iter_out[i] > 0
+				? mandelbrot_simd::exterior_distance(x, y, dz_re, dz_im, distance_scale)
+				: 0.f;
+		}
+	}
+}
+
+int mandelbrot_perturbation::skipped_iterations() const
+{
+	return series_index_ - 1;
+}
+
+template<typename high_precision>
+void mandelbrot_perturbation::compute_reference_orbit(const high_precision & center_re, const high_precision & center_im)
+{
+	bool keep_exponents = exponent_ > max_double_exponent;
+	z_re_.clear();
+	z_im_.clear();
+	z_re_.reserve(max_iter_ + 2);
+	z_im_.reserve(max_iter_ + 2);
+	z_re_.push_back(0.);
+	z_im_.push_back(0.);
+	if (keep_exponents) {
+		z_exp_re_.assign(1, float_exp());
+		z_exp_im_.assign(1, float_exp());
+	}
+
+	high_precision x = center_re;
+	high_precision y = center_im;
+	const high_precision threshold((double)max_threshold_);
+	/*Z_1 = center, then as many steps as the slowest pixel can take*/
+	for (int n = 1; n <= max_iter_ + 1; n++) {
+		z_re_.push_back(to_double(x));
+		z_im_.push_back(to_double(y));
+		if (keep_exponents) {
+			z_exp_re_.push_back(to_float_exp(x));
+			z_exp_im_.push_back(to_float_exp(y));
+		}
+
+		high_precision xx = x * x;
+		high_precision yy = y * y;
+		if (xx + yy > threshold) break;
+
+		high_precision xy = x * y;
+		x = xx - yy + center_re;
+		y = xy + xy + center_im;
+	}
+}
+
+void mandelbrot_perturbation::compute_series(double radius)
+{
+	/*
+	* the coefficients are scaled to the units of the deltas, A by the unit, B by its square
+	* and C by its cube, so the checks compare them with the radius in units
+	*/
+	float_exp r = radius;
+	float_exp r2 = r * r;
+	float_exp r3 = r2 * r;
+	float_exp tolerance = series_tolerance;
+	float_exp escape_radius = sqrt((double)max_threshold_);
+	float_exp unit(1., -exponent_);
+	int last = (int)z_re_.size() - 1;
+
+	float_exp a_re = unit, a_im;
+	float_exp b_re, b_im;
+	float_exp c_re, c_im;
+
+	/*d_1 = dc, i.e. A_1 = 1, B_1 = C_1 = 0*/
+	for (int n = 1; n + 1 < last && n < max_iter_; n++) {
+		float_exp zr2 = ldexp(reference_re(n), 1);
+		float_exp zi2 = ldexp(reference_im(n), 1);
+
+		/*A' = 2 Z A + 1, B' = 2 Z B + A^2, C' = 2 Z C + 2 A B*/
+		float_exp na_re = zr2 * a_re - zi2 * a_im + unit;
+		float_exp na_im = zr2 * a_im + zi2 * a_re;
+		float_exp nb_re = zr2 * b_re - zi2 * b_im + (a_re * a_re - a_im * a_im);
+		float_exp nb_im = zr2 * b_im + zi2 * b_re + ldexp(a_re * a_im, 1);
+		float_exp nc_re = zr2 * c_re - zi2 * c_im + ldexp(a_re * b_re - a_im * b_im, 1);
+		float_exp nc_im = zr2 * c_im + zi2 * c_re + ldexp(a_re * b_im + a_im * b_re, 1);
+
+		float_exp abs_a = sqrt(na_re * na_re + na_im * na_im);
+		float_exp abs_b = sqrt(nb_re * nb_re + nb_im * nb_im);
+		float_exp abs_c = sqrt(nc_re * nc_re + nc_im * nc_im);
+
+		/*the truncated cubic term has to be negligible against the linear one*/
+		if (!(abs_c * r2 <= tolerance * abs_a)) break;
+
+		/*no pixel may escape within the skipped iterations*/
+		float_exp abs_z = sqrt(z_re_[n + 1] * z_re_[n + 1] + z_im_[n + 1] * z_im_[n + 1]);
+		if (!(abs_z + abs_a * r + abs_b * r2 + abs_c * r3 < escape_radius)) break;
+
+		a_re = na_re; a_im = na_im;
+		b_re = nb_re; b_im = nb_im;
+		c_re = nc_re; c_im = nc_im;
+		series_index_ = n + 1;
+	}
+
+	a_exp_re_ = a_re; a_exp_im_ = a_im;
+	b_exp_re_ = b_re; b_exp_im_ = b_im;
+	c_exp_re_ = c_re; c_exp_im_ = c_im;
+	a_re_ = to_double(a_re); a_im_ = to_double(a_im);
+	b_re_ = to_double(b_re); b_im_ = to_double(b_im);
+	c_re_ = to_double(c_re); c_im_ = to_double(c_im);
+}
+
+float_exp mandelbrot_perturbation::reference_re(int n) const
+{
+	return z_exp_re_.empty() ? float_exp(z_re_[n]) : z_exp_re_[n];
+}
+
+float_exp mandelbrot_perturbation::reference_im(int n) const
+{
+	return z_exp_im_.empty() ? float_exp(z_im_[n]) : z_exp_im_[n];
+}
+
+int mandelbrot_perturbation::remain_iter(double delta_re, double delta_im, double& x_out, double& y_out,
+	bool keep_derivative, double& dz_re_out, double& dz_im_out) const
+{
+	/*d = A dc + B dc^2 + C dc^3*/
+	double dc2_re = delta_re * delta_re - delta_im * delta_im;
+	double dc2_im = 2. * delta_re * delta_im;
+	double dc3_re = dc2_re * delta_re - dc2_im * delta_im;
+	double dc3_im = dc2_re * delta_im + dc2_im * delta_re;
+	double d_re = a_re_ * delta_re - a_im_ * delta_im + b_re_ * dc2_re - b_im_ * dc2_im
+		+ c_re_ * dc3_re - c_im_ * dc3_im;
+	double d_im = a_re_ * delta_im + a_im_ * delta_re + b_re_ * dc2_im + b_im_ * dc2_re
+		+ c_re_ * dc3_im + c_im_ * dc3_re;
+
+	dz_re_out = 0.;
+	dz_im_out = 0.;
+	if (keep_derivative) {
+		dz_re_out = a_re_ + 2. * (b_re_ * delta_re - b_im_ * delta_im) + 3. * (c_re_ * dc2_re - c_im_ * dc2_im);
+		dz_im_out = a_im_ + 2. * (b_re_ * delta_im + b_im_ * delta_re) + 3. * (c_re_ * dc2_im + c_im_ * dc2_re);
+	}
+
+	int m = series_index_;
+	int steps = series_index_ - 1;
+	iterate(m, steps, d_re, d_im, delta_re * unit_, delta_im * unit_, x_out, y_out, keep_derivative,
+		dz_re_out, dz_im_out);
+	return max_iter_ - steps;
+}
+
+int mandelbrot_perturbation::remain_iter_deep(double delta_re, double delta_im, double& x_out, double& y_out,
+	bool keep_derivative, double& dz_re_out, double& dz_im_out) const
+{
+	int last = (int)z_re_.size() - 1;
+	float_exp unit(1., -exponent_);
+	float_exp dc_re(delta_re, -exponent_);
+	float_exp dc_im(delta_im, -exponent_);
+
+	/*the series as in remain_iter, the powers of the deltas are in units and fit into doubles*/
+	double square_re = delta_re * delta_re - delta_im * delta_im;
+	double square_im = 2. * delta_re * delta_im;
+	float_exp delta_re_exp = delta_re;
+	float_exp delta_im_exp = delta_im;
+	float_exp dc2_re = square_re;
+	float_exp dc2_im = square_im;
+	float_exp dc3_re = square_re * delta_re - square_im * delta_im;
+	float_exp dc3_im = square_re * delta_im + square_im * delta_re;
+	float_exp d_re = a_exp_re_ * delta_re_exp - a_exp_im_ * delta_im_exp + b_exp_re_ * dc2_re - b_exp_im_ * dc2_im
+		+ c_exp_re_ * dc3_re - c_exp_im_ * dc3_im;
+	float_exp d_im = a_exp_re_ * delta_im_exp + a_exp_im_ * delta_re_exp + b_exp_re_ * dc2_im + b_exp_im_ * dc2_re
+		+ c_exp_re_ * dc3_im + c_exp_im_ * dc3_re;
+
+	float_exp dz_re, dz_im;
+	if (keep_derivative) {
+		dz_re = a_exp_re_ + ldexp(b_exp_re_ * delta_re_exp - b_exp_im_ * delta_im_exp, 1)
+			+ float_exp(3.) * (c_exp_re_ * dc2_re - c_exp_im_ * dc2_im);
+		dz_im = a_exp_im_ + ldexp(b_exp_re_ * delta_im_exp + b_exp_im_ * delta_re_exp, 1)
+			+ float_exp(3.) * (c_exp_re_ * dc2_im + c_exp_im_ * dc2_re);
+	}
+
+	/*the loop of iterate in float_exp, it hands large d_n to iterate and takes them back once small again*/
+	int m = series_index_;
+	int steps = series_index_ - 1;
+	for (;;) {
+		if (std::max(d_re.exponent, d_im.exponent) > handover_exponent) {
+			double double_d_re = to_double(d_re);
+			double double_d_im = to_double(d_im);
+			dz_re_out = to_double(dz_re);
+			dz_im_out = to_double(dz_im);
+			if (iterate(m, steps, double_d_re, double_d_im, to_double(dc_re), to_double(dc_im),
+				x_out, y_out, keep_derivative, dz_re_out, dz_im_out)) return max_iter_ - steps;
+			d_re = double_d_re;
+			d_im = double_d_im;
+			dz_re = dz_re_out;
+			dz_im = dz_im_out;
+		}
+
+		float_exp x = z_exp_re_[m] + d_re;
+		float_exp y = z_exp_im_[m] + d_im;
+		x_out = to_double(x);
+		y_out = to_double(y);
+		float_exp abs_2 = x * x + y * y;
+		if (!(to_double(abs_2) <= max_threshold_ && steps < max_iter_)) break;
+
+		if (keep_derivative) {
+			float_exp n_re = ldexp(x * dz_re - y * dz_im, 1) + unit;
+			float_exp n_im = ldexp(x * dz_im + y * dz_re, 1);
+			dz_re = n_re;
+			dz_im = n_im;
+		}
+
+		/*rebase onto Z_0 = 0 when the reference ran out or z got closer to 0 than d*/
+		if (m == last || abs_2 < d_re * d_re + d_im * d_im) {
+			d_re = x;
+			d_im = y;
+			m = 0;
+		}
+
+		/*d' = (2 Z + d) d + dc*/
+		float_exp t_re = ldexp(z_exp_re_[m], 1) + d_re;
+		float_exp t_im = ldexp(z_exp_im_[m], 1) + d_im;
+		float_exp n_re = t_re * d_re - t_im * d_im + dc_re;
+		float_exp n_im = t_re * d_im + t_im * d_re + dc_im;
+		d_re = n_re;
+		d_im = n_im;
+		m++;
+		steps++;
+	}
+	dz_re_out = to_double(dz_re);
+	dz_im_out = to_double(dz_im);
+	return max_iter_ - steps;
+}
+
+bool mandelbrot_perturbation::iterate(int& m, int& steps, double& d_re, double& d_im, double dc_re, double dc_im,
+	double& x_out, double& y_out, bool keep_derivative, double& dz_re, double& dz_im) const
+{
+	int last = (int)z_re_.size() - 1;
+	for (;;) {
+		double abs_d_2 = d_re * d_re + d_im * d_im;
+		if (abs_d_2 < min_d_square_) return false;
+
+		double x = z_re_[m] + d_re;
+		double y = z_im_[m] + d_im;
+		x_out = x;
+		y_out = y;
+		double abs_2 = x * x + y * y;
+		if (!(abs_2 <= max_threshold_ && steps < max_iter_)) break;
+
+		/*dz' = 2 z dz + 1, the 1 being one unit of the deltas*/
+		if (keep_derivative) {
+			double n_re = 2. * (x * dz_re - y * dz_im) + unit_;
+			double n_im = 2. * (x * dz_im + y * dz_re);
+			dz_re = n_re;
+			dz_im = n_im;
+		}
+
+		/*rebase onto Z_0 = 0 when the reference ran out or z got closer to 0 than d*/
+		if (m == last || abs_2 < abs_d_2) {
+			d_re = x;
+			d_im = y;
+			m = 0;
+		}
+
+		/*d' = (2 Z + d) d + dc*/
+		double t_re = 2. * z_re_[m] + d_re;
+		double t_im = 2. * z_im_[m] + d_im;
+		double n_re = t_re * d_re - t_im * d_im + dc_re;
+		double n_im = t_re * d_im + t_im * d_re + dc_im;
+		d_re = n_re;
+		d_im = n_im;
+		m++;
+		steps++;
+	}
+	return true;
+}
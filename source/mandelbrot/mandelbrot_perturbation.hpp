@@ -0,0 +1,157 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_perturbation.hpp
+*
+* Perturbation theory for deep zooms into the mandelbrot set,
+* see http://www.science.eclipse.co.uk/sft_maths.pdf
+*
+************************************************************************/
+
+#ifndef MANDELBROT_PERTURBATION_HPP_INCLUDED
+#define MANDELBROT_PERTURBATION_HPP_INCLUDED
+
+#include "arbitrary_precision.hpp"
+#include "double_double.hpp"
+#include "float_exp.hpp"
+
+#include <vector>
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_perturbation
+*
+* computes one reference orbit Z_n at high precision, all pixels then only
+* iterate their (small) difference d_n = z_n - Z_n in hardware doubles:
+* d_{n+1} = 2 Z_n d_n + d_n^2 + dc
+* the first iterations are skipped with a third order series approximation
+* d_n = A_n dc + B_n dc^2 + C_n dc^3, which is valid for the whole view.
+* when |z_n| < |d_n| or the reference orbit escaped, the pixel is rebased
+* onto the start of the reference orbit to avoid precision loss (glitches).
+*
+* deep views pass deltas in units of 2^-exponent, so they stay in the range
+* of double however deep the zoom goes. the series coefficients are kept as
+* \bref{float_exp} and scaled to these units. beyond the exponent range of
+* double, pixels iterate d_n as float_exp while it is small enough for d_n^2
+* or dc to underflow in doubles, i.e. near the reference and near 0 after a
+* rebase, and in doubles otherwise
+*
+************************************************************************/
+class mandelbrot_perturbation {
+public:
+	/**
+	* computes the reference orbit for c = \bref{center_re} + \bref{center_im}*i.
+	* \bref{radius} is the largest distance of any pixel to the center, it limits
+	* how many iterations the series approximation may skip
+	*/
+	mandelbrot_perturbation(const double_double& center_re, const double_double& center_im,
+		double radius, float max_threshold, int max_iter);
+
+	/**
+	* computes the reference orbit of a deep view in as many bits as \bref{exponent} needs.
+	* \bref{radius} and the deltas of \bref{escape_time} are in units of 2^-\bref{exponent}
+	*/
+	mandelbrot_perturbation(const arbitrary_precision& center_re, const arbitrary_precision& center_im,
+		double radius, int exponent, float max_threshold, int max_iter);
+
+	/**
+	* number of iterations left for the points c = center + delta[i] and optionally
+	* their last z and exterior distance times \bref{distance_scale}, same semantics
+	* as \bref{mandelbrot_simd::escape_time}. the distance is in the units of the deltas
+	*/
+	void escape_time(const double* delta_re, const double* delta_im, int count,
+		int* remain_iter_out, float* x_out = 0, float* y_out = 0,
+		float* distance_out = 0, double distance_scale = 1.) const;
+
+	/** number of iterations every pixel skips through the series approximation */
+	int skipped_iterations() const;
+
+private:
+	/** relative truncation error up to which the series approximation is used */
+	static const double series_tolerance;
+
+	/**
+	* deepest exponent whose pixels iterate in doubles only, and the exponent d_n has to
+	* reach before deeper pixels continue in doubles. then d_n^2 is a normal double and dc
+	* is below its rounding, pixels return to float_exp once |d_n| fell below 2^-500
+	*/
+	//{
+	static const int max_double_exponent = 960;
+	static const int handover_exponent = -480;
+	//}
+
+	/**
+	* units of the deltas are 2^-exponent_, unit_ is that as double, 0 below its range.
+	* \bref{iterate} stops at |d_n|^2 < min_d_square_, 0 for exponents that stay in doubles
+	*/
+	//{
+	int exponent_ = 0;
+	double unit_ = 1.;
+	double min_d_square_ = 0.;
+	//}
+
+	/** reference orbit, Z_0 = 0, Z_1 = center, ... rounded to double */
+	//{
+	std::vector<double> z_re_;
+	std::vector<double> z_im_;
+	//}
+	/** the reference orbit as float_exp, only for exponents beyond \bref{max_double_exponent} */
+	//{
+	std::vector<float_exp> z_exp_re_;
+	std::vector<float_exp> z_exp_im_;
+	//}
+
+	/**
+	* index n of the reference orbit where pixels start and series coefficients at n,
+	* A, B and C are scaled by the unit, its square and its cube. the doubles are the
+	* coefficients rounded for \bref{remain_iter}
+	*/
+	//{
+	int series_index_ = 1;
+	double a_re_ = 1., a_im_ = 0.;
+	double b_re_ = 0., b_im_ = 0.;
+	double c_re_ = 0., c_im_ = 0.;
+	float_exp a_exp_re_, a_exp_im_;
+	float_exp b_exp_re_, b_exp_im_;
+	float_exp c_exp_re_, c_exp_im_;
+	//}
+
+	float max_threshold_;
+	int max_iter_;
+
+	/** iterates the reference orbit in \bref{high_precision} arithmetic */
+	template<typename high_precision>
+	void compute_reference_orbit(const high_precision& center_re, const high_precision& center_im);
+
+	/** \bref{radius} in units of the deltas */
+	void compute_series(double radius);
+
+	/** Z_n, as float_exp where it may be below the range of double */
+	//{
+	float_exp reference_re(int n) const;
+	float_exp reference_im(int n) const;
+	//}
+
+	/**
+	* iterates one pixel, dz/dc of the full z is only iterated if \bref{keep_derivative}
+	* is set and starts from the derivative of the series, A + 2 B dc + 3 C dc^2.
+	* dz is per unit of the deltas
+	*/
+	int remain_iter(double delta_re, double delta_im, double& x_out, double& y_out,
+		bool keep_derivative, double& dz_re_out, double& dz_im_out) const;
+
+	/** \bref{remain_iter} for exponents beyond \bref{max_double_exponent} */
+	int remain_iter_deep(double delta_re, double delta_im, double& x_out, double& y_out,
+		bool keep_derivative, double& dz_re_out, double& dz_im_out) const;
+
+	/**
+	* continues a pixel at Z_\bref{m} after \bref{steps} iterations in doubles, dc and
+	* d are absolute, dz is per unit. false if it stopped at |d_n|^2 < min_d_square_,
+	* the arguments then hold the state to continue from
+	*/
+	bool iterate(int& m, int& steps, double& d_re, double& d_im, double dc_re, double dc_im,
+		double& x_out, double& y_out, bool keep_derivative, double& dz_re, double& dz_im) const;
+};
+
+#endif//#ifndef MANDELBROT_PERTURBATION_HPP_INCLUDED
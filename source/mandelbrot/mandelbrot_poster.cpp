@@ -0,0 +1,467 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_poster.cpp
+*
+* implementation of \bref{mandelbrot_poster}
+*
+************************************************************************/
+
+#include "mandelbrot_poster.hpp"
+#include "mandelbrot_distributed.hpp"
+#include "mandelbrot_parameter_file.hpp"
+#include "mandelbrot_profiler.hpp"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace viral_core;
+
+/** TIFF field types */
+enum tiff_type {
+	tiff_short = 3,
+	tiff_long = 4,
+	tiff_long8 = 16
+};
+
+/** a directory entry, written inline or after the directory depending on its size */
+struct tiff_entry {
+	uint16_t tag;
+	tiff_type type;
+	std::vector<uint64_t> values;
+};
+
+static int tiff_type_size(tiff_type type)
+{
+	return type == tiff_short ? 2 : type == tiff_long ? 4 : 8;
+}
+
+/** little endian, like the "II" in the header says */
+static void put_le(std::vector<unsigned char>& out, size_t offset, uint64_t value, int bytes)
+{
+	for (int i = 0; i < bytes; i++) out[offset + i] = (unsigned char)(value >> (8 * i));
+}
+
+static bool seek_file(FILE* file, long long offset)
+{
+#ifdef _WIN32
+	return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+/** flushes \bref{file} to the disk, so a checkpoint written afterwards never counts lost tiles */
+static bool sync_file(FILE* file)
+{
+	if (fflush(file) != 0) return false;
+#ifdef _WIN32
+	return _commit(_fileno(file)) == 0;
+#else
+	return fsync(fileno(file)) == 0;
+#endif
+}
+
+/*version 1 computed the chunks with their own views, its tiles do not fit these*/
+static const char poster_checkpoint_magic[] = "mandelbrot_poster checkpoint 2\n";
+static const char finished_tiles_key[] = "finished_tiles = ";
+
+/** the tiles start at a multiple of this, a tile of a multiple of 16 pixels is a multiple of it as well */
+static const int poster_data_alignment = 4096;
+
+//////////////////////////////////////////////////////////////////////////
+//
+// mandelbrot_poster
+//
+//////////////////////////////////////////////////////////////////////////
+
+mandelbrot_poster::mandelbrot_poster(const mandelbrot_generator::parameter_set & params, const settings & s) :
+	parameters_(params),
+	settings_(s),
+	/*the chunk being rendered, the one waiting and the one being written*/
+	image_pool_(3)
+{
+	tile_size_ = (std::max(settings_.tile_size_, 16) + 15) / 16 * 16;
+	tiles_x_ = (parameters_.image_dimensions_.x + tile_size_ - 1) / tile_size_;
+	tiles_y_ = (parameters_.image_dimensions_.y + tile_size_ - 1) / tile_size_;
+	/*with room for the directory, whose two arrays of offsets take at most 8 bytes per tile each*/
+	big_tiff_ = tile_count() * (tile_bytes() + 16) + 2 * poster_data_alignment > 0xffffffffll;
+
+	/*chunks are cancelled per tile, they are no previews*/
+	control_.passes_ = false;
+}
+
+mandelbrot_poster::~mandelbrot_poster()
+{
+	if (file_) fclose(file_);
+}
+
+bool mandelbrot_poster::render(const chunk_callback & on_chunk, std::string & error_out)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (parameters_.image_dimensions_.x <= 0 || parameters_.image_dimensions_.y <= 0) {
+		error_out = "invalid image size for " + settings_.output_path_;
+		return false;
+	}
+
+	long long finished = 0;
+	if (settings_.resume_ && !read_checkpoint(finished, error_out)) return false;
+	if (!open_output(finished, error_out)) return false;
+	/*a render that starts over must not leave the checkpoint of the previous one*/
+	if (finished == 0) remove(checkpoint_path(settings_.output_path_).c_str());
+	chunk_tiles_ = budget_chunk_tiles();
+
+	progress_ = progress();
+	progress_.tile_count_ = tile_count();
+	progress_.resumed_tiles_ = finished;
+	progress_.rendered_tiles_ = finished;
+	progress_.written_tiles_ = finished;
+	written_tiles_ = finished;
+	rendering_done_ = false;
+	write_failed_ = false;
+	control_.cancel_ = false;
+
+	std::thread writer(&mandelbrot_poster::write_main, this);
+
+	bool stopped = false;
+	for (long long t = finished; t < tile_count() && !stopped;) {
+		chunk c;
+		c.first_tile = t;
+		c.tiles = std::min(chunk_tiles_, tiles_x_ - (int)(t % tiles_x_));
+		if (!render_chunk(c)) break;
+		t += c.tiles;
+		progress_.rendered_tiles_ = t;
+		progress_.pixels_ += (long long)c.size.x * c.size.y;
+
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex_);
+			queue_condition_.wait(lock, [this] { return queue_.empty() || write_failed_; });
+			if (write_failed_) break;
+			queue_.push_back(std::move(c));
+		}
+		queue_condition_.notify_all();
+
+		progress_.written_tiles_ = written_tiles_;
+		progress_.seconds_ =
+			std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		stopped = on_chunk && !on_chunk(progress_);
+	}
+
+	/*the chunks rendered so far are still written*/
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex_);
+		rendering_done_ = true;
+	}
+	queue_condition_.notify_all();
+	writer.join();
+
+	bool closed = fclose(file_) == 0;
+	file_ = 0;
+	progress_.written_tiles_ = written_tiles_;
+	progress_.seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (write_failed_ || !closed) {
+		error_out = write_failed_ ? write_error_ : "could not write " + settings_.output_path_;
+		return false;
+	}
+	if (progress_.written_tiles_ < tile_count()) {
+		error_out = "stopped after " + std::to_string(progress_.written_tiles_) + " of "
+			+ std::to_string(tile_count()) + " tiles, " + checkpoint_path(settings_.output_path_)
+			+ " continues the poster";
+		return false;
+	}
+	remove(checkpoint_path(settings_.output_path_).c_str());
+	return true;
+}
+
+void mandelbrot_poster::cancel()
+{
+	control_.cancel_ = true;
+}
+
+const mandelbrot_poster::progress & mandelbrot_poster::current_progress() const
+{
+	return progress_;
+}
+
+std::string mandelbrot_poster::checkpoint_path(const std::string & output_path)
+{
+	return output_path + ".checkpoint";
+}
+
+long long mandelbrot_poster::tile_bytes() const
+{
+	return (long long)tile_size_ * tile_size_ * 3;
+}
+
+long long mandelbrot_poster::tile_count() const
+{
+	return (long long)tiles_x_ * tiles_y_;
+}
+
+int mandelbrot_poster::budget_chunk_tiles() const
+{
+	/*the rgba image and the supersampling edges while rendering, the rgb tiles while writing*/
+	const long long bytes_per_pixel = 4 + 1 + 3;
+	long long tiles = settings_.memory_budget_ / (3 * bytes_per_pixel * tile_size_ * tile_size_);
+	return (int)std::max(1ll, std::min(tiles, (long long)tiles_x_));
+}
+
+bool mandelbrot_poster::open_output(long long & finished_tiles, std::string & error_out)
+{
+	std::vector<unsigned char> header = tiff_header();
+	data_offset_ = (long long)header.size();
+
+	/*a file that does not start with the header of this poster is not continued*/
+	if (finished_tiles > 0) {
+		file_ = fopen(settings_.output_path_.c_str(), "r+b");
+		std::vector<unsigned char> existing(header.size());
+		if (file_ && fread(existing.data(), 1, existing.size(), file_) == existing.size() && existing == header)
+			return true;
+		if (file_) fclose(file_);
+		file_ = 0;
+		finished_tiles = 0;
+	}
+
+	/*the tiles extend the file as they are written*/
+	file_ = fopen(settings_.output_path_.c_str(), "w+b");
+	if (!file_ || fwrite(header.data(), 1, header.size(), file_) != header.size() || fflush(file_) != 0) {
+		if (file_) fclose(file_);
+		file_ = 0;
+		error_out = "could not create " + settings_.output_path_;
+		return false;
+	}
+	return true;
+}
+
+std::vector<unsigned char> mandelbrot_poster::tiff_header() const
+{
+	const tiff_type offset_type = big_tiff_ ? tiff_long8 : tiff_long;
+	std::vector<uint64_t> tile_offsets((size_t)tile_count(), 0);
+	std::vector<uint64_t> tile_byte_counts((size_t)tile_count(), (uint64_t)tile_bytes());
+
+	/*in ascending order of the tags*/
+	std::vector<tiff_entry> entries = {
+		{ 256, tiff_long, { (uint64_t)parameters_.image_dimensions_.x } },	//ImageWidth
+		{ 257, tiff_long, { (uint64_t)parameters_.image_dimensions_.y } },	//ImageLength
+		{ 258, tiff_short, { 8, 8, 8 } },									//BitsPerSample
+		{ 259, tiff_short, { 1 } },											//Compression: none
+		{ 262, tiff_short, { 2 } },											//PhotometricInterpretation: rgb
+		{ 277, tiff_short, { 3 } },											//SamplesPerPixel
+		{ 284, tiff_short, { 1 } },											//PlanarConfiguration: interleaved
+		{ 322, tiff_long, { (uint64_t)tile_size_ } },						//TileWidth
+		{ 323, tiff_long, { (uint64_t)tile_size_ } },						//TileLength
+		{ 324, offset_type, tile_offsets },									//TileOffsets, filled in below
+		{ 325, offset_type, tile_byte_counts }								//TileByteCounts
+	};
+
+	/*BigTIFF widens the counts, the offsets and the inline values to 8 bytes*/
+	const int count_bytes = big_tiff_ ? 8 : 4;
+	const int header_bytes = big_tiff_ ? 16 : 8;
+	const int entry_bytes = big_tiff_ ? 20 : 12;
+	const int entry_count_bytes = big_tiff_ ? 8 : 2;
+
+	/*the values that do not fit into their entry follow the directory*/
+	size_t directory = header_bytes;
+	size_t end = directory + entry_count_bytes + entries.size() * entry_bytes + count_bytes;
+	std::vector<size_t> value_offsets(entries.size(), 0);
+	for (size_t i = 0; i < entries.size(); i++) {
+		size_t bytes = entries[i].values.size() * tiff_type_size(entries[i].type);
+		if (bytes <= (size_t)count_bytes) continue;
+		end = (end + 7) / 8 * 8;
+		value_offsets[i] = end;
+		end += bytes;
+	}
+	size_t data_offset = (end + poster_data_alignment - 1) / poster_data_alignment * poster_data_alignment;
+	for (tiff_entry& e : entries) {
+		if (e.tag != 324) continue;
+		for (size_t i = 0; i < e.values.size(); i++) e.values[i] = data_offset + i * (uint64_t)tile_bytes();
+	}
+
+	std::vector<unsigned char> ret(data_offset, 0);
+	ret[0] = 'I';
+	ret[1] = 'I';
+	if (big_tiff_) {
+		put_le(ret, 2, 43, 2);
+		put_le(ret, 4, 8, 2);
+		put_le(ret, 8, directory, 8);
+	}
+	else {
+		put_le(ret, 2, 42, 2);
+		put_le(ret, 4, directory, 4);
+	}
+
+	size_t position = directory;
+	put_le(ret, position, entries.size(), entry_count_bytes);
+	position += entry_count_bytes;
+	for (size_t i = 0; i < entries.size(); i++, position += entry_bytes) {
+		const tiff_entry& e = entries[i];
+		int size = tiff_type_size(e.type);
+		put_le(ret, position, e.tag, 2);
+		put_le(ret, position + 2, e.type, 2);
+		put_le(ret, position + 4, e.values.size(), count_bytes);
+		size_t value_position = value_offsets[i] ? value_offsets[i] : position + 4 + count_bytes;
+		if (value_offsets[i]) put_le(ret, position + 4 + count_bytes, value_offsets[i], count_bytes);
+		for (size_t v = 0; v < e.values.size(); v++) put_le(ret, value_position + v * size, e.values[v], size);
+	}
+	//the offset of the next directory stays 0
+	return ret;
+}
+
+bool mandelbrot_poster::read_checkpoint(long long & tiles_out, std::string & error_out) const
+{
+	tiles_out = 0;
+	std::string path = checkpoint_path(settings_.output_path_);
+	std::ifstream in(path.c_str(), std::ios::binary);
+	if (!in) return true;
+	std::ostringstream content;
+	content << in.rdbuf();
+	std::string text = content.str();
+
+	std::string expected = checkpoint_text();
+	if (text.compare(0, expected.size(), expected) != 0) {
+		error_out = path + " belongs to another poster, delete it to start over";
+		return false;
+	}
+	if (text.compare(expected.size(), sizeof(finished_tiles_key) - 1, finished_tiles_key) != 0) {
+		error_out = path + " is damaged, delete it to start over";
+		return false;
+	}
+	tiles_out = std::min(atoll(text.c_str() + expected.size() + sizeof(finished_tiles_key) - 1), tile_count());
+	return true;
+}
+
+bool mandelbrot_poster::write_checkpoint(long long tiles, std::string & error_out) const
+{
+	/*written next to the checkpoint first, so an interruption keeps the previous one*/
+	std::string path = checkpoint_path(settings_.output_path_);
+	std::string temporary = path + ".part";
+	std::string text = checkpoint_text() + finished_tiles_key + std::to_string(tiles) + "\n";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (!file) {
+		error_out = "could not create " + temporary;
+		return false;
+	}
+	bool written = fwrite(text.data(), 1, text.size(), file) == text.size() && sync_file(file);
+	written = fclose(file) == 0 && written;
+
+	remove(path.c_str());
+	if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(temporary.c_str());
+		error_out = "could not write " + path;
+		return false;
+	}
+	return true;
+}
+
+std::string mandelbrot_poster::checkpoint_text() const
+{
+	/*the thread count and the instruction set do not change the pixels*/
+	mandelbrot_parameter_file::frame f;
+	f.params_ = parameters_;
+	f.params_.worker_count_ = 0;
+	f.params_.simd_level_ = mandelbrot_simd::automatic;
+	f.visualization_ = settings_.escape_time_
+		? mandelbrot_parameter_file::visualization_julia_iter : mandelbrot_parameter_file::visualization_julia_value;
+	f.output_ = settings_.output_path_;
+	return std::string(poster_checkpoint_magic) + "tile_size = " + std::to_string(tile_size_) + "\n"
+		+ mandelbrot_parameter_file::write(f);
+}
+
+bool mandelbrot_poster::render_chunk(chunk & c)
+{
+	int row = (int)(c.first_tile / tiles_x_);
+	int column = (int)(c.first_tile % tiles_x_);
+	const vector2i& dimensions = parameters_.image_dimensions_;
+	vector2i begin(column * tile_size_, row * tile_size_);
+	c.size = vector2i(std::min(c.tiles * tile_size_, dimensions.x - begin.x), std::min(tile_size_, dimensions.y - begin.y));
+	MANDELBROT_PROFILE_SCOPE("poster chunk", (long long)c.size.x * c.size.y);
+
+	/*the supersampling compares a pixel with its neighbours, so those of the chunk are rendered along*/
+	vector2i render_begin = begin;
+	vector2i render_end(begin.x + c.size.x, begin.y + c.size.y);
+	if (settings_.escape_time_ && parameters_.max_samples_ > 1) {
+		render_begin = vector2i(std::max(begin.x - 1, 0), std::max(begin.y - 1, 0));
+		render_end = vector2i(std::min(render_end.x + 1, dimensions.x), std::min(render_end.y + 1, dimensions.y));
+	}
+	c.origin = vector2i(begin.x - render_begin.x, begin.y - render_begin.y);
+	vector2i render_size(render_end.x - render_begin.x, render_end.y - render_begin.y);
+
+	mandelbrot_generator::parameter_set params = mandelbrot_distributed::tile_parameters(parameters_, render_begin,
+		render_size);
+	params.bgra_ = false;
+	c.img.reset(image_pool_.acquire(render_size).release());
+	if (settings_.escape_time_)
+		return mandelbrot_generator::generate_mandelbrot_image_julia_iter(params, *c.img, 0, &control_);
+	return mandelbrot_generator::generate_mandelbrot_image_julia_value(params, *c.img, &control_);
+}
+
+void mandelbrot_poster::write_main()
+{
+	std::vector<unsigned char> tiles;
+	for (;;) {
+		chunk c;
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex_);
+			queue_condition_.wait(lock, [this] { return !queue_.empty() || rendering_done_; });
+			if (queue_.empty()) break;
+			c = std::move(queue_.front());
+			queue_.pop_front();
+		}
+		/*the renderer may wait for the queue to empty*/
+		queue_condition_.notify_all();
+
+		convert(c, tiles);
+		auto_pointer<image> converted(c.img.release());
+		image_pool_.recycle(converted);
+
+		std::string error;
+		long long finished = c.first_tile + c.tiles;
+		bool written = seek_file(file_, data_offset_ + c.first_tile * tile_bytes())
+			&& fwrite(tiles.data(), 1, tiles.size(), file_) == tiles.size() && sync_file(file_)
+			&& write_checkpoint(finished, error);
+		if (!written) {
+			{
+				std::lock_guard<std::mutex> lock(queue_mutex_);
+				write_failed_ = true;
+				write_error_ = error.empty() ? "could not write " + settings_.output_path_ : error;
+				queue_.clear();
+			}
+			queue_condition_.notify_all();
+			return;
+		}
+		written_tiles_ = finished;
+	}
+}
+
+void mandelbrot_poster::convert(const chunk & c, std::vector<unsigned char>& out) const
+{
+	int stride = c.img->size().x;
+	const unsigned char* data = c.img->data();
+	out.assign((size_t)(c.tiles * tile_bytes()), 0);
+
+	for (int t = 0; t < c.tiles; t++) {
+		int x_begin = t * tile_size_;
+		int width = std::min(tile_size_, c.size.x - x_begin);
+		unsigned char* tile = out.data() + t * tile_bytes();
+		for (int y = 0; y < c.size.y; y++) {
+			const unsigned char* source = data + ((size_t)(c.origin.y + y) * stride + c.origin.x + x_begin) * 4;
+			unsigned char* target = tile + (size_t)y * tile_size_ * 3;
+			for (int x = 0; x < width; x++) {
+				target[x * 3] = source[x * 4];
+				target[x * 3 + 1] = source[x * 4 + 1];
+				target[x * 3 + 2] = source[x * 4 + 2];
+			}
+		}
+	}
+}
@@ -0,0 +1,193 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_poster.hpp
+*
+* Out-of-core renderer for frames larger than memory, streamed to a tiled
+* TIFF file and resumable after an interruption
+*
+************************************************************************/
+
+#ifndef MANDELBROT_POSTER_HPP_INCLUDED
+#define MANDELBROT_POSTER_HPP_INCLUDED
+
+#include "mandelbrot_generator.hpp"
+#include "mandelbrot_image_pool.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_poster
+*
+* renders a frame of any size, e.g. 100000 x 100000 pixels, without ever
+* holding more than a part of it. the output is an uncompressed tiled rgb
+* TIFF, a BigTIFF if it exceeds 4GB. all tiles have the same size on disk,
+* so the offset of every tile is known when the file is created and the
+* tiles are written straight to their place.
+*
+* the frame is rendered in chunks: runs of consecutive tiles of one row of
+* tiles, as many as fit into the memory budget. each chunk is a part of the
+* frame for \bref{mandelbrot_generator}, see
+* \bref{mandelbrot_distributed::tile_parameters}, so it is rendered on all
+* cores through the \bref{render_thread_pool} from the coordinates of the
+* whole frame. with supersampling it is rendered with a one pixel apron of
+* its neighbours. the poster is thus the same image as the frame rendered in
+* memory, whatever the chunk width. the tiles of a chunk are adjacent in the
+* file, a writer thread converts and writes them in one piece while the next
+* chunk renders.
+*
+* chunks are written in order. after each one the file is flushed and the
+* number of finished tiles goes to a checkpoint file next to the output.
+* a render that is started again with the same parameters continues after
+* the finished tiles. the checkpoint is deleted once the poster is complete
+*
+************************************************************************/
+class mandelbrot_poster {
+public:
+	/**
+	*************************************************************************
+	* @class mandelbrot_poster::settings
+	* output and resources of a poster
+	************************************************************************/
+	class settings {
+	public:
+		std::string output_path_ = "poster.tif";
+		/** edge of the square TIFF tiles, rounded up to a multiple of 16 */
+		int tile_size_ = 256;
+		/**
+		* bound of the pixel memory. a chunk takes about 8 bytes per pixel, up to three are
+		* alive: one rendering, one waiting for the writer and one being written. chunks
+		* are at least one tile
+		*/
+		long long memory_budget_ = 512ll << 20;
+		/** \bref{mandelbrot_generator::generate_mandelbrot_image_julia_iter} instead of julia_value */
+		bool escape_time_ = true;
+		/** continues a checkpoint of the same parameters instead of starting over */
+		bool resume_ = true;
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_poster::progress
+	* state of a render, tiles count in row order
+	************************************************************************/
+	class progress {
+	public:
+		long long tile_count_ = 0;
+		/** finished by an earlier render */
+		long long resumed_tiles_ = 0;
+		long long rendered_tiles_ = 0;
+		/** written and in the checkpoint */
+		long long written_tiles_ = 0;
+		/** pixels rendered by this render, without the resumed ones */
+		long long pixels_ = 0;
+		double seconds_ = 0.;
+	};
+
+	/** called after each chunk is rendered, false stops the render */
+	typedef std::function<bool(const progress& p)> chunk_callback;
+
+	mandelbrot_poster(const mandelbrot_generator::parameter_set& params, const settings& s);
+	~mandelbrot_poster();
+
+	mandelbrot_poster(const mandelbrot_poster&) = delete;
+	mandelbrot_poster& operator=(const mandelbrot_poster&) = delete;
+
+	/**
+	* renders the tiles that are not finished yet. false with a message if the files could
+	* not be written or the render was stopped, the checkpoint then has the written tiles
+	*/
+	bool render(const chunk_callback& on_chunk, std::string& error_out);
+
+	/** may be called from any thread, \bref{render} returns after the tiles in progress */
+	void cancel();
+
+	const progress& current_progress() const;
+
+	/** the checkpoint of the poster written to \bref{output_path} */
+	static std::string checkpoint_path(const std::string& output_path);
+
+private:
+	/**
+	*************************************************************************
+	* @class mandelbrot_poster::chunk
+	* rendered tiles waiting for the writer
+	************************************************************************/
+	struct chunk {
+		long long first_tile;
+		int tiles;
+		/** pixels of the tiles, they start at origin in img, past the apron */
+		//{
+		viral_core::vector2i size;
+		viral_core::vector2i origin;
+		//}
+		std::unique_ptr<viral_core::image> img;
+	};
+
+	const mandelbrot_generator::parameter_set parameters_;
+	const settings settings_;
+	int tile_size_;
+	int tiles_x_;
+	int tiles_y_;
+	/** 8 byte offsets beyond 4GB */
+	bool big_tiff_;
+	/** tiles per chunk, the last chunk of a row may be shorter */
+	int chunk_tiles_ = 1;
+
+	progress progress_;
+	mandelbrot_generator::progressive_control control_;
+	mandelbrot_image_pool image_pool_;
+
+	FILE* file_ = 0;
+	/** offset of the first tile, the others follow in row order */
+	long long data_offset_ = 0;
+
+	/** chunks for the writer, it takes one at a time */
+	//{
+	std::mutex queue_mutex_;
+	std::condition_variable queue_condition_;
+	std::deque<chunk> queue_;
+	bool rendering_done_ = false;
+	bool write_failed_ = false;
+	std::string write_error_;
+	//}
+	std::atomic<long long> written_tiles_{ 0 };
+
+	long long tile_bytes() const;
+	long long tile_count() const;
+	/** tiles in a chunk under the memory budget */
+	int budget_chunk_tiles() const;
+
+	/**
+	* opens the output to continue after \bref{finished_tiles}. if it is missing or not the
+	* file of this poster, it is created with the TIFF header and directory and
+	* \bref{finished_tiles} is set to 0
+	*/
+	bool open_output(long long& finished_tiles, std::string& error_out);
+	/** the TIFF header, directory and tile offsets */
+	std::vector<unsigned char> tiff_header() const;
+
+	/** finished tiles of a checkpoint of these parameters, 0 if there is none. false if it is of others */
+	bool read_checkpoint(long long& tiles_out, std::string& error_out) const;
+	bool write_checkpoint(long long tiles, std::string& error_out) const;
+	/** identifies the poster in its checkpoint */
+	std::string checkpoint_text() const;
+
+	bool render_chunk(chunk& c);
+	void write_main();
+	/** the tiles of \bref{c} in file layout, padded at the right and bottom edges of the frame */
+	void convert(const chunk& c, std::vector<unsigned char>& out) const;
+};
+
+#endif//#ifndef MANDELBROT_POSTER_HPP_INCLUDED
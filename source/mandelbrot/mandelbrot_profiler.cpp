@@ -0,0 +1,232 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_profiler.cpp
+*
+* implementation of \bref{mandelbrot_profiler}
+*
+************************************************************************/
+
+#include "mandelbrot_profiler.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+struct mandelbrot_profiler::thread_buffer {
+	std::mutex mutex;
+	std::vector<event> events;
+	int index = 0;
+	/** set when the thread ended, the buffer is released once it was taken */
+	bool finished = false;
+};
+
+/** buffers of all threads that recorded since the last \bref{mandelbrot_profiler::take_events} */
+//{
+static std::mutex registry_mutex;
+static std::vector<std::shared_ptr<mandelbrot_profiler::thread_buffer> > registry;
+static int next_thread_index = 0;
+//}
+
+/** marks the buffer of a thread as finished when the thread ends */
+struct thread_buffer_owner {
+	std::shared_ptr<mandelbrot_profiler::thread_buffer> buffer;
+
+	~thread_buffer_owner()
+	{
+		if (!buffer) return;
+		std::lock_guard<std::mutex> lock(buffer->mutex);
+		buffer->finished = true;
+	}
+};
+
+static const long long start_time = mandelbrot_profiler::now();
+
+//////////////////////////////////////////////////////////////////////////
+//
+// mandelbrot_profiler
+//
+//////////////////////////////////////////////////////////////////////////
+
+std::atomic<bool> mandelbrot_profiler::enabled_(false);
+
+void mandelbrot_profiler::set_enabled(bool enabled)
+{
+	enabled_ = enabled;
+}
+
+long long mandelbrot_profiler::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void mandelbrot_profiler::record(const char * name, long long begin, long long end, long long count)
+{
+	if (!enabled()) return;
+
+	event e;
+	e.name = name;
+	e.begin_us = (begin - start_time) * 1e-3;
+	e.duration_us = (end - begin) * 1e-3;
+	e.count = count;
+	e.counter = false;
+	append(e);
+}
+
+void mandelbrot_profiler::counter(const char * name, long long value)
+{
+	if (!enabled()) return;
+
+	event e;
+	e.name = name;
+	e.begin_us = (now() - start_time) * 1e-3;
+	e.duration_us = 0.;
+	e.count = value;
+	e.counter = true;
+	append(e);
+}
+
+mandelbrot_profiler::thread_buffer & mandelbrot_profiler::local_buffer()
+{
+	static thread_local thread_buffer_owner owner;
+	if (!owner.buffer) {
+		owner.buffer = std::make_shared<thread_buffer>();
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		owner.buffer->index = next_thread_index++;
+		registry.push_back(owner.buffer);
+	}
+	return *owner.buffer;
+}
+
+void mandelbrot_profiler::append(const event & e)
+{
+	thread_buffer& buffer = local_buffer();
+	std::lock_guard<std::mutex> lock(buffer.mutex);
+	if (buffer.events.size() >= max_thread_events) return;
+	buffer.events.push_back(e);
+	buffer.events.back().thread = buffer.index;
+}
+
+std::vector<mandelbrot_profiler::event> mandelbrot_profiler::take_events()
+{
+	std::vector<event> ret;
+	std::lock_guard<std::mutex> registry_lock(registry_mutex);
+	for (size_t i = 0; i < registry.size();) {
+		thread_buffer& buffer = *registry[i];
+		bool finished;
+		{
+			std::lock_guard<std::mutex> lock(buffer.mutex);
+			ret.insert(ret.end(), buffer.events.begin(), buffer.events.end());
+			buffer.events.clear();
+			finished = buffer.finished;
+		}
+		if (finished) registry.erase(registry.begin() + i);
+		else i++;
+	}
+
+	std::stable_sort(ret.begin(), ret.end(), [](const event& a, const event& b) { return a.begin_us < b.begin_us; });
+	return ret;
+}
+
+bool mandelbrot_profiler::write_chrome_trace(const std::string & path, const std::vector<event>& events)
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file) return false;
+
+	/*complete events (ph X) for scopes, counter events (ph C) are drawn as a graph per name*/
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (size_t i = 0; i < events.size(); i++) {
+		const event& e = events[i];
+		const char* separator = i + 1 < events.size() ? "," : "";
+		if (e.counter) {
+			fprintf(file, "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"value\":%lld}}%s\n",
+				e.name, e.begin_us, e.thread, e.count, separator);
+		}
+		else {
+			fprintf(file, "{\"name\":\"%s\",\"cat\":\"mandelbrot\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+				"\"pid\":1,\"tid\":%d,\"args\":{\"count\":%lld}}%s\n",
+				e.name, e.begin_us, e.duration_us, e.thread, e.count, separator);
+		}
+	}
+	fprintf(file, "]}\n");
+	return fclose(file) == 0;
+}
+
+mandelbrot_profiler::summary mandelbrot_profiler::summarize(const std::vector<event>& events, const char * busy_name)
+{
+	summary ret;
+	double first_begin = 0.;
+	double last_end = 0.;
+	bool any = false;
+	for (const event& e : events) {
+		if (e.counter) continue;
+
+		double end = e.begin_us + e.duration_us;
+		first_begin = any ? std::min(first_begin, e.begin_us) : e.begin_us;
+		last_end = any ? std::max(last_end, end) : end;
+		any = true;
+
+		double ms = e.duration_us * 1e-3;
+		auto found = std::find_if(ret.scopes_.begin(), ret.scopes_.end(),
+			[&](const summary::scope_total& s) { return strcmp(s.name, e.name) == 0; });
+		if (found == ret.scopes_.end()) {
+			summary::scope_total total = { e.name, 1, ms, ms };
+			ret.scopes_.push_back(total);
+		}
+		else {
+			found->count++;
+			found->total_ms += ms;
+			found->max_ms = std::max(found->max_ms, ms);
+		}
+
+		if (strcmp(e.name, busy_name) == 0) {
+			if ((int)ret.thread_busy_ms_.size() <= e.thread) ret.thread_busy_ms_.resize(e.thread + 1, 0.);
+			ret.thread_busy_ms_[e.thread] += ms;
+		}
+	}
+	ret.wall_ms_ = (last_end - first_begin) * 1e-3;
+	return ret;
+}
+
+const mandelbrot_profiler::summary::scope_total * mandelbrot_profiler::summary::find(const char * name) const
+{
+	for (const scope_total& s : scopes_)
+		if (strcmp(s.name, name) == 0) return &s;
+	return 0;
+}
+
+int mandelbrot_profiler::summary::busy_threads() const
+{
+	int ret = 0;
+	for (double ms : thread_busy_ms_)
+		if (ms > 0.) ret++;
+	return ret;
+}
+
+double mandelbrot_profiler::summary::utilization() const
+{
+	int threads = busy_threads();
+	if (threads == 0 || !(wall_ms_ > 0.)) return 1.;
+
+	double busy = 0.;
+	for (double ms : thread_busy_ms_) busy += ms;
+	return std::min(busy / (wall_ms_ * threads), 1.);
+}
+
+std::string mandelbrot_profiler::summary::format() const
+{
+	std::string ret;
+	char line[256];
+	for (const scope_total& s : scopes_) {
+		snprintf(line, sizeof(line), "%s: %.2f ms (%d x, max %.2f ms)\n", s.name, s.total_ms, s.count, s.max_ms);
+		ret += line;
+	}
+	snprintf(line, sizeof(line), "%d threads, %.0f%% utilized over %.2f ms",
+		busy_threads(), utilization() * 100., wall_ms_);
+	ret += line;
+	return ret;
+}
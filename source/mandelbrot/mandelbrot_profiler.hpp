@@ -0,0 +1,168 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_profiler.hpp
+*
+* Scoped timers and counters of the render path, exported as a chrome
+* trace or summarized per frame
+*
+************************************************************************/
+
+#ifndef MANDELBROT_PROFILER_HPP_INCLUDED
+#define MANDELBROT_PROFILER_HPP_INCLUDED
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+/** 0 compiles \bref{MANDELBROT_PROFILE_SCOPE} and \bref{MANDELBROT_PROFILE_COUNTER} to nothing */
+#ifndef MANDELBROT_PROFILING
+#define MANDELBROT_PROFILING 1
+#endif
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_profiler
+*
+* records timed scopes and counter values of all threads while enabled.
+* each thread appends to a buffer of its own, so recording takes no lock
+* that another thread holds for longer than moving the buffer out in
+* \bref{take_events}. while disabled, a scope costs one atomic load.
+* names are not copied and have to be string literals
+*
+************************************************************************/
+class mandelbrot_profiler {
+public:
+	/**
+	*************************************************************************
+	* @class mandelbrot_profiler::event
+	* a scope of duration_us or, with counter, a value of the counter name
+	************************************************************************/
+	struct event {
+		const char* name;
+		/** microseconds since the first use of the profiler */
+		double begin_us;
+		double duration_us;
+		/** threads are numbered in the order of their first event */
+		int thread;
+		/** work done in the scope, e.g. the pixels of a tile, or the value of a counter */
+		long long count;
+		bool counter;
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_profiler::scope
+	* records an event from its construction to its destruction
+	************************************************************************/
+	class scope {
+	public:
+		explicit scope(const char* name, long long count = 0);
+		~scope();
+
+		scope(const scope&) = delete;
+		scope& operator=(const scope&) = delete;
+
+	private:
+		const char* const name_;
+		const long long count_;
+		/** negative if the profiler was disabled when the scope started */
+		const long long begin_;
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_profiler::summary
+	* totals of the events of a frame, see \bref{summarize}
+	************************************************************************/
+	class summary {
+	public:
+		struct scope_total {
+			const char* name;
+			int count;
+			double total_ms;
+			double max_ms;
+		};
+		/** in the order of their first event */
+		std::vector<scope_total> scopes_;
+		/** time each thread spent in the busy scopes, indexed by event::thread */
+		std::vector<double> thread_busy_ms_;
+		/** from the first begin to the last end of the events */
+		double wall_ms_ = 0.;
+
+		/** totals of \bref{name}, null if there was no such scope */
+		const scope_total* find(const char* name) const;
+		/** busy time over the time of the threads that were busy at all, 1 if none was */
+		double utilization() const;
+		int busy_threads() const;
+		/** one line per scope and a line with the thread utilization */
+		std::string format() const;
+	};
+
+	static void set_enabled(bool enabled);
+	static bool enabled();
+
+	/** nanoseconds of a steady clock */
+	static long long now();
+
+	/** adds a scope from \bref{begin} to \bref{end}, both from \bref{now}, if enabled */
+	static void record(const char* name, long long begin, long long end, long long count = 0);
+	/** adds a value of the counter \bref{name} if enabled, e.g. the iterations of a frame */
+	static void counter(const char* name, long long value);
+
+	/** moves the events of all threads out, ordered by begin */
+	static std::vector<event> take_events();
+
+	/**
+	* writes \bref{events} in the trace event format of chrome://tracing and
+	* https://ui.perfetto.dev, false if the file could not be written
+	*/
+	static bool write_chrome_trace(const std::string& path, const std::vector<event>& events);
+
+	/** totals per name, the scopes named \bref{busy_name} count as work of their thread */
+	static summary summarize(const std::vector<event>& events, const char* busy_name);
+
+	/** events of one thread, defined in the implementation */
+	struct thread_buffer;
+
+private:
+	/** buffer of the calling thread, registered on first use */
+	static thread_buffer& local_buffer();
+	static void append(const event& e);
+
+	/** events beyond this are dropped until the buffer is taken */
+	static const size_t max_thread_events = 1 << 20;
+
+	static std::atomic<bool> enabled_;
+};
+
+#if MANDELBROT_PROFILING
+#define MANDELBROT_PROFILE_CONCAT_(a, b) a##b
+#define MANDELBROT_PROFILE_CONCAT(a, b) MANDELBROT_PROFILE_CONCAT_(a, b)
+/** times the rest of the enclosing block, an optional second argument is the work done in it */
+#define MANDELBROT_PROFILE_SCOPE(...) \
+	mandelbrot_profiler::scope MANDELBROT_PROFILE_CONCAT(profile_scope_, __LINE__)(__VA_ARGS__)
+#define MANDELBROT_PROFILE_COUNTER(name, value) mandelbrot_profiler::counter(name, value)
+#else
+#define MANDELBROT_PROFILE_SCOPE(...)
+#define MANDELBROT_PROFILE_COUNTER(name, value)
+#endif
+
+inline mandelbrot_profiler::scope::scope(const char * name, long long count) :
+	name_(name),
+	count_(count),
+	begin_(enabled() ? now() : -1)
+{}
+
+inline mandelbrot_profiler::scope::~scope()
+{
+	if (begin_ >= 0) record(name_, begin_, now(), count_);
+}
+
+inline bool mandelbrot_profiler::enabled()
+{
+	return enabled_.load(std::memory_order_relaxed);
+}
+
+#endif//#ifndef MANDELBROT_PROFILER_HPP_INCLUDED
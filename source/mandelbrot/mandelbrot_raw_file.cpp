@@ -0,0 +1,417 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_raw_file.cpp
+*
+* implementation of \bref{mandelbrot_raw_file}
+*
+************************************************************************/
+
+#include "mandelbrot_raw_file.hpp"
+#include "render_thread_pool.hpp"
+
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace viral_core;
+
+static const unsigned int all_planes = (1u << mandelbrot_raw_file::plane_count) - 1;
+
+static void store_double_double(const double_double& value, double* out)
+{
+	out[0] = value.hi;
+	out[1] = value.lo;
+}
+
+static double_double load_double_double(const double* in)
+{
+	double_double ret;
+	ret.hi = in[0];
+	ret.lo = in[1];
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// mandelbrot_raw_file
+//
+//////////////////////////////////////////////////////////////////////////
+
+const char mandelbrot_raw_file::magic[8] = { 'M', 'B', 'R', 'A', 'W', 0, 0, 0 };
+
+mandelbrot_raw_file::mandelbrot_raw_file()
+{
+	std::fill(plane_offsets_, plane_offsets_ + plane_count, 0);
+}
+
+mandelbrot_raw_file::~mandelbrot_raw_file()
+{
+	close();
+}
+
+bool mandelbrot_raw_file::create(const std::string & path, const mandelbrot_generator::parameter_set & params,
+	unsigned int plane_mask, std::string & error_out)
+{
+	close();
+	if (params.image_dimensions_.x <= 0 || params.image_dimensions_.y <= 0 || (plane_mask & all_planes) == 0
+		|| (plane_mask & ~all_planes) != 0) {
+		error_out = "invalid image size or planes for " + path;
+		return false;
+	}
+
+	header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic_, magic, sizeof(magic));
+	h.version_ = version;
+	h.header_size_ = (uint32_t)alignment;
+	h.width_ = (uint32_t)params.image_dimensions_.x;
+	h.height_ = (uint32_t)params.image_dimensions_.y;
+	h.tile_size_ = tile_size;
+	h.plane_mask_ = plane_mask;
+	h.max_iter_ = params.max_iter_;
+	h.iterations_ = params.iterations_;
+	h.max_threshold_ = params.max_threshold_;
+	h.interpolation_ = params.interpolation_;
+	h.coloring_ = (uint32_t)params.coloring_;
+	/*deep views are stored with their bounds rounded to double_double*/
+	mandelbrot_generator::parameter_set flat = params.flat_view();
+	store_double_double(flat.real_min_, h.real_min_);
+	store_double_double(flat.imaginary_min_, h.imaginary_min_);
+	store_double_double(flat.real_max_, h.real_max_);
+	store_double_double(flat.imaginary_max_, h.imaginary_max_);
+
+	compute_layout(plane_mask);
+	size_t tiles_x = (h.width_ + tile_size - 1) / tile_size;
+	size_t tiles_y = (h.height_ + tile_size - 1) / tile_size;
+	if (!map(path, alignment + tile_bytes_ * tiles_x * tiles_y, true, error_out)) return false;
+	memcpy(data_, &h, sizeof(h));
+	return true;
+}
+
+bool mandelbrot_raw_file::open(const std::string & path, std::string & error_out)
+{
+	close();
+	if (!map(path, 0, false, error_out)) return false;
+
+	const header& h = get_header();
+	bool valid = size_ >= sizeof(header) && memcmp(h.magic_, magic, sizeof(magic)) == 0;
+	if (valid && h.version_ != version) {
+		close();
+		error_out = path + " has version " + std::to_string(h.version_) + ", expected " + std::to_string(version);
+		return false;
+	}
+	valid = valid && h.header_size_ == alignment && h.tile_size_ == tile_size
+		&& h.width_ > 0 && h.height_ > 0 && (h.plane_mask_ & all_planes) != 0 && (h.plane_mask_ & ~all_planes) == 0;
+	if (valid) {
+		compute_layout(h.plane_mask_);
+		vector2i tiles = tile_count();
+		valid = size_ >= alignment + tile_bytes_ * tiles.x * tiles.y;
+	}
+	if (!valid) {
+		close();
+		error_out = path + " is not a raw frame file";
+		return false;
+	}
+	return true;
+}
+
+void mandelbrot_raw_file::close()
+{
+#ifdef _WIN32
+	if (data_) UnmapViewOfFile(data_);
+	if (mapping_handle_) CloseHandle(mapping_handle_);
+	if (file_handle_) CloseHandle(file_handle_);
+	mapping_handle_ = 0;
+	file_handle_ = 0;
+#else
+	if (data_) munmap(data_, size_);
+	if (descriptor_ >= 0) ::close(descriptor_);
+	descriptor_ = -1;
+#endif
+	data_ = 0;
+	size_ = 0;
+}
+
+bool mandelbrot_raw_file::is_open() const
+{
+	return data_ != 0;
+}
+
+const mandelbrot_raw_file::header & mandelbrot_raw_file::get_header() const
+{
+	return *(const header*)data_;
+}
+
+bool mandelbrot_raw_file::has_plane(plane p) const
+{
+	return (get_header().plane_mask_ & (1u << p)) != 0;
+}
+
+vector2i mandelbrot_raw_file::size() const
+{
+	return vector2i((int)get_header().width_, (int)get_header().height_);
+}
+
+vector2i mandelbrot_raw_file::tile_count() const
+{
+	return vector2i((size().x + tile_size - 1) / tile_size, (size().y + tile_size - 1) / tile_size);
+}
+
+mandelbrot_generator::parameter_set mandelbrot_raw_file::parameters() const
+{
+	const header& h = get_header();
+	mandelbrot_generator::parameter_set ret;
+	ret.image_dimensions_ = size();
+	ret.max_iter_ = h.max_iter_;
+	ret.iterations_ = h.iterations_;
+	ret.max_threshold_ = h.max_threshold_;
+	ret.interpolation_ = h.interpolation_;
+	if (h.coloring_ <= mandelbrot_generator::coloring_distance)
+		ret.coloring_ = (mandelbrot_generator::escape_coloring)h.coloring_;
+	ret.real_min_ = load_double_double(h.real_min_);
+	ret.imaginary_min_ = load_double_double(h.imaginary_min_);
+	ret.real_max_ = load_double_double(h.real_max_);
+	ret.imaginary_max_ = load_double_double(h.imaginary_max_);
+	return ret;
+}
+
+int32_t * mandelbrot_raw_file::remain_iter(const vector2i & tile) const
+{
+	return (int32_t*)values(tile, plane_remain_iter);
+}
+
+float * mandelbrot_raw_file::values(const vector2i & tile, plane p) const
+{
+	if (!has_plane(p)) return 0;
+	size_t index = (size_t)tile.y * tile_count().x + tile.x;
+	return (float*)(data_ + alignment + index * tile_bytes_ + plane_offsets_[p]);
+}
+
+void mandelbrot_raw_file::store(const mandelbrot_generator::raw_frame & raw)
+{
+	int width = size().x;
+	for_each_tile(0, [&](const vector2i& tile, const vector2i& begin, const vector2i& end) {
+		int32_t* remain = remain_iter(tile);
+		float* planes[] = { 0, values(tile, plane_x), values(tile, plane_y), values(tile, plane_smooth),
+			values(tile, plane_distance) };
+		const std::vector<float>* sources[] = { 0, &raw.x_, &raw.y_, &raw.smooth_, &raw.distance_ };
+
+		for (int y = begin.y; y < end.y; y++) {
+			size_t row = (size_t)y * width;
+			size_t tile_row = (size_t)(y - begin.y) * tile_size;
+			if (remain && !raw.remain_iter_.empty())
+				std::copy(raw.remain_iter_.begin() + row + begin.x, raw.remain_iter_.begin() + row + end.x,
+					remain + tile_row);
+			for (int p = plane_x; p < plane_count; p++) {
+				if (planes[p] && !sources[p]->empty())
+					std::copy(sources[p]->begin() + row + begin.x, sources[p]->begin() + row + end.x,
+						planes[p] + tile_row);
+			}
+		}
+	});
+}
+
+void mandelbrot_raw_file::load(mandelbrot_generator::raw_frame & raw_out) const
+{
+	size_t pixel_count = (size_t)size().x * size().y;
+	raw_out.size_ = size();
+	raw_out.remain_iter_.assign(has_plane(plane_remain_iter) ? pixel_count : 0, 0);
+	raw_out.x_.assign(has_plane(plane_x) ? pixel_count : 0, 0.f);
+	raw_out.y_.assign(has_plane(plane_y) ? pixel_count : 0, 0.f);
+	raw_out.smooth_.assign(has_plane(plane_smooth) ? pixel_count : 0, 0.f);
+	raw_out.distance_.assign(has_plane(plane_distance) ? pixel_count : 0, 0.f);
+
+	int width = size().x;
+	for_each_tile(0, [&](const vector2i& tile, const vector2i& begin, const vector2i& end) {
+		const int32_t* remain = remain_iter(tile);
+		const float* planes[] = { 0, values(tile, plane_x), values(tile, plane_y), values(tile, plane_smooth),
+			values(tile, plane_distance) };
+		std::vector<float>* targets[] = { 0, &raw_out.x_, &raw_out.y_, &raw_out.smooth_, &raw_out.distance_ };
+
+		for (int y = begin.y; y < end.y; y++) {
+			size_t row = (size_t)y * width;
+			size_t tile_row = (size_t)(y - begin.y) * tile_size;
+			if (remain)
+				std::copy(remain + tile_row, remain + tile_row + (end.x - begin.x),
+					raw_out.remain_iter_.begin() + row + begin.x);
+			for (int p = plane_x; p < plane_count; p++) {
+				if (planes[p])
+					std::copy(planes[p] + tile_row, planes[p] + tile_row + (end.x - begin.x),
+						targets[p]->begin() + row + begin.x);
+			}
+		}
+	});
+}
+
+auto_pointer<image> mandelbrot_raw_file::recolor(const mandelbrot_generator::parameter_set & params) const
+{
+	auto_pointer<image> ret(new image(size()));
+	unsigned char* data = ret->data();
+	int width = size().x;
+	bool escape_time = has_plane(plane_remain_iter);
+	std::vector<unsigned char> palette;
+	if (escape_time) palette = mandelbrot_generator::julia_iter_palette(params);
+	int palette_entries = (int)palette.size() / 4;
+	bool smooth = escape_time && params.coloring_ != mandelbrot_generator::coloring_escape_time
+		&& has_plane(plane_smooth);
+	bool shaded = smooth && params.coloring_ == mandelbrot_generator::coloring_distance && has_plane(plane_distance);
+
+	for_each_tile(params.worker_count_, [&](const vector2i& tile, const vector2i& begin, const vector2i& end) {
+		const int32_t* remain = remain_iter(tile);
+		const float* x = values(tile, plane_x);
+		const float* y = values(tile, plane_y);
+		const float* smooth_iter = values(tile, plane_smooth);
+		const float* distance = values(tile, plane_distance);
+
+		for (int row = begin.y; row < end.y; row++) {
+			unsigned char* pixels = data + ((size_t)row * width + begin.x) * 4;
+			size_t tile_row = (size_t)(row - begin.y) * tile_size;
+			if (escape_time) {
+				for (int column = 0; column < end.x - begin.x; column++) {
+					/*a file of another max_iter_ must not read past the palette*/
+					int entry = std::min(std::max((int)remain[tile_row + column], 0), palette_entries - 1);
+					if (smooth)
+						mandelbrot_generator::color_escape(params, palette.data(), entry, smooth_iter[tile_row + column],
+							shaded ? distance[tile_row + column] : FLT_MAX, pixels + column * 4);
+					else
+						std::copy(&palette[entry * 4], &palette[entry * 4] + 4, pixels + column * 4);
+				}
+			}
+			else if (x && y) {
+				mandelbrot_generator::color_julia_values(params, x + tile_row, y + tile_row, end.x - begin.x, pixels);
+			}
+		}
+	});
+	return ret;
+}
+
+bool mandelbrot_raw_file::write(const std::string & path, const mandelbrot_generator::parameter_set & params,
+	const mandelbrot_generator::raw_frame & raw, std::string & error_out)
+{
+	if (raw.size_.x != params.image_dimensions_.x || raw.size_.y != params.image_dimensions_.y) {
+		error_out = "raw frame does not match the image size of the parameters";
+		return false;
+	}
+
+	unsigned int plane_mask = 0;
+	if (!raw.remain_iter_.empty()) plane_mask |= 1u << plane_remain_iter;
+	if (!raw.x_.empty()) plane_mask |= 1u << plane_x;
+	if (!raw.y_.empty()) plane_mask |= 1u << plane_y;
+	if (!raw.smooth_.empty()) plane_mask |= 1u << plane_smooth;
+	if (!raw.distance_.empty()) plane_mask |= 1u << plane_distance;
+
+	mandelbrot_raw_file file;
+	if (!file.create(path, params, plane_mask, error_out)) return false;
+	file.store(raw);
+	return true;
+}
+
+bool mandelbrot_raw_file::read(const std::string & path, mandelbrot_generator::parameter_set & params_out,
+	mandelbrot_generator::raw_frame & raw_out, std::string & error_out)
+{
+	mandelbrot_raw_file file;
+	if (!file.open(path, error_out)) return false;
+	params_out = file.parameters();
+	file.load(raw_out);
+	return true;
+}
+
+bool mandelbrot_raw_file::map(const std::string & path, size_t size, bool writable, std::string & error_out)
+{
+#ifdef _WIN32
+	file_handle_ = CreateFileA(path.c_str(), writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+		FILE_SHARE_READ, 0, writable ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file_handle_ == INVALID_HANDLE_VALUE) {
+		file_handle_ = 0;
+		error_out = "could not open " + path;
+		return false;
+	}
+	if (size == 0) {
+		LARGE_INTEGER file_size;
+		GetFileSizeEx(file_handle_, &file_size);
+		size = (size_t)file_size.QuadPart;
+	}
+	if (size == 0) {
+		close();
+		error_out = path + " is empty";
+		return false;
+	}
+
+	/*a writable mapping larger than the file extends the file*/
+	mapping_handle_ = CreateFileMappingA(file_handle_, 0, writable ? PAGE_READWRITE : PAGE_READONLY,
+		(DWORD)((unsigned long long)size >> 32), (DWORD)(size & 0xffffffff), 0);
+	if (mapping_handle_) data_ = (unsigned char*)MapViewOfFile(mapping_handle_,
+		writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+#else
+	descriptor_ = ::open(path.c_str(), writable ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+	if (descriptor_ < 0) {
+		error_out = "could not open " + path + ": " + strerror(errno);
+		return false;
+	}
+	if (size == 0) {
+		struct stat status;
+		if (fstat(descriptor_, &status) == 0) size = (size_t)status.st_size;
+	}
+	else if (ftruncate(descriptor_, (off_t)size) != 0) {
+		close();
+		error_out = "could not resize " + path + ": " + strerror(errno);
+		return false;
+	}
+	if (size == 0) {
+		close();
+		error_out = path + " is empty";
+		return false;
+	}
+
+	void* mapping = mmap(0, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, descriptor_, 0);
+	if (mapping != MAP_FAILED) data_ = (unsigned char*)mapping;
+#endif
+
+	if (!data_) {
+		close();
+		error_out = "could not map " + path;
+		return false;
+	}
+	size_ = size;
+	return true;
+}
+
+void mandelbrot_raw_file::compute_layout(unsigned int plane_mask)
+{
+	size_t plane_bytes = (size_t)tile_size * tile_size * 4;
+	tile_bytes_ = 0;
+	for (int p = 0; p < plane_count; p++) {
+		plane_offsets_[p] = tile_bytes_;
+		if (plane_mask & (1u << p)) tile_bytes_ += plane_bytes;
+	}
+	/*64x64 values are 16kB, so tiles stay page aligned anyway*/
+	tile_bytes_ = (tile_bytes_ + alignment - 1) / alignment * alignment;
+}
+
+void mandelbrot_raw_file::for_each_tile(int worker_count,
+	const std::function<void(const vector2i&, const vector2i&, const vector2i&)>& function) const
+{
+	vector2i tiles = tile_count();
+	vector2i image_size = size();
+	std::shared_ptr<render_thread_pool> pool = render_thread_pool::shared(worker_count);
+	pool->run(tiles.x * tiles.y, [&](int index) {
+		vector2i tile(index % tiles.x, index / tiles.x);
+		vector2i begin(tile.x * tile_size, tile.y * tile_size);
+		vector2i end(std::min(begin.x + tile_size, image_size.x), std::min(begin.y + tile_size, image_size.y));
+		function(tile, begin, end);
+	});
+}
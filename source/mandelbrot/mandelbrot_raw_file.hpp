@@ -0,0 +1,177 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_raw_file.hpp
+*
+* On-disk format for \bref{mandelbrot_generator::raw_frame}, written and
+* read through memory mapping
+*
+************************************************************************/
+
+#ifndef MANDELBROT_RAW_FILE_HPP_INCLUDED
+#define MANDELBROT_RAW_FILE_HPP_INCLUDED
+
+#include "mandelbrot_generator.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_raw_file
+*
+* file of the uncolored planes of a frame, split into square tiles:
+*
+*	header		4096 bytes, see \bref{header}
+*	tile 0,0	each stored plane with tile_size * tile_size 4 byte values
+*	tile 1,0	in row order, in the order of \bref{plane}
+*	...
+*
+* tiles follow in row order, tiles at the right and bottom edges are padded
+* to the full size. every tile starts at a multiple of 4096 bytes, so a plane
+* of a tile can be used in place from the mapping, and rendering or shading a
+* region only touches the pages of its tiles. values are little endian.
+* the file is mapped for its whole lifetime, the planes are not copied
+*
+************************************************************************/
+class mandelbrot_raw_file {
+public:
+	/** values stored per pixel, see \bref{mandelbrot_generator::raw_frame} */
+	enum plane {
+		plane_remain_iter,	/**< int32 */
+		plane_x,			/**< float */
+		plane_y,			/**< float */
+		plane_smooth,		/**< float */
+		plane_distance,		/**< float */
+		plane_count
+	};
+
+	/** edge length of a tile in pixels */
+	static const int tile_size = 64;
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_raw_file::header
+	* first bytes of the file, padded to header_size_
+	************************************************************************/
+	struct header {
+		char magic_[8];
+		uint32_t version_;
+		uint32_t header_size_;
+		uint32_t width_;
+		uint32_t height_;
+		uint32_t tile_size_;
+		/** bit i set if \bref{plane} i is stored */
+		uint32_t plane_mask_;
+		/** parameters the frame was generated with */
+		//{
+		int32_t max_iter_;
+		int32_t iterations_;
+		float max_threshold_;
+		float interpolation_;
+		double real_min_[2];
+		double imaginary_min_[2];
+		double real_max_[2];
+		double imaginary_max_[2];
+		/** \bref{mandelbrot_generator::escape_coloring}, 0 in files written before it existed */
+		uint32_t coloring_;
+		//}
+	};
+
+	mandelbrot_raw_file();
+	~mandelbrot_raw_file();
+
+	mandelbrot_raw_file(const mandelbrot_raw_file&) = delete;
+	mandelbrot_raw_file& operator=(const mandelbrot_raw_file&) = delete;
+
+	/**
+	* creates or truncates the file at \bref{path} for a frame of \bref{params} with the
+	* planes of \bref{plane_mask} and maps it for writing, the tiles are zero
+	*/
+	bool create(const std::string& path, const mandelbrot_generator::parameter_set& params,
+		unsigned int plane_mask, std::string& error_out);
+
+	/** maps an existing file for reading, fails on files of another format or version */
+	bool open(const std::string& path, std::string& error_out);
+
+	/** unmaps the file, done by the destructor as well */
+	void close();
+
+	bool is_open() const;
+	const header& get_header() const;
+	bool has_plane(plane p) const;
+	viral_core::vector2i size() const;
+	viral_core::vector2i tile_count() const;
+
+	/** parameters of the header, the remaining members keep their defaults */
+	mandelbrot_generator::parameter_set parameters() const;
+
+	/**
+	* values of plane \bref{p} of the tile with the given tile coordinates in place in the
+	* mapping, tile_size values per row. null if the plane is not stored. only writable
+	* after \bref{create}
+	*/
+	//{
+	int32_t* remain_iter(const viral_core::vector2i& tile) const;
+	float* values(const viral_core::vector2i& tile, plane p) const;
+	//}
+
+	/** copies the planes stored in the file from / to a frame of the same size */
+	//{
+	void store(const mandelbrot_generator::raw_frame& raw);
+	void load(mandelbrot_generator::raw_frame& raw_out) const;
+	//}
+
+	/**
+	* colors the frame straight from the mapping, escape times if the file has them, with
+	* the smooth colorings if it has the planes those need, z as
+	* \bref{mandelbrot_generator::generate_mandelbrot_image_julia_value} otherwise.
+	* \bref{params} gives the colors, its max_iter_ has to match the file
+	*/
+	viral_core::auto_pointer<viral_core::image> recolor(const mandelbrot_generator::parameter_set& params) const;
+
+	/** \bref{create} and \bref{store} in one go, the planes are the ones \bref{raw} has */
+	static bool write(const std::string& path, const mandelbrot_generator::parameter_set& params,
+		const mandelbrot_generator::raw_frame& raw, std::string& error_out);
+
+	/** \bref{open} and \bref{load} in one go */
+	static bool read(const std::string& path, mandelbrot_generator::parameter_set& params_out,
+		mandelbrot_generator::raw_frame& raw_out, std::string& error_out);
+
+private:
+	static const char magic[8];
+	static const uint32_t version = 1;
+	/** alignment of the tiles, a multiple of the page size of all supported systems */
+	static const size_t alignment = 4096;
+
+	unsigned char* data_ = 0;
+	size_t size_ = 0;
+	size_t tile_bytes_ = 0;
+	/** offset of each plane within a tile, 0 for planes that are not stored */
+	size_t plane_offsets_[plane_count];
+
+	/** operating system handles of the file and the mapping */
+	//{
+#ifdef _WIN32
+	void* file_handle_ = 0;
+	void* mapping_handle_ = 0;
+#else
+	int descriptor_ = -1;
+#endif
+	//}
+
+	/** maps \bref{path} with \bref{size} bytes, or the size of the file if \bref{size} is 0 */
+	bool map(const std::string& path, size_t size, bool writable, std::string& error_out);
+
+	/** tile_bytes_ and plane_offsets_ for the planes of \bref{plane_mask} */
+	void compute_layout(unsigned int plane_mask);
+
+	/** calls \bref{function}(tile, begin, end) for all tiles, end being exclusive */
+	void for_each_tile(int worker_count,
+		const std::function<void(const viral_core::vector2i&, const viral_core::vector2i&,
+			const viral_core::vector2i&)>& function) const;
+};
+
+#endif//#ifndef MANDELBROT_RAW_FILE_HPP_INCLUDED
@@ -0,0 +1,265 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_render_scheduler.cpp
+*
+* implementation of \bref{mandelbrot_render_scheduler}
+*
+************************************************************************/
+
+#include "mandelbrot_render_scheduler.hpp"
+#include "mandelbrot_orbit_cache.hpp"
+#include "mandelbrot_profiler.hpp"
+#include "mandelbrot_tile_cache.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace viral_core;
+
+//////////////////////////////////////////////////////////////////////////
+//
+// mandelbrot_render_scheduler
+//
+//////////////////////////////////////////////////////////////////////////
+
+mandelbrot_render_scheduler::mandelbrot_render_scheduler(int job_threads, int pooled_images) :
+	image_pool_(pooled_images)
+{
+	if (job_threads <= 0) job_threads = 1;
+	for (int i = 0; i < job_threads; i++)
+		threads_.push_back(std::thread(&mandelbrot_render_scheduler::thread_main, this));
+}
+
+mandelbrot_render_scheduler::~mandelbrot_render_scheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+		for (auto& entry : jobs_) entry.second->control.cancel_ = true;
+	}
+	condition_.notify_all();
+	for (size_t i = 0; i < threads_.size(); i++) threads_[i].join();
+
+	completion_node* node = completions_.exchange(nullptr);
+	while (node) {
+		completion_node* next = node->next;
+		delete node;
+		node = next;
+	}
+}
+
+int mandelbrot_render_scheduler::submit(const request & r)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	/*the queued jobs of the channel are superseded, a running one is left to the caller*/
+	if (r.channel_ >= 0) {
+		std::vector<job*> superseded;
+		for (auto& entry : jobs_)
+			if (!entry.second->running && entry.second->req.channel_ == r.channel_) superseded.push_back(entry.second.get());
+		for (size_t i = 0; i < superseded.size(); i++) drop_queued(*superseded[i]);
+	}
+
+	std::unique_ptr<job> j(new job());
+	j->id = next_job_++;
+	j->req = r;
+	j->sequence = next_sequence_++;
+	queue_entry entry = { r.priority_, j->sequence, j->id };
+	queue_.push(entry);
+	int id = j->id;
+	jobs_[id] = std::move(j);
+
+	preempt_for(r.priority_);
+	condition_.notify_one();
+	return id;
+}
+
+void mandelbrot_render_scheduler::cancel(int job_id)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto found = jobs_.find(job_id);
+	if (found == jobs_.end()) return;
+
+	job& j = *found->second;
+	if (!j.running) {
+		drop_queued(j);
+		return;
+	}
+	j.cancelled = true;
+	j.control.cancel_ = true;
+}
+
+std::vector<std::unique_ptr<mandelbrot_render_scheduler::completion> > mandelbrot_render_scheduler::take_completions()
+{
+	completion_node* node = completions_.exchange(nullptr, std::memory_order_acquire);
+
+	std::vector<std::unique_ptr<completion> > ret;
+	while (node) {
+		completion_node* next = node->next;
+		ret.push_back(std::move(node->value));
+		delete node;
+		node = next;
+	}
+	std::reverse(ret.begin(), ret.end());
+	return ret;
+}
+
+void mandelbrot_render_scheduler::recycle(auto_pointer<image>& img)
+{
+	image_pool_.recycle(img);
+}
+
+bool mandelbrot_render_scheduler::queue_entry::operator<(const queue_entry & other) const
+{
+	if (priority != other.priority) return priority < other.priority;
+	return sequence > other.sequence;
+}
+
+void mandelbrot_render_scheduler::thread_main()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	for (;;) {
+		job* j = 0;
+		while (!stopping_ && !(j = pop_runnable())) condition_.wait(lock);
+		if (stopping_) return;
+
+		j->running = true;
+		running_jobs_++;
+		lock.unlock();
+
+		std::unique_ptr<completion> c(new completion());
+		bool completed = render(*j, *c);
+
+		lock.lock();
+		j->running = false;
+		running_jobs_--;
+		/*the channel of the job is free again*/
+		condition_.notify_all();
+
+		if (!completed && j->preempted && !j->cancelled && !stopping_) {
+			j->preempted = false;
+			j->control.cancel_ = false;
+			j->restarts++;
+			queue_entry entry = { j->req.priority_, j->sequence, j->id };
+			queue_.push(entry);
+			image_pool_.recycle(c->image_);
+			continue;
+		}
+
+		c->job_ = j->id;
+		c->request_ = j->req;
+		c->completed_ = completed;
+		c->restarts_ = j->restarts;
+		if (!completed) {
+			image_pool_.recycle(c->image_);
+			c->raw_frame_ = mandelbrot_generator::raw_frame();
+		}
+		jobs_.erase(j->id);
+		push_completion(std::move(c));
+	}
+}
+
+mandelbrot_render_scheduler::job * mandelbrot_render_scheduler::pop_runnable()
+{
+	std::vector<queue_entry> blocked;
+	job* ret = 0;
+	while (!queue_.empty()) {
+		queue_entry entry = queue_.top();
+		queue_.pop();
+
+		auto found = jobs_.find(entry.job);
+		if (found == jobs_.end()) continue;//cancelled or superseded
+		if (found->second->req.channel_ >= 0 && channel_running(found->second->req.channel_)) {
+			blocked.push_back(entry);
+			continue;
+		}
+		ret = found->second.get();
+		break;
+	}
+	for (size_t i = 0; i < blocked.size(); i++) queue_.push(blocked[i]);
+	return ret;
+}
+
+bool mandelbrot_render_scheduler::channel_running(int channel) const
+{
+	for (auto& entry : jobs_)
+		if (entry.second->running && entry.second->req.channel_ == channel) return true;
+	return false;
+}
+
+void mandelbrot_render_scheduler::preempt_for(int priority)
+{
+	if (running_jobs_ < (int)threads_.size()) return;
+
+	job* lowest = 0;
+	for (auto& entry : jobs_) {
+		job& j = *entry.second;
+		if (!j.running || j.cancelled || j.preempted || j.req.priority_ >= priority) continue;
+		if (!lowest || j.req.priority_ < lowest->req.priority_) lowest = &j;
+	}
+	if (!lowest) return;
+
+	lowest->preempted = true;
+	lowest->control.cancel_ = true;
+}
+
+void mandelbrot_render_scheduler::drop_queued(job & j)
+{
+	std::unique_ptr<completion> c(new completion());
+	c->job_ = j.id;
+	c->request_ = j.req;
+	c->restarts_ = j.restarts;
+	/*its queue entry is skipped once it reaches the top*/
+	jobs_.erase(j.id);
+	push_completion(std::move(c));
+}
+
+bool mandelbrot_render_scheduler::render(job & j, completion & out)
+{
+	MANDELBROT_PROFILE_SCOPE("scheduled frame",
+		(long long)j.req.parameters_.image_dimensions_.x * j.req.parameters_.image_dimensions_.y);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	/*single pass jobs get the control too, so they are cancelled per tile as well*/
+	j.control.passes_ = j.req.progressive_;
+	j.control.on_pass_ = [&](const image& img, bool final_pass) {
+		if (final_pass) return;//becomes the result anyway
+
+		/*the generator keeps writing into img, the caller gets a copy*/
+		std::unique_ptr<completion> preview(new completion());
+		preview->job_ = j.id;
+		preview->request_ = j.req;
+		preview->final_ = false;
+		preview->completed_ = true;
+		preview->image_.reset(image_pool_.acquire(img.size()).release());
+		std::copy(img.data(), img.data() + img.size().x * img.size().y * 4, preview->image_->data());
+		preview->render_milliseconds_ =
+			std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		preview->restarts_ = j.restarts;
+		push_completion(std::move(preview));
+	};
+
+	out.image_.reset(image_pool_.acquire(j.req.parameters_.image_dimensions_).release());
+	mandelbrot_generator::raw_frame* raw = j.req.keep_raw_frame_ ? &out.raw_frame_ : 0;
+	bool completed;
+	if (j.req.escape_time_)
+		completed = mandelbrot_generator::generate_mandelbrot_image_julia_iter(j.req.parameters_, *out.image_,
+			&out.statistics_, &j.control, raw, j.req.tile_cache_);
+	else
+		completed = mandelbrot_generator::generate_mandelbrot_image_julia_value(j.req.parameters_, *out.image_,
+			&j.control, j.req.orbit_cache_, raw);
+
+	out.render_milliseconds_ =
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return completed;
+}
+
+void mandelbrot_render_scheduler::push_completion(std::unique_ptr<completion> c)
+{
+	completion_node* node = new completion_node();
+	node->value = std::move(c);
+	node->next = completions_.load(std::memory_order_relaxed);
+	while (!completions_.compare_exchange_weak(node->next, node,
+		std::memory_order_release, std::memory_order_relaxed));
+}
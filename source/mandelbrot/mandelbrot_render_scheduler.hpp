@@ -0,0 +1,224 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_render_scheduler.hpp
+*
+* Long-lived threads rendering frames of \bref{mandelbrot_generator} by
+* priority, with cancellation and lock-free delivery of the results
+*
+************************************************************************/
+
+#ifndef MANDELBROT_RENDER_SCHEDULER_HPP_INCLUDED
+#define MANDELBROT_RENDER_SCHEDULER_HPP_INCLUDED
+
+#include <viral_core/auto_pointer.hpp>
+#include <viral_core/image.hpp>
+
+#include "mandelbrot_generator.hpp"
+#include "mandelbrot_image_pool.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class mandelbrot_orbit_cache;
+class mandelbrot_tile_cache;
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_render_scheduler
+*
+* frames are submitted as jobs into a priority queue and rendered by job
+* threads that live as long as the scheduler, each frame on all cores
+* through the \bref{render_thread_pool}.
+*
+* a job can be cancelled at any time, it stops after the tiles in progress.
+* jobs of a channel run one after the other, and submitting a job drops the
+* ones of its channel that did not start yet, so a caller that submits
+* faster than the frames render only renders the latest one. if all job
+* threads are busy, a job of a higher priority preempts the running job of
+* the lowest priority, which goes back to the queue and starts over later.
+*
+* the job threads push their results onto a lock-free list that the caller
+* takes from whenever it likes, e.g. once per frame of the gui, without
+* waiting for a job thread. the images of the results come from a pool and
+* should be given back with \bref{recycle}
+*
+************************************************************************/
+class mandelbrot_render_scheduler {
+public:
+	/** suggested priorities, any int can be used, higher ones run first */
+	enum priority {
+		priority_background = 0,	/**< e.g. frames nobody looks at yet */
+		priority_normal = 1,		/**< frames in full quality */
+		priority_interactive = 2	/**< frames while the view changes */
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_render_scheduler::request
+	* a frame to render
+	************************************************************************/
+	class request {
+	public:
+		mandelbrot_generator::parameter_set parameters_;
+		/** \bref{mandelbrot_generator::generate_mandelbrot_image_julia_iter} instead of julia_value */
+		bool escape_time_ = false;
+		/** renders in passes, every pass but the last is delivered as a preview */
+		bool progressive_ = false;
+		/** fills completion::raw_frame_ */
+		bool keep_raw_frame_ = false;
+		/** may be null, they must only be used by the jobs of one channel */
+		//{
+		mandelbrot_orbit_cache* orbit_cache_ = 0;
+		mandelbrot_tile_cache* tile_cache_ = 0;
+		//}
+		int priority_ = priority_normal;
+		/** jobs of the same channel run in turn and supersede each other, -1 for none */
+		int channel_ = -1;
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_render_scheduler::completion
+	* the result of a job or a preview of it
+	************************************************************************/
+	class completion {
+	public:
+		/** as returned by \bref{submit} */
+		int job_ = 0;
+		request request_;
+		/** false for the previews of the passes, they all come before the final completion */
+		bool final_ = true;
+		/** false if the job was cancelled or superseded, the image is empty then */
+		bool completed_ = false;
+		/** the frame or the preview */
+		viral_core::auto_pointer<viral_core::image> image_;
+		mandelbrot_generator::raw_frame raw_frame_;
+		/** work of an escape time frame */
+		mandelbrot_generator::frame_statistics statistics_;
+		/** time the job rendered since it last started, 0 if it never started */
+		double render_milliseconds_ = 0.;
+		/** times the job was preempted and started over */
+		int restarts_ = 0;
+	};
+
+	/**
+	* starts \bref{job_threads} job threads, values <= 0 start 1. the tiles of concurrent
+	* jobs share the \bref{render_thread_pool}, so more than one only helps to overlap
+	* the parts of a frame that do not use all cores. \bref{pooled_images} images are
+	* kept for reuse by later jobs
+	*/
+	explicit mandelbrot_render_scheduler(int job_threads = 1, int pooled_images = 4);
+	/** cancels all jobs and waits for the running ones, their completions are dropped */
+	~mandelbrot_render_scheduler();
+
+	mandelbrot_render_scheduler(const mandelbrot_render_scheduler&) = delete;
+	mandelbrot_render_scheduler& operator=(const mandelbrot_render_scheduler&) = delete;
+
+	/** queues \bref{r} and returns the id of its job, ids start at 1 */
+	int submit(const request& r);
+
+	/**
+	* a queued job completes as cancelled right away, a running one once its tiles in
+	* progress are done. unknown and finished jobs are ignored
+	*/
+	void cancel(int job);
+
+	/** completions since the last call in the order they happened, never blocks */
+	std::vector<std::unique_ptr<completion> > take_completions();
+
+	/** gives the image of a completion back for later jobs, \bref{img} is empty afterwards */
+	void recycle(viral_core::auto_pointer<viral_core::image>& img);
+
+private:
+	/**
+	*************************************************************************
+	* @class mandelbrot_render_scheduler::job
+	* a submitted request until it completes
+	************************************************************************/
+	struct job {
+		int id;
+		request req;
+		/** submission order, equal priorities run in it */
+		long long sequence;
+		mandelbrot_generator::progressive_control control;
+		bool running = false;
+		bool cancelled = false;
+		/** cancelled to make room for a job of a higher priority, it is queued again */
+		bool preempted = false;
+		int restarts = 0;
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_render_scheduler::queue_entry
+	* position of a job in the queue
+	************************************************************************/
+	struct queue_entry {
+		int priority;
+		long long sequence;
+		int job;
+
+		/** the top of the queue is the highest priority, the earliest first */
+		bool operator<(const queue_entry& other) const;
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_render_scheduler::completion_node
+	* element of the lock-free list of completions
+	************************************************************************/
+	struct completion_node {
+		std::unique_ptr<completion> value;
+		completion_node* next;
+	};
+
+	mandelbrot_image_pool image_pool_;
+
+	/** all state below is guarded by the mutex */
+	//{
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	/** queued and running jobs by id */
+	std::unordered_map<int, std::unique_ptr<job> > jobs_;
+	/** cancelled and superseded jobs stay in it until they reach the top */
+	std::priority_queue<queue_entry> queue_;
+	int next_job_ = 1;
+	long long next_sequence_ = 0;
+	int running_jobs_ = 0;
+	bool stopping_ = false;
+	//}
+
+	/** newest first, pushed by any thread and taken as a whole by \bref{take_completions} */
+	std::atomic<completion_node*> completions_{ nullptr };
+
+	std::vector<std::thread> threads_;
+
+	void thread_main();
+
+	/**
+	* takes the first job in the queue whose channel has no running job, null if there
+	* is none. lock held
+	*/
+	job* pop_runnable();
+	/** true if a job of \bref{channel} is running, lock held */
+	bool channel_running(int channel) const;
+	/** preempts the running job of the lowest priority below \bref{priority} if no thread is free, lock held */
+	void preempt_for(int priority);
+	/** removes a job that did not start and delivers its completion, lock held */
+	void drop_queued(job& j);
+
+	/** renders the job into \bref{out}, false if it was cancelled */
+	bool render(job& j, completion& out);
+
+	void push_completion(std::unique_ptr<completion> c);
+};
+
+#endif//#ifndef MANDELBROT_RENDER_SCHEDULER_HPP_INCLUDED
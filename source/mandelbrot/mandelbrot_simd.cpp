@@ -0,0 +1,955 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_simd.cpp
+*
+* implementation of \bref{mandelbrot_simd}
+*
+************************************************************************/
+
+/*
+* the scalar loop and the kernels must round alike. gcc and clang are built with
+* -ffp-contract=off, msvc would contract a*b+c into fma under /fp:precise as well
+*/
+#ifdef _MSC_VER
+#pragma fp_contract(off)
+#endif
+
+#include "mandelbrot_simd.hpp"
+
+#include <math.h>
+#include <algorithm>
+#include <type_traits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MANDELBROT_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+/*msvc accepts intrinsics of any instruction set, gcc and clang need them enabled per function*/
+#if defined(MANDELBROT_SIMD_X86) && !defined(_MSC_VER)
+#define MANDELBROT_TARGET_AVX2 __attribute__((target("avx2")))
+#define MANDELBROT_TARGET_AVX512 __attribute__((target("avx512f")))
+/*
+* the formula steps are compiled without a target, their lane operations can only be
+* inlined once the step itself is inlined into a kernel of the instruction set
+*/
+#define MANDELBROT_FLATTEN __attribute__((flatten))
+#else
+#define MANDELBROT_TARGET_AVX2
+#define MANDELBROT_TARGET_AVX512
+#define MANDELBROT_FLATTEN
+#endif
+
+#ifdef _MSC_VER
+#define MANDELBROT_FORCE_INLINE __forceinline
+#else
+#define MANDELBROT_FORCE_INLINE inline
+#endif
+
+/*avx-512 intrinsics are available from visual studio 2017 on*/
+#if defined(MANDELBROT_SIMD_X86) && (!defined(_MSC_VER) || _MSC_VER >= 1911)
+#define MANDELBROT_SIMD_AVX512
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//
+// mandelbrot_simd
+//
+//////////////////////////////////////////////////////////////////////////
+
+mandelbrot_simd::simd_level mandelbrot_simd::supported_level()
+{
+	static const simd_level level = detect_level();
+	return level;
+}
+
+mandelbrot_simd::simd_level mandelbrot_simd::resolve(simd_level requested)
+{
+	simd_level supported = supported_level();
+	if (requested == automatic || requested > supported) return supported;
+	return requested;
+}
+
+void mandelbrot_simd::escape_statistics::add(const escape_statistics & other)
+{
+	iterations += other.iterations;
+	interior_pixels += other.interior_pixels;
+	interior_skipped_iterations += other.interior_skipped_iterations;
+	periodic_pixels += other.periodic_pixels;
+	periodic_skipped_iterations += other.periodic_skipped_iterations;
+}
+
+/** \bref{out} advanced by \bref{offset}, outputs that were not requested stay null */
+static float* output_offset(float* out, int offset)
+{
+	return out ? out + offset : 0;
+}
+
+float mandelbrot_simd::exterior_distance(double x, double y, double dx, double dy, double scale)
+{
+	double abs_z = sqrt(x * x + y * y);
+	double abs_dz = sqrt(dx * dx + dy * dy);
+	if (!(abs_z > 1.) || !(abs_dz > 0.)) return 0.f;
+	return (float)(0.5 * abs_z * log(abs_z) / abs_dz * scale);
+}
+
+template<typename scalar_type>
+void mandelbrot_simd::escape_time_dispatch(simd_level level, const scalar_type * re, const scalar_type * im, int count,
+	const escape_parameters & params, int * remain_iter_out, escape_statistics & statistics,
+	float * x_out, float * y_out, float * distance_out)
+{
+	escape_statistics local;
+
+	if (!params.interior_check || !params.formula.quadratic_mandelbrot()) {
+		escape_time_kernel(level, re, im, count, params, remain_iter_out, local, x_out, y_out, distance_out);
+	}
+	else {
+		/*the points outside of cardioid and bulb are packed, so no vector lane idles on interior points*/
+		const int chunk_size = 256;
+		scalar_type re_chunk[chunk_size];
+		scalar_type im_chunk[chunk_size];
+		int remain_chunk[chunk_size];
+		int index_chunk[chunk_size];
+		float x_chunk[chunk_size];
+		float y_chunk[chunk_size];
+		float distance_chunk[chunk_size];
+
+		for (int begin = 0; begin < count; begin += chunk_size) {
+			int end = std::min(begin + chunk_size, count);
+			int packed = 0;
+			for (int i = begin; i < end; i++) {
+				if (in_main_cardioid_or_bulb(re[i], im[i])) {
+					remain_iter_out[i] = 0;
+					if (x_out) x_out[i] = y_out[i] = 0.f;
+					if (distance_out) distance_out[i] = 0.f;
+					local.interior_pixels++;
+					local.interior_skipped_iterations += params.max_iter;
+				}
+				else {
+					re_chunk[packed] = re[i];
+					im_chunk[packed] = im[i];
+					index_chunk[packed] = i;
+					packed++;
+				}
+			}
+
+			escape_time_kernel(level, re_chunk, im_chunk, packed, params, remain_chunk, local,
+				x_out ? x_chunk : 0, y_out ? y_chunk : 0, distance_out ? distance_chunk : 0);
+			for (int j = 0; j < packed; j++) remain_iter_out[index_chunk[j]] = remain_chunk[j];
+			if (x_out) {
+				for (int j = 0; j < packed; j++) {
+					x_out[index_chunk[j]] = x_chunk[j];
+					y_out[index_chunk[j]] = y_chunk[j];
+				}
+			}
+			if (distance_out) {
+				for (int j = 0; j < packed; j++) distance_out[index_chunk[j]] = distance_chunk[j];
+			}
+		}
+	}
+
+	long long iterations = 0;
+	for (int i = 0; i < count; i++) iterations += params.max_iter - remain_iter_out[i];
+	local.iterations = iterations - local.interior_skipped_iterations - local.periodic_skipped_iterations;
+	statistics.add(local);
+}
+
+template<typename scalar_type>
+void mandelbrot_simd::escape_time_kernel(simd_level level, const scalar_type * re, const scalar_type * im, int count,
+	const escape_parameters & params, int * remain_iter_out, escape_statistics & statistics,
+	float * x_out, float * y_out, float * distance_out)
+{
+	params.formula.dispatch([&](auto step) {
+		escape_time_level<decltype(step)>(level, re, im, count, params, remain_iter_out, statistics,
+			x_out, y_out, distance_out);
+	});
+}
+
+template<typename step>
+void mandelbrot_simd::escape_time_level(simd_level level, const float * re, const float * im, int count,
+	const escape_parameters & params, int * remain_iter_out, escape_statistics & statistics,
+	float * x_out, float * y_out, float * distance_out)
+{
+	switch (level) {
+	case avx512:
+		escape_time_avx512<step>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+		break;
+	case avx2:
+		escape_time_avx2<step>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+		break;
+	default:
+		escape_time_scalar<step>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+		break;
+	}
+}
+
+template<typename step>
+void mandelbrot_simd::escape_time_level(simd_level level, const double * re, const double * im, int count,
+	const escape_parameters & params, int * remain_iter_out, escape_statistics & statistics,
+	float * x_out, float * y_out, float * distance_out)
+{
+	switch (level) {
+	case avx512:
+		escape_time_avx512<step>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+		break;
+	case avx2:
+		escape_time_avx2<step>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+		break;
+	default:
+		escape_time_scalar<step>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+		break;
+	}
+}
+
+template<typename step>
+void mandelbrot_simd::escape_time_level(simd_level, const double_double * re, const double_double * im, int count,
+	const escape_parameters & params, int * remain_iter_out, escape_statistics & statistics,
+	float * x_out, float * y_out, float * distance_out)
+{
+	escape_time_scalar<step>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+}
+
+template<typename scalar_type>
+void mandelbrot_simd::advance_iterations_dispatch(simd_level level, const mandelbrot_formula & formula,
+	const scalar_type * re, const scalar_type * im, int count, int iterations,
+	scalar_type * x_inout, scalar_type * y_inout)
+{
+	formula.dispatch([&](auto step) {
+		advance_iterations_level<decltype(step)>(resolve(level), formula, re, im, count, iterations,
+			x_inout, y_inout);
+	});
+}
+
+template<typename step>
+void mandelbrot_simd::advance_iterations_level(simd_level level, const mandelbrot_formula & formula,
+	const float * re, const float * im, int count, int iterations, float * x_inout, float * y_inout)
+{
+	switch (level) {
+	case avx512:
+		advance_iterations_avx512<step>(formula, re, im, count, iterations, x_inout, y_inout);
+		break;
+	case avx2:
+		advance_iterations_avx2<step>(formula, re, im, count, iterations, x_inout, y_inout);
+		break;
+	default:
+		advance_iterations_scalar<step>(formula, re, im, count, iterations, x_inout, y_inout);
+		break;
+	}
+}
+
+template<typename step>
+void mandelbrot_simd::advance_iterations_level(simd_level level, const mandelbrot_formula & formula,
+	const double * re, const double * im, int count, int iterations, double * x_inout, double * y_inout)
+{
+	switch (level) {
+	case avx512:
+		advance_iterations_avx512<step>(formula, re, im, count, iterations, x_inout, y_inout);
+		break;
+	case avx2:
+		advance_iterations_avx2<step>(formula, re, im, count, iterations, x_inout, y_inout);
+		break;
+	default:
+		advance_iterations_scalar<step>(formula, re, im, count, iterations, x_inout, y_inout);
+		break;
+	}
+}
+
+template<typename step>
+void mandelbrot_simd::advance_iterations_level(simd_level, const mandelbrot_formula & formula,
+	const double_double * re, const double_double * im, int count, int iterations,
+	double_double * x_inout, double_double * y_inout)
+{
+	advance_iterations_scalar<step>(formula, re, im, count, iterations, x_inout, y_inout);
+}
+
+void mandelbrot_simd::escape_time(simd_level level, const float * re, const float * im, int count,
+	const escape_parameters & params, int * remain_iter_out, escape_statistics & statistics,
+	float * x_out, float * y_out, float * distance_out)
+{
+	escape_time_dispatch(resolve(level), re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+}
+
+void mandelbrot_simd::escape_time(simd_level level, const double * re, const double * im, int count,
+	const escape_parameters & params, int * remain_iter_out, escape_statistics & statistics,
+	float * x_out, float * y_out, float * distance_out)
+{
+	escape_time_dispatch(resolve(level), re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+}
+
+void mandelbrot_simd::escape_time(simd_level, const double_double * re, const double_double * im, int count,
+	const escape_parameters & params, int * remain_iter_out, escape_statistics & statistics,
+	float * x_out, float * y_out, float * distance_out)
+{
+	escape_time_dispatch(scalar, re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+}
+
+void mandelbrot_simd::fixed_iterations(simd_level level, const mandelbrot_formula & formula, const float * re,
+	const float * im, int count, int iterations, float * x_out, float * y_out)
+{
+	std::copy(re, re + count, x_out);
+	std::copy(im, im + count, y_out);
+	advance_iterations_dispatch(level, formula, re, im, count, iterations, x_out, y_out);
+}
+
+void mandelbrot_simd::fixed_iterations(simd_level level, const mandelbrot_formula & formula, const double * re,
+	const double * im, int count, int iterations, double * x_out, double * y_out)
+{
+	std::copy(re, re + count, x_out);
+	std::copy(im, im + count, y_out);
+	advance_iterations_dispatch(level, formula, re, im, count, iterations, x_out, y_out);
+}
+
+void mandelbrot_simd::fixed_iterations(simd_level, const mandelbrot_formula & formula, const double_double * re,
+	const double_double * im, int count, int iterations, double_double * x_out, double_double * y_out)
+{
+	std::copy(re, re + count, x_out);
+	std::copy(im, im + count, y_out);
+	advance_iterations_dispatch(scalar, formula, re, im, count, iterations, x_out, y_out);
+}
+
+void mandelbrot_simd::advance_iterations(simd_level level, const mandelbrot_formula & formula, const float * re,
+	const float * im, int count, int iterations, float * x_inout, float * y_inout)
+{
+	advance_iterations_dispatch(level, formula, re, im, count, iterations, x_inout, y_inout);
+}
+
+void mandelbrot_simd::advance_iterations(simd_level level, const mandelbrot_formula & formula, const double * re,
+	const double * im, int count, int iterations, double * x_inout, double * y_inout)
+{
+	advance_iterations_dispatch(level, formula, re, im, count, iterations, x_inout, y_inout);
+}
+
+void mandelbrot_simd::advance_iterations(simd_level, const mandelbrot_formula & formula, const double_double * re,
+	const double_double * im, int count, int iterations, double_double * x_inout, double_double * y_inout)
+{
+	advance_iterations_dispatch(scalar, formula, re, im, count, iterations, x_inout, y_inout);
+}
+
+/** zeroes the remaining iterations of the lanes flagged in \bref{periodic_mask} and counts them */
+static void finish_periodic_lanes(int lanes, unsigned int periodic_mask, const int* remain_iter,
+	int* remain_iter_out, mandelbrot_simd::escape_statistics& statistics)
+{
+	for (int j = 0; j < lanes; j++) {
+		if (periodic_mask & (1u << j)) {
+			statistics.periodic_pixels++;
+			statistics.periodic_skipped_iterations += remain_iter[j];
+			remain_iter_out[j] = 0;
+		}
+		else remain_iter_out[j] = remain_iter[j];
+	}
+}
+
+/** distances of the first \bref{lanes} lanes from z (\bref{values}[0], [1]) and dz/dc ([2], [3]) */
+template<typename lane_type, int lane_count>
+static void finish_distance_lanes(int lanes, const lane_type (&values)[4][lane_count], const int* remain_iter,
+	double distance_scale, float* distance_out)
+{
+	for (int j = 0; j < lanes; j++) {
+		distance_out[j] = remain_iter[j] > 0
+			? mandelbrot_simd::exterior_distance(values[0][j], values[1][j], values[2][j], values[3][j], distance_scale)
+			: 0.f;
+	}
+}
+
+/**
+* full vectors of the escape time kernels, returns how many points were done. \bref{lanes}
+* is one of the register types below, the formula \bref{step} computes with its value type.
+* lanes that escaped or became periodic keep their values, the others do the operations of
+* mandelbrot_simd::escape_time_scalar in the same order
+*/
+template<typename lanes, typename step, bool keep_z, bool keep_derivative>
+static int escape_time_lanes(const typename lanes::scalar * re, const typename lanes::scalar * im, int count,
+	const mandelbrot_simd::escape_parameters & params, int * remain_iter_out,
+	mandelbrot_simd::escape_statistics & statistics, float * x_out, float * y_out, float * distance_out)
+{
+	typedef typename lanes::value value;
+	typedef typename lanes::mask mask;
+	const mandelbrot_formula& formula = params.formula;
+	const value threshold = value(params.max_threshold);
+	const value one_real = value(1.);
+	const value derivative_offset = value(formula.julia_ ? 0. : 1.);
+	const value julia_re = value(formula.julia_re_);
+	const value julia_im = value(formula.julia_im_);
+	int i = 0;
+	for (; i + lanes::count <= count; i += lanes::count) {
+		value re_part = lanes::load(re + i);
+		value im_part = lanes::load(im + i);
+		value c_x = formula.julia_ ? julia_re : re_part;
+		value c_y = formula.julia_ ? julia_im : im_part;
+
+		typename lanes::counter remain_iter = lanes::counters(params.max_iter);
+		value xx = re_part * re_part;
+		value yy = im_part * im_part;
+		value xy = re_part * im_part;
+		value abs_2 = xx + yy;
+
+		value z_x = re_part;
+		value z_y = im_part;
+		value dz_x = one_real;
+		value dz_y = value(0.);
+		value check_x = re_part;
+		value check_y = im_part;
+		mask periodic = lanes::none();
+		int check_interval = 1;
+		int check_steps = 0;
+
+		for (int n = 0; n < params.max_iter; n++) {
+			mask active = lanes::without(lanes::less_equal(abs_2, threshold), periodic);
+			if (lanes::bits(active) == 0) break;
+
+			remain_iter = lanes::decrement(remain_iter, active);
+
+			value x, y;
+			step::iterate(z_x, z_y, xx, yy, xy, c_x, c_y, x, y);
+			xx = lanes::select(active, x * x, xx);
+			yy = lanes::select(active, y * y, yy);
+			xy = lanes::select(active, x * y, xy);
+			abs_2 = lanes::select(active, xx + yy, abs_2);
+			if (keep_derivative) {
+				/*with the z before this step*/
+				value next_dz_x, next_dz_y;
+				step::derivative(z_x, z_y, dz_x, dz_y, derivative_offset, next_dz_x, next_dz_y);
+				dz_x = lanes::select(active, next_dz_x, dz_x);
+				dz_y = lanes::select(active, next_dz_y, dz_y);
+			}
+			if (keep_z) {
+				z_x = lanes::select(active, x, z_x);
+				z_y = lanes::select(active, y, z_y);
+			}
+			else if (step::needs_z) {
+				/*only the lanes that are still active are read again*/
+				z_x = x;
+				z_y = y;
+			}
+
+			if (params.periodicity_check) {
+				mask same = lanes::both(lanes::equal(x, check_x), lanes::equal(y, check_y));
+				periodic = lanes::either(periodic, lanes::both(same, active));
+				if (++check_steps == check_interval) {
+					check_x = x;
+					check_y = y;
+					check_steps = 0;
+					check_interval *= 2;
+				}
+			}
+		}
+
+		int remain[lanes::count];
+		lanes::store_counters(remain, remain_iter);
+		finish_periodic_lanes(lanes::count, lanes::bits(periodic), remain, remain_iter_out + i, statistics);
+		if (keep_z) {
+			lanes::store_float(x_out + i, z_x);
+			lanes::store_float(y_out + i, z_y);
+		}
+		if (keep_derivative) {
+			typename lanes::scalar values[4][lanes::count];
+			lanes::store(values[0], z_x);
+			lanes::store(values[1], z_y);
+			lanes::store(values[2], dz_x);
+			lanes::store(values[3], dz_y);
+			finish_distance_lanes(lanes::count, values, remain_iter_out + i, params.distance_scale, distance_out + i);
+		}
+	}
+	return i;
+}
+
+/** full vectors of the fixed iteration kernels, as \bref{escape_time_lanes} */
+template<typename lanes, typename step>
+static int advance_iterations_lanes(const mandelbrot_formula & formula, const typename lanes::scalar * re,
+	const typename lanes::scalar * im, int count, int iterations,
+	typename lanes::scalar * x_inout, typename lanes::scalar * y_inout)
+{
+	typedef typename lanes::value value;
+	const value julia_re = value(formula.julia_re_);
+	const value julia_im = value(formula.julia_im_);
+	int i = 0;
+	for (; i + lanes::count <= count; i += lanes::count) {
+		value c_x = formula.julia_ ? julia_re : lanes::load(re + i);
+		value c_y = formula.julia_ ? julia_im : lanes::load(im + i);
+
+		value x = lanes::load(x_inout + i);
+		value y = lanes::load(y_inout + i);
+		value xx = x * x;
+		value yy = y * y;
+		value xy = x * y;
+
+		for (int j = 0; j < iterations; j++) {
+			value next_x, next_y;
+			step::iterate(x, y, xx, yy, xy, c_x, c_y, next_x, next_y);
+			x = next_x;
+			y = next_y;
+			xx = x * x;
+			yy = y * y;
+			xy = x * y;
+		}
+		lanes::store(x_inout + i, x);
+		lanes::store(y_inout + i, y);
+	}
+	return i;
+}
+
+#ifdef MANDELBROT_SIMD_X86
+
+/**
+* registers of the avx2 kernels. value is what the formula steps compute with, the
+* static functions are the masked operations of \bref{escape_time_lanes}
+*/
+//{
+struct avx2_float_lanes {
+	typedef float scalar;
+	typedef __m256 mask;
+	typedef __m256i counter;
+	static const int count = 8;
+
+	struct value {
+		__m256 v;
+
+		value() {}
+		MANDELBROT_TARGET_AVX2 MANDELBROT_FORCE_INLINE explicit value(__m256 vector) : v(vector) {}
+		MANDELBROT_TARGET_AVX2 MANDELBROT_FORCE_INLINE explicit value(double constant) :
+			v(_mm256_set1_ps((float)constant)) {}
+
+		MANDELBROT_TARGET_AVX2 MANDELBROT_FORCE_INLINE friend value operator+(const value& a, const value& b)
+			{ return value(_mm256_add_ps(a.v, b.v)); }
+		MANDELBROT_TARGET_AVX2 MANDELBROT_FORCE_INLINE friend value operator-(const value& a, const value& b)
+			{ return value(_mm256_sub_ps(a.v, b.v)); }
+		MANDELBROT_TARGET_AVX2 MANDELBROT_FORCE_INLINE friend value operator*(const value& a, const value& b)
+			{ return value(_mm256_mul_ps(a.v, b.v)); }
+		MANDELBROT_TARGET_AVX2 MANDELBROT_FORCE_INLINE friend value abs(const value& a)
+			{ return value(_mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v)); }
+	};
+
+	MANDELBROT_TARGET_AVX2 static value load(const float* p) { return value(_mm256_loadu_ps(p)); }
+	MANDELBROT_TARGET_AVX2 static void store(float* p, const value& a) { _mm256_storeu_ps(p, a.v); }
+	MANDELBROT_TARGET_AVX2 static void store_float(float* p, const value& a) { _mm256_storeu_ps(p, a.v); }
+	MANDELBROT_TARGET_AVX2 static value select(mask m, const value& if_set, const value& otherwise)
+		{ return value(_mm256_blendv_ps(otherwise.v, if_set.v, m)); }
+
+	MANDELBROT_TARGET_AVX2 static mask less_equal(const value& a, const value& b)
+		{ return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+	MANDELBROT_TARGET_AVX2 static mask equal(const value& a, const value& b)
+		{ return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+	MANDELBROT_TARGET_AVX2 static mask none() { return _mm256_setzero_ps(); }
+	MANDELBROT_TARGET_AVX2 static mask both(mask a, mask b) { return _mm256_and_ps(a, b); }
+	MANDELBROT_TARGET_AVX2 static mask either(mask a, mask b) { return _mm256_or_ps(a, b); }
+	MANDELBROT_TARGET_AVX2 static mask without(mask a, mask b) { return _mm256_andnot_ps(b, a); }
+	MANDELBROT_TARGET_AVX2 static unsigned int bits(mask m) { return (unsigned int)_mm256_movemask_ps(m); }
+
+	MANDELBROT_TARGET_AVX2 static counter counters(int start) { return _mm256_set1_epi32(start); }
+	/*active lanes are all ones, i.e. -1*/
+	MANDELBROT_TARGET_AVX2 static counter decrement(counter c, mask m)
+		{ return _mm256_add_epi32(c, _mm256_castps_si256(m)); }
+	MANDELBROT_TARGET_AVX2 static void store_counters(int* p, counter c) { _mm256_storeu_si256((__m256i*)p, c); }
+};
+
+struct avx2_double_lanes {
+	typedef double scalar;
+	typedef __m256d mask;
+	typedef __m256i counter;
+	static const int count = 4;
+
+	struct value {
+		__m256d v;
+
+		value() {}
+		MANDELBROT_TARGET_AVX2 MANDELBROT_FORCE_INLINE explicit value(__m256d vector) : v(vector) {}
+		MANDELBROT_TARGET_AVX2 MANDELBROT_FORCE_INLINE explicit value(double constant) :
+			v(_mm256_set1_pd(constant)) {}
+
+		MANDELBROT_TARGET_AVX2 MANDELBROT_FORCE_INLINE friend value operator+(const value& a, const value& b)
+			{ return value(_mm256_add_pd(a.v, b.v)); }
+		MANDELBROT_TARGET_AVX2 MANDELBROT_FORCE_INLINE friend value operator-(const value& a, const value& b)
+			{ return value(_mm256_sub_pd(a.v, b.v)); }
+		MANDELBROT_TARGET_AVX2 MANDELBROT_FORCE_INLINE friend value operator*(const value& a, const value& b)
+			{ return value(_mm256_mul_pd(a.v, b.v)); }
+		MANDELBROT_TARGET_AVX2 MANDELBROT_FORCE_INLINE friend value abs(const value& a)
+			{ return value(_mm256_andnot_pd(_mm256_set1_pd(-0.), a.v)); }
+	};
+
+	MANDELBROT_TARGET_AVX2 static value load(const double* p) { return value(_mm256_loadu_pd(p)); }
+	MANDELBROT_TARGET_AVX2 static void store(double* p, const value& a) { _mm256_storeu_pd(p, a.v); }
+	MANDELBROT_TARGET_AVX2 static void store_float(float* p, const value& a) { _mm_storeu_ps(p, _mm256_cvtpd_ps(a.v)); }
+	MANDELBROT_TARGET_AVX2 static value select(mask m, const value& if_set, const value& otherwise)
+		{ return value(_mm256_blendv_pd(otherwise.v, if_set.v, m)); }
+
+	MANDELBROT_TARGET_AVX2 static mask less_equal(const value& a, const value& b)
+		{ return _mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ); }
+	MANDELBROT_TARGET_AVX2 static mask equal(const value& a, const value& b)
+		{ return _mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ); }
+	MANDELBROT_TARGET_AVX2 static mask none() { return _mm256_setzero_pd(); }
+	MANDELBROT_TARGET_AVX2 static mask both(mask a, mask b) { return _mm256_and_pd(a, b); }
+	MANDELBROT_TARGET_AVX2 static mask either(mask a, mask b) { return _mm256_or_pd(a, b); }
+	MANDELBROT_TARGET_AVX2 static mask without(mask a, mask b) { return _mm256_andnot_pd(b, a); }
+	MANDELBROT_TARGET_AVX2 static unsigned int bits(mask m) { return (unsigned int)_mm256_movemask_pd(m); }
+
+	MANDELBROT_TARGET_AVX2 static counter counters(int start) { return _mm256_set1_epi64x(start); }
+	MANDELBROT_TARGET_AVX2 static counter decrement(counter c, mask m)
+		{ return _mm256_add_epi64(c, _mm256_castpd_si256(m)); }
+	MANDELBROT_TARGET_AVX2 static void store_counters(int* p, counter c)
+	{
+		long long wide[4];
+		_mm256_storeu_si256((__m256i*)wide, c);
+		for (int j = 0; j < 4; j++) p[j] = (int)wide[j];
+	}
+};
+//}
+
+/** \bref{escape_time_lanes} and \bref{advance_iterations_lanes} compiled for avx2 */
+//{
+template<typename step, bool keep_z, bool keep_derivative, typename scalar_type>
+MANDELBROT_TARGET_AVX2 MANDELBROT_FLATTEN
+static int escape_time_lanes_avx2(const scalar_type * re, const scalar_type * im, int count,
+	const mandelbrot_simd::escape_parameters & params, int * remain_iter_out,
+	mandelbrot_simd::escape_statistics & statistics, float * x_out, float * y_out, float * distance_out)
+{
+	typedef typename std::conditional<std::is_same<scalar_type, float>::value,
+		avx2_float_lanes, avx2_double_lanes>::type lanes;
+	return escape_time_lanes<lanes, step, keep_z, keep_derivative>(re, im, count, params, remain_iter_out,
+		statistics, x_out, y_out, distance_out);
+}
+
+template<typename step, typename scalar_type>
+MANDELBROT_TARGET_AVX2 MANDELBROT_FLATTEN
+static int advance_iterations_lanes_avx2(const mandelbrot_formula & formula, const scalar_type * re,
+	const scalar_type * im, int count, int iterations, scalar_type * x_inout, scalar_type * y_inout)
+{
+	typedef typename std::conditional<std::is_same<scalar_type, float>::value,
+		avx2_float_lanes, avx2_double_lanes>::type lanes;
+	return advance_iterations_lanes<lanes, step>(formula, re, im, count, iterations, x_inout, y_inout);
+}
+//}
+
+template<typename step>
+void mandelbrot_simd::escape_time_avx2(const float * re, const float * im, int count,
+	const escape_parameters & params, int * remain_iter_out, escape_statistics & statistics,
+	float * x_out, float * y_out, float * distance_out)
+{
+	/*tracking z and dz/dc costs registers and blends, so each combination is a separate loop*/
+	int i = distance_out
+		? escape_time_lanes_avx2<step, true, true>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out)
+		: x_out
+		? escape_time_lanes_avx2<step, true, false>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out)
+		: escape_time_lanes_avx2<step, false, false>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+	escape_time_scalar<step>(re + i, im + i, count - i, params, remain_iter_out + i, statistics,
+		output_offset(x_out, i), output_offset(y_out, i), output_offset(distance_out, i));
+}
+
+template<typename step>
+void mandelbrot_simd::escape_time_avx2(const double * re, const double * im, int count,
+	const escape_parameters & params, int * remain_iter_out, escape_statistics & statistics,
+	float * x_out, float * y_out, float * distance_out)
+{
+	int i = distance_out
+		? escape_time_lanes_avx2<step, true, true>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out)
+		: x_out
+		? escape_time_lanes_avx2<step, true, false>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out)
+		: escape_time_lanes_avx2<step, false, false>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+	escape_time_scalar<step>(re + i, im + i, count - i, params, remain_iter_out + i, statistics,
+		output_offset(x_out, i), output_offset(y_out, i), output_offset(distance_out, i));
+}
+
+template<typename step>
+void mandelbrot_simd::advance_iterations_avx2(const mandelbrot_formula & formula, const float * re,
+	const float * im, int count, int iterations, float * x_inout, float * y_inout)
+{
+	int i = advance_iterations_lanes_avx2<step>(formula, re, im, count, iterations, x_inout, y_inout);
+	advance_iterations_scalar<step>(formula, re + i, im + i, count - i, iterations, x_inout + i, y_inout + i);
+}
+
+template<typename step>
+void mandelbrot_simd::advance_iterations_avx2(const mandelbrot_formula & formula, const double * re,
+	const double * im, int count, int iterations, double * x_inout, double * y_inout)
+{
+	int i = advance_iterations_lanes_avx2<step>(formula, re, im, count, iterations, x_inout, y_inout);
+	advance_iterations_scalar<step>(formula, re + i, im + i, count - i, iterations, x_inout + i, y_inout + i);
+}
+
+#else
+
+template<typename step>
+void mandelbrot_simd::escape_time_avx2(const float * re, const float * im, int count,
+	const escape_parameters & params, int * remain_iter_out, escape_statistics & statistics,
+	float * x_out, float * y_out, float * distance_out)
+{
+	escape_time_scalar<step>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+}
+
+template<typename step>
+void mandelbrot_simd::escape_time_avx2(const double * re, const double * im, int count,
+	const escape_parameters & params, int * remain_iter_out, escape_statistics & statistics,
+	float * x_out, float * y_out, float * distance_out)
+{
+	escape_time_scalar<step>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+}
+
+template<typename step>
+void mandelbrot_simd::advance_iterations_avx2(const mandelbrot_formula & formula, const float * re,
+	const float * im, int count, int iterations, float * x_inout, float * y_inout)
+{
+	advance_iterations_scalar<step>(formula, re, im, count, iterations, x_inout, y_inout);
+}
+
+template<typename step>
+void mandelbrot_simd::advance_iterations_avx2(const mandelbrot_formula & formula, const double * re,
+	const double * im, int count, int iterations, double * x_inout, double * y_inout)
+{
+	advance_iterations_scalar<step>(formula, re, im, count, iterations, x_inout, y_inout);
+}
+
+#endif//#ifdef MANDELBROT_SIMD_X86
+
+#ifdef MANDELBROT_SIMD_AVX512
+
+/** registers of the avx-512 kernels, as the avx2 ones with mask registers */
+//{
+struct avx512_float_lanes {
+	typedef float scalar;
+	typedef __mmask16 mask;
+	typedef __m512i counter;
+	static const int count = 16;
+
+	struct value {
+		__m512 v;
+
+		value() {}
+		MANDELBROT_TARGET_AVX512 MANDELBROT_FORCE_INLINE explicit value(__m512 vector) : v(vector) {}
+		MANDELBROT_TARGET_AVX512 MANDELBROT_FORCE_INLINE explicit value(double constant) :
+			v(_mm512_set1_ps((float)constant)) {}
+
+		MANDELBROT_TARGET_AVX512 MANDELBROT_FORCE_INLINE friend value operator+(const value& a, const value& b)
+			{ return value(_mm512_add_ps(a.v, b.v)); }
+		MANDELBROT_TARGET_AVX512 MANDELBROT_FORCE_INLINE friend value operator-(const value& a, const value& b)
+			{ return value(_mm512_sub_ps(a.v, b.v)); }
+		MANDELBROT_TARGET_AVX512 MANDELBROT_FORCE_INLINE friend value operator*(const value& a, const value& b)
+			{ return value(_mm512_mul_ps(a.v, b.v)); }
+		MANDELBROT_TARGET_AVX512 MANDELBROT_FORCE_INLINE friend value abs(const value& a)
+			{ return value(_mm512_abs_ps(a.v)); }
+	};
+
+	MANDELBROT_TARGET_AVX512 static value load(const float* p) { return value(_mm512_loadu_ps(p)); }
+	MANDELBROT_TARGET_AVX512 static void store(float* p, const value& a) { _mm512_storeu_ps(p, a.v); }
+	MANDELBROT_TARGET_AVX512 static void store_float(float* p, const value& a) { _mm512_storeu_ps(p, a.v); }
+	MANDELBROT_TARGET_AVX512 static value select(mask m, const value& if_set, const value& otherwise)
+		{ return value(_mm512_mask_mov_ps(otherwise.v, m, if_set.v)); }
+
+	MANDELBROT_TARGET_AVX512 static mask less_equal(const value& a, const value& b)
+		{ return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ); }
+	MANDELBROT_TARGET_AVX512 static mask equal(const value& a, const value& b)
+		{ return _mm512_cmp_ps_mask(a.v, b.v, _CMP_EQ_OQ); }
+	static mask none() { return 0; }
+	static mask both(mask a, mask b) { return a & b; }
+	static mask either(mask a, mask b) { return a | b; }
+	static mask without(mask a, mask b) { return a & ~b; }
+	static unsigned int bits(mask m) { return m; }
+
+	MANDELBROT_TARGET_AVX512 static counter counters(int start) { return _mm512_set1_epi32(start); }
+	MANDELBROT_TARGET_AVX512 static counter decrement(counter c, mask m)
+		{ return _mm512_mask_sub_epi32(c, m, c, _mm512_set1_epi32(1)); }
+	MANDELBROT_TARGET_AVX512 static void store_counters(int* p, counter c) { _mm512_storeu_si512((void*)p, c); }
+};
+
+struct avx512_double_lanes {
+	typedef double scalar;
+	typedef __mmask8 mask;
+	typedef __m512i counter;
+	static const int count = 8;
+
+	struct value {
+		__m512d v;
+
+		value() {}
+		MANDELBROT_TARGET_AVX512 MANDELBROT_FORCE_INLINE explicit value(__m512d vector) : v(vector) {}
+		MANDELBROT_TARGET_AVX512 MANDELBROT_FORCE_INLINE explicit value(double constant) :
+			v(_mm512_set1_pd(constant)) {}
+
+		MANDELBROT_TARGET_AVX512 MANDELBROT_FORCE_INLINE friend value operator+(const value& a, const value& b)
+			{ return value(_mm512_add_pd(a.v, b.v)); }
+		MANDELBROT_TARGET_AVX512 MANDELBROT_FORCE_INLINE friend value operator-(const value& a, const value& b)
+			{ return value(_mm512_sub_pd(a.v, b.v)); }
+		MANDELBROT_TARGET_AVX512 MANDELBROT_FORCE_INLINE friend value operator*(const value& a, const value& b)
+			{ return value(_mm512_mul_pd(a.v, b.v)); }
+		MANDELBROT_TARGET_AVX512 MANDELBROT_FORCE_INLINE friend value abs(const value& a)
+			{ return value(_mm512_abs_pd(a.v)); }
+	};
+
+	MANDELBROT_TARGET_AVX512 static value load(const double* p) { return value(_mm512_loadu_pd(p)); }
+	MANDELBROT_TARGET_AVX512 static void store(double* p, const value& a) { _mm512_storeu_pd(p, a.v); }
+	MANDELBROT_TARGET_AVX512 static void store_float(float* p, const value& a)
+		{ _mm256_storeu_ps(p, _mm512_cvtpd_ps(a.v)); }
+	MANDELBROT_TARGET_AVX512 static value select(mask m, const value& if_set, const value& otherwise)
+		{ return value(_mm512_mask_mov_pd(otherwise.v, m, if_set.v)); }
+
+	MANDELBROT_TARGET_AVX512 static mask less_equal(const value& a, const value& b)
+		{ return _mm512_cmp_pd_mask(a.v, b.v, _CMP_LE_OQ); }
+	MANDELBROT_TARGET_AVX512 static mask equal(const value& a, const value& b)
+		{ return _mm512_cmp_pd_mask(a.v, b.v, _CMP_EQ_OQ); }
+	static mask none() { return 0; }
+	static mask both(mask a, mask b) { return a & b; }
+	static mask either(mask a, mask b) { return a | b; }
+	static mask without(mask a, mask b) { return a & ~b; }
+	static unsigned int bits(mask m) { return m; }
+
+	MANDELBROT_TARGET_AVX512 static counter counters(int start) { return _mm512_set1_epi64(start); }
+	MANDELBROT_TARGET_AVX512 static counter decrement(counter c, mask m)
+		{ return _mm512_mask_sub_epi64(c, m, c, _mm512_set1_epi64(1)); }
+	MANDELBROT_TARGET_AVX512 static void store_counters(int* p, counter c)
+		{ _mm256_storeu_si256((__m256i*)p, _mm512_cvtepi64_epi32(c)); }
+};
+//}
+
+/** \bref{escape_time_lanes} and \bref{advance_iterations_lanes} compiled for avx-512 */
+//{
+template<typename step, bool keep_z, bool keep_derivative, typename scalar_type>
+MANDELBROT_TARGET_AVX512 MANDELBROT_FLATTEN
+static int escape_time_lanes_avx512(const scalar_type * re, const scalar_type * im, int count,
+	const mandelbrot_simd::escape_parameters & params, int * remain_iter_out,
+	mandelbrot_simd::escape_statistics & statistics, float * x_out, float * y_out, float * distance_out)
+{
+	typedef typename std::conditional<std::is_same<scalar_type, float>::value,
+		avx512_float_lanes, avx512_double_lanes>::type lanes;
+	return escape_time_lanes<lanes, step, keep_z, keep_derivative>(re, im, count, params, remain_iter_out,
+		statistics, x_out, y_out, distance_out);
+}
+
+template<typename step, typename scalar_type>
+MANDELBROT_TARGET_AVX512 MANDELBROT_FLATTEN
+static int advance_iterations_lanes_avx512(const mandelbrot_formula & formula, const scalar_type * re,
+	const scalar_type * im, int count, int iterations, scalar_type * x_inout, scalar_type * y_inout)
+{
+	typedef typename std::conditional<std::is_same<scalar_type, float>::value,
+		avx512_float_lanes, avx512_double_lanes>::type lanes;
+	return advance_iterations_lanes<lanes, step>(formula, re, im, count, iterations, x_inout, y_inout);
+}
+//}
+
+template<typename step>
+void mandelbrot_simd::escape_time_avx512(const float * re, const float * im, int count,
+	const escape_parameters & params, int * remain_iter_out, escape_statistics & statistics,
+	float * x_out, float * y_out, float * distance_out)
+{
+	int i = distance_out
+		? escape_time_lanes_avx512<step, true, true>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out)
+		: x_out
+		? escape_time_lanes_avx512<step, true, false>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out)
+		: escape_time_lanes_avx512<step, false, false>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+	escape_time_avx2<step>(re + i, im + i, count - i, params, remain_iter_out + i, statistics,
+		output_offset(x_out, i), output_offset(y_out, i), output_offset(distance_out, i));
+}
+
+template<typename step>
+void mandelbrot_simd::escape_time_avx512(const double * re, const double * im, int count,
+	const escape_parameters & params, int * remain_iter_out, escape_statistics & statistics,
+	float * x_out, float * y_out, float * distance_out)
+{
+	int i = distance_out
+		? escape_time_lanes_avx512<step, true, true>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out)
+		: x_out
+		? escape_time_lanes_avx512<step, true, false>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out)
+		: escape_time_lanes_avx512<step, false, false>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+	escape_time_avx2<step>(re + i, im + i, count - i, params, remain_iter_out + i, statistics,
+		output_offset(x_out, i), output_offset(y_out, i), output_offset(distance_out, i));
+}
+
+template<typename step>
+void mandelbrot_simd::advance_iterations_avx512(const mandelbrot_formula & formula, const float * re,
+	const float * im, int count, int iterations, float * x_inout, float * y_inout)
+{
+	int i = advance_iterations_lanes_avx512<step>(formula, re, im, count, iterations, x_inout, y_inout);
+	advance_iterations_avx2<step>(formula, re + i, im + i, count - i, iterations, x_inout + i, y_inout + i);
+}
+
+template<typename step>
+void mandelbrot_simd::advance_iterations_avx512(const mandelbrot_formula & formula, const double * re,
+	const double * im, int count, int iterations, double * x_inout, double * y_inout)
+{
+	int i = advance_iterations_lanes_avx512<step>(formula, re, im, count, iterations, x_inout, y_inout);
+	advance_iterations_avx2<step>(formula, re + i, im + i, count - i, iterations, x_inout + i, y_inout + i);
+}
+
+#else
+
+template<typename step>
+void mandelbrot_simd::escape_time_avx512(const float * re, const float * im, int count,
+	const escape_parameters & params, int * remain_iter_out, escape_statistics & statistics,
+	float * x_out, float * y_out, float * distance_out)
+{
+	escape_time_avx2<step>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+}
+
+template<typename step>
+void mandelbrot_simd::escape_time_avx512(const double * re, const double * im, int count,
+	const escape_parameters & params, int * remain_iter_out, escape_statistics & statistics,
+	float * x_out, float * y_out, float * distance_out)
+{
+	escape_time_avx2<step>(re, im, count, params, remain_iter_out, statistics, x_out, y_out, distance_out);
+}
+
+template<typename step>
+void mandelbrot_simd::advance_iterations_avx512(const mandelbrot_formula & formula, const float * re,
+	const float * im, int count, int iterations, float * x_inout, float * y_inout)
+{
+	advance_iterations_avx2<step>(formula, re, im, count, iterations, x_inout, y_inout);
+}
+
+template<typename step>
+void mandelbrot_simd::advance_iterations_avx512(const mandelbrot_formula & formula, const double * re,
+	const double * im, int count, int iterations, double * x_inout, double * y_inout)
+{
+	advance_iterations_avx2<step>(formula, re, im, count, iterations, x_inout, y_inout);
+}
+
+#endif//#ifdef MANDELBROT_SIMD_AVX512
+
+mandelbrot_simd::simd_level mandelbrot_simd::detect_level()
+{
+#ifdef MANDELBROT_SIMD_X86
+	unsigned int leaf1[4] = { 0, 0, 0, 0 };
+	unsigned int leaf7[4] = { 0, 0, 0, 0 };
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+	__cpuidex(info, 1, 0);
+	for (int i = 0; i < 4; i++) leaf1[i] = (unsigned int)info[i];
+	if (max_leaf >= 7) {
+		__cpuidex(info, 7, 0);
+		for (int i = 0; i < 4; i++) leaf7[i] = (unsigned int)info[i];
+	}
+#else
+	unsigned int max_leaf = __get_cpuid_max(0, 0);
+	__cpuid_count(1, 0, leaf1[0], leaf1[1], leaf1[2], leaf1[3]);
+	if (max_leaf >= 7) __cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+#endif
+
+	/*the os has to save the ymm/zmm registers on context switches (osxsave + xcr0)*/
+	bool osxsave = (leaf1[2] & (1u << 27)) != 0;
+	if (!osxsave) return scalar;
+#ifdef _MSC_VER
+	unsigned long long xcr0 = _xgetbv(0);
+#else
+	unsigned int xcr0_lo, xcr0_hi;
+	__asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+	unsigned long long xcr0 = ((unsigned long long)xcr0_hi << 32) | xcr0_lo;
+#endif
+	bool os_ymm = (xcr0 & 0x6) == 0x6;
+	bool os_zmm = (xcr0 & 0xe6) == 0xe6;
+
+	bool cpu_avx2 = (leaf7[1] & (1u << 5)) != 0;
+	bool cpu_avx512f = (leaf7[1] & (1u << 16)) != 0;
+
+#ifdef MANDELBROT_SIMD_AVX512
+	if (cpu_avx512f && os_zmm) return avx512;
+#else
+	(void)cpu_avx512f;
+	(void)os_zmm;
+#endif
+	if (cpu_avx2 && os_ymm) return avx2;
+#endif//#ifdef MANDELBROT_SIMD_X86
+	return scalar;
+}
@@ -0,0 +1,368 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_simd.hpp
+*
+* Vectorized iteration kernels used by \bref{mandelbrot_generator},
+* the instruction set is selected at runtime
+*
+************************************************************************/
+
+#ifndef MANDELBROT_SIMD_HPP_INCLUDED
+#define MANDELBROT_SIMD_HPP_INCLUDED
+
+#include "double_double.hpp"
+#include "mandelbrot_formula.hpp"
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_simd
+*
+* iterates a \bref{mandelbrot_formula} for a batch of points at once. the
+* avx2 kernels process 8 floats or 4 doubles, the avx-512 kernels 16 floats
+* or 8 doubles in parallel. there is one vector kernel, instantiated per
+* formula step and instruction set. all kernels perform the same operations
+* in the same order as the scalar loop, hence produce bit-identical results
+* as long as the compiler does not contract a*b+c into fma, which only the
+* avx-512 target would allow. the build turns contraction off, see
+* CMakeLists.txt, and mandelbrot_test checks the equality
+*
+************************************************************************/
+class mandelbrot_simd {
+public:
+	/** instruction sets the kernels can be executed with */
+	enum simd_level {
+		automatic,	/**< best level supported by the cpu */
+		scalar,
+		avx2,
+		avx512
+	};
+
+	/** termination criteria and shortcuts of \bref{escape_time} */
+	struct escape_parameters {
+		float max_threshold;
+		int max_iter;
+		/**
+		* points inside the main cardioid or the period-2 bulb are not iterated at all,
+		* only used for \bref{mandelbrot_formula::quadratic_mandelbrot}
+		*/
+		bool interior_check;
+		/**
+		* Brent's cycle detection: z is saved after 1, 2, 4, 8, ... iterations, if it
+		* reappears exactly the orbit is periodic and the point will never escape
+		*/
+		bool periodicity_check;
+		/** factor of the distances of \bref{escape_time}, e.g. 1 / pixel spacing to get them in pixels */
+		double distance_scale = 1.;
+		mandelbrot_formula formula;
+	};
+
+	/** work done and saved by \bref{escape_time} */
+	struct escape_statistics {
+		long long iterations = 0;
+		long long interior_pixels = 0;
+		long long interior_skipped_iterations = 0;
+		long long periodic_pixels = 0;
+		long long periodic_skipped_iterations = 0;
+
+		void add(const escape_statistics& other);
+	};
+
+	/** best level supported by the cpu and the operating system, determined once */
+	static simd_level supported_level();
+
+	/** \bref{requested} limited to \bref{supported_level}, never returns \bref{automatic} */
+	static simd_level resolve(simd_level requested);
+
+	/**
+	* iterates each point re[i] + im[i]*i until |z|^2 exceeds max_threshold
+	* or max_iter iterations are done, writes the number of iterations left to
+	* \bref{remain_iter_out}. lanes that escaped are masked out, a batch ends as soon
+	* as all of its lanes escaped. double_double always runs the scalar loop.
+	* if \bref{x_out} and \bref{y_out} are given, they receive the last z, i.e. the first
+	* one outside the threshold for escaped points (0 for interior points).
+	* if \bref{distance_out} is given as well, the kernels also iterate dz/dc and it receives
+	* the exterior distance estimate |z| log|z| / (2 |dz/dc|), a lower bound of the distance
+	* to the set, 0 for points that did not escape. dz/dc is iterated in double for double_double,
+	* julia sets iterate the derivative by the starting point instead
+	*/
+	//{
+	static void escape_time(simd_level level, const float* re, const float* im, int count,
+		const escape_parameters& params, int* remain_iter_out, escape_statistics& statistics,
+		float* x_out = 0, float* y_out = 0, float* distance_out = 0);
+	static void escape_time(simd_level level, const double* re, const double* im, int count,
+		const escape_parameters& params, int* remain_iter_out, escape_statistics& statistics,
+		float* x_out = 0, float* y_out = 0, float* distance_out = 0);
+	static void escape_time(simd_level level, const double_double* re, const double_double* im, int count,
+		const escape_parameters& params, int* remain_iter_out, escape_statistics& statistics,
+		float* x_out = 0, float* y_out = 0, float* distance_out = 0);
+	//}
+
+	/**
+	* iterates each point re[i] + im[i]*i exactly \bref{iterations} times with
+	* \bref{formula} and writes the resulting z to \bref{x_out} and \bref{y_out}
+	*/
+	//{
+	static void fixed_iterations(simd_level level, const mandelbrot_formula& formula, const float* re,
+		const float* im, int count, int iterations, float* x_out, float* y_out);
+	static void fixed_iterations(simd_level level, const mandelbrot_formula& formula, const double* re,
+		const double* im, int count, int iterations, double* x_out, double* y_out);
+	static void fixed_iterations(simd_level level, const mandelbrot_formula& formula, const double_double* re,
+		const double_double* im, int count, int iterations, double_double* x_out, double_double* y_out);
+	//}
+
+	/**
+	* continues the iteration of the points re[i] + im[i]*i from the z given in
+	* \bref{x_inout} and \bref{y_inout} for another \bref{iterations} steps. the result
+	* is the same as if all steps were done by one call of \bref{fixed_iterations}
+	*/
+	//{
+	static void advance_iterations(simd_level level, const mandelbrot_formula& formula, const float* re,
+		const float* im, int count, int iterations, float* x_inout, float* y_inout);
+	static void advance_iterations(simd_level level, const mandelbrot_formula& formula, const double* re,
+		const double* im, int count, int iterations, double* x_inout, double* y_inout);
+	static void advance_iterations(simd_level level, const mandelbrot_formula& formula, const double_double* re,
+		const double_double* im, int count, int iterations, double_double* x_inout, double_double* y_inout);
+	//}
+
+	/** true if c lies in the main cardioid or the period-2 bulb, i.e. never escapes */
+	template<typename scalar_type>
+	static bool in_main_cardioid_or_bulb(const scalar_type& re, const scalar_type& im);
+
+	/**
+	* exterior distance estimate from the escaped z and dz/dc times \bref{scale},
+	* 0 if |z| <= 1 or dz/dc is 0
+	*/
+	static float exterior_distance(double x, double y, double dx, double dy, double scale);
+
+	/**
+	* scalar reference implementations, also used for the tails of a batch. \bref{step} is
+	* the step of the formula, see \bref{mandelbrot_formula::dispatch}
+	*/
+	//{
+	template<typename step, typename scalar_type>
+	static void escape_time_scalar(const scalar_type* re, const scalar_type* im, int count,
+		const escape_parameters& params, int* remain_iter_out, escape_statistics& statistics,
+		float* x_out, float* y_out, float* distance_out);
+	template<typename step, typename scalar_type>
+	static void advance_iterations_scalar(const mandelbrot_formula& formula, const scalar_type* re,
+		const scalar_type* im, int count, int iterations, scalar_type* x_inout, scalar_type* y_inout);
+	//}
+
+private:
+	/**
+	* the vector kernels only handle the periodicity check and count the
+	* iterations it saved, \bref{escape_time_dispatch} does everything else
+	*/
+	//{
+	template<typename step>
+	static void escape_time_avx2(const float* re, const float* im, int count,
+		const escape_parameters& params, int* remain_iter_out, escape_statistics& statistics,
+		float* x_out, float* y_out, float* distance_out);
+	template<typename step>
+	static void escape_time_avx2(const double* re, const double* im, int count,
+		const escape_parameters& params, int* remain_iter_out, escape_statistics& statistics,
+		float* x_out, float* y_out, float* distance_out);
+	template<typename step>
+	static void escape_time_avx512(const float* re, const float* im, int count,
+		const escape_parameters& params, int* remain_iter_out, escape_statistics& statistics,
+		float* x_out, float* y_out, float* distance_out);
+	template<typename step>
+	static void escape_time_avx512(const double* re, const double* im, int count,
+		const escape_parameters& params, int* remain_iter_out, escape_statistics& statistics,
+		float* x_out, float* y_out, float* distance_out);
+	//}
+
+	template<typename step>
+	static void advance_iterations_avx2(const mandelbrot_formula& formula, const float* re, const float* im,
+		int count, int iterations, float* x_inout, float* y_inout);
+	template<typename step>
+	static void advance_iterations_avx2(const mandelbrot_formula& formula, const double* re, const double* im,
+		int count, int iterations, double* x_inout, double* y_inout);
+	template<typename step>
+	static void advance_iterations_avx512(const mandelbrot_formula& formula, const float* re, const float* im,
+		int count, int iterations, float* x_inout, float* y_inout);
+	template<typename step>
+	static void advance_iterations_avx512(const mandelbrot_formula& formula, const double* re, const double* im,
+		int count, int iterations, double* x_inout, double* y_inout);
+
+	/**
+	* applies the interior check, runs the kernel of \bref{level} on the remaining
+	* points and counts the iterations
+	*/
+	template<typename scalar_type>
+	static void escape_time_dispatch(simd_level level, const scalar_type* re, const scalar_type* im, int count,
+		const escape_parameters& params, int* remain_iter_out, escape_statistics& statistics,
+		float* x_out, float* y_out, float* distance_out);
+	/** selects the step of the formula and runs the kernel of \bref{level} with it */
+	template<typename scalar_type>
+	static void escape_time_kernel(simd_level level, const scalar_type* re, const scalar_type* im, int count,
+		const escape_parameters& params, int* remain_iter_out, escape_statistics& statistics,
+		float* x_out, float* y_out, float* distance_out);
+	template<typename step>
+	static void escape_time_level(simd_level level, const float* re, const float* im, int count,
+		const escape_parameters& params, int* remain_iter_out, escape_statistics& statistics,
+		float* x_out, float* y_out, float* distance_out);
+	template<typename step>
+	static void escape_time_level(simd_level level, const double* re, const double* im, int count,
+		const escape_parameters& params, int* remain_iter_out, escape_statistics& statistics,
+		float* x_out, float* y_out, float* distance_out);
+	template<typename step>
+	static void escape_time_level(simd_level level, const double_double* re, const double_double* im, int count,
+		const escape_parameters& params, int* remain_iter_out, escape_statistics& statistics,
+		float* x_out, float* y_out, float* distance_out);
+
+	/** as \bref{escape_time_kernel} */
+	template<typename scalar_type>
+	static void advance_iterations_dispatch(simd_level level, const mandelbrot_formula& formula,
+		const scalar_type* re, const scalar_type* im, int count, int iterations,
+		scalar_type* x_inout, scalar_type* y_inout);
+	template<typename step>
+	static void advance_iterations_level(simd_level level, const mandelbrot_formula& formula,
+		const float* re, const float* im, int count, int iterations, float* x_inout, float* y_inout);
+	template<typename step>
+	static void advance_iterations_level(simd_level level, const mandelbrot_formula& formula,
+		const double* re, const double* im, int count, int iterations, double* x_inout, double* y_inout);
+	template<typename step>
+	static void advance_iterations_level(simd_level level, const mandelbrot_formula& formula,
+		const double_double* re, const double_double* im, int count, int iterations,
+		double_double* x_inout, double_double* y_inout);
+
+	static simd_level detect_level();
+
+	/** type dz/dc is iterated in, double is precise enough for double_double */
+	//{
+	template<typename scalar_type>
+	struct derivative_type { typedef scalar_type type; };
+	//}
+};
+
+template<>
+struct mandelbrot_simd::derivative_type<double_double> { typedef double type; };
+
+template<typename scalar_type>
+bool mandelbrot_simd::in_main_cardioid_or_bulb(const scalar_type& re, const scalar_type& im)
+{
+	/*see https://en.wikipedia.org/wiki/Plotting_algorithms_for_the_Mandelbrot_set#Cardioid_/_bulb_checking */
+	scalar_type yy = im * im;
+	scalar_type x_shifted = re - (scalar_type)0.25;
+	scalar_type q = x_shifted * x_shifted + yy;
+	if (q * (q + x_shifted) <= yy * (scalar_type)0.25) return true;
+
+	scalar_type x_bulb = re + (scalar_type)1.;
+	return x_bulb * x_bulb + yy <= (scalar_type)0.0625;
+}
+
+template<typename step, typename scalar_type>
+void mandelbrot_simd::escape_time_scalar(const scalar_type* re, const scalar_type* im, int count,
+	const escape_parameters& params, int* remain_iter_out, escape_statistics& statistics,
+	float* x_out, float* y_out, float* distance_out)
+{
+	/*computation according to https://de.wikipedia.org/wiki/Mandelbrot-Menge#Programmbeispiel */
+	typedef typename derivative_type<scalar_type>::type derivative;
+	const mandelbrot_formula& formula = params.formula;
+	const scalar_type julia_re = (scalar_type)formula.julia_re_;
+	const scalar_type julia_im = (scalar_type)formula.julia_im_;
+	const derivative derivative_offset = formula.julia_ ? (derivative)0 : (derivative)1;
+
+	for (int i = 0; i < count; i++) {
+		scalar_type re_part = re[i];
+		scalar_type im_part = im[i];
+		scalar_type c_x = formula.julia_ ? julia_re : re_part;
+		scalar_type c_y = formula.julia_ ? julia_im : im_part;
+
+		int remain_iter = params.max_iter;
+		scalar_type x = re_part;
+		scalar_type y = im_part;
+		scalar_type xx = re_part * re_part;
+		scalar_type yy = im_part * im_part;
+		scalar_type xy = re_part * im_part;
+		scalar_type abs_2 = xx + yy;
+
+		scalar_type check_x = re_part;
+		scalar_type check_y = im_part;
+		int check_interval = 1;
+		int check_steps = 0;
+
+		derivative dz_x = 1;
+		derivative dz_y = 0;
+
+		while (abs_2 <= params.max_threshold && remain_iter > 0) {
+			remain_iter--;
+			if (distance_out) {
+				derivative next_dz_x, next_dz_y;
+				step::derivative((derivative)to_double(x), (derivative)to_double(y), dz_x, dz_y,
+					derivative_offset, next_dz_x, next_dz_y);
+				dz_x = next_dz_x;
+				dz_y = next_dz_y;
+			}
+			scalar_type next_x, next_y;
+			step::iterate(x, y, xx, yy, xy, c_x, c_y, next_x, next_y);
+			x = next_x;
+			y = next_y;
+			xx = x*x;
+			yy = y*y;
+			xy = x*y;
+			abs_2 = xx + yy;
+
+			if (params.periodicity_check) {
+				if (x == check_x && y == check_y) {
+					statistics.periodic_pixels++;
+					statistics.periodic_skipped_iterations += remain_iter;
+					remain_iter = 0;
+					break;
+				}
+				if (++check_steps == check_interval) {
+					check_x = x;
+					check_y = y;
+					check_steps = 0;
+					check_interval *= 2;
+				}
+			}
+		}
+		remain_iter_out[i] = remain_iter;
+		if (x_out) {
+			x_out[i] = (float)to_double(x);
+			y_out[i] = (float)to_double(y);
+		}
+		if (distance_out) {
+			distance_out[i] = remain_iter > 0
+				? exterior_distance(to_double(x), to_double(y), dz_x, dz_y, params.distance_scale)
+				: 0.f;
+		}
+	}
+}
+
+template<typename step, typename scalar_type>
+void mandelbrot_simd::advance_iterations_scalar(const mandelbrot_formula& formula, const scalar_type* re,
+	const scalar_type* im, int count, int iterations, scalar_type* x_inout, scalar_type* y_inout)
+{
+	const scalar_type julia_re = (scalar_type)formula.julia_re_;
+	const scalar_type julia_im = (scalar_type)formula.julia_im_;
+
+	for (int i = 0; i < count; i++) {
+		scalar_type c_x = formula.julia_ ? julia_re : re[i];
+		scalar_type c_y = formula.julia_ ? julia_im : im[i];
+
+		scalar_type x = x_inout[i];
+		scalar_type y = y_inout[i];
+		scalar_type xx = x * x;
+		scalar_type yy = y * y;
+		scalar_type xy = x * y;
+
+		for (int j = 0; j < iterations; j++) {
+			scalar_type next_x, next_y;
+			step::iterate(x, y, xx, yy, xy, c_x, c_y, next_x, next_y);
+			x = next_x;
+			y = next_y;
+			xx = x*x;
+			yy = y*y;
+			xy = x*y;
+		}
+		x_inout[i] = x;
+		y_inout[i] = y;
+	}
+}
+
+#endif//#ifndef MANDELBROT_SIMD_HPP_INCLUDED
@@ -0,0 +1,318 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_socket.cpp
+*
+* implementation of \bref{mandelbrot_socket}
+*
+************************************************************************/
+
+#include "mandelbrot_socket.hpp"
+
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET native_socket;
+static const native_socket invalid_socket = INVALID_SOCKET;
+#else
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+typedef int native_socket;
+static const native_socket invalid_socket = -1;
+#endif
+
+/** winsock has to be started once per process, the other systems need nothing */
+static bool initialize_sockets()
+{
+#ifdef _WIN32
+	static const bool initialized = []() {
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return initialized;
+#else
+	return true;
+#endif
+}
+
+static void close_native(native_socket s)
+{
+#ifdef _WIN32
+	closesocket(s);
+#else
+	::close(s);
+#endif
+}
+
+/** tiles are sent as one large write after a small header, so nagle would only delay the header */
+static void disable_nagle(native_socket s)
+{
+	int enable = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&enable, sizeof(enable));
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// mandelbrot_socket
+//
+//////////////////////////////////////////////////////////////////////////
+
+mandelbrot_socket::mandelbrot_socket() :
+	handle_((intptr_t)invalid_socket)
+{}
+
+mandelbrot_socket::~mandelbrot_socket()
+{
+	close();
+}
+
+bool mandelbrot_socket::listen(const std::string & address, mandelbrot_socket & out, std::string & error_out)
+{
+	out.close();
+	bool is_unix;
+	std::string host, port;
+	if (!parse_address(address, is_unix, host, port, error_out)) return false;
+	if (!initialize_sockets()) {
+		error_out = "sockets are not available";
+		return false;
+	}
+
+#ifndef _WIN32
+	if (is_unix) {
+		sockaddr_un local;
+		memset(&local, 0, sizeof(local));
+		local.sun_family = AF_UNIX;
+		strncpy(local.sun_path, host.c_str(), sizeof(local.sun_path) - 1);
+		native_socket s = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (s == invalid_socket) {
+			error_out = last_error();
+			return false;
+		}
+		unlink(host.c_str());
+		if (bind(s, (const sockaddr*)&local, sizeof(local)) != 0 || ::listen(s, SOMAXCONN) != 0) {
+			error_out = address + ": " + last_error();
+			close_native(s);
+			return false;
+		}
+		out.handle_ = (intptr_t)s;
+		out.unix_path_ = host;
+		return true;
+	}
+#endif
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	addrinfo* found = 0;
+	if (getaddrinfo(host.empty() ? 0 : host.c_str(), port.c_str(), &hints, &found) != 0 || !found) {
+		error_out = address + ": unknown address";
+		return false;
+	}
+
+	native_socket s = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+	int reuse = 1;
+	if (s != invalid_socket) setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+	if (s == invalid_socket || bind(s, found->ai_addr, (int)found->ai_addrlen) != 0
+		|| ::listen(s, SOMAXCONN) != 0) {
+		error_out = address + ": " + last_error();
+		if (s != invalid_socket) close_native(s);
+		freeaddrinfo(found);
+		return false;
+	}
+	freeaddrinfo(found);
+	out.handle_ = (intptr_t)s;
+	return true;
+}
+
+bool mandelbrot_socket::connect(const std::string & address, mandelbrot_socket & out, std::string & error_out)
+{
+	out.close();
+	bool is_unix;
+	std::string host, port;
+	if (!parse_address(address, is_unix, host, port, error_out)) return false;
+	if (!initialize_sockets()) {
+		error_out = "sockets are not available";
+		return false;
+	}
+
+#ifndef _WIN32
+	if (is_unix) {
+		sockaddr_un remote;
+		memset(&remote, 0, sizeof(remote));
+		remote.sun_family = AF_UNIX;
+		strncpy(remote.sun_path, host.c_str(), sizeof(remote.sun_path) - 1);
+		native_socket s = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (s == invalid_socket || ::connect(s, (const sockaddr*)&remote, sizeof(remote)) != 0) {
+			error_out = address + ": " + last_error();
+			if (s != invalid_socket) close_native(s);
+			return false;
+		}
+		out.handle_ = (intptr_t)s;
+		return true;
+	}
+#endif
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* found = 0;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0 || !found) {
+		error_out = address + ": unknown address";
+		return false;
+	}
+
+	error_out = address + ": no address could be connected";
+	for (addrinfo* candidate = found; candidate; candidate = candidate->ai_next) {
+		native_socket s = socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+		if (s == invalid_socket) continue;
+		if (::connect(s, candidate->ai_addr, (int)candidate->ai_addrlen) != 0) {
+			error_out = address + ": " + last_error();
+			close_native(s);
+			continue;
+		}
+		disable_nagle(s);
+		out.handle_ = (intptr_t)s;
+		break;
+	}
+	freeaddrinfo(found);
+	return out.is_open();
+}
+
+bool mandelbrot_socket::accept(mandelbrot_socket & out)
+{
+	out.close();
+	native_socket s = ::accept((native_socket)handle_, 0, 0);
+	if (s == invalid_socket) return false;
+	if (unix_path_.empty()) disable_nagle(s);
+	out.handle_ = (intptr_t)s;
+	return true;
+}
+
+bool mandelbrot_socket::send(const void * data, size_t size)
+{
+	const char* c = (const char*)data;
+	while (size > 0) {
+		/*a broken connection is reported by the return value, not by SIGPIPE*/
+#ifdef _WIN32
+		int chunk = (int)(size < (1u << 30) ? size : (1u << 30));
+		int sent = ::send((native_socket)handle_, c, chunk, 0);
+#elif defined(MSG_NOSIGNAL)
+		ssize_t sent = ::send((native_socket)handle_, c, size, MSG_NOSIGNAL);
+#else
+		ssize_t sent = ::send((native_socket)handle_, c, size, 0);
+#endif
+		if (sent <= 0) {
+#ifndef _WIN32
+			if (sent < 0 && errno == EINTR) continue;
+#endif
+			return false;
+		}
+		c += sent;
+		size -= (size_t)sent;
+	}
+	return true;
+}
+
+bool mandelbrot_socket::receive(void * data, size_t size)
+{
+	char* c = (char*)data;
+	while (size > 0) {
+#ifdef _WIN32
+		int chunk = (int)(size < (1u << 30) ? size : (1u << 30));
+		int received = ::recv((native_socket)handle_, c, chunk, 0);
+#else
+		ssize_t received = ::recv((native_socket)handle_, c, size, 0);
+#endif
+		if (received <= 0) {
+#ifndef _WIN32
+			if (received < 0 && errno == EINTR) continue;
+#endif
+			return false;
+		}
+		c += received;
+		size -= (size_t)received;
+	}
+	return true;
+}
+
+bool mandelbrot_socket::is_open() const
+{
+	return (native_socket)handle_ != invalid_socket;
+}
+
+void mandelbrot_socket::shutdown()
+{
+	if (!is_open()) return;
+#ifdef _WIN32
+	::shutdown((native_socket)handle_, SD_BOTH);
+#else
+	::shutdown((native_socket)handle_, SHUT_RDWR);
+#endif
+}
+
+void mandelbrot_socket::close()
+{
+	if (!is_open()) return;
+	close_native((native_socket)handle_);
+	handle_ = (intptr_t)invalid_socket;
+#ifndef _WIN32
+	if (!unix_path_.empty()) unlink(unix_path_.c_str());
+#endif
+	unix_path_.clear();
+}
+
+bool mandelbrot_socket::parse_address(const std::string & address, bool & unix_out, std::string & host_out,
+	std::string & port_out, std::string & error_out)
+{
+	if (address.compare(0, 5, "unix:") == 0) {
+#ifdef _WIN32
+		error_out = address + ": unix domain sockets are not supported on windows";
+		return false;
+#else
+		unix_out = true;
+		host_out = address.substr(5);
+		port_out.clear();
+		if (host_out.empty() || host_out.size() >= sizeof(((sockaddr_un*)0)->sun_path)) {
+			error_out = address + ": the socket path is empty or too long";
+			return false;
+		}
+		return true;
+#endif
+	}
+
+	/*the last colon, so [::1]:port works for ipv6*/
+	size_t colon = address.rfind(':');
+	if (colon == std::string::npos || colon + 1 == address.size()) {
+		error_out = address + ": expected host:port or unix:path";
+		return false;
+	}
+	unix_out = false;
+	host_out = address.substr(0, colon);
+	if (host_out.size() >= 2 && host_out[0] == '[' && host_out[host_out.size() - 1] == ']')
+		host_out = host_out.substr(1, host_out.size() - 2);
+	port_out = address.substr(colon + 1);
+	return true;
+}
+
+std::string mandelbrot_socket::last_error()
+{
+#ifdef _WIN32
+	return std::string("socket error ") + std::to_string(WSAGetLastError());
+#else
+	return strerror(errno);
+#endif
+}
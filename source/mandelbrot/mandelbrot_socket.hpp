@@ -0,0 +1,67 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_socket.hpp
+*
+* Blocking stream sockets for \bref{mandelbrot_distributed}
+*
+************************************************************************/
+
+#ifndef MANDELBROT_SOCKET_HPP_INCLUDED
+#define MANDELBROT_SOCKET_HPP_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_socket
+*
+* owns a tcp or unix domain stream socket. addresses are host:port for tcp
+* and unix:path for a unix domain socket, which only exists outside of
+* windows. all calls block, \bref{shutdown} from another thread makes a
+* blocked call return false
+*
+************************************************************************/
+class mandelbrot_socket {
+public:
+	mandelbrot_socket();
+	~mandelbrot_socket();
+
+	mandelbrot_socket(const mandelbrot_socket&) = delete;
+	mandelbrot_socket& operator=(const mandelbrot_socket&) = delete;
+
+	/** a listening socket on \bref{address}, an existing unix socket file is replaced */
+	static bool listen(const std::string& address, mandelbrot_socket& out, std::string& error_out);
+	static bool connect(const std::string& address, mandelbrot_socket& out, std::string& error_out);
+
+	/** waits for the next connection to this listening socket */
+	bool accept(mandelbrot_socket& out);
+
+	/** transfer exactly \bref{size} bytes, false if the connection broke */
+	//{
+	bool send(const void* data, size_t size);
+	bool receive(void* data, size_t size);
+	//}
+
+	bool is_open() const;
+	/** stops both directions, a thread blocked in this socket returns. may be called from any thread */
+	void shutdown();
+	void close();
+
+private:
+	/** SOCKET on windows, a file descriptor elsewhere */
+	intptr_t handle_;
+	/** removed when a listening unix socket closes */
+	std::string unix_path_;
+
+	/** splits \bref{address}, false if it is malformed */
+	static bool parse_address(const std::string& address, bool& unix_out, std::string& host_out,
+		std::string& port_out, std::string& error_out);
+	/** the message of the last error of the socket functions */
+	static std::string last_error();
+};
+
+#endif//#ifndef MANDELBROT_SOCKET_HPP_INCLUDED
@@ -0,0 +1,205 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_tile_cache.cpp
+*
+* implementation of \bref{mandelbrot_tile_cache}
+*
+************************************************************************/
+
+#include "mandelbrot_tile_cache.hpp"
+
+#include <math.h>
+#include <functional>
+
+using namespace viral_core;
+
+//////////////////////////////////////////////////////////////////////////
+//
+// mandelbrot_tile_cache
+//
+//////////////////////////////////////////////////////////////////////////
+
+const double mandelbrot_tile_cache::level_zero_spacing = 1. / 64.;
+
+/** grid pixels are kept below this, so they convert to double_double exactly */
+static const double max_grid_index = 4611686018427387904.;//2^62
+
+bool mandelbrot_tile_cache::key::operator==(const key & other) const
+{
+	return level == other.level && x == other.x && y == other.y && max_iter == other.max_iter
+		&& max_threshold == other.max_threshold && coloring == other.coloring && precision == other.precision
+		&& formula == other.formula;
+}
+
+size_t mandelbrot_tile_cache::key_hash::operator()(const key & k) const
+{
+	size_t ret = std::hash<long long>()(k.x);
+	ret = ret * 31 + std::hash<long long>()(k.y);
+	ret = ret * 31 + (size_t)k.level;
+	ret = ret * 31 + (size_t)k.max_iter;
+	ret = ret * 31 + (size_t)k.formula.family_;
+	return ret;
+}
+
+size_t mandelbrot_tile_cache::entry::bytes() const
+{
+	return remain_iter_.size() * sizeof(int) + (smooth_.size() + distance_.size()) * sizeof(float);
+}
+
+mandelbrot_tile_cache::mandelbrot_tile_cache(size_t budget) :
+	budget_(budget)
+{
+}
+
+void mandelbrot_tile_cache::clear()
+{
+	index_.clear();
+	tiles_.clear();
+	bytes_ = 0;
+}
+
+void mandelbrot_tile_cache::set_budget(size_t budget)
+{
+	budget_ = budget;
+	trim();
+}
+
+size_t mandelbrot_tile_cache::budget() const
+{
+	return budget_;
+}
+
+size_t mandelbrot_tile_cache::bytes() const
+{
+	return bytes_;
+}
+
+size_t mandelbrot_tile_cache::tile_count() const
+{
+	return tiles_.size();
+}
+
+bool mandelbrot_tile_cache::place(const mandelbrot_generator::parameter_set & params, placement & placement_out)
+{
+	vector2i size = params.frame_size();
+	if (size.x <= 0 || size.y <= 0) return false;
+
+	double spacing_x = (params.real_max_ - params.real_min_).hi / size.x;
+	double spacing_y = (params.imaginary_max_ - params.imaginary_min_).hi / size.y;
+	if (!(spacing_x > 0.)) return false;
+
+	int level = (int)floor(log2(level_zero_spacing / spacing_x) + 0.5);
+	double s = spacing(level);
+	if (fabs(spacing_x - s) > s * 1e-9 || fabs(spacing_y - s) > s * 1e-9) return false;
+
+	/*the corner has to be on a pixel, up to the rounding of the view*/
+	double_double corner[] = { params.real_min_ / double_double(s), params.imaginary_min_ / double_double(s) };
+	long long grid[2];
+	for (int i = 0; i < 2; i++) {
+		if (!(fabs(corner[i].hi) < max_grid_index)) return false;
+		double rounded = floor(corner[i].hi + 0.5);
+		if (fabs((corner[i].hi - rounded) + corner[i].lo) > 1e-6) return false;
+		grid[i] = (long long)rounded;
+	}
+
+	placement_out.level = level;
+	placement_out.x = grid[0] + params.image_offset_.x;
+	placement_out.y = grid[1] + params.image_offset_.y;
+	return true;
+}
+
+void mandelbrot_tile_cache::snap(mandelbrot_generator::parameter_set & params)
+{
+	vector2i size = params.image_dimensions_;
+	double spacing_x = (params.real_max_ - params.real_min_).hi / size.x;
+	int level = (int)floor(log2(level_zero_spacing / spacing_x) + 0.5);
+	double s = spacing(level);
+
+	double_double center_re = (params.real_min_ + params.real_max_) * 0.5;
+	double_double center_im = (params.imaginary_min_ + params.imaginary_max_) * 0.5;
+	long long x = (long long)floor((center_re / double_double(s)).hi - size.x * 0.5 + 0.5);
+	long long y = (long long)floor((center_im / double_double(s)).hi - size.y * 0.5 + 0.5);
+
+	params.real_min_ = coordinate(x, level);
+	params.real_max_ = coordinate(x + size.x, level);
+	params.imaginary_min_ = coordinate(y, level);
+	params.imaginary_max_ = coordinate(y + size.y, level);
+}
+
+double mandelbrot_tile_cache::spacing(int level)
+{
+	return ldexp(level_zero_spacing, -level);
+}
+
+double_double mandelbrot_tile_cache::coordinate(long long index, int level)
+{
+	/*split into two exact doubles, the scaling by a power of 2 is exact as well*/
+	double high = (double)index;
+	double low = (double)(index - (long long)high);
+	double s = spacing(level);
+	return double_double(high * s, low * s);
+}
+
+mandelbrot_tile_cache::key mandelbrot_tile_cache::tile_key(const mandelbrot_generator::parameter_set & params,
+	mandelbrot_generator::precision precision, int level, long long x, long long y)
+{
+	key ret;
+	ret.level = level;
+	ret.x = x;
+	ret.y = y;
+	ret.max_iter = params.max_iter_;
+	ret.max_threshold = params.max_threshold_;
+	ret.coloring = params.coloring_;
+	ret.precision = precision;
+	ret.formula = params.formula_;
+	return ret;
+}
+
+const mandelbrot_tile_cache::entry * mandelbrot_tile_cache::find(const key & k)
+{
+	auto found = index_.find(k);
+	if (found == index_.end()) return 0;
+
+	tiles_.splice(tiles_.begin(), tiles_, found->second);
+	return &found->second->second;
+}
+
+mandelbrot_tile_cache::entry & mandelbrot_tile_cache::insert(const key & k)
+{
+	auto found = index_.find(k);
+	if (found != index_.end()) {
+		tiles_.splice(tiles_.begin(), tiles_, found->second);
+		return found->second->second;
+	}
+
+	tiles_.push_front(std::make_pair(k, entry()));
+	index_[k] = tiles_.begin();
+
+	entry& ret = tiles_.front().second;
+	size_t pixel_count = tile_size * tile_size;
+	ret.remain_iter_.resize(pixel_count);
+	if (k.coloring != mandelbrot_generator::coloring_escape_time) ret.smooth_.resize(pixel_count);
+	if (k.coloring == mandelbrot_generator::coloring_distance) ret.distance_.resize(pixel_count);
+	bytes_ += ret.bytes();
+	return ret;
+}
+
+void mandelbrot_tile_cache::erase(const key & k)
+{
+	auto found = index_.find(k);
+	if (found == index_.end()) return;
+
+	bytes_ -= found->second->second.bytes();
+	tiles_.erase(found->second);
+	index_.erase(found);
+}
+
+void mandelbrot_tile_cache::trim()
+{
+	while (bytes_ > budget_ && !tiles_.empty()) {
+		bytes_ -= tiles_.back().second.bytes();
+		index_.erase(tiles_.back().first);
+		tiles_.pop_back();
+	}
+}
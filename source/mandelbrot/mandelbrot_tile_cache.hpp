@@ -0,0 +1,168 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_tile_cache.hpp
+*
+* Escape times of square tiles on a global quadtree grid, kept between
+* frames so pans and zooms only compute what they did not show before
+*
+************************************************************************/
+
+#ifndef MANDELBROT_TILE_CACHE_HPP_INCLUDED
+#define MANDELBROT_TILE_CACHE_HPP_INCLUDED
+
+#include "mandelbrot_generator.hpp"
+
+#include <stddef.h>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_tile_cache
+*
+* the plane is divided into pixels like the tiles of a map: level 0 has a
+* pixel spacing of \bref{level_zero_spacing}, every further level halves it,
+* negative levels double it. pixel (x, y) of a level is the point
+* (x + y*i) * spacing, tiles are tile_size x tile_size pixels of a level.
+*
+* \bref{mandelbrot_generator::generate_mandelbrot_image_julia_iter} uses the
+* cache for every view that lies on this grid, see \bref{place}, and only
+* computes the tiles that are missing. a missing tile starts from the pixels
+* its parent or its four children share with it, so a zoom by a factor of 2
+* in either direction reuses a quarter or all of the pixels.
+*
+* the tiles used least recently are dropped once the cache exceeds its
+* memory budget. a cache must only be used by one generation at a time
+*
+************************************************************************/
+class mandelbrot_tile_cache {
+public:
+	/** edge length of a tile in pixels */
+	static const int tile_size = 64;
+
+	/** pixel spacing of level 0, 256 pixels cover the whole set */
+	static const double level_zero_spacing;
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_tile_cache::placement
+	* position of a view on the grid
+	************************************************************************/
+	struct placement {
+		int level = 0;
+		/** grid pixel of the top left image pixel, real_min_ + imaginary_min_*i moved by image_offset_ */
+		//{
+		long long x = 0;
+		long long y = 0;
+		//}
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_tile_cache::key
+	* identifies a tile, the values of a tile depend on the parameters besides its position
+	************************************************************************/
+	struct key {
+		int level;
+		long long x;
+		long long y;
+		int max_iter;
+		float max_threshold;
+		mandelbrot_generator::escape_coloring coloring;
+		mandelbrot_generator::precision precision;
+		mandelbrot_formula formula;
+
+		bool operator==(const key& other) const;
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_tile_cache::entry
+	* values of the pixels of a tile, tile_size * tile_size each in row order.
+	* smooth_ is only kept for the smooth colorings, distance_ (in pixels of the
+	* tile's level) only for \bref{mandelbrot_generator::coloring_distance}
+	************************************************************************/
+	class entry {
+	public:
+		std::vector<int> remain_iter_;
+		std::vector<float> smooth_;
+		std::vector<float> distance_;
+
+		size_t bytes() const;
+	};
+
+	/** \bref{budget} is the memory the tiles may take in bytes */
+	explicit mandelbrot_tile_cache(size_t budget = (size_t)256 << 20);
+
+	/** forgets all tiles and releases their memory */
+	void clear();
+
+	/** sets the memory budget, dropping tiles if it is exceeded now */
+	void set_budget(size_t budget);
+	size_t budget() const;
+
+	/** memory taken by the tiles in bytes and number of tiles */
+	//{
+	size_t bytes() const;
+	size_t tile_count() const;
+	//}
+
+	/**
+	* true if the view of \bref{params} lies on the grid: square pixels with the spacing
+	* of a level and real_min_ and imaginary_min_ on a pixel of that level
+	*/
+	static bool place(const mandelbrot_generator::parameter_set& params, placement& placement_out);
+
+	/**
+	* moves the view of \bref{params} to the nearest one that lies on the grid, keeping
+	* its center and the image size. the pixel spacing is rounded to the one of a level
+	*/
+	static void snap(mandelbrot_generator::parameter_set& params);
+
+	/** spacing of the pixels of \bref{level} and coordinate of grid pixel \bref{index}, both exact */
+	//{
+	static double spacing(int level);
+	static double_double coordinate(long long index, int level);
+	//}
+
+	/** key of the tile at \bref{x}, \bref{y} of \bref{level} for a frame of \bref{params} */
+	static key tile_key(const mandelbrot_generator::parameter_set& params, mandelbrot_generator::precision precision,
+		int level, long long x, long long y);
+
+	/** the tile of \bref{k} and marks it as used, null if it is not cached */
+	const entry* find(const key& k);
+
+	/**
+	* adds an empty tile for \bref{k} or returns the existing one and marks it as used.
+	* the tile stays valid until the next \bref{trim} or \bref{clear}
+	*/
+	entry& insert(const key& k);
+
+	/**
+	* removes the tile of \bref{k}, e.g. because its computation was cancelled. the
+	* caller must not hold on to it any more
+	*/
+	void erase(const key& k);
+
+	/** drops the tiles used least recently until the cache fits its budget */
+	void trim();
+
+private:
+	struct key_hash {
+		size_t operator()(const key& k) const;
+	};
+
+	typedef std::list<std::pair<key, entry> > tile_list;
+
+	/** most recently used tile first */
+	tile_list tiles_;
+	std::unordered_map<key, tile_list::iterator, key_hash> index_;
+
+	size_t budget_;
+	size_t bytes_ = 0;
+};
+
+#endif//#ifndef MANDELBROT_TILE_CACHE_HPP_INCLUDED
@@ -0,0 +1,183 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_video_export.cpp
+*
+* implementation of \bref{mandelbrot_video_export}
+*
+************************************************************************/
+
+#include "mandelbrot_video_export.hpp"
+#include "mandelbrot_orbit_cache.hpp"
+
+#include <viral_core/log.hpp>
+
+#include <opencv2/videoio.hpp>
+
+#include <math.h>
+
+using namespace viral_core;
+
+//////////////////////////////////////////////////////////////////////////
+//
+// mandelbrot_video_export
+//
+//////////////////////////////////////////////////////////////////////////
+
+mandelbrot_video_export::mandelbrot_video_export(const mandelbrot_generator::parameter_set & params,
+	const settings & s)
+	:
+	parameters_(params),
+	settings_(s),
+	writer_(new cv::VideoWriter()),
+	/*the queued frames, the one being rendered and the one being encoded*/
+	frame_pool_(s.queue_capacity_ + 2)
+{
+	writer_->open(settings_.output_path_, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), settings_.frames_per_second_,
+		cv::Size(parameters_.image_dimensions_.x, parameters_.image_dimensions_.y), true);
+	if (!writer_->isOpened()) {
+		LOG_ERROR(string("could not open output writer for ") + string(settings_.output_path_.c_str()));
+		finished_ = true;
+		return;
+	}
+
+	render_thread_ = std::thread(&mandelbrot_video_export::render_main, this);
+	encode_thread_ = std::thread(&mandelbrot_video_export::encode_main, this);
+}
+
+mandelbrot_video_export::~mandelbrot_video_export()
+{
+	cancel();
+	if (render_thread_.joinable()) render_thread_.join();
+	if (encode_thread_.joinable()) encode_thread_.join();
+}
+
+void mandelbrot_video_export::cancel()
+{
+	cancel_ = true;
+	/*taking the lock makes sure no thread misses the notification between its check and its wait*/
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex_);
+	}
+	queue_condition_.notify_all();
+}
+
+int mandelbrot_video_export::frame_count() const
+{
+	return settings_.frame_count_;
+}
+
+int mandelbrot_video_export::rendered_frames() const
+{
+	return rendered_frames_;
+}
+
+int mandelbrot_video_export::encoded_frames() const
+{
+	return encoded_frames_;
+}
+
+bool mandelbrot_video_export::finished() const
+{
+	return finished_;
+}
+
+bool mandelbrot_video_export::succeeded() const
+{
+	return finished_ && encoded_frames_ == settings_.frame_count_;
+}
+
+void mandelbrot_video_export::frame_iterations(const settings & s, int frame, int & iterations_out,
+	float & interpolation_out)
+{
+	/*the first frame already shows one step of the animation, the last one its end*/
+	double progress = (double)(frame + 1) / s.frame_count_;
+	double peak = s.max_iterations_;
+	double value = 0.;
+	switch (s.easing_) {
+	case easing_exponential_there_and_back:
+		value = pow(peak + 1., progress <= 0.5 ? 2. * progress : 2. - 2. * progress) - 1.;
+		break;
+	case easing_exponential:
+		value = pow(peak + 1., progress) - 1.;
+		break;
+	case easing_linear:
+		value = peak * progress;
+		break;
+	case easing_smoothstep:
+		value = peak * progress * progress * (3. - 2. * progress);
+		break;
+	}
+
+	iterations_out = (int)value;
+	interpolation_out = (float)(value - iterations_out);
+}
+
+void mandelbrot_video_export::render_main()
+{
+	mandelbrot_generator::parameter_set params = parameters_;
+	params.bgra_ = true;
+	mandelbrot_orbit_cache orbit_cache;
+
+	for (int i = 0; i < settings_.frame_count_ && !cancel_;) {
+		/*consecutive frames of the same iteration count only differ in the interpolation, they are one sweep*/
+		std::vector<float> interpolations;
+		std::vector<image*> outputs;
+		std::vector<std::unique_ptr<image> > frames;
+		frame_iterations(settings_, i, params.iterations_, params.interpolation_);
+		for (int frame = i; frame < settings_.frame_count_ && (int)frames.size() < settings_.queue_capacity_; frame++) {
+			int iterations;
+			float interpolation;
+			frame_iterations(settings_, frame, iterations, interpolation);
+			if (iterations != params.iterations_) break;
+			interpolations.push_back(interpolation);
+			frames.emplace_back(frame_pool_.acquire(params.image_dimensions_).release());
+			outputs.push_back(frames.back().get());
+		}
+		if (!mandelbrot_generator::generate_mandelbrot_image_julia_value_sweep(params, interpolations, outputs,
+			&cancel_, &orbit_cache)) break;
+		i += (int)frames.size();
+		rendered_frames_ += (int)frames.size();
+
+		for (size_t f = 0; f < frames.size(); f++) {
+			std::unique_lock<std::mutex> lock(queue_mutex_);
+			queue_condition_.wait(lock, [this] { return (int)queue_.size() < settings_.queue_capacity_ || cancel_; });
+			if (cancel_) break;
+			queue_.push_back(std::move(frames[f]));
+			lock.unlock();
+			queue_condition_.notify_all();
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex_);
+		rendering_done_ = true;
+	}
+	queue_condition_.notify_all();
+}
+
+void mandelbrot_video_export::encode_main()
+{
+	for (;;) {
+		std::unique_ptr<image> img;
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex_);
+			queue_condition_.wait(lock, [this] { return !queue_.empty() || rendering_done_ || cancel_; });
+			if (cancel_ || queue_.empty()) break;
+			img = std::move(queue_.front());
+			queue_.pop_front();
+		}
+		/*the render thread may wait for space in the queue*/
+		queue_condition_.notify_all();
+
+		cv::Mat frame(img->size().y, img->size().x, CV_8UC4, img->data());
+		writer_->write(frame);
+		encoded_frames_++;
+
+		auto_pointer<image> encoded(img.release());
+		frame_pool_.recycle(encoded);
+	}
+
+	writer_->release();
+	finished_ = true;
+}
@@ -0,0 +1,132 @@
+/**
+*************************************************************************
+*
+* @file mandelbrot_video_export.hpp
+*
+* Background export of an iteration animation of
+* \bref{mandelbrot_generator::generate_mandelbrot_image_julia_value} to a video file
+*
+************************************************************************/
+
+#ifndef MANDELBROT_VIDEO_EXPORT_HPP_INCLUDED
+#define MANDELBROT_VIDEO_EXPORT_HPP_INCLUDED
+
+#include "mandelbrot_generator.hpp"
+#include "mandelbrot_image_pool.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace cv { class VideoWriter; }
+
+/**
+*************************************************************************
+*
+* @class mandelbrot_video_export
+*
+* two stage pipeline: a render thread computes the frames in order, each
+* one on all cores through the \bref{render_thread_pool} and continuing the
+* orbits of the previous frame, and hands them to an encoder thread over a
+* bounded queue. encoding overlaps with rendering the next frames, the queue
+* bounds the memory if the encoder falls behind. consecutive frames with the
+* same iteration count are rendered in one
+* \bref{mandelbrot_generator::generate_mandelbrot_image_julia_value_sweep}.
+* the frames are generated in bgra order, so they go to the encoder unconverted
+*
+************************************************************************/
+class mandelbrot_video_export {
+public:
+	/** course of the iteration count (including the interpolation) over the animation */
+	enum easing {
+		easing_exponential_there_and_back,	/**< grows exponentially up to max_iterations_ halfway and back */
+		easing_exponential,
+		easing_linear,
+		easing_smoothstep					/**< slow start and end, 3p^2 - 2p^3 */
+	};
+
+	/**
+	*************************************************************************
+	* @class mandelbrot_video_export::settings
+	* everything about the animation besides the view
+	************************************************************************/
+	class settings {
+	public:
+		std::string output_path_ = "mandelbrot.avi";
+		int frame_count_ = 240;
+		double frames_per_second_ = 30.;
+		easing easing_ = easing_exponential_there_and_back;
+		/** iteration count at the peak of the easing curve */
+		float max_iterations_ = 55.7f;
+		/**
+		* frames that were rendered but not encoded yet, 8MB each at 1920x1080. a sweep
+		* renders up to as many more before they are queued
+		*/
+		int queue_capacity_ = 4;
+	};
+
+	/**
+	* opens the output file and starts the threads. \bref{params} gives the view,
+	* iterations_ and interpolation_ are set per frame. if the file cannot be
+	* opened, the export is finished right away and not \bref{succeeded}
+	*/
+	mandelbrot_video_export(const mandelbrot_generator::parameter_set& params, const settings& s);
+	/** cancels the export if it is still running and waits for the threads */
+	~mandelbrot_video_export();
+
+	mandelbrot_video_export(const mandelbrot_video_export&) = delete;
+	mandelbrot_video_export& operator=(const mandelbrot_video_export&) = delete;
+
+	/** stops after the frame in progress, may be called from any thread */
+	void cancel();
+
+	/** progress, may be polled from any thread */
+	//{
+	int frame_count() const;
+	int rendered_frames() const;
+	int encoded_frames() const;
+	bool finished() const;
+	//}
+
+	/** true once all frames are written to the file */
+	bool succeeded() const;
+
+	/**
+	* iteration count of \bref{frame} in [0, frame_count_), split into the integral
+	* iterations and the interpolation towards the next iteration
+	*/
+	static void frame_iterations(const settings& s, int frame, int& iterations_out, float& interpolation_out);
+
+private:
+	const mandelbrot_generator::parameter_set parameters_;
+	const settings settings_;
+
+	std::unique_ptr<cv::VideoWriter> writer_;
+
+	/** rendered frames waiting for the encoder, in frame order */
+	//{
+	std::mutex queue_mutex_;
+	std::condition_variable queue_condition_;
+	std::deque<std::unique_ptr<viral_core::image> > queue_;
+	bool rendering_done_ = false;
+	//}
+	/** encoded frames go back here, so the frames after the first few render without allocating */
+	mandelbrot_image_pool frame_pool_;
+
+	std::atomic<bool> cancel_{ false };
+	std::atomic<int> rendered_frames_{ 0 };
+	std::atomic<int> encoded_frames_{ 0 };
+	std::atomic<bool> finished_{ false };
+
+	std::thread render_thread_;
+	std::thread encode_thread_;
+
+	void render_main();
+	void encode_main();
+};
+
+#endif//#ifndef MANDELBROT_VIDEO_EXPORT_HPP_INCLUDED
@@ -0,0 +1,168 @@
+/**
+*************************************************************************
+*
+* @file render_thread_pool.cpp
+*
+* implementation of \bref{render_thread_pool}
+*
+************************************************************************/
+
+#include "render_thread_pool.hpp"
+
+#include <stdexcept>
+
+/** pool whose task the current thread is executing, to reject nested calls of run */
+static thread_local const render_thread_pool* running_pool = 0;
+
+//////////////////////////////////////////////////////////////////////////
+//
+// render_thread_pool
+//
+//////////////////////////////////////////////////////////////////////////
+
+render_thread_pool::render_thread_pool(int worker_count)
+	:
+	pending_tasks_(0)
+{
+	if (worker_count <= 0) worker_count = hardware_worker_count();
+
+	for (int i = 0; i < worker_count; i++)
+		queues_.push_back(std::unique_ptr<worker_queue>(new worker_queue()));
+
+	/*worker 0 is the thread calling run()*/
+	for (int i = 1; i < worker_count; i++)
+		threads_.push_back(std::thread(&render_thread_pool::worker_main, this, i));
+}
+
+render_thread_pool::~render_thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(state_mutex_);
+		shutdown_ = true;
+	}
+	wake_condition_.notify_all();
+	for (size_t i = 0; i < threads_.size(); i++) threads_[i].join();
+}
+
+int render_thread_pool::worker_count() const
+{
+	return (int)queues_.size();
+}
+
+void render_thread_pool::run(int task_count, const task_function & task)
+{
+	if (task_count <= 0) return;
+	if (running_pool == this) throw std::logic_error("render_thread_pool::run called from one of its own tasks");
+	std::lock_guard<std::mutex> run_lock(run_mutex_);
+
+	pending_tasks_ = task_count;
+
+	/*hand out contiguous blocks, stealing balances the rest*/
+	int workers = worker_count();
+	for (int w = 0; w < workers; w++) {
+		int begin = (int)((long long)task_count * w / workers);
+		int end = (int)((long long)task_count * (w + 1) / workers);
+		std::lock_guard<std::mutex> lock(queues_[w]->mutex);
+		for (int i = begin; i < end; i++) {
+			queued_task t = { &task, i };
+			queues_[w]->tasks.push_back(t);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(state_mutex_);
+		generation_++;
+	}
+	wake_condition_.notify_all();
+
+	drain(0);
+
+	std::exception_ptr exception;
+	{
+		std::unique_lock<std::mutex> lock(state_mutex_);
+		done_condition_.wait(lock, [this] { return pending_tasks_ == 0; });
+		exception.swap(task_exception_);
+	}
+	if (exception) std::rethrow_exception(exception);
+}
+
+int render_thread_pool::hardware_worker_count()
+{
+	int count = (int)std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+std::shared_ptr<render_thread_pool> render_thread_pool::shared(int worker_count)
+{
+	static std::mutex shared_mutex;
+	static std::shared_ptr<render_thread_pool> shared_pool;
+
+	if (worker_count <= 0) worker_count = hardware_worker_count();
+
+	std::lock_guard<std::mutex> lock(shared_mutex);
+	if (!shared_pool || shared_pool->worker_count() != worker_count)
+		shared_pool.reset(new render_thread_pool(worker_count));
+	return shared_pool;
+}
+
+bool render_thread_pool::try_get_task(int worker, queued_task & out)
+{
+	{
+		worker_queue& own = *queues_[worker];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			out = own.tasks.back();
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+
+	int workers = worker_count();
+	for (int i = 1; i < workers; i++) {
+		worker_queue& victim = *queues_[(worker + i) % workers];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			out = victim.tasks.front();
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void render_thread_pool::drain(int worker)
+{
+	queued_task t;
+	while (try_get_task(worker, t)) {
+		/*a task that throws still counts as finished, run rethrows the first exception*/
+		const render_thread_pool* outer_pool = running_pool;
+		running_pool = this;
+		try {
+			(*t.function)(t.index);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(state_mutex_);
+			if (!task_exception_) task_exception_ = std::current_exception();
+		}
+		running_pool = outer_pool;
+		if (--pending_tasks_ == 0) {
+			std::lock_guard<std::mutex> lock(state_mutex_);
+			done_condition_.notify_all();
+		}
+	}
+}
+
+void render_thread_pool::worker_main(int worker)
+{
+	unsigned int seen_generation = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(state_mutex_);
+			wake_condition_.wait(lock,
+				[&] { return shutdown_ || generation_ != seen_generation; });
+			if (shutdown_) return;
+			seen_generation = generation_;
+		}
+		drain(worker);
+	}
+}
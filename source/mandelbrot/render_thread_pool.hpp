@@ -0,0 +1,106 @@
+/**
+*************************************************************************
+*
+* @file render_thread_pool.hpp
+*
+* Work-stealing thread pool used to distribute image tiles of
+* \bref{mandelbrot_generator} over all cores of the machine
+*
+************************************************************************/
+
+#ifndef RENDER_THREAD_POOL_HPP_INCLUDED
+#define RENDER_THREAD_POOL_HPP_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+*************************************************************************
+*
+* @class render_thread_pool
+*
+* persistent set of worker threads, each owning a queue of task indices.
+* a worker pops from the back of its own queue and steals from the front
+* of the other queues once it runs dry, so expensive tasks (e.g. tiles
+* close to the set boundary) do not stall the whole batch
+*
+************************************************************************/
+class render_thread_pool {
+public:
+	/** signature of a task, receives the index of the task within its batch */
+	typedef std::function<void(int)> task_function;
+
+	/**
+	* creates a pool with \bref{worker_count} workers, the calling thread
+	* of \bref{run} counts as one of them. values <= 0 select
+	* \bref{hardware_worker_count}
+	*/
+	explicit render_thread_pool(int worker_count);
+	~render_thread_pool();
+
+	render_thread_pool(const render_thread_pool&) = delete;
+	render_thread_pool& operator=(const render_thread_pool&) = delete;
+
+	int worker_count() const;
+
+	/**
+	* executes task(i) for all i in [0, task_count) and blocks until all
+	* of them finished. consecutive indices are handed to the same worker
+	* first to keep neighbouring tiles on one core. if tasks throw, the
+	* others still run and the first exception is rethrown afterwards.
+	* tasks must not call run of their own pool, it would wait for itself,
+	* such calls throw std::logic_error instead
+	*/
+	void run(int task_count, const task_function& task);
+
+	/** number of hardware threads, at least 1 */
+	static int hardware_worker_count();
+
+	/**
+	* process-wide pool, recreated when a different \bref{worker_count}
+	* is requested than on the previous call. callers still holding the
+	* previous pool keep it alive until they are done
+	*/
+	static std::shared_ptr<render_thread_pool> shared(int worker_count);
+
+private:
+	struct queued_task {
+		const task_function* function;
+		int index;
+	};
+
+	struct worker_queue {
+		std::mutex mutex;
+		std::deque<queued_task> tasks;
+	};
+
+	/** pops from the own queue or steals from another one, false if all are empty */
+	bool try_get_task(int worker, queued_task& out);
+	/** executes tasks until no queue has any left */
+	void drain(int worker);
+	void worker_main(int worker);
+
+	std::vector<std::unique_ptr<worker_queue> > queues_;
+	std::vector<std::thread> threads_;
+
+	/** serializes concurrent calls to \bref{run} */
+	std::mutex run_mutex_;
+
+	std::mutex state_mutex_;
+	std::condition_variable wake_condition_;
+	std::condition_variable done_condition_;
+	unsigned int generation_ = 0;
+	bool shutdown_ = false;
+	std::atomic<int> pending_tasks_;
+	/** first exception thrown by a task of the current \bref{run} */
+	std::exception_ptr task_exception_;
+};
+
+#endif//#ifndef RENDER_THREAD_POOL_HPP_INCLUDED
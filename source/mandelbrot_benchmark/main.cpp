@@ -0,0 +1,468 @@
+/**
+*************************************************************************
+*
+* @file main.cpp
+*
+* Benchmark of the generators, interpolation methods and color converters
+* of \bref{mandelbrot_generator} on fixed scenes. prints a table with
+* Mpixel/s and Giter/s and optionally writes the results as csv or json
+* to compare builds
+*
+************************************************************************/
+
+#include "mandelbrot/mandelbrot_generator.hpp"
+#include "mandelbrot/mandelbrot_parameter_file.hpp"
+#include "mandelbrot/mandelbrot_tile_cache.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace viral_core;
+
+/** views that are rendered by every generator case, coordinates as decimal strings for double_double */
+struct benchmark_scene {
+	const char* name;
+	const char* center_real;
+	const char* center_imaginary;
+	const char* width;
+	int max_iter;
+};
+
+static const benchmark_scene scenes[] = {
+	{ "full_set", "-0.5", "0", "3.2", 1000 },
+	{ "seahorse_valley", "-0.7453", "0.1127", "0.01", 2000 },
+	{ "deep_zoom", "-0.743643887037158704752191506114774", "0.131825904205311970493132056385139", "1e-15", 2000 },
+	{ "interior", "-0.1226", "0.7449", "0.02", 50000 }
+};
+
+/** interpolation methods of \bref{generate_mandelbrot_image_julia_value} */
+struct benchmark_interpolation {
+	const char* name;
+	void(*method)(float, float, float, float, float, float&, float&);
+};
+
+static const benchmark_interpolation interpolations[] = {
+	{ "polynomial", &mandelbrot_generator::polynomial },
+	{ "linear_angle_and_abs", &mandelbrot_generator::linear_angle_and_abs },
+	{ "linear_short_angle_and_abs", &mandelbrot_generator::linear_short_angle_and_abs },
+	{ "linear_xy", &mandelbrot_generator::linear_xy }
+};
+
+/** iteration count of the julia value cases, the interpolation goes halfway to the next one */
+static const int julia_value_iterations = 20;
+
+/** frames of the julia value sweep cases */
+static const int sweep_frames = 10;
+
+/** one line of the report */
+struct benchmark_result {
+	std::string scene;
+	std::string name;
+	long long pixels = 0;
+	long long iterations = 0;
+	/** of the generator cases, pixels iterated and pixels filled by render_subdivision */
+	//{
+	long long evaluated_pixels = 0;
+	long long filled_pixels = 0;
+	//}
+	std::vector<double> milliseconds;
+
+	double mean_milliseconds() const
+	{
+		double sum = 0.;
+		for (double ms : milliseconds) sum += ms;
+		return sum / milliseconds.size();
+	}
+
+	double stddev_milliseconds() const
+	{
+		double mean = mean_milliseconds();
+		double sum = 0.;
+		for (double ms : milliseconds) sum += (ms - mean) * (ms - mean);
+		return milliseconds.size() > 1 ? sqrt(sum / (milliseconds.size() - 1)) : 0.;
+	}
+
+	double mpixel_per_second() const { return pixels / mean_milliseconds() / 1000.; }
+	double giter_per_second() const { return iterations / mean_milliseconds() / 1000000.; }
+};
+
+struct benchmark_options {
+	vector2i size = vector2i(1280, 720);
+	int repetitions = 5;
+	int worker_count = 0;
+	std::string filter;
+	std::string csv_path;
+	std::string json_path;
+};
+
+static double milliseconds_since(const std::chrono::steady_clock::time_point& start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/** runs \bref{function} once to warm up and then \bref{options.repetitions} times */
+template<typename function_type>
+static void measure(const benchmark_options& options, benchmark_result& result, const function_type& function)
+{
+	function();
+	for (int i = 0; i < options.repetitions; i++) {
+		auto start = std::chrono::steady_clock::now();
+		function();
+		result.milliseconds.push_back(milliseconds_since(start));
+	}
+}
+
+static mandelbrot_generator::parameter_set scene_parameters(const benchmark_scene& scene,
+	const benchmark_options& options)
+{
+	double_double center_real, center_imaginary, width;
+	mandelbrot_parameter_file::parse_double_double(scene.center_real, center_real);
+	mandelbrot_parameter_file::parse_double_double(scene.center_imaginary, center_imaginary);
+	mandelbrot_parameter_file::parse_double_double(scene.width, width);
+	double_double height = width * ((double)options.size.y / options.size.x);
+
+	mandelbrot_generator::parameter_set params;
+	params.image_dimensions_ = options.size;
+	params.real_min_ = center_real - width * 0.5;
+	params.real_max_ = center_real + width * 0.5;
+	params.imaginary_min_ = center_imaginary - height * 0.5;
+	params.imaginary_max_ = center_imaginary + height * 0.5;
+	params.max_iter_ = scene.max_iter;
+	params.worker_count_ = options.worker_count;
+	return params;
+}
+
+static bool selected(const benchmark_options& options, const std::string& scene, const std::string& name)
+{
+	return options.filter.empty() || (scene + "/" + name).find(options.filter) != std::string::npos;
+}
+
+static void print_result(const benchmark_result& result)
+{
+	printf("%-16s %-38s %10.2f ms +- %7.2f %10.2f Mpixel/s", result.scene.c_str(), result.name.c_str(),
+		result.mean_milliseconds(), result.stddev_milliseconds(), result.mpixel_per_second());
+	if (result.iterations > 0) printf(" %8.3f Giter/s", result.giter_per_second());
+	if (result.evaluated_pixels > 0 || result.filled_pixels > 0)
+		printf(" %10lld evaluated %10lld filled", result.evaluated_pixels, result.filled_pixels);
+	printf("\n");
+	fflush(stdout);
+}
+
+static void run_generators(const benchmark_options& options, std::vector<benchmark_result>& results)
+{
+	for (const benchmark_scene& scene : scenes) {
+		mandelbrot_generator::parameter_set params = scene_parameters(scene, options);
+		long long pixels = (long long)options.size.x * options.size.y;
+
+		const struct {
+			const char* name;
+			mandelbrot_generator::render_mode mode;
+			mandelbrot_generator::escape_coloring coloring;
+		} julia_iter_cases[] = {
+			{ "julia_iter/brute_force", mandelbrot_generator::render_brute_force, mandelbrot_generator::coloring_escape_time },
+			{ "julia_iter/subdivision", mandelbrot_generator::render_subdivision, mandelbrot_generator::coloring_escape_time },
+			{ "julia_iter/smooth", mandelbrot_generator::render_brute_force, mandelbrot_generator::coloring_smooth },
+			{ "julia_iter/distance", mandelbrot_generator::render_brute_force, mandelbrot_generator::coloring_distance },
+			{ "julia_iter/supersampled", mandelbrot_generator::render_brute_force, mandelbrot_generator::coloring_smooth }
+		};
+		for (const auto& c : julia_iter_cases) {
+			if (!selected(options, scene.name, c.name)) continue;
+			benchmark_result result;
+			result.scene = scene.name;
+			result.name = c.name;
+			result.pixels = pixels;
+			params.render_mode_ = c.mode;
+			params.coloring_ = c.coloring;
+			params.max_samples_ = strcmp(c.name, "julia_iter/supersampled") == 0 ? 16 : 1;
+			measure(options, result, [&]() {
+				mandelbrot_generator::frame_statistics statistics;
+				mandelbrot_generator::generate_mandelbrot_image_julia_iter(params, &statistics);
+				result.iterations = statistics.escape_.iterations;
+				result.evaluated_pixels = statistics.evaluated_pixels_;
+				result.filled_pixels = statistics.filled_pixels_;
+			});
+			print_result(result);
+			results.push_back(result);
+		}
+		params.render_mode_ = mandelbrot_generator::render_brute_force;
+		params.coloring_ = mandelbrot_generator::coloring_escape_time;
+		params.max_samples_ = 1;
+
+		if (selected(options, scene.name, "julia_iter/tile_cache_pan")) {
+			benchmark_result result;
+			result.scene = scene.name;
+			result.name = "julia_iter/tile_cache_pan";
+			result.pixels = pixels;
+			/*every frame moves the view by 16 pixels, the cache keeps the rest from the frame before*/
+			mandelbrot_generator::parameter_set pan_params = params;
+			mandelbrot_tile_cache::snap(pan_params);
+			mandelbrot_tile_cache tile_cache;
+			int frame = 0;
+			measure(options, result, [&]() {
+				mandelbrot_tile_cache::placement p;
+				mandelbrot_generator::parameter_set frame_params = pan_params;
+				if (mandelbrot_tile_cache::place(pan_params, p)) {
+					long long offset = 16 * frame++;
+					frame_params.real_min_ = mandelbrot_tile_cache::coordinate(p.x + offset, p.level);
+					frame_params.real_max_ = mandelbrot_tile_cache::coordinate(p.x + offset + options.size.x, p.level);
+				}
+				mandelbrot_generator::frame_statistics statistics;
+				mandelbrot_generator::generate_mandelbrot_image_julia_iter(frame_params, &statistics, 0, 0, &tile_cache);
+				result.iterations = statistics.escape_.iterations;
+				result.evaluated_pixels = statistics.evaluated_pixels_;
+				result.filled_pixels = statistics.filled_pixels_;
+			});
+			print_result(result);
+			results.push_back(result);
+		}
+
+		/*the other formulas of the same view, how much the step of each costs against z^2 + c*/
+		const struct {
+			const char* name;
+			mandelbrot_formula::family family;
+			int power;
+			bool julia;
+		} formula_cases[] = {
+			{ "julia_iter/multibrot3", mandelbrot_formula::multibrot, 3, false },
+			{ "julia_iter/multibrot8", mandelbrot_formula::multibrot, 8, false },
+			{ "julia_iter/burning_ship", mandelbrot_formula::burning_ship, 2, false },
+			{ "julia_iter/tricorn", mandelbrot_formula::tricorn, 2, false },
+			{ "julia_iter/julia", mandelbrot_formula::mandelbrot, 2, true }
+		};
+		for (const auto& c : formula_cases) {
+			if (!selected(options, scene.name, c.name)) continue;
+			benchmark_result result;
+			result.scene = scene.name;
+			result.name = c.name;
+			result.pixels = pixels;
+			mandelbrot_generator::parameter_set formula_params = params;
+			formula_params.formula_.family_ = c.family;
+			formula_params.formula_.power_ = c.power;
+			formula_params.formula_.julia_ = c.julia;
+			formula_params.formula_.julia_re_ = -0.8;
+			formula_params.formula_.julia_im_ = 0.156;
+			measure(options, result, [&]() {
+				mandelbrot_generator::frame_statistics statistics;
+				mandelbrot_generator::generate_mandelbrot_image_julia_iter(formula_params, &statistics);
+				result.iterations = statistics.escape_.iterations;
+				result.evaluated_pixels = statistics.evaluated_pixels_;
+				result.filled_pixels = statistics.filled_pixels_;
+			});
+			print_result(result);
+			results.push_back(result);
+		}
+
+		for (int i = 0; i < 2 * (int)(sizeof(interpolations) / sizeof(interpolations[0])); i++) {
+			const benchmark_interpolation& interpolation = interpolations[i / 2];
+			bool fast_math = i % 2 == 1;
+			std::string name = std::string("julia_value/") + interpolation.name + (fast_math ? "/fast_math" : "");
+			if (!selected(options, scene.name, name)) continue;
+			benchmark_result result;
+			result.scene = scene.name;
+			result.name = name;
+			result.pixels = pixels;
+			result.iterations = pixels * julia_value_iterations;
+			mandelbrot_generator::parameter_set value_params = params;
+			value_params.iterations_ = julia_value_iterations;
+			value_params.interpolate_ = true;
+			value_params.interpolation_ = 0.5f;
+			value_params.interpolation_method_ = interpolation.method;
+			value_params.fast_math_ = fast_math;
+			measure(options, result, [&]() {
+				mandelbrot_generator::generate_mandelbrot_image_julia_value(value_params);
+			});
+			print_result(result);
+			results.push_back(result);
+		}
+
+		/*the frames of the same cases at 0, 0.1, ..., 0.9 in one sweep, pixels count per frame*/
+		for (int i = 0; i < (int)(sizeof(interpolations) / sizeof(interpolations[0])); i++) {
+			const benchmark_interpolation& interpolation = interpolations[i];
+			std::string name = std::string("julia_value_sweep/") + interpolation.name;
+			if (!selected(options, scene.name, name)) continue;
+			benchmark_result result;
+			result.scene = scene.name;
+			result.name = name;
+			result.pixels = pixels * sweep_frames;
+			result.iterations = pixels * julia_value_iterations;
+			mandelbrot_generator::parameter_set value_params = params;
+			value_params.iterations_ = julia_value_iterations;
+			value_params.interpolate_ = true;
+			value_params.interpolation_method_ = interpolation.method;
+			std::vector<float> sweep_interpolations;
+			std::vector<std::unique_ptr<image> > frames;
+			std::vector<image*> outputs;
+			for (int frame = 0; frame < sweep_frames; frame++) {
+				sweep_interpolations.push_back(frame / (float)sweep_frames);
+				frames.emplace_back(new image(options.size));
+				outputs.push_back(frames.back().get());
+			}
+			measure(options, result, [&]() {
+				mandelbrot_generator::generate_mandelbrot_image_julia_value_sweep(value_params, sweep_interpolations,
+					outputs);
+			});
+			print_result(result);
+			results.push_back(result);
+		}
+	}
+}
+
+/** sink for the output of the color converters, so the calls cannot be optimized away */
+static volatile unsigned int color_checksum;
+
+/** color converters on a full image worth of inputs, single threaded */
+static void run_color_converters(const benchmark_options& options, std::vector<benchmark_result>& results)
+{
+	const int width = options.size.x;
+	const int height = options.size.y;
+
+	const struct {
+		const char* name;
+		void(*convert)(float, float, unsigned char&, unsigned char&, unsigned char&);
+	} converters[] = {
+		{ "color/hsv_to_rgb", [](float a, float b, unsigned char& r, unsigned char& g, unsigned char& bl) {
+			mandelbrot_generator::hsv_to_rgb(a, 1.f, b, r, g, bl); } },
+		{ "color/hsl_to_rgb", [](float a, float b, unsigned char& r, unsigned char& g, unsigned char& bl) {
+			mandelbrot_generator::hsl_to_rgb(a, 1.f, b, r, g, bl); } },
+		{ "color/rgb_project_2d", [](float a, float b, unsigned char& r, unsigned char& g, unsigned char& bl) {
+			mandelbrot_generator::rgb_project_2d(a, b, r, g, bl); } }
+	};
+
+	for (const auto& c : converters) {
+		if (!selected(options, "color", c.name)) continue;
+		benchmark_result result;
+		result.scene = "color";
+		result.name = c.name;
+		result.pixels = (long long)width * height;
+		unsigned int checksum = 0;
+		measure(options, result, [&]() {
+			for (int y = 0; y < height; y++) {
+				float b = (float)y / height;
+				for (int x = 0; x < width; x++) {
+					unsigned char r, g, bl;
+					c.convert((float)x / width, b, r, g, bl);
+					checksum += r + g + bl;
+				}
+			}
+		});
+		color_checksum = checksum;
+		print_result(result);
+		results.push_back(result);
+	}
+
+	/*the coloring pass of julia_value, one row of z values at a time*/
+	if (selected(options, "color", "color/color_julia_values")) {
+		benchmark_result result;
+		result.scene = "color";
+		result.name = "color/color_julia_values";
+		result.pixels = (long long)width * height;
+		mandelbrot_generator::parameter_set params;
+		std::vector<float> x(width), y(width);
+		std::vector<unsigned char> pixels(width * 4);
+		unsigned int checksum = 0;
+		measure(options, result, [&]() {
+			for (int row = 0; row < height; row++) {
+				for (int column = 0; column < width; column++) {
+					x[column] = 4.f * column / width - 2.f;
+					y[column] = 4.f * row / height - 2.f;
+				}
+				mandelbrot_generator::color_julia_values(params, x.data(), y.data(), width, pixels.data());
+				checksum += pixels[row % width * 4];
+			}
+		});
+		color_checksum = checksum;
+		print_result(result);
+		results.push_back(result);
+	}
+}
+
+static bool write_csv(const std::string& path, const std::vector<benchmark_result>& results)
+{
+	std::ofstream out(path.c_str());
+	out << "scene,case,pixels,iterations,evaluated_pixels,filled_pixels,repetitions,mean_ms,stddev_ms,"
+		"mpixel_per_s,giter_per_s\n";
+	for (const benchmark_result& r : results) {
+		out << r.scene << "," << r.name << "," << r.pixels << "," << r.iterations << ","
+			<< r.evaluated_pixels << "," << r.filled_pixels << ","
+			<< r.milliseconds.size() << "," << r.mean_milliseconds() << "," << r.stddev_milliseconds() << ","
+			<< r.mpixel_per_second() << "," << r.giter_per_second() << "\n";
+	}
+	return (bool)out;
+}
+
+static bool write_json(const std::string& path, const benchmark_options& options,
+	const std::vector<benchmark_result>& results)
+{
+	std::ofstream out(path.c_str());
+	out << "{\n  \"width\": " << options.size.x << ",\n  \"height\": " << options.size.y
+		<< ",\n  \"repetitions\": " << options.repetitions << ",\n  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		const benchmark_result& r = results[i];
+		out << "    { \"scene\": \"" << r.scene << "\", \"case\": \"" << r.name << "\", \"pixels\": " << r.pixels
+			<< ", \"iterations\": " << r.iterations << ", \"evaluated_pixels\": " << r.evaluated_pixels
+			<< ", \"filled_pixels\": " << r.filled_pixels << ", \"milliseconds\": [";
+		for (size_t j = 0; j < r.milliseconds.size(); j++) out << (j ? ", " : "") << r.milliseconds[j];
+		out << "], \"mean_ms\": " << r.mean_milliseconds() << ", \"stddev_ms\": " << r.stddev_milliseconds()
+			<< ", \"mpixel_per_s\": " << r.mpixel_per_second() << ", \"giter_per_s\": " << r.giter_per_second()
+			<< " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+	return (bool)out;
+}
+
+static bool parse_options(int argc, char** argv, benchmark_options& options)
+{
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc) return false;
+		const char* value = argv[++i];
+		if (arg == "--size") {
+			if (sscanf(value, "%dx%d", &options.size.x, &options.size.y) != 2) return false;
+			if (options.size.x <= 0 || options.size.y <= 0) return false;
+		}
+		else if (arg == "--repetitions") {
+			options.repetitions = atoi(value);
+			if (options.repetitions <= 0) return false;
+		}
+		else if (arg == "--workers") options.worker_count = atoi(value);
+		else if (arg == "--filter") options.filter = value;
+		else if (arg == "--csv") options.csv_path = value;
+		else if (arg == "--json") options.json_path = value;
+		else return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	benchmark_options options;
+	if (!parse_options(argc, argv, options)) {
+		fprintf(stderr,
+			"usage: mandelbrot_benchmark [--size 1280x720] [--repetitions 5] [--workers 0]\n"
+			"                            [--filter text] [--csv file] [--json file]\n"
+			"  --filter only runs the cases whose scene/case name contains the text\n");
+		return 2;
+	}
+
+	printf("%dx%d, %d repetitions after one warm up run\n", options.size.x, options.size.y, options.repetitions);
+	std::vector<benchmark_result> results;
+	run_generators(options, results);
+	run_color_converters(options, results);
+
+	if (!options.csv_path.empty() && !write_csv(options.csv_path, results)) {
+		fprintf(stderr, "could not write %s\n", options.csv_path.c_str());
+		return 1;
+	}
+	if (!options.json_path.empty() && !write_json(options.json_path, options, results)) {
+		fprintf(stderr, "could not write %s\n", options.json_path.c_str());
+		return 1;
+	}
+	return 0;
+}
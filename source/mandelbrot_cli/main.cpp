@@ -0,0 +1,458 @@
+/**
+*************************************************************************
+*
+* @file main.cpp
+*
+* Headless batch renderer: renders the frames of a parameter file, see
+* \bref{mandelbrot_parameter_file}, and reports the time per frame.
+* frames saved with raw_output can be colored again without iterating.
+* the frames can be split across worker processes, see
+* \bref{mandelbrot_distributed}, or accumulated as orbit densities, see
+* \bref{mandelbrot_buddhabrot}. frames larger than memory are streamed to
+* a tiled TIFF, see \bref{mandelbrot_poster}.
+* only depends on viral_core, hence runs without a display
+*
+************************************************************************/
+
+#include <viral_core/file.hpp>
+#include <viral_core/image.hpp>
+
+#include "mandelbrot/mandelbrot_buddhabrot.hpp"
+#include "mandelbrot/mandelbrot_distributed.hpp"
+#include "mandelbrot/mandelbrot_generator.hpp"
+#include "mandelbrot/mandelbrot_parameter_file.hpp"
+#include "mandelbrot/mandelbrot_poster.hpp"
+#include "mandelbrot/mandelbrot_profiler.hpp"
+#include "mandelbrot/mandelbrot_raw_file.hpp"
+#include "mandelbrot/mandelbrot_tile_cache.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace viral_core;
+
+/** writes the rgb channels of \bref{img} as binary ppm */
+static bool save_ppm(const image& img, const std::string& path)
+{
+	std::ofstream out(path.c_str(), std::ios::binary);
+	if (!out) return false;
+
+	out << "P6\n" << img.size().x << " " << img.size().y << "\n255\n";
+	const unsigned char* data = img.data();
+	std::vector<char> row(img.size().x * 3);
+	for (int y = 0; y < img.size().y; y++) {
+		for (int x = 0; x < img.size().x; x++) {
+			const unsigned char* pixel = data + (y * img.size().x + x) * 4;
+			row[x * 3] = (char)pixel[0];
+			row[x * 3 + 1] = (char)pixel[1];
+			row[x * 3 + 2] = (char)pixel[2];
+		}
+		out.write(row.data(), row.size());
+	}
+	out.close();
+	return !out.fail();
+}
+
+/** true if the file at \bref{path} ends with the IEND chunk, i.e. the png was written completely */
+static bool png_complete(const std::string& path)
+{
+	static const unsigned char iend[12] = { 0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xae, 0x42, 0x60, 0x82 };
+	std::ifstream in(path.c_str(), std::ios::binary);
+	unsigned char tail[sizeof(iend)];
+	in.seekg(-(std::streamoff)sizeof(tail), std::ios::end);
+	return in.read((char*)tail, sizeof(tail)) && std::equal(tail, tail + sizeof(tail), iend);
+}
+
+/**
+* writes a png, or a ppm if \bref{path} ends with .ppm. false if the file could not be written
+* completely, e.g. on a full disk, the previous file at \bref{path} is kept then
+*/
+static bool save_image(const image& img, const std::string& path)
+{
+	size_t dot = path.find_last_of('.');
+	if (dot != std::string::npos && path.substr(dot) == ".ppm") return save_ppm(img, path);
+
+	/*the encoder does not report errors, so the written file is checked before it replaces the target*/
+	std::string temporary = path + ".part";
+	bool written = true;
+	try {
+		disk_file img_file(string(temporary.c_str()), file::read_write_truncate);
+		img.save_png(img_file);
+	}
+	catch (...) {
+		written = false;
+	}
+	written = written && png_complete(temporary);
+
+	if (written) remove(path.c_str());
+	if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+static double milliseconds_since(const std::chrono::steady_clock::time_point& start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/** colors a file written through raw_output with another color offset */
+static int recolor(const std::string& raw_path, const std::string& image_path, float hsv_color_offset)
+{
+	auto start = std::chrono::steady_clock::now();
+	mandelbrot_raw_file raw;
+	std::string error;
+	if (!raw.open(raw_path, error)) {
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	mandelbrot_generator::parameter_set params = raw.parameters();
+	params.hsv_color_offset_ = hsv_color_offset;
+	auto_pointer<image> img = raw.recolor(params);
+	double recolor_ms = milliseconds_since(start);
+
+	start = std::chrono::steady_clock::now();
+	if (!save_image(*img, image_path)) {
+		fprintf(stderr, "could not write %s\n", image_path.c_str());
+		return 1;
+	}
+	printf("%dx%d recolor %.1f ms write %.1f ms -> %s\n", img->size().x, img->size().y, recolor_ms,
+		milliseconds_since(start), image_path.c_str());
+	return 0;
+}
+
+/** totals over all frames of a run */
+struct run_totals {
+	double render_ms = 0.;
+	double write_ms = 0.;
+	long long pixels = 0;
+};
+
+/** writes a rendered frame and prints its line, false if a file could not be written */
+static bool finish_frame(const mandelbrot_parameter_file::frame& f, int index, const image& img,
+	const mandelbrot_generator::frame_statistics& statistics, const mandelbrot_generator::raw_frame* raw,
+	double render_ms, std::vector<mandelbrot_profiler::event>& trace, run_totals& totals)
+{
+	std::string path = mandelbrot_parameter_file::output_path(f, index);
+	std::string error;
+	auto start = std::chrono::steady_clock::now();
+	if (!save_image(img, path)) {
+		fprintf(stderr, "frame %d: could not write %s\n", index, path.c_str());
+		return false;
+	}
+	if (raw && !mandelbrot_raw_file::write(mandelbrot_parameter_file::raw_output_path(f, index), f.params_,
+		*raw, error)) {
+		fprintf(stderr, "frame %d: %s\n", index, error.c_str());
+		return false;
+	}
+	double write_ms = milliseconds_since(start);
+
+	long long pixels = (long long)img.size().x * img.size().y;
+	printf("frame %d: %dx%d render %.1f ms (%.1f Mpixel/s) write %.1f ms",
+		index, img.size().x, img.size().y, render_ms, pixels / render_ms / 1000., write_ms);
+	if (f.visualization_ == mandelbrot_parameter_file::visualization_julia_iter) {
+		printf(" iterations %lld", statistics.escape_.iterations);
+		if (f.params_.max_samples_ > 1) printf(" %.2f spp", statistics.samples_per_pixel());
+	}
+	if (mandelbrot_profiler::enabled()) {
+		std::vector<mandelbrot_profiler::event> events = mandelbrot_profiler::take_events();
+		mandelbrot_profiler::summary summary = mandelbrot_profiler::summarize(events, "tile");
+		if (summary.busy_threads() > 0)
+			printf(" utilization %.0f%% of %d threads", summary.utilization() * 100., summary.busy_threads());
+		trace.insert(trace.end(), events.begin(), events.end());
+	}
+	printf(" -> %s\n", path.c_str());
+	fflush(stdout);
+
+	totals.render_ms += render_ms;
+	totals.write_ms += write_ms;
+	totals.pixels += pixels;
+	return true;
+}
+
+/**
+* accumulates the orbit densities of the view of the first frame of a parameter file and
+* writes the image after every pass. with a state file, the accumulation continues from
+* it and is saved after every pass
+*/
+static int buddhabrot(const std::string& parameter_path, long long samples, const std::string& state_path,
+	bool nebulabrot, bool metropolis)
+{
+	std::vector<mandelbrot_parameter_file::frame> frames;
+	std::string error;
+	if (!mandelbrot_parameter_file::read(parameter_path, frames, error)) {
+		fprintf(stderr, "%s: %s\n", parameter_path.c_str(), error.c_str());
+		return 1;
+	}
+	const mandelbrot_parameter_file::frame& f = frames[0];
+	mandelbrot_generator::parameter_set view = f.params_.flat_view();
+
+	/*the classic nebulabrot limits are max_iter, a tenth and a hundredth of it*/
+	mandelbrot_buddhabrot::settings s;
+	s.image_dimensions_ = f.params_.image_dimensions_;
+	s.real_min_ = view.real_min_.to_double();
+	s.imaginary_min_ = view.imaginary_min_.to_double();
+	s.real_max_ = view.real_max_.to_double();
+	s.imaginary_max_ = view.imaginary_max_.to_double();
+	s.channel_max_iter_[0] = f.params_.max_iter_;
+	s.channel_max_iter_[1] = nebulabrot ? std::max(f.params_.max_iter_ / 10, 1) : f.params_.max_iter_;
+	s.channel_max_iter_[2] = nebulabrot ? std::max(f.params_.max_iter_ / 100, 1) : f.params_.max_iter_;
+	s.formula_ = f.params_.formula_;
+	s.sampling_ = metropolis ? mandelbrot_buddhabrot::sampling_metropolis : mandelbrot_buddhabrot::sampling_uniform;
+	s.worker_count_ = f.params_.worker_count_;
+	s.simd_level_ = f.params_.simd_level_;
+
+	mandelbrot_buddhabrot accumulation(s);
+	std::ifstream existing(state_path.c_str());
+	if (!state_path.empty() && existing) {
+		existing.close();
+		if (!accumulation.load(state_path, error)) {
+			fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+		printf("continuing %lld samples of %s\n", accumulation.current_progress().samples_, state_path.c_str());
+	}
+
+	std::string path = mandelbrot_parameter_file::output_path(f, 0);
+	bool written = true;
+	accumulation.accumulate(samples, [&](const mandelbrot_buddhabrot::progress& p) {
+		auto start = std::chrono::steady_clock::now();
+		written = save_image(*accumulation.snapshot(), path)
+			&& (state_path.empty() || accumulation.save(state_path, error));
+		if (!written) {
+			fprintf(stderr, "%s\n", error.empty() ? ("could not write " + path).c_str() : error.c_str());
+			return false;
+		}
+		printf("pass %d: %lld samples (%.2f Msamples/s) %lld orbits %lld hits write %.1f ms -> %s\n",
+			p.passes_, p.samples_, p.samples_per_second() * 1e-6, p.counted_, p.hits_,
+			milliseconds_since(start), path.c_str());
+		fflush(stdout);
+		return true;
+	});
+	return written ? 0 : 1;
+}
+
+/**
+* renders the first frame of a parameter file as a poster next to its output, with the
+* extension replaced by .tif. an interrupted poster is continued
+*/
+static int poster(const std::string& parameter_path, long long budget_mb, int tile_size, bool restart)
+{
+	std::vector<mandelbrot_parameter_file::frame> frames;
+	std::string error;
+	if (!mandelbrot_parameter_file::read(parameter_path, frames, error)) {
+		fprintf(stderr, "%s: %s\n", parameter_path.c_str(), error.c_str());
+		return 1;
+	}
+	const mandelbrot_parameter_file::frame& f = frames[0];
+
+	mandelbrot_poster::settings s;
+	s.output_path_ = mandelbrot_parameter_file::output_path(f, 0);
+	size_t dot = s.output_path_.find_last_of('.');
+	if (dot != std::string::npos && s.output_path_.find_first_of("/\\", dot) == std::string::npos)
+		s.output_path_.erase(dot);
+	s.output_path_ += ".tif";
+	if (budget_mb > 0) s.memory_budget_ = budget_mb << 20;
+	if (tile_size > 0) s.tile_size_ = tile_size;
+	s.escape_time_ = f.visualization_ == mandelbrot_parameter_file::visualization_julia_iter;
+	s.resume_ = !restart;
+
+	mandelbrot_poster renderer(f.params_, s);
+	bool rendered = renderer.render([&](const mandelbrot_poster::progress& p) {
+		/*nothing to extrapolate from before the first chunk of this render*/
+		long long done = p.rendered_tiles_ - p.resumed_tiles_;
+		double remaining = done > 0 ? p.seconds_ / done * (p.tile_count_ - p.rendered_tiles_) : 0.;
+		double rate = p.seconds_ > 0. ? p.pixels_ / p.seconds_ * 1e-6 : 0.;
+		printf("%lld of %lld tiles (%lld written) %.1f Mpixel/s, %.0f s left\n", p.rendered_tiles_, p.tile_count_,
+			p.written_tiles_, rate, remaining);
+		fflush(stdout);
+		return true;
+	}, error);
+	if (!rendered) {
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+
+	const mandelbrot_poster::progress& p = renderer.current_progress();
+	if (p.resumed_tiles_ > 0) printf("continued after %lld tiles\n", p.resumed_tiles_);
+	printf("%dx%d poster: %.1f s -> %s\n", f.params_.image_dimensions_.x, f.params_.image_dimensions_.y,
+		p.seconds_, s.output_path_.c_str());
+	return 0;
+}
+
+static void print_usage()
+{
+	fprintf(stderr,
+		"usage: mandelbrot_cli <parameter file> [--trace <trace file>] [--coordinator <address> [--tile <pixels>]]\n"
+		"                                         renders all frames of the file, optionally with\n"
+		"                                         a chrome://tracing file of the timings. with\n"
+		"                                         --coordinator, the frames are split into tiles\n"
+		"                                         that are rendered by the workers connecting to\n"
+		"                                         host:port or unix:path\n"
+		"       mandelbrot_cli --worker <address> [--threads <count>]\n"
+		"                                         renders tiles for the coordinator at the address\n"
+		"       mandelbrot_cli --buddhabrot <parameter file> [--samples <count>] [--state <file>]\n"
+		"                      [--nebulabrot] [--metropolis]\n"
+		"                                         accumulates the orbit densities of the view of the\n"
+		"                                         first frame, optionally continuing a saved state\n"
+		"       mandelbrot_cli --poster <parameter file> [--budget <MB>] [--tile <pixels>] [--restart]\n"
+		"                                         streams the first frame to a tiled TIFF in bounded\n"
+		"                                         memory, continuing an interrupted render\n"
+		"       mandelbrot_cli --defaults         prints a parameter file with the default values\n"
+		"       mandelbrot_cli --recolor <raw file> <image file> [hsv color offset]\n"
+		"                                         colors a frame saved with raw_output\n");
+}
+
+int main(int argc, char** argv)
+{
+	if (argc >= 4 && argc <= 5 && std::string(argv[1]) == "--recolor")
+		return recolor(argv[2], argv[3], argc == 5 ? (float)atof(argv[4]) : 0.f);
+
+	if (argc >= 3 && std::string(argv[1]) == "--worker") {
+		int threads = 0;
+		if (argc == 5 && std::string(argv[3]) == "--threads") threads = atoi(argv[4]);
+		else if (argc != 3) {
+			print_usage();
+			return 2;
+		}
+		std::string error;
+		if (!mandelbrot_distributed::work(argv[2], threads, error)) {
+			fprintf(stderr, "worker: %s\n", error.c_str());
+			return 1;
+		}
+		return 0;
+	}
+
+	if (argc >= 3 && std::string(argv[1]) == "--buddhabrot") {
+		long long samples = 1ll << 24;
+		std::string state_path;
+		bool nebulabrot = false;
+		bool metropolis = false;
+		bool valid = true;
+		for (int i = 3; i < argc && valid; i++) {
+			std::string option = argv[i];
+			if (option == "--nebulabrot") nebulabrot = true;
+			else if (option == "--metropolis") metropolis = true;
+			else if (option == "--samples" && i + 1 < argc) samples = atoll(argv[++i]);
+			else if (option == "--state" && i + 1 < argc) state_path = argv[++i];
+			else valid = false;
+		}
+		if (!valid) {
+			print_usage();
+			return 2;
+		}
+		return buddhabrot(argv[2], samples, state_path, nebulabrot, metropolis);
+	}
+
+	if (argc >= 3 && std::string(argv[1]) == "--poster") {
+		long long budget_mb = 0;
+		int tile_size = 0;
+		bool restart = false;
+		bool valid = true;
+		for (int i = 3; i < argc && valid; i++) {
+			std::string option = argv[i];
+			if (option == "--restart") restart = true;
+			else if (option == "--budget" && i + 1 < argc) budget_mb = atoll(argv[++i]);
+			else if (option == "--tile" && i + 1 < argc) tile_size = atoi(argv[++i]);
+			else valid = false;
+		}
+		if (!valid) {
+			print_usage();
+			return 2;
+		}
+		return poster(argv[2], budget_mb, tile_size, restart);
+	}
+
+	/*the trace covers all frames, each frame line gets the utilization of the threads*/
+	std::string trace_path;
+	mandelbrot_distributed::settings distributed;
+	bool valid = argc >= 2;
+	for (int i = 2; i < argc && valid; i += 2) {
+		std::string option = argv[i];
+		valid = i + 1 < argc;
+		if (!valid) break;
+		if (option == "--trace") trace_path = argv[i + 1];
+		else if (option == "--coordinator") distributed.address_ = argv[i + 1];
+		else if (option == "--tile") distributed.tile_size_ = atoi(argv[i + 1]);
+		else valid = false;
+	}
+	if (!valid) {
+		print_usage();
+		return 2;
+	}
+
+	if (std::string(argv[1]) == "--defaults") {
+		mandelbrot_parameter_file::frame defaults;
+		defaults.params_.image_dimensions_ = vector2i(1920, 1080);
+		printf("%s", mandelbrot_parameter_file::write(defaults).c_str());
+		return 0;
+	}
+
+	std::vector<mandelbrot_parameter_file::frame> frames;
+	std::string error;
+	if (!mandelbrot_parameter_file::read(argv[1], frames, error)) {
+		fprintf(stderr, "%s: %s\n", argv[1], error.c_str());
+		return 1;
+	}
+
+	std::vector<mandelbrot_profiler::event> trace;
+	mandelbrot_profiler::set_enabled(!trace_path.empty());
+	run_totals totals;
+
+	if (!distributed.address_.empty()) {
+		/*the render time of a frame is the time since the previous one arrived*/
+		auto start = std::chrono::steady_clock::now();
+		for (const mandelbrot_parameter_file::frame& f : frames)
+			if (!f.raw_output_.empty()) fprintf(stderr, "raw_output is not written by distributed renders\n");
+		bool written = true;
+		bool rendered = mandelbrot_distributed::coordinate(frames, distributed,
+			[&](int index, const image& img, const mandelbrot_generator::frame_statistics& statistics) {
+			written = finish_frame(frames[index], index, img, statistics, 0, milliseconds_since(start), trace, totals);
+			start = std::chrono::steady_clock::now();
+			return written;
+		}, error);
+		if (!written) return 1;
+		if (!rendered) {
+			fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+	}
+	else {
+		/*frames of a zoom or pan on the grid reuse the tiles of the previous ones*/
+		mandelbrot_tile_cache tile_cache;
+
+		for (int i = 0; i < (int)frames.size(); i++) {
+			const mandelbrot_parameter_file::frame& f = frames[i];
+
+			mandelbrot_generator::frame_statistics statistics;
+			mandelbrot_generator::raw_frame raw_frame;
+			mandelbrot_generator::raw_frame* raw = f.raw_output_.empty() ? 0 : &raw_frame;
+			auto start = std::chrono::steady_clock::now();
+			auto_pointer<image> img = f.visualization_ == mandelbrot_parameter_file::visualization_julia_iter
+				? mandelbrot_generator::generate_mandelbrot_image_julia_iter(f.params_, &statistics, 0, raw,
+					raw ? 0 : &tile_cache)
+				: mandelbrot_generator::generate_mandelbrot_image_julia_value(f.params_, 0, 0, raw);
+			double render_ms = milliseconds_since(start);
+
+			if (!finish_frame(f, i, *img, statistics, raw, render_ms, trace, totals)) return 1;
+		}
+	}
+
+	printf("%d frames: render %.1f ms (%.1f ms/frame, %.1f Mpixel/s) write %.1f ms\n",
+		(int)frames.size(), totals.render_ms, totals.render_ms / frames.size(),
+		totals.pixels / totals.render_ms / 1000., totals.write_ms);
+	if (!trace_path.empty()) {
+		if (!mandelbrot_profiler::write_chrome_trace(trace_path, trace)) {
+			fprintf(stderr, "could not write %s\n", trace_path.c_str());
+			return 1;
+		}
+		printf("trace of %d events -> %s\n", (int)trace.size(), trace_path.c_str());
+	}
+	return 0;
+}
@@ -0,0 +1,138 @@
+/**
+*************************************************************************
+*
+* @file main.cpp
+*
+* Checks that the vector kernels of \bref{mandelbrot_simd} give the same
+* escape times, escape z and distances as the scalar loop, bit for bit,
+* for every formula. levels the cpu does not support are skipped. run by
+* ctest, the exit code is the number of failed cases
+*
+************************************************************************/
+
+#include "mandelbrot/mandelbrot_simd.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/** formulas of the cases, every power of multibrot and the folds */
+struct parity_formula {
+	const char* name;
+	mandelbrot_formula::family family;
+	int power;
+	bool julia;
+};
+
+static const parity_formula formulas[] = {
+	{ "mandelbrot", mandelbrot_formula::mandelbrot, 2, false },
+	{ "multibrot_3", mandelbrot_formula::multibrot, 3, false },
+	{ "multibrot_4", mandelbrot_formula::multibrot, 4, false },
+	{ "multibrot_5", mandelbrot_formula::multibrot, 5, false },
+	{ "multibrot_6", mandelbrot_formula::multibrot, 6, false },
+	{ "multibrot_7", mandelbrot_formula::multibrot, 7, false },
+	{ "multibrot_8", mandelbrot_formula::multibrot, 8, false },
+	{ "burning_ship", mandelbrot_formula::burning_ship, 2, false },
+	{ "tricorn", mandelbrot_formula::tricorn, 2, false },
+	{ "julia", mandelbrot_formula::mandelbrot, 2, true }
+};
+
+/** pixel grid of the cases, odd sizes so the batches end with scalar tails */
+//{
+static const int grid_width = 333;
+static const int grid_height = 211;
+//}
+
+/** escape_time of every pixel of the grid with all outputs */
+template<typename scalar_type>
+struct parity_planes {
+	std::vector<int> remain_iter;
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> distance;
+
+	void compute(mandelbrot_simd::simd_level level, const std::vector<scalar_type>& re,
+		const std::vector<scalar_type>& im, const mandelbrot_simd::escape_parameters& params)
+	{
+		int count = (int)re.size();
+		remain_iter.resize(count);
+		x.resize(count);
+		y.resize(count);
+		distance.resize(count);
+		mandelbrot_simd::escape_statistics statistics;
+		mandelbrot_simd::escape_time(level, re.data(), im.data(), count, params, remain_iter.data(), statistics,
+			x.data(), y.data(), distance.data());
+	}
+
+	/** pixels in which any plane differs in any bit */
+	int differences(const parity_planes& other) const
+	{
+		int ret = 0;
+		for (size_t i = 0; i < remain_iter.size(); i++) {
+			if (remain_iter[i] != other.remain_iter[i]
+				|| memcmp(&x[i], &other.x[i], sizeof(float)) != 0
+				|| memcmp(&y[i], &other.y[i], sizeof(float)) != 0
+				|| memcmp(&distance[i], &other.distance[i], sizeof(float)) != 0) ret++;
+		}
+		return ret;
+	}
+};
+
+/** compares the vector levels to the scalar loop for one formula, returns the number of failed levels */
+template<typename scalar_type>
+static int check_formula(const parity_formula& formula, const char* type_name)
+{
+	std::vector<scalar_type> re(grid_width * grid_height);
+	std::vector<scalar_type> im(grid_width * grid_height);
+	for (int y = 0; y < grid_height; y++) {
+		for (int x = 0; x < grid_width; x++) {
+			re[y * grid_width + x] = (scalar_type)(-1.9 + 3.2 * x / grid_width);
+			im[y * grid_width + x] = (scalar_type)(-1.3 + 2.6 * y / grid_height);
+		}
+	}
+
+	mandelbrot_simd::escape_parameters params;
+	params.max_threshold = 20.f;
+	params.max_iter = 500;
+	params.interior_check = true;
+	params.periodicity_check = true;
+	params.distance_scale = grid_width / 3.2;
+	params.formula.family_ = formula.family;
+	params.formula.power_ = formula.power;
+	params.formula.julia_ = formula.julia;
+	params.formula.julia_re_ = -0.8;
+	params.formula.julia_im_ = 0.156;
+
+	parity_planes<scalar_type> reference;
+	reference.compute(mandelbrot_simd::scalar, re, im, params);
+
+	int ret = 0;
+	const mandelbrot_simd::simd_level levels[] = { mandelbrot_simd::avx2, mandelbrot_simd::avx512 };
+	const char* level_names[] = { "avx2", "avx512" };
+	for (int l = 0; l < 2; l++) {
+		if (mandelbrot_simd::resolve(levels[l]) != levels[l]) {
+			printf("%-14s %-6s %-6s skipped, not supported\n", formula.name, type_name, level_names[l]);
+			continue;
+		}
+		parity_planes<scalar_type> vector;
+		vector.compute(levels[l], re, im, params);
+		int differences = reference.differences(vector);
+		printf("%-14s %-6s %-6s %s", formula.name, type_name, level_names[l], differences == 0 ? "ok\n" : "FAILED");
+		if (differences != 0) {
+			printf(", %d pixels differ from scalar\n", differences);
+			ret++;
+		}
+	}
+	return ret;
+}
+
+int main()
+{
+	int failed = 0;
+	for (const parity_formula& formula : formulas) {
+		failed += check_formula<float>(formula, "float");
+		failed += check_formula<double>(formula, "double");
+	}
+	return failed;
+}